@@ -157,6 +157,9 @@ static int ahci_dev_init(hba_ctrl_t *const ctrl,
 #if CONFIG(LP_STORAGE_ATA)
 		dev->ata_dev.identify = ahci_identify_device;
 		dev->ata_dev.read_sectors = ahci_ata_read_sectors;
+		if (ctrl->caps & HBA_CAPS_SNCQ)
+			dev->ata_dev.read_sectors_queued =
+				ahci_ata_read_sectors_queued;
 		return ata_attach_device(&dev->ata_dev, PORT_TYPE_SATA);
 #endif
 		break;
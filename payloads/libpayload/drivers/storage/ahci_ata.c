@@ -39,6 +39,229 @@
 #include "ahci_private.h"
 
 
+/* Split reads so that large transfers keep multiple slots busy. */
+#define NCQ_BYTES_PER_CMD	(256 << 10)
+
+#define ATA_READ_LOG_EXT	0x2f
+#define ATA_LOG_NCQ_ERROR	0x10
+
+static int ahci_ncq_init(ahci_dev_t *const dev)
+{
+	if (!(dev->port->cmd_stat & HBA_PxCMD_CR))
+		return -1;
+	if (dev->ncq_slots)
+		return 0;
+	if (dev->ata_dev.queue_depth == 0 || dev->ncq_failed)
+		return -1;
+
+	const unsigned int slots = MIN(HBA_CAPS_DECODE_NCS(dev->ctrl->caps),
+				       dev->ata_dev.queue_depth);
+	dev->ncq_cmdtables = memalign(128, slots * sizeof(cmdtable_t));
+	if (!dev->ncq_cmdtables)
+		return -1;
+	dev->ncq_slots = slots;
+	return 0;
+}
+
+/**
+ * Falls back to one command at a time for good. The command tables are
+ * only freed if the command engine stopped, otherwise the controller may
+ * still read them.
+ */
+static void ahci_ncq_disable(ahci_dev_t *const dev)
+{
+	printf("ahci: Disabling NCQ.\n");
+	dev->ncq_failed = 1;
+	dev->ncq_slots = 0;
+	if (!(dev->port->cmd_stat & HBA_PxCMD_CR))
+		free((void *)dev->ncq_cmdtables);
+	dev->ncq_cmdtables = NULL;
+}
+
+/** Reading the NCQ error log brings the device out of its error state. */
+static void ahci_ncq_read_error_log(ahci_dev_t *const dev)
+{
+	u8 *const log = malloc(512);
+	if (!log)
+		return;
+
+	ahci_cmdslot_prepare(dev, log, 512, 0);
+	dev->cmdtable->fis[ 0] = FIS_HOST_TO_DEVICE;
+	dev->cmdtable->fis[ 1] = FIS_H2D_CMD;
+	dev->cmdtable->fis[ 2] = ATA_READ_LOG_EXT;
+	dev->cmdtable->fis[ 4] = ATA_LOG_NCQ_ERROR;
+	dev->cmdtable->fis[12] = 1;
+	if (ahci_cmdslot_exec(dev) >= 0 && !(log[0] & 0x80))
+		printf("ahci: NCQ error at tag %d, status 0x%02x, "
+		       "error 0x%02x.\n", log[0] & 0x1f, log[2], log[3]);
+
+	free(log);
+}
+
+static void ahci_ncq_prepare(ahci_dev_t *const dev, const int slot,
+			     const lba_t start, const size_t count,
+			     u8 *buf)
+{
+	cmd_t *const cmd = &dev->cmdlist[slot];
+	cmdtable_t *const cmdtable = &dev->ncq_cmdtables[slot];
+	size_t bytes = count << dev->ata_dev.sector_size_shift;
+	int i;
+
+	memset((void *)cmd, '\0', sizeof(*cmd));
+	memset((void *)cmdtable, '\0', sizeof(*cmdtable));
+	cmd->cmd = CMD_CFL(FIS_H2D_FIS_LEN);
+	cmd->cmdtable_base = virt_to_phys(cmdtable);
+
+	/* The data goes straight into the caller's buffer. */
+	for (i = 0; bytes > 0; ++i) {
+		const size_t prd_bytes = MIN(bytes, BYTES_PER_PRD);
+		cmdtable->prdt[i].data_base = virt_to_phys(buf);
+		cmdtable->prdt[i].flags = PRD_TABLE_BYTES(prd_bytes);
+		bytes -= prd_bytes;
+		buf += prd_bytes;
+	}
+	cmd->prdt_length = i;
+
+	cmdtable->fis[ 0] = FIS_HOST_TO_DEVICE;
+	cmdtable->fis[ 1] = FIS_H2D_CMD;
+	cmdtable->fis[ 2] = ATA_READ_FPDMA_QUEUED;
+	cmdtable->fis[ 3] = (count >>  0) & 0xff;
+	cmdtable->fis[ 4] = (start >>  0) & 0xff;
+	cmdtable->fis[ 5] = (start >>  8) & 0xff;
+	cmdtable->fis[ 6] = (start >> 16) & 0xff;
+	cmdtable->fis[ 7] = FIS_H2D_DEV_LBA;
+	cmdtable->fis[ 8] = (start >> 24) & 0xff;
+#if CONFIG(LP_STORAGE_64BIT_LBA)
+	cmdtable->fis[ 9] = (start >> 32) & 0xff;
+	cmdtable->fis[10] = (start >> 40) & 0xff;
+#endif
+	cmdtable->fis[11] = (count >>  8) & 0xff;
+	cmdtable->fis[12] = FIS_H2D_NCQ_TAG(slot);
+}
+
+/**
+ * Reads a batch of requests with READ FPDMA QUEUED, keeping as many
+ * command slots busy as the controller and the device allow.
+ */
+int ahci_ata_read_sectors_queued(ata_dev_t *const ata_dev,
+				 storage_read_req_t *const reqs,
+				 const size_t num)
+{
+	ahci_dev_t *const dev = (ahci_dev_t *)ata_dev;
+	size_t slot_req[32], slot_count[32];
+	size_t next = 0, offset = 0, i;
+	u32 busy = 0;
+	int ret = 0;
+
+	for (i = 0; i < num; ++i) {
+		reqs[i].ret = 0;
+		/* PRDs need even addresses. */
+		if ((uintptr_t)reqs[i].buf & 1)
+			ret = -1;
+	}
+
+	if (ret < 0 || ahci_ncq_init(dev) < 0) {
+		/* Fall back to one command at a time. */
+		for (i = 0; i < num; ++i) {
+			reqs[i].ret = ahci_ata_read_sectors(ata_dev,
+					reqs[i].start, reqs[i].count,
+					reqs[i].buf);
+			if (reqs[i].ret != reqs[i].count)
+				ret = -1;
+		}
+		return ret;
+	}
+
+	const u32 all_slots = (dev->ncq_slots == 32) ? 0xffffffff
+				: (1U << dev->ncq_slots) - 1;
+	const size_t max_count =
+		NCQ_BYTES_PER_CMD >> ata_dev->sector_size_shift;
+
+	while (next < num || busy) {
+		/* Fill all free slots. */
+		while (next < num && busy != all_slots) {
+			storage_read_req_t *const req = &reqs[next];
+			const size_t count = MIN(req->count - offset,
+						 max_count);
+
+			if (count == 0) {
+				++next;
+				offset = 0;
+				continue;
+			}
+#if CONFIG(LP_STORAGE_64BIT_LBA)
+			if (req->start + offset + count > (1ULL << 48)) {
+				printf("ahci: Sector is not 48-bit "
+				       "addressable.\n");
+				req->ret = -1;
+				++next;
+				offset = 0;
+				continue;
+			}
+#endif
+
+			const int slot = __ffs(~busy);
+			ahci_ncq_prepare(dev, slot, req->start + offset, count,
+				req->buf + (offset << ata_dev->sector_size_shift));
+			slot_req[slot] = next;
+			slot_count[slot] = count;
+
+			/* PxSACT has to be set before PxCI. */
+			dev->port->sata_active = 1U << slot;
+			dev->port->cmd_issue = 1U << slot;
+			busy |= 1U << slot;
+
+			offset += count;
+			if (offset == req->count) {
+				++next;
+				offset = 0;
+			}
+		}
+
+		/* Wait for at least one command to complete. */
+		int timeout = 50000; /* Time out after 50000 * 100us == 5s. */
+		while ((dev->port->sata_active & busy) == busy &&
+				!(dev->port->intr_status & HBA_PxIS_FATAL) &&
+				timeout--)
+			udelay(100);
+
+		const u32 done = busy & ~dev->port->sata_active;
+		for (i = 0; i < 32; ++i) {
+			if (!(done & (1U << i)))
+				continue;
+			if (reqs[slot_req[i]].ret >= 0)
+				reqs[slot_req[i]].ret += slot_count[i];
+		}
+		busy &= ~done;
+
+		const u32 intr_status = dev->port->intr_status;
+		if (intr_status)
+			dev->port->intr_status = intr_status;
+		if (timeout < 0 || (intr_status & HBA_PxIS_FATAL)) {
+			if (timeout < 0)
+				printf("ahci: Timeout during NCQ execution.\n");
+			/* Stopping the command engine drops all commands. */
+			for (i = 0; i < 32; ++i) {
+				if (busy & (1U << i))
+					reqs[slot_req[i]].ret = -1;
+			}
+			const int recovered =
+				ahci_error_recovery(dev, intr_status) == 0;
+			if (recovered && (intr_status & HBA_PxIS_TFES))
+				ahci_ncq_read_error_log(dev);
+			if (!recovered || timeout < 0)
+				ahci_ncq_disable(dev);
+			return -1;
+		}
+	}
+
+	for (i = 0; i < num; ++i) {
+		if (reqs[i].ret != reqs[i].count)
+			ret = -1;
+	}
+	return ret;
+}
+
 ssize_t ahci_ata_read_sectors(ata_dev_t *const ata_dev,
 				     const lba_t start, size_t count,
 				     u8 *const buf)
@@ -48,6 +271,20 @@ ssize_t ahci_ata_read_sectors(ata_dev_t *const ata_dev,
 	if (count == 0)
 		return 0;
 
+	/* Let large reads run on multiple slots. */
+	if (ata_dev->read_sectors_queued && ata_dev->queue_depth > 1 &&
+			!((uintptr_t)buf & 1) && (count <<
+			ata_dev->sector_size_shift) > NCQ_BYTES_PER_CMD &&
+			ahci_ncq_init(dev) == 0) {
+		storage_read_req_t req = {
+			.start = start,
+			.count = count,
+			.buf = buf,
+		};
+		ahci_ata_read_sectors_queued(ata_dev, &req, 1);
+		return req.ret;
+	}
+
 	if (ata_dev->read_cmd == ATA_READ_DMA) {
 		if (start >= (1 << 28)) {
 		       printf("ahci: Sector is not 28-bit addressable.\n");
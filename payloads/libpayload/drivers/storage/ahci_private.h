@@ -109,6 +109,7 @@ typedef volatile struct {
 	hba_port_t ports[32];
 } hba_ctrl_t;
 
+#define HBA_CAPS_SNCQ		(1 << 30) /* SNCQ - Supports Native Command Queuing */
 #define HBA_CAPS_SSS		(1 << 27) /* SSS - Supports Staggered Spin-up */
 #define HBA_CAPS_NCS_SHIFT	8	/* NCS - Number of Command Slots */
 #define HBA_CAPS_NCS_MASK	(0x1f << HBA_CAPS_NCS_SHIFT)
@@ -176,6 +177,7 @@ enum {
 #define FIS_H2D_CMD	(1 << 7)
 #define FIS_H2D_FIS_LEN	20
 #define FIS_H2D_DEV_LBA	(1 << 6)
+#define FIS_H2D_NCQ_TAG(x)	((x) << 3)
 
 #define PRD_TABLE_I		(1 << 31) /* I - Interrupt on Completion */
 #define PRD_TABLE_BYTES_MASK	0x3fffff
@@ -197,6 +199,11 @@ typedef struct {
 	u8 *buf, *user_buf;
 	int write_back;
 	size_t buflen;
+
+	/* NCQ: one command table per slot, allocated on first use */
+	cmdtable_t *ncq_cmdtables;
+	unsigned int ncq_slots;
+	int ncq_failed;		/* timed out or recovery failed, don't use */
 } ahci_dev_t;
 
 /*
@@ -230,5 +237,8 @@ ssize_t ahci_ata_read_sectors(ata_dev_t *const ata_dev,
 		     const lba_t start, size_t count,
 		     u8 *const buf);
 
+int ahci_ata_read_sectors_queued(ata_dev_t *const ata_dev,
+		     storage_read_req_t *const reqs, const size_t num);
+
 
 #endif /* _AHCI_PRIVATE_H */
@@ -136,6 +136,45 @@ static ssize_t ata_read512(storage_dev_t *_dev,
 	}
 }
 
+static int ata_read512_queued(storage_dev_t *const _dev,
+			      storage_read_req_t *const reqs, const size_t num)
+{
+	ata_dev_t *const dev = (ata_dev_t *)_dev;
+	const size_t shift = dev->sector_size_shift - 9;
+	const size_t mask = (dev->sector_size >> 9) - 1;
+	size_t i;
+	int ret = 0;
+
+	/* Only whole sectors can be queued, read others one by one. */
+	for (i = 0; i < num; ++i) {
+		if ((reqs[i].start & mask) || (reqs[i].count & mask))
+			break;
+	}
+
+	if (dev->read_sectors_queued && dev->sector_size >= 512 && i == num) {
+		for (i = 0; i < num; ++i) {
+			reqs[i].start >>= shift;
+			reqs[i].count >>= shift;
+		}
+		ret = dev->read_sectors_queued(dev, reqs, num);
+		for (i = 0; i < num; ++i) {
+			reqs[i].start <<= shift;
+			reqs[i].count <<= shift;
+			if (reqs[i].ret > 0)
+				reqs[i].ret <<= shift;
+		}
+		return ret;
+	}
+
+	for (i = 0; i < num; ++i) {
+		reqs[i].ret = ata_read512(_dev, reqs[i].start,
+					  reqs[i].count, reqs[i].buf);
+		if (reqs[i].ret != reqs[i].count)
+			ret = -1;
+	}
+	return ret;
+}
+
 static ssize_t ata_write512(storage_dev_t *const dev,
 			    const lba_t start, const size_t count,
 			    const unsigned char *const buf)
@@ -147,6 +186,7 @@ static ssize_t ata_write512(storage_dev_t *const dev,
 void ata_initialize_storage_ops(ata_dev_t *const dev)
 {
 	dev->storage_dev.read_blocks512 = ata_read512;
+	dev->storage_dev.read_blocks512_queued = ata_read512_queued;
 	dev->storage_dev.write_blocks512 = ata_write512;
 }
 
@@ -223,6 +263,13 @@ int ata_attach_device(ata_dev_t *const dev, const storage_port_t port_type)
 	dev->read_cmd = ATA_READ_DMA;
 #endif
 
+	if (id[ATA_ID_SATA_CAPS] != 0xffff &&
+			(id[ATA_ID_SATA_CAPS] & (1 << 8))) {
+		dev->queue_depth = (id[ATA_ID_QUEUE_DEPTH] & 0x1f) + 1;
+		printf("ata: NCQ supported, queue depth %u.\n",
+		       dev->queue_depth);
+	}
+
 	if (ata_decode_sector_size(dev, id))
 		return -1;
 
@@ -0,0 +1,336 @@
+/*
+ * This file is part of the libpayload project.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Block cache for storage devices
+ *
+ * Reads are cached in lines of CACHE_LINE_BLOCKS 512-byte blocks with LRU
+ * eviction. When a read starts where the previous one ended, the next
+ * lines are read ahead in the same batch as the missing ones, so drivers
+ * with queued reads fetch both at once. The read-ahead window doubles
+ * with every sequential read. Reads larger than a quarter of the cache
+ * bypass it, so loading a kernel doesn't flush file system metadata.
+ */
+
+#include <libpayload.h>
+#include <stdlib.h>
+#include <string.h>
+#include <storage/storage.h>
+
+#include "cache.h"
+
+#define CACHE_LINE_BLOCKS	8
+#define CACHE_LINE_SIZE		(CACHE_LINE_BLOCKS * 512)
+#define CACHE_LINES		(CONFIG_LP_STORAGE_CACHE_SIZE_KB * 1024 / \
+				 CACHE_LINE_SIZE)
+#define READAHEAD_MIN_LINES	4
+#define READAHEAD_MAX_LINES	MIN(CONFIG_LP_STORAGE_CACHE_READAHEAD_KB * \
+				    1024 / CACHE_LINE_SIZE, CACHE_LINES / 2)
+#define BYPASS_BLOCKS		(CACHE_LINES * CACHE_LINE_BLOCKS / 4)
+
+struct cache_line {
+	lba_t line;
+	int valid;
+	int readahead;		/* read ahead, not used yet */
+	struct cache_line *hash_next;
+	struct cache_line *prev, *next;	/* LRU list, most recent first */
+	u8 *data;
+};
+
+struct storage_cache {
+	struct cache_line lines[CACHE_LINES];
+	struct cache_line *hash[CACHE_LINES];
+	struct cache_line lru;
+	u8 *data;
+
+	lba_t next_seq;		/* block following the last read */
+	size_t readahead;	/* current read-ahead window in lines */
+
+	storage_cache_stats_t stats;
+};
+
+static size_t cache_hash(const lba_t line)
+{
+	return (line * 0x9e3779b1) % CACHE_LINES;
+}
+
+static void lru_unlink(struct cache_line *const l)
+{
+	l->prev->next = l->next;
+	l->next->prev = l->prev;
+}
+
+static void lru_push_front(struct storage_cache *const cache,
+			   struct cache_line *const l)
+{
+	l->next = cache->lru.next;
+	l->prev = &cache->lru;
+	cache->lru.next->prev = l;
+	cache->lru.next = l;
+}
+
+static struct storage_cache *cache_get(storage_dev_t *const dev)
+{
+	struct storage_cache *cache = dev->cache;
+	size_t i;
+
+	if (cache)
+		return cache;
+
+	cache = calloc(1, sizeof(*cache));
+	if (!cache)
+		return NULL;
+	cache->data = malloc(CACHE_LINES * CACHE_LINE_SIZE);
+	if (!cache->data) {
+		free(cache);
+		return NULL;
+	}
+
+	cache->lru.next = cache->lru.prev = &cache->lru;
+	for (i = 0; i < CACHE_LINES; ++i) {
+		cache->lines[i].data = cache->data + i * CACHE_LINE_SIZE;
+		lru_push_front(cache, &cache->lines[i]);
+	}
+	cache->next_seq = (lba_t)-1;
+
+	dev->cache = cache;
+	return cache;
+}
+
+static struct cache_line *cache_lookup(struct storage_cache *const cache,
+				       const lba_t line)
+{
+	struct cache_line *l;
+
+	for (l = cache->hash[cache_hash(line)]; l; l = l->hash_next) {
+		if (l->line == line)
+			return l;
+	}
+	return NULL;
+}
+
+static void cache_unhash(struct storage_cache *const cache,
+			 struct cache_line *const l)
+{
+	struct cache_line **link = &cache->hash[cache_hash(l->line)];
+
+	while (*link != l)
+		link = &(*link)->hash_next;
+	*link = l->hash_next;
+	l->valid = 0;
+}
+
+/** Fills the least recently used line with data for `line`. */
+static void cache_insert(struct storage_cache *const cache, const lba_t line,
+			 const u8 *const data, const int readahead)
+{
+	struct cache_line *l = cache_lookup(cache, line);
+
+	if (!l) {
+		l = cache->lru.prev;
+		if (l->valid)
+			cache_unhash(cache, l);
+		l->line = line;
+		l->valid = 1;
+		l->hash_next = cache->hash[cache_hash(line)];
+		cache->hash[cache_hash(line)] = l;
+	}
+	l->readahead = readahead;
+	memcpy(l->data, data, CACHE_LINE_SIZE);
+
+	lru_unlink(l);
+	lru_push_front(cache, l);
+}
+
+/** Copies the part of a line that overlaps [start, start + count). */
+static void copy_line(const lba_t line, const u8 *const data,
+		      const lba_t start, const size_t count,
+		      unsigned char *const buf)
+{
+	const lba_t first = MAX(line * CACHE_LINE_BLOCKS, start);
+	const lba_t end = MIN((line + 1) * CACHE_LINE_BLOCKS, start + count);
+
+	memcpy(buf + (first - start) * 512,
+	       data + (first - line * CACHE_LINE_BLOCKS) * 512,
+	       (end - first) * 512);
+}
+
+static int cache_fill(storage_dev_t *const dev, storage_read_req_t *const reqs,
+		      const size_t num)
+{
+	size_t i;
+	int ret = 0;
+
+	if (dev->read_blocks512_queued)
+		return dev->read_blocks512_queued(dev, reqs, num);
+
+	for (i = 0; i < num; ++i) {
+		reqs[i].ret = dev->read_blocks512(dev, reqs[i].start,
+						  reqs[i].count, reqs[i].buf);
+		if (reqs[i].ret != reqs[i].count)
+			ret = -1;
+	}
+	return ret;
+}
+
+ssize_t storage_cache_read(storage_dev_t *const dev, const lba_t start,
+			   const size_t count, unsigned char *const buf)
+{
+	struct storage_cache *const cache = cache_get(dev);
+	lba_t line, miss_first = 0, miss_last = 0;
+	int missed = 0;
+
+	if (!cache || count > BYPASS_BLOCKS) {
+		if (cache) {
+			cache->stats.bypassed++;
+			cache->next_seq = start + count;
+		}
+		return dev->read_blocks512(dev, start, count, buf);
+	}
+	if (count == 0)
+		return 0;
+
+	const lba_t first = start / CACHE_LINE_BLOCKS;
+	const lba_t last = (start + count - 1) / CACHE_LINE_BLOCKS;
+
+	if (start == cache->next_seq)
+		cache->readahead = MIN(MAX(cache->readahead * 2,
+					   READAHEAD_MIN_LINES),
+				       READAHEAD_MAX_LINES);
+	else
+		cache->readahead = 0;
+	cache->next_seq = start + count;
+
+	/* Serve hits, remember the range of lines to fetch. */
+	for (line = first; line <= last; ++line) {
+		struct cache_line *const l = cache_lookup(cache, line);
+
+		if (!l) {
+			cache->stats.misses++;
+			if (!missed)
+				miss_first = line;
+			miss_last = line;
+			missed = 1;
+			continue;
+		}
+		cache->stats.hits++;
+		if (l->readahead) {
+			cache->stats.readahead_hits++;
+			l->readahead = 0;
+		}
+		copy_line(line, l->data, start, count, buf);
+		lru_unlink(l);
+		lru_push_front(cache, l);
+	}
+
+	/* Refill the read-ahead window once half of it was consumed. */
+	lba_t ra_first = last + 1;
+	size_t ra_lines = 0;
+	while (ra_first <= last + cache->readahead &&
+			cache_lookup(cache, ra_first))
+		++ra_first;
+	if (ra_first - (last + 1) < (cache->readahead + 1) / 2)
+		ra_lines = cache->readahead;
+
+	if (!missed && !ra_lines)
+		return count;
+
+	const size_t miss_lines = missed ? miss_last - miss_first + 1 : 0;
+	u8 *const tmp = malloc((miss_lines + ra_lines) * CACHE_LINE_SIZE);
+	if (!tmp)
+		return missed ? dev->read_blocks512(dev, start, count, buf)
+			      : count;
+
+	storage_read_req_t reqs[2];
+	size_t num = 0;
+	if (missed)
+		reqs[num++] = (storage_read_req_t){
+			.start = miss_first * CACHE_LINE_BLOCKS,
+			.count = miss_lines * CACHE_LINE_BLOCKS,
+			.buf = tmp,
+		};
+	if (ra_lines)
+		reqs[num++] = (storage_read_req_t){
+			.start = ra_first * CACHE_LINE_BLOCKS,
+			.count = ra_lines * CACHE_LINE_BLOCKS,
+			.buf = tmp + miss_lines * CACHE_LINE_SIZE,
+		};
+	cache_fill(dev, reqs, num);
+
+	ssize_t ret = count;
+	if (missed) {
+		if (reqs[0].ret == reqs[0].count) {
+			for (line = miss_first; line <= miss_last; ++line) {
+				const u8 *const data = tmp +
+					(line - miss_first) * CACHE_LINE_SIZE;
+				cache_insert(cache, line, data, 0);
+				copy_line(line, data, start, count, buf);
+			}
+		} else {
+			/* Whole lines may reach past the end of the device,
+			   read only what was asked for. */
+			ret = dev->read_blocks512(dev, start, count, buf);
+		}
+	}
+	if (ra_lines && reqs[num - 1].ret > 0) {
+		const size_t got = reqs[num - 1].ret / CACHE_LINE_BLOCKS;
+		for (line = 0; line < got; ++line)
+			cache_insert(cache, ra_first + line,
+				     reqs[num - 1].buf + line * CACHE_LINE_SIZE,
+				     1);
+		cache->stats.readahead += got;
+	}
+
+	free(tmp);
+	return ret;
+}
+
+void storage_cache_invalidate(storage_dev_t *const dev)
+{
+	struct storage_cache *const cache = dev->cache;
+	size_t i;
+
+	if (!cache)
+		return;
+
+	for (i = 0; i < CACHE_LINES; ++i) {
+		if (cache->lines[i].valid)
+			cache_unhash(cache, &cache->lines[i]);
+	}
+	cache->next_seq = (lba_t)-1;
+	cache->readahead = 0;
+}
+
+int storage_cache_get_stats(storage_dev_t *const dev,
+			    storage_cache_stats_t *const stats)
+{
+	if (!dev->cache)
+		memset(stats, 0, sizeof(*stats));
+	else
+		*stats = dev->cache->stats;
+	return 0;
+}
@@ -0,0 +1,715 @@
+/*
+ * This file is part of the libpayload project.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <libpayload.h>
+#include <arch/barrier.h>
+#include <pci.h>
+#include <pci/pci.h>
+#include <storage/storage.h>
+#include <storage/nvme.h>
+
+/* Controller registers */
+#define NVME_REG_CAP_LO		0x00
+#define NVME_REG_CAP_HI		0x04
+#define NVME_REG_CC		0x14
+#define NVME_REG_CSTS		0x1c
+#define NVME_REG_AQA		0x24
+#define NVME_REG_ASQ		0x28
+#define NVME_REG_ACQ		0x30
+#define NVME_REG_DOORBELLS	0x1000
+
+#define NVME_CAP_MQES(lo)	((lo) & 0xffff)
+#define NVME_CAP_TO(lo)		(((lo) >> 24) & 0xff)	/* in 500ms units */
+#define NVME_CAP_DSTRD(hi)	((hi) & 0xf)
+#define NVME_CAP_CSS_NVM(hi)	((hi) & (1 << 5))
+#define NVME_CAP_MPSMIN(hi)	(((hi) >> 16) & 0xf)
+
+#define NVME_CC_EN		(1 << 0)
+#define NVME_CC_IOSQES(x)	((x) << 16)
+#define NVME_CC_IOCQES(x)	((x) << 20)
+
+#define NVME_CSTS_RDY		(1 << 0)
+#define NVME_CSTS_CFS		(1 << 1)
+
+enum {
+	NVME_ADMIN_CREATE_SQ	= 0x01,
+	NVME_ADMIN_CREATE_CQ	= 0x05,
+	NVME_ADMIN_IDENTIFY	= 0x06,
+};
+
+enum {
+	NVME_CMD_READ		= 0x02,
+};
+
+enum {
+	NVME_IDENTIFY_NS	= 0,
+	NVME_IDENTIFY_CTRL	= 1,
+};
+
+/* Byte offsets into identify data */
+#define NVME_ID_CTRL_MDTS	77
+#define NVME_ID_CTRL_NN		516
+#define NVME_ID_NS_NSZE		0
+#define NVME_ID_NS_FLBAS	26
+#define NVME_ID_NS_LBAF		128
+
+#define NVME_PAGE_SHIFT		12
+#define NVME_PAGE_SIZE		(1 << NVME_PAGE_SHIFT)
+
+#define NVME_ADMIN_QUEUE_SIZE	8
+/* Commands in flight on the I/O queue, tracked in a 32-bit mask. */
+#define NVME_IO_DEPTH		32
+/* Small enough that a single PRP list page per command always suffices. */
+#define NVME_MAX_XFER		(256 << 10)
+
+#define NVME_TIMEOUT_US		(5 * 1000 * 1000)
+
+typedef struct {
+	u8 opc;
+	u8 flags;
+	u16 cid;
+	u32 nsid;
+	u64 _reserved;
+	u64 mptr;
+	u64 prp1;
+	u64 prp2;
+	u32 cdw10;
+	u32 cdw11;
+	u32 cdw12;
+	u32 cdw13;
+	u32 cdw14;
+	u32 cdw15;
+} nvme_sqe_t;
+
+typedef volatile struct {
+	u32 dw0;
+	u32 _reserved;
+	u16 sqhd;
+	u16 sqid;
+	u16 cid;
+	u16 status;
+} nvme_cqe_t;
+
+#define NVME_CQE_PHASE		(1 << 0)
+#define NVME_CQE_STATUS(x)	(((x) >> 1) & 0x7fff)
+
+typedef struct {
+	nvme_sqe_t *sq;
+	nvme_cqe_t *cq;
+	u16 size;
+	u16 sq_tail;
+	u16 cq_head;
+	u16 phase;
+	volatile u32 *sq_doorbell;
+	volatile u32 *cq_doorbell;
+} nvme_queue_t;
+
+typedef struct {
+	pcidev_t pcidev;
+	u8 *bar;
+	int failed;		/* stopped after a timeout, queues unusable */
+	nvme_queue_t admin;
+	nvme_queue_t io;
+	unsigned int depth;
+	size_t max_xfer;
+	u64 *prp_lists[NVME_IO_DEPTH];
+} nvme_ctrl_t;
+
+typedef struct {
+	storage_dev_t storage_dev;
+	nvme_ctrl_t *ctrl;
+	u32 nsid;
+	unsigned int lba_shift;
+	u64 lba_count;
+} nvme_dev_t;
+
+static int nvme_queue_init(nvme_ctrl_t *const ctrl, nvme_queue_t *const q,
+			   const int qid, const u16 size)
+{
+	const u32 dstrd = NVME_CAP_DSTRD(read32(ctrl->bar + NVME_REG_CAP_HI));
+
+	q->sq = dma_memalign(NVME_PAGE_SIZE, size * sizeof(*q->sq));
+	q->cq = dma_memalign(NVME_PAGE_SIZE, size * sizeof(*q->cq));
+	if (!q->sq || !q->cq) {
+		free(q->sq);
+		free((void *)q->cq);
+		return -1;
+	}
+	memset(q->sq, 0, size * sizeof(*q->sq));
+	memset((void *)q->cq, 0, size * sizeof(*q->cq));
+
+	q->size = size;
+	q->sq_tail = 0;
+	q->cq_head = 0;
+	q->phase = 1;
+	q->sq_doorbell = (u32 *)(ctrl->bar + NVME_REG_DOORBELLS +
+				 ((2 * qid) << (2 + dstrd)));
+	q->cq_doorbell = (u32 *)(ctrl->bar + NVME_REG_DOORBELLS +
+				 ((2 * qid + 1) << (2 + dstrd)));
+	return 0;
+}
+
+static void nvme_submit(nvme_queue_t *const q, const nvme_sqe_t *const sqe)
+{
+	memcpy(&q->sq[q->sq_tail], sqe, sizeof(*sqe));
+	if (++q->sq_tail == q->size)
+		q->sq_tail = 0;
+	wmb();
+	write32(q->sq_doorbell, q->sq_tail);
+}
+
+/** Returns the next completion or NULL if there is none yet. */
+static nvme_cqe_t *nvme_poll(nvme_queue_t *const q)
+{
+	nvme_cqe_t *const cqe = &q->cq[q->cq_head];
+
+	if ((cqe->status & NVME_CQE_PHASE) != q->phase)
+		return NULL;
+	rmb();
+
+	if (++q->cq_head == q->size) {
+		q->cq_head = 0;
+		q->phase ^= 1;
+	}
+	return cqe;
+}
+
+static void nvme_poll_done(nvme_queue_t *const q)
+{
+	write32(q->cq_doorbell, q->cq_head);
+}
+
+static int nvme_wait_ready(nvme_ctrl_t *const ctrl, const u32 ready)
+{
+	const u32 cap_lo = read32(ctrl->bar + NVME_REG_CAP_LO);
+	const u64 timeout_us = (NVME_CAP_TO(cap_lo) + 1) * 500 * 1000;
+	const u64 start = timer_us(0);
+
+	while ((read32(ctrl->bar + NVME_REG_CSTS) & NVME_CSTS_RDY) != ready) {
+		if (read32(ctrl->bar + NVME_REG_CSTS) & NVME_CSTS_CFS) {
+			printf("nvme: Controller fatal status.\n");
+			return -1;
+		}
+		if (timer_us(start) > timeout_us) {
+			printf("nvme: Timeout waiting for CSTS.RDY == %u.\n",
+			       ready);
+			return -1;
+		}
+		mdelay(1);
+	}
+	return 0;
+}
+
+/**
+ * Stops a controller that didn't complete a command in time. Clearing
+ * CC.EN aborts everything in flight; bus mastering is turned off as well
+ * so a controller that doesn't react can't write to the buffers anymore.
+ */
+static void nvme_stop(nvme_ctrl_t *const ctrl)
+{
+	write32(ctrl->bar + NVME_REG_CC, 0);
+	nvme_wait_ready(ctrl, 0);
+	pci_write_config16(ctrl->pcidev, PCI_COMMAND,
+			   pci_read_config16(ctrl->pcidev, PCI_COMMAND) &
+			   ~PCI_COMMAND_MASTER);
+	ctrl->failed = 1;
+}
+
+static int nvme_admin_cmd(nvme_ctrl_t *const ctrl, nvme_sqe_t *const sqe)
+{
+	nvme_cqe_t *cqe;
+	const u64 start = timer_us(0);
+
+	nvme_submit(&ctrl->admin, sqe);
+	while (!(cqe = nvme_poll(&ctrl->admin))) {
+		if (timer_us(start) > NVME_TIMEOUT_US) {
+			printf("nvme: Timeout during admin command 0x%02x.\n",
+			       sqe->opc);
+			/* It may still write to the command's buffer. */
+			nvme_stop(ctrl);
+			return -1;
+		}
+		udelay(1);
+	}
+	const u16 status = NVME_CQE_STATUS(cqe->status);
+	nvme_poll_done(&ctrl->admin);
+
+	if (status) {
+		printf("nvme: Admin command 0x%02x failed (status 0x%x).\n",
+		       sqe->opc, status);
+		return -1;
+	}
+	return 0;
+}
+
+static int nvme_identify(nvme_ctrl_t *const ctrl, const u32 nsid,
+			 const u32 cns, u8 *const buf)
+{
+	nvme_sqe_t sqe = {
+		.opc = NVME_ADMIN_IDENTIFY,
+		.nsid = nsid,
+		.prp1 = virt_to_phys(buf),
+		.cdw10 = cns,
+	};
+
+	return nvme_admin_cmd(ctrl, &sqe);
+}
+
+/**
+ * Sets up the PRPs of a command for len bytes at buf. The transfer is
+ * limited to NVME_MAX_XFER, so the PRP list always fits a single page.
+ */
+static void nvme_prepare_prps(nvme_ctrl_t *const ctrl, nvme_sqe_t *const sqe,
+			      u8 *const buf, const size_t len)
+{
+	const uintptr_t phys = virt_to_phys(buf);
+	const size_t first = NVME_PAGE_SIZE - (phys & (NVME_PAGE_SIZE - 1));
+	u64 *const list = ctrl->prp_lists[sqe->cid];
+	size_t i;
+
+	sqe->prp1 = phys;
+	if (len <= first) {
+		sqe->prp2 = 0;
+	} else if (len <= first + NVME_PAGE_SIZE) {
+		sqe->prp2 = phys + first;
+	} else {
+		const size_t pages =
+			DIV_ROUND_UP(len - first, NVME_PAGE_SIZE);
+		for (i = 0; i < pages; ++i)
+			list[i] = phys + first + i * NVME_PAGE_SIZE;
+		sqe->prp2 = virt_to_phys(list);
+	}
+}
+
+/**
+ * Reads a batch of requests, keeping up to ctrl->depth commands in
+ * flight. Requests are counted in LBAs of the namespace here.
+ */
+static int nvme_read_lbas_queued(nvme_dev_t *const dev,
+				 storage_read_req_t *const reqs,
+				 const size_t num)
+{
+	nvme_ctrl_t *const ctrl = dev->ctrl;
+	size_t cid_req[NVME_IO_DEPTH], cid_count[NVME_IO_DEPTH];
+	const size_t max_count = ctrl->max_xfer >> dev->lba_shift;
+	const u32 all_cids = (ctrl->depth == 32) ? 0xffffffff
+				: (1U << ctrl->depth) - 1;
+	size_t next = 0, offset = 0, i;
+	u32 busy = 0;
+	int ret = 0;
+
+	for (i = 0; i < num; ++i)
+		reqs[i].ret = ctrl->failed ? -1 : 0;
+	if (ctrl->failed)
+		return -1;
+
+	while (next < num || busy) {
+		/* Fill the queue. */
+		while (next < num && busy != all_cids) {
+			storage_read_req_t *const req = &reqs[next];
+			const size_t count = MIN(req->count - offset,
+						 max_count);
+
+			if (count == 0 || req->start + offset + count >
+					dev->lba_count) {
+				if (count != 0)
+					req->ret = -1;
+				++next;
+				offset = 0;
+				continue;
+			}
+
+			const u64 lba = req->start + offset;
+			nvme_sqe_t sqe = {
+				.opc = NVME_CMD_READ,
+				.cid = __ffs(~busy),
+				.nsid = dev->nsid,
+				.cdw10 = lba & 0xffffffff,
+				.cdw11 = lba >> 32,
+				.cdw12 = count - 1,
+			};
+			nvme_prepare_prps(ctrl, &sqe,
+				req->buf + (offset << dev->lba_shift),
+				count << dev->lba_shift);
+			cid_req[sqe.cid] = next;
+			cid_count[sqe.cid] = count;
+			busy |= 1U << sqe.cid;
+			nvme_submit(&ctrl->io, &sqe);
+
+			offset += count;
+			if (offset == req->count) {
+				++next;
+				offset = 0;
+			}
+		}
+		if (!busy)
+			break;
+
+		/* Reap completions. */
+		nvme_cqe_t *cqe;
+		const u64 start = timer_us(0);
+		while (!(cqe = nvme_poll(&ctrl->io))) {
+			if (timer_us(start) > NVME_TIMEOUT_US) {
+				printf("nvme: Timeout during read.\n");
+				for (i = 0; i < NVME_IO_DEPTH; ++i) {
+					if (busy & (1U << i))
+						reqs[cid_req[i]].ret = -1;
+				}
+				/* Don't return while it still owns the buffers. */
+				nvme_stop(ctrl);
+				return -1;
+			}
+			udelay(1);
+		}
+		do {
+			const u16 cid = cqe->cid;
+			const u16 status = NVME_CQE_STATUS(cqe->status);
+
+			if (cid >= NVME_IO_DEPTH || !(busy & (1U << cid)))
+				continue;
+			busy &= ~(1U << cid);
+			if (status) {
+				printf("nvme: Read failed (status 0x%x).\n",
+				       status);
+				reqs[cid_req[cid]].ret = -1;
+			} else if (reqs[cid_req[cid]].ret >= 0) {
+				reqs[cid_req[cid]].ret += cid_count[cid];
+			}
+		} while ((cqe = nvme_poll(&ctrl->io)));
+		nvme_poll_done(&ctrl->io);
+	}
+
+	for (i = 0; i < num; ++i) {
+		if (reqs[i].ret != reqs[i].count)
+			ret = -1;
+	}
+	return ret;
+}
+
+/** Reads through a bounce buffer for misaligned blocks or buffers. */
+static ssize_t nvme_read_bounced(nvme_dev_t *const dev, const lba_t start,
+				 const size_t count, unsigned char *buf)
+{
+	const size_t per_lba = 1 << (dev->lba_shift - 9);
+	size_t done = 0;
+
+	u8 *const bounce = dma_memalign(NVME_PAGE_SIZE, dev->ctrl->max_xfer);
+	if (!bounce)
+		return -1;
+
+	while (done < count) {
+		const lba_t block = start + done;
+		const size_t skip = block & (per_lba - 1);
+		const size_t lbas = MIN(DIV_ROUND_UP(skip + count - done,
+						     per_lba),
+					dev->ctrl->max_xfer >> dev->lba_shift);
+		const size_t blocks = MIN(lbas * per_lba - skip, count - done);
+		storage_read_req_t req = {
+			.start = block / per_lba,
+			.count = lbas,
+			.buf = bounce,
+		};
+
+		if (nvme_read_lbas_queued(dev, &req, 1) < 0)
+			break;
+		memcpy(buf, bounce + (skip << 9), blocks << 9);
+		buf += blocks << 9;
+		done += blocks;
+	}
+
+	free(bounce);
+	return done ? done : -1;
+}
+
+static int nvme_aligned(const nvme_dev_t *const dev,
+			const storage_read_req_t *const req)
+{
+	const size_t mask = (1 << (dev->lba_shift - 9)) - 1;
+
+	/* PRP entries need dword aligned buffers. */
+	return !(req->start & mask) && !(req->count & mask) &&
+		!((uintptr_t)req->buf & 3);
+}
+
+static int nvme_read512_queued(storage_dev_t *const _dev,
+			       storage_read_req_t *const reqs,
+			       const size_t num)
+{
+	nvme_dev_t *const dev = (nvme_dev_t *)_dev;
+	const unsigned int shift = dev->lba_shift - 9;
+	size_t i;
+	int ret = 0;
+
+	for (i = 0; i < num; ++i) {
+		if (!nvme_aligned(dev, &reqs[i]))
+			break;
+	}
+
+	if (i < num) {
+		for (i = 0; i < num; ++i) {
+			reqs[i].ret = nvme_read_bounced(dev, reqs[i].start,
+						reqs[i].count, reqs[i].buf);
+			if (reqs[i].ret != reqs[i].count)
+				ret = -1;
+		}
+		return ret;
+	}
+
+	for (i = 0; i < num; ++i) {
+		reqs[i].start >>= shift;
+		reqs[i].count >>= shift;
+	}
+	ret = nvme_read_lbas_queued(dev, reqs, num);
+	for (i = 0; i < num; ++i) {
+		reqs[i].start <<= shift;
+		reqs[i].count <<= shift;
+		if (reqs[i].ret > 0)
+			reqs[i].ret <<= shift;
+	}
+	return ret;
+}
+
+static ssize_t nvme_read512(storage_dev_t *const _dev, const lba_t start,
+			    const size_t count, unsigned char *const buf)
+{
+	storage_read_req_t req = {
+		.start = start,
+		.count = count,
+		.buf = buf,
+	};
+
+	nvme_read512_queued(_dev, &req, 1);
+	return req.ret;
+}
+
+static ssize_t nvme_write512(storage_dev_t *const dev, const lba_t start,
+			     const size_t count,
+			     const unsigned char *const buf)
+{
+	printf("nvme: No write support implemented.\n");
+	return -1;
+}
+
+static int nvme_create_io_queues(nvme_ctrl_t *const ctrl)
+{
+	const u32 mqes = NVME_CAP_MQES(read32(ctrl->bar + NVME_REG_CAP_LO));
+	/* One entry always stays free to tell a full queue from an empty one. */
+	const u16 size = MIN(NVME_IO_DEPTH + 1, mqes + 1);
+	int i;
+
+	if (nvme_queue_init(ctrl, &ctrl->io, 1, size))
+		return -1;
+	ctrl->depth = size - 1;
+
+	for (i = 0; i < ctrl->depth; ++i) {
+		ctrl->prp_lists[i] = dma_memalign(NVME_PAGE_SIZE,
+						  NVME_PAGE_SIZE);
+		if (!ctrl->prp_lists[i])
+			return -1;
+	}
+
+	nvme_sqe_t create_cq = {
+		.opc = NVME_ADMIN_CREATE_CQ,
+		.prp1 = virt_to_phys((void *)ctrl->io.cq),
+		.cdw10 = (size - 1) << 16 | 1,
+		.cdw11 = 1,		/* physically contiguous, no interrupts */
+	};
+	if (nvme_admin_cmd(ctrl, &create_cq))
+		return -1;
+
+	nvme_sqe_t create_sq = {
+		.opc = NVME_ADMIN_CREATE_SQ,
+		.prp1 = virt_to_phys(ctrl->io.sq),
+		.cdw10 = (size - 1) << 16 | 1,
+		.cdw11 = 1 << 16 | 1,	/* completion queue 1, contiguous */
+	};
+	return nvme_admin_cmd(ctrl, &create_sq);
+}
+
+/** Returns the number of namespaces attached. */
+static int nvme_attach_namespaces(nvme_ctrl_t *const ctrl, u8 *const id)
+{
+	u32 nn, nsid;
+	int attached = 0;
+
+	if (nvme_identify(ctrl, 0, NVME_IDENTIFY_CTRL, id))
+		return 0;
+
+	nn = read32(id + NVME_ID_CTRL_NN);
+	if (id[NVME_ID_CTRL_MDTS])
+		ctrl->max_xfer = MIN(NVME_MAX_XFER,
+			NVME_PAGE_SIZE << id[NVME_ID_CTRL_MDTS]);
+	else
+		ctrl->max_xfer = NVME_MAX_XFER;
+
+	for (nsid = 1; nsid <= nn; ++nsid) {
+		if (nvme_identify(ctrl, nsid, NVME_IDENTIFY_NS, id)) {
+			if (ctrl->failed)
+				break;
+			continue;
+		}
+
+		const u64 nsze = read32(id + NVME_ID_NS_NSZE) |
+			(u64)read32(id + NVME_ID_NS_NSZE + 4) << 32;
+		const u8 flbas = id[NVME_ID_NS_FLBAS] & 0xf;
+		const u8 lbads = id[NVME_ID_NS_LBAF + 4 * flbas + 2];
+		if (!nsze)
+			continue;
+		if (lbads < 9 || (1 << lbads) > ctrl->max_xfer) {
+			printf("nvme: Unsupported block size 2^%u at "
+			       "namespace %u.\n", lbads, nsid);
+			continue;
+		}
+
+		nvme_dev_t *const dev = calloc(1, sizeof(*dev));
+		if (!dev)
+			break;
+		dev->ctrl = ctrl;
+		dev->nsid = nsid;
+		dev->lba_shift = lbads;
+		dev->lba_count = nsze;
+		dev->storage_dev.port_type = PORT_TYPE_NVME;
+		dev->storage_dev.read_blocks512 = nvme_read512;
+		dev->storage_dev.read_blocks512_queued = nvme_read512_queued;
+		dev->storage_dev.write_blocks512 = nvme_write512;
+
+		printf("nvme: Namespace %u, %llu blocks of %u bytes.\n",
+		       nsid, nsze, 1 << lbads);
+		if (storage_attach_device(&dev->storage_dev)) {
+			free(dev);
+			break;
+		}
+		++attached;
+	}
+	return attached;
+}
+
+static void nvme_init_pci(pcidev_t dev)
+{
+	if (pci_read_config16(dev, 0xa) != 0x0108 ||
+			pci_read_config8(dev, 0x9) != 0x02)
+		return;
+
+	printf("nvme: Found NVMe controller %02x:%02x.%02x (%04x:%04x).\n",
+		PCI_BUS(dev), PCI_SLOT(dev), PCI_FUNC(dev),
+		pci_read_config16(dev, 0x00), pci_read_config16(dev, 0x02));
+
+	const u32 bar_lo = pci_read_config32(dev, PCI_BASE_ADDRESS_0);
+	if ((bar_lo & 0x6) == 0x4 &&
+			pci_read_config32(dev, PCI_BASE_ADDRESS_1)) {
+		printf("nvme: BAR above 4GiB is not supported.\n");
+		return;
+	}
+
+	nvme_ctrl_t *const ctrl = calloc(1, sizeof(*ctrl));
+	u8 *const id = dma_memalign(NVME_PAGE_SIZE, NVME_PAGE_SIZE);
+	if (!ctrl || !id)
+		goto _free_ret;
+	ctrl->pcidev = dev;
+	ctrl->bar = phys_to_virt(bar_lo & ~0xf);
+
+	/* Enable memory space and bus mastering. */
+	const u16 command = pci_read_config16(dev, PCI_COMMAND);
+	pci_write_config16(dev, PCI_COMMAND,
+			   command | PCI_COMMAND_MEMORY | PCI_COMMAND_MASTER);
+
+	const u32 cap_hi = read32(ctrl->bar + NVME_REG_CAP_HI);
+	if (!NVME_CAP_CSS_NVM(cap_hi) || NVME_CAP_MPSMIN(cap_hi) != 0) {
+		printf("nvme: Unsupported controller capabilities.\n");
+		goto _free_ret;
+	}
+
+	/* Reset the controller, then set up the admin queue. */
+	write32(ctrl->bar + NVME_REG_CC, 0);
+	if (nvme_wait_ready(ctrl, 0))
+		goto _free_ret;
+
+	if (nvme_queue_init(ctrl, &ctrl->admin, 0, NVME_ADMIN_QUEUE_SIZE))
+		goto _free_ret;
+	write32(ctrl->bar + NVME_REG_AQA, (NVME_ADMIN_QUEUE_SIZE - 1) << 16 |
+					  (NVME_ADMIN_QUEUE_SIZE - 1));
+	write32(ctrl->bar + NVME_REG_ASQ, virt_to_phys(ctrl->admin.sq));
+	write32(ctrl->bar + NVME_REG_ASQ + 4, 0);
+	write32(ctrl->bar + NVME_REG_ACQ,
+		virt_to_phys((void *)ctrl->admin.cq));
+	write32(ctrl->bar + NVME_REG_ACQ + 4, 0);
+
+	/* 64-byte submission and 16-byte completion entries, 4KiB pages. */
+	write32(ctrl->bar + NVME_REG_CC, NVME_CC_IOSQES(6) | NVME_CC_IOCQES(4) |
+					 NVME_CC_EN);
+	if (nvme_wait_ready(ctrl, NVME_CSTS_RDY))
+		goto _disable_ret;
+
+	if (nvme_create_io_queues(ctrl)) {
+		printf("nvme: Failed to create I/O queues.\n");
+		goto _disable_ret;
+	}
+
+	if (!nvme_attach_namespaces(ctrl, id))
+		goto _disable_ret;
+	/* Identify has completed, or the controller was stopped. */
+	free(id);
+	/* The controller stays around for its namespaces. */
+	return;
+
+_disable_ret:
+	/* Stop the controller before its queues go away. */
+	write32(ctrl->bar + NVME_REG_CC, 0);
+	if (nvme_wait_ready(ctrl, 0))
+		return;
+_free_ret:
+	if (ctrl) {
+		int i;
+		for (i = 0; i < NVME_IO_DEPTH; ++i)
+			free(ctrl->prp_lists[i]);
+		free(ctrl->io.sq);
+		free((void *)ctrl->io.cq);
+		free(ctrl->admin.sq);
+		free((void *)ctrl->admin.cq);
+	}
+	free(ctrl);
+	free(id);
+}
+
+void nvme_initialize(void)
+{
+	int bus, dev, func;
+
+	for (bus = 0; bus < 256; ++bus) {
+		for (dev = 0; dev < 32; ++dev) {
+			const u16 class =
+				pci_read_config16(PCI_DEV(bus, dev, 0), 0xa);
+			if (class != 0xffff) {
+				for (func = 0; func < 8; ++func)
+					nvme_init_pci(PCI_DEV(bus, dev, func));
+			}
+		}
+	}
+}
@@ -31,8 +31,13 @@
 #if CONFIG(LP_STORAGE_AHCI)
 # include <storage/ahci.h>
 #endif
+#if CONFIG(LP_STORAGE_NVME)
+# include <storage/nvme.h>
+#endif
 #include <storage/storage.h>
 
+#include "cache.h"
+
 
 static storage_dev_t **devices = NULL;
 static size_t devices_length = 0;
@@ -74,10 +79,14 @@ storage_poll_t storage_probe(const size_t dev_num)
 {
 	if (dev_num >= dev_count)
 		return POLL_NO_DEVICE;
-	else if (devices[dev_num]->poll)
-		return devices[dev_num]->poll(devices[dev_num]);
-	else
+	else if (!devices[dev_num]->poll)
 		return POLL_MEDIUM_PRESENT;
+
+	const storage_poll_t ret = devices[dev_num]->poll(devices[dev_num]);
+	/* The medium may have changed. */
+	if (CONFIG(LP_STORAGE_CACHE) && ret != POLL_MEDIUM_PRESENT)
+		storage_cache_invalidate(devices[dev_num]);
+	return ret;
 }
 
 /**
@@ -95,11 +104,62 @@ ssize_t storage_read_blocks512(const size_t dev_num,
 			       const lba_t start, const size_t count,
 			       unsigned char *const buf)
 {
-	if ((dev_num < dev_count) && devices[dev_num]->read_blocks512)
+	if ((dev_num >= dev_count) || !devices[dev_num]->read_blocks512)
+		return -1;
+	else if (CONFIG(LP_STORAGE_CACHE))
+		return storage_cache_read(devices[dev_num], start, count, buf);
+	else
 		return devices[dev_num]->read_blocks512(
 				devices[dev_num], start, count, buf);
-	else
+}
+
+/**
+ * Read a batch of 512-byte blocks
+ *
+ * Submits all requests at once, so drivers that support it can keep
+ * multiple commands in flight. Each request's ret is set to the number
+ * of blocks read, or to a negative value on error.
+ *
+ * @dev_num device number counted from 0
+ * @reqs requests to process
+ * @num number of requests
+ * @return 0 if all requests completed, -1 otherwise
+ */
+int storage_read_blocks512_queued(const size_t dev_num,
+				  storage_read_req_t *const reqs,
+				  const size_t num)
+{
+	size_t i;
+	int ret = 0;
+
+	if (dev_num >= dev_count)
+		return -1;
+	if (devices[dev_num]->read_blocks512_queued)
+		return devices[dev_num]->read_blocks512_queued(
+				devices[dev_num], reqs, num);
+
+	for (i = 0; i < num; ++i) {
+		reqs[i].ret = storage_read_blocks512(dev_num, reqs[i].start,
+						     reqs[i].count, reqs[i].buf);
+		if (reqs[i].ret != reqs[i].count)
+			ret = -1;
+	}
+	return ret;
+}
+
+/**
+ * Get block cache statistics
+ *
+ * @dev_num device number counted from 0
+ * @stats where to store the statistics
+ * @return 0 on success, -1 if there is no such device or no cache
+ */
+int storage_cache_stats(const size_t dev_num,
+			storage_cache_stats_t *const stats)
+{
+	if (!CONFIG(LP_STORAGE_CACHE) || dev_num >= dev_count)
 		return -1;
+	return storage_cache_get_stats(devices[dev_num], stats);
 }
 
 /**
@@ -113,4 +173,7 @@ void storage_initialize(void)
 #if CONFIG(LP_STORAGE_AHCI)
 	ahci_initialize();
 #endif
+#if CONFIG(LP_STORAGE_NVME)
+	nvme_initialize();
+#endif
 }
@@ -33,13 +33,72 @@
 #include <usb/usb.h>
 #include "generic_hub.h"
 
+/* usb20 spec 9.1.2 asks for 100ms of stable connection, linux gives up
+   after 1500ms. Linux samples every 25ms, we're busy anyway. */
+#define DEBOUNCE_STEP_US	1000
+#define DEBOUNCE_STABLE_MS	100
+#define DEBOUNCE_TIMEOUT_US	(1500 * 1000)
+/* usb20 spec 11.5.1.5: reset should take 10 to 20ms. xHCI root ports may
+   take longer, especially for a warm reset. */
+#define RESET_MIN_US		(10 * 1000)
+#define RESET_TIMEOUT_US	(150 * 1000)
+#define ENABLE_TIMEOUT_US	(10 * 1000)
+/* Reset recovery time (usb20 spec 7.1.7.5) */
+#define RECOVERY_US		(10 * 1000)
+
+/*
+ * Ports are enumerated by a small state machine each. Instead of waiting
+ * for a port in mdelay(), the time it may be looked at again is recorded
+ * and generic_hub_enumerate() advances all ports of all hubs together.
+ * Thus, the time taken is bounded by the slowest port.
+ */
+enum generic_hub_port_state {
+	PORT_IDLE = 0,
+	PORT_DEBOUNCE,		/* waiting for a stable connection */
+	PORT_RESET_QUEUED,	/* waiting for the bus to be free */
+	/* all states below hold the bus */
+	PORT_RESETTING,		/* waiting for the reset to finish */
+	PORT_ENABLING,		/* waiting for the port to be enabled */
+	PORT_RECOVERY,		/* reset recovery time */
+};
+
+struct generic_hub_port {
+	enum generic_hub_port_state state;
+	u64 start;		/* when the current state was entered */
+	u64 next;		/* when to look at the port again */
+	int stable_ms;
+};
+
+static generic_hub_t *hub_list;
+static int hub_list_changed;
+
+static void
+generic_hub_port_enter(struct generic_hub_port *const p,
+		       const enum generic_hub_port_state state,
+		       const unsigned int delay_us)
+{
+	p->state = state;
+	p->start = timer_us(0);
+	p->next = p->start + delay_us;
+	p->stable_ms = 0;
+}
+
 void
 generic_hub_destroy(usbdev_t *const dev)
 {
 	generic_hub_t *const hub = GEN_HUB(dev);
+	generic_hub_t **link;
 	if (!hub)
 		return;
 
+	for (link = &hub_list; *link; link = &(*link)->next) {
+		if (*link == hub) {
+			*link = hub->next;
+			hub_list_changed = 1;
+			break;
+		}
+	}
+
 	/* First, detach all devices behind this hub */
 	int port;
 	for (port = 1; port <= hub->num_ports; ++port) {
@@ -56,43 +115,11 @@ generic_hub_destroy(usbdev_t *const dev)
 			hub->ops->disable_port(dev, port);
 	}
 
+	free(hub->port_state);
 	free(hub->ports);
 	free(hub);
 }
 
-static int
-generic_hub_debounce(usbdev_t *const dev, const int port)
-{
-	generic_hub_t *const hub = GEN_HUB(dev);
-
-	const int step_ms	= 1;	/* linux uses 25ms, we're busy anyway */
-	const int at_least_ms	= 100;	/* 100ms as in usb20 spec 9.1.2 */
-	const int timeout_ms	= 1500;	/* linux uses this value */
-
-	int total_ms = 0;
-	int stable_ms = 0;
-	while (stable_ms < at_least_ms && total_ms < timeout_ms) {
-		mdelay(step_ms);
-
-		const int changed = hub->ops->port_status_changed(dev, port);
-		const int connected = hub->ops->port_connected(dev, port);
-		if (changed < 0 || connected < 0)
-			return -1;
-
-		if (!changed && connected) {
-			stable_ms += step_ms;
-		} else {
-			usb_debug("generic_hub: Unstable connection at %d\n",
-				  port);
-			stable_ms = 0;
-		}
-		total_ms += step_ms;
-	}
-	if (total_ms >= timeout_ms)
-		usb_debug("generic_hub: Debouncing timed out at %d\n", port);
-	return 0; /* ignore timeouts, try to always go on */
-}
-
 int
 generic_hub_wait_for_port(usbdev_t *const dev, const int port,
 			  const int wait_for,
@@ -135,6 +162,38 @@ generic_hub_resetport(usbdev_t *const dev, const int port)
 	return 0; /* ignore timeouts, try to always go on */
 }
 
+/*
+ * Devices answer to the default address until they are addressed, so only
+ * one of them may be enabled on a bus at a time. Every xHCI root port is a
+ * bus of its own, though, as the controller addresses devices per slot.
+ */
+static int
+generic_hub_shares_bus(usbdev_t *const dev)
+{
+	return dev->controller->type != XHCI || dev->hub >= 0;
+}
+
+static int
+generic_hub_bus_busy(usbdev_t *const dev)
+{
+	generic_hub_t *hub;
+	int port;
+
+	if (!generic_hub_shares_bus(dev))
+		return 0;
+
+	for (hub = hub_list; hub; hub = hub->next) {
+		if (hub->dev->controller != dev->controller ||
+				!generic_hub_shares_bus(hub->dev))
+			continue;
+		for (port = 1; port <= hub->num_ports; ++port) {
+			if (hub->port_state[port].state >= PORT_RESETTING)
+				return 1;
+		}
+	}
+	return 0;
+}
+
 static int
 generic_hub_detach_dev(usbdev_t *const dev, const int port)
 {
@@ -151,42 +210,150 @@ generic_hub_attach_dev(usbdev_t *const dev, const int port)
 {
 	generic_hub_t *const hub = GEN_HUB(dev);
 
-	if (generic_hub_debounce(dev, port) < 0)
-		return -1;
+	hub->port_state[port].state = PORT_IDLE;
+
+	const usb_speed speed = hub->ops->port_speed(dev, port);
+	if (speed >= 0) {
+		usb_debug("generic_hub: Success at port %d\n", port);
+		hub->ports[port] = usb_attach_device(
+				dev->controller, dev->address, port, speed);
+	}
+	return 0;
+}
+
+static int
+generic_hub_reset_done(usbdev_t *const dev, const int port)
+{
+	generic_hub_t *const hub = GEN_HUB(dev);
+	struct generic_hub_port *const p = &hub->port_state[port];
+
+	if (!hub->ops->port_connected(dev, port)) {
+		usb_debug(
+			"generic_hub: Port %d disconnected after "
+			"reset. Possibly upgraded, rescan required.\n",
+			port);
+		p->state = PORT_IDLE;
+		return 0;
+	}
+
+	/* after reset the port will be enabled automatically */
+	generic_hub_port_enter(p, PORT_ENABLING, 0);
+	return 0;
+}
 
-	if (hub->ops->reset_port) {
-		if (hub->ops->reset_port(dev, port) < 0)
+/* Takes the port one step further if it's due. Never waits. */
+static int
+generic_hub_advance_port(usbdev_t *const dev, const int port)
+{
+	generic_hub_t *const hub = GEN_HUB(dev);
+	struct generic_hub_port *const p = &hub->port_state[port];
+	const u64 now = timer_us(0);
+	int ret;
+
+	if (p->state == PORT_IDLE || now < p->next)
+		return 0;
+
+	switch (p->state) {
+	case PORT_DEBOUNCE: {
+		const int changed = hub->ops->port_status_changed(dev, port);
+		const int connected = hub->ops->port_connected(dev, port);
+		if (changed < 0 || connected < 0)
 			return -1;
 
-		if (!hub->ops->port_connected(dev, port)) {
-			usb_debug(
-				"generic_hub: Port %d disconnected after "
-				"reset. Possibly upgraded, rescan required.\n",
-				port);
+		if (!changed && connected) {
+			p->stable_ms += DEBOUNCE_STEP_US / 1000;
+		} else {
+			usb_debug("generic_hub: Unstable connection at %d\n",
+				  port);
+			p->stable_ms = 0;
+		}
+		if (p->stable_ms < DEBOUNCE_STABLE_MS) {
+			if (now - p->start < DEBOUNCE_TIMEOUT_US) {
+				p->next = now + DEBOUNCE_STEP_US;
+				return 0;
+			}
+			usb_debug("generic_hub: Debouncing timed out at %d\n",
+				  port);
+		}
+		/* ignore timeouts, try to always go on */
+		generic_hub_port_enter(p, PORT_RESET_QUEUED, 0);
+		return 0;
+	}
+	case PORT_RESET_QUEUED:
+		if (generic_hub_bus_busy(dev))
 			return 0;
+		if (!hub->ops->reset_port)
+			return generic_hub_attach_dev(dev, port);
+		if (!hub->ops->start_port_reset) {
+			if (hub->ops->reset_port(dev, port) < 0)
+				return -1;
+			return generic_hub_reset_done(dev, port);
 		}
-
-		/* after reset the port will be enabled automatically */
-		const int ret = generic_hub_wait_for_port(
-			/* time out after 1,000 * 10us = 10ms */
-			dev, port, 1, hub->ops->port_enabled, 1000, 10);
+		if (hub->ops->start_port_reset(dev, port) < 0)
+			return -1;
+		generic_hub_port_enter(p, PORT_RESETTING, RESET_MIN_US);
+		return 0;
+	case PORT_RESETTING:
+		ret = hub->ops->port_in_reset(dev, port);
+		if (ret < 0)
+			return -1;
+		if (ret && now - p->start < RESET_TIMEOUT_US) {
+			p->next = now + 100;
+			return 0;
+		}
+		if (ret)
+			usb_debug("generic_hub: Reset timed out at port %d\n",
+				  port);
+		else if (hub->ops->finish_port_reset &&
+				hub->ops->finish_port_reset(dev, port) < 0)
+			return -1;
+		return generic_hub_reset_done(dev, port);
+	case PORT_ENABLING:
+		ret = hub->ops->port_enabled(dev, port);
 		if (ret < 0)
 			return -1;
-		else if (!ret)
+		if (!ret && now - p->start < ENABLE_TIMEOUT_US) {
+			p->next = now + 10;
+			return 0;
+		}
+		if (!ret)
 			usb_debug("generic_hub: Port %d still "
 				  "disabled after 10ms\n", port);
+		generic_hub_port_enter(p, PORT_RECOVERY, RECOVERY_US);
+		return 0;
+	case PORT_RECOVERY:
+		return generic_hub_attach_dev(dev, port);
+	default:
+		p->state = PORT_IDLE;
+		return 0;
 	}
+}
 
-	const usb_speed speed = hub->ops->port_speed(dev, port);
-	if (speed >= 0) {
-		usb_debug("generic_hub: Success at port %d\n", port);
-		if (hub->ops->reset_port)
-			mdelay(10); /* Reset recovery time
-				       (usb20 spec 7.1.7.5) */
-		hub->ports[port] = usb_attach_device(
-				dev->controller, dev->address, port, speed);
-	}
-	return 0;
+void
+generic_hub_enumerate(void)
+{
+	generic_hub_t *hub;
+	int pending, port;
+
+	do {
+		pending = 0;
+		hub_list_changed = 0;
+		/* Attaching a hub or detaching one changes the list,
+		   start over then. */
+		for (hub = hub_list; hub && !hub_list_changed;
+				hub = hub->next) {
+			for (port = 1; port <= hub->num_ports; ++port) {
+				if (generic_hub_advance_port(hub->dev,
+							     port) < 0)
+					hub->port_state[port].state =
+						PORT_IDLE;
+				if (hub_list_changed)
+					break;
+				if (hub->port_state[port].state != PORT_IDLE)
+					pending = 1;
+			}
+		}
+	} while (pending || hub_list_changed);
 }
 
 int
@@ -194,6 +361,8 @@ generic_hub_scanport(usbdev_t *const dev, const int port)
 {
 	generic_hub_t *const hub = GEN_HUB(dev);
 
+	hub->port_state[port].state = PORT_IDLE;
+
 	if (hub->ports[port] >= 0) {
 		usb_debug("generic_hub: Detachment at port %d\n", port);
 
@@ -205,7 +374,10 @@ generic_hub_scanport(usbdev_t *const dev, const int port)
 	if (hub->ops->port_connected(dev, port)) {
 		usb_debug("generic_hub: Attachment at port %d\n", port);
 
-		return generic_hub_attach_dev(dev, port);
+		/* Debouncing starts right away, the port is attached
+		   by generic_hub_enumerate(). */
+		generic_hub_port_enter(&hub->port_state[port],
+				       PORT_DEBOUNCE, DEBOUNCE_STEP_US);
 	}
 
 	return 0;
@@ -252,9 +424,13 @@ generic_hub_init(usbdev_t *const dev, const int num_ports,
 	generic_hub_t *const hub = GEN_HUB(dev);
 	hub->num_ports = num_ports;
 	hub->ports = malloc(sizeof(*hub->ports) * (num_ports + 1));
+	hub->port_state = calloc(num_ports + 1, sizeof(*hub->port_state));
 	hub->ops = ops;
-	if (!hub->ports) {
+	hub->dev = dev;
+	if (!hub->ports || !hub->port_state) {
 		usb_debug("generic_hub: ERROR: Out of memory\n");
+		free(hub->port_state);
+		free(hub->ports);
 		free(dev->data);
 		dev->data = NULL;
 		return -1;
@@ -270,5 +446,9 @@ generic_hub_init(usbdev_t *const dev, const int num_ports,
 		mdelay(20);
 	}
 
+	hub->next = hub_list;
+	hub_list = hub;
+	hub_list_changed = 1;
+
 	return 0;
 }
@@ -55,6 +55,9 @@ typedef struct generic_hub_ops {
 	/* starts a port reset (required if reset_port is set to a generic one from below) */
 	int (*start_port_reset)(usbdev_t *, int port);
 
+	/* acknowledges a port reset started with start_port_reset (optional) */
+	int (*finish_port_reset)(usbdev_t *, int port);
+
 	/* performs a port reset (optional, generic implementations below) */
 	int (*reset_port)(usbdev_t *, int port);
 } generic_hub_ops_t;
@@ -69,6 +72,11 @@ typedef struct generic_hub {
 	const generic_hub_ops_t *ops;
 
 	void *data;
+
+	/* enumeration state of each port, private to generic_hub.c */
+	struct generic_hub_port *port_state;
+	usbdev_t *dev;
+	struct generic_hub *next;
 } generic_hub_t;
 
 void generic_hub_destroy(usbdev_t *);
@@ -77,7 +85,10 @@ int generic_hub_wait_for_port(usbdev_t *const dev, const int port,
 			      int (*const port_op)(usbdev_t *, int),
 			      int timeout_steps, const int step_us);
 int  generic_hub_resetport(usbdev_t *, int port);
+/* detaches the port's device and starts enumeration if connected */
 int  generic_hub_scanport(usbdev_t *, int port);
+/* runs the enumeration of all hubs' ports until they are done */
+void generic_hub_enumerate(void);
 /* the provided generic_hub_ops struct has to be static */
 int generic_hub_init(usbdev_t *, int num_ports, const generic_hub_ops_t *);
 
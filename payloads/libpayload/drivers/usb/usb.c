@@ -31,6 +31,7 @@
 
 #include <libpayload-config.h>
 #include <usb/usb.h>
+#include "generic_hub.h"
 
 #define DR_DESC gen_bmRequestType(device_to_host, standard_type, dev_recp)
 
@@ -97,6 +98,10 @@ usb_poll (void)
 		}
 		controller = controller->next;
 	}
+#if CONFIG(LP_USB_GEN_HUB)
+	/* Let all hubs enumerate the ports that changed, concurrently. */
+	generic_hub_enumerate();
+#endif
 }
 
 usbdev_t *
@@ -96,8 +96,9 @@ usb_msc_destroy (usbdev_t *dev)
 const int DEV_RESET = 0xff;
 const int GET_MAX_LUN = 0xfe;
 /* Many USB3 devices do not work with large transfer requests.
- * Limit the request size to 64KB chunks to ensure maximum compatibility. */
-const int MAX_CHUNK_BYTES = 1024 * 64;
+ * By default, limit the request size to 64KB chunks to ensure maximum
+ * compatibility. */
+const int MAX_CHUNK_BYTES = 1024 * CONFIG_LP_USB_MSC_MAX_TRANSFER_KB;
 
 const unsigned int cbw_signature = 0x43425355;
 const unsigned int csw_signature = 0x53425355;
@@ -312,6 +313,15 @@ typedef struct {
 	unsigned char control;	//9 - the block is 10 bytes long
 } __packed cmdblock_t;
 
+typedef struct {
+	unsigned char command;	//0
+	unsigned char res1;	//1 - service action for READ CAPACITY(16)
+	unsigned long long block;	//2-9
+	unsigned int numblocks;	//10-13 - allocation length for READ CAPACITY
+	unsigned char res2;	//14
+	unsigned char control;	//15 - the block is 16 bytes long
+} __packed cmdblock16_t;
+
 typedef struct {
 	unsigned char command;	//0
 	unsigned char res1;	//1
@@ -341,7 +351,7 @@ typedef struct {
  * @return 0 on success, 1 on failure
  */
 int
-readwrite_blocks_512 (usbdev_t *dev, int start, int n,
+readwrite_blocks_512 (usbdev_t *dev, u64 start, int n,
 	cbw_direction dir, u8 *buf)
 {
 	int blocksize_divider = MSC_INST(dev)->blocksize / 512;
@@ -351,43 +361,47 @@ readwrite_blocks_512 (usbdev_t *dev, int start, int n,
 
 /**
  * Reads or writes a number of sequential blocks on a USB storage device.
- * As it uses the READ(10) SCSI-2 command, it's limited to storage devices
- * of at most 2TB. It assumes sectors of 512 bytes.
+ * It uses the READ(10) SCSI-2 command, or READ(16) for blocks beyond what
+ * READ(10) can address.
  *
  * @param dev device to access
  * @param start first sector to access
- * @param n number of sectors to access
+ * @param n number of sectors to access, at most 0xffff
  * @param dir direction of access: cbw_direction_data_in == read, cbw_direction_data_out == write
  * @param buf buffer to read into or write from. Must be at least n*sectorsize bytes
  * @return 0 on success, 1 on failure
  */
 static int
-readwrite_chunk (usbdev_t *dev, int start, int n, cbw_direction dir, u8 *buf)
+readwrite_chunk (usbdev_t *dev, u64 start, int n, cbw_direction dir, u8 *buf)
 {
-	cmdblock_t cb;
-	memset (&cb, 0, sizeof (cb));
-	if (dir == cbw_direction_data_in) {
-		// read
-		cb.command = 0x28;
+	const int read = dir == cbw_direction_data_in;
+	int ret;
+
+	if (start + n - 1 > 0xffffffff) {
+		cmdblock16_t cb;
+		memset (&cb, 0, sizeof (cb));
+		cb.command = read ? 0x88 : 0x8a;
+		cb.block = htonll (start);
+		cb.numblocks = htonl (n);
+		ret = execute_command (dev, dir, (u8 *) &cb, sizeof (cb), buf,
+				       n * MSC_INST(dev)->blocksize, 0);
 	} else {
-		// write
-		cb.command = 0x2a;
+		cmdblock_t cb;
+		memset (&cb, 0, sizeof (cb));
+		cb.command = read ? 0x28 : 0x2a;
+		cb.block = htonl (start);
+		cb.numblocks = htonw (n);
+		ret = execute_command (dev, dir, (u8 *) &cb, sizeof (cb), buf,
+				       n * MSC_INST(dev)->blocksize, 0);
 	}
-	cb.block = htonl (start);
-	cb.numblocks = htonw (n);
 
-	return execute_command (dev, dir, (u8 *) &cb, sizeof (cb), buf,
-				n * MSC_INST(dev)->blocksize, 0)
-		!= MSC_COMMAND_OK ? 1 : 0;
+	return ret != MSC_COMMAND_OK ? 1 : 0;
 }
 
 /**
  * Reads or writes a number of sequential blocks on a USB storage device
  * that is split into MAX_CHUNK_BYTES size requests.
  *
- * As it uses the READ(10) SCSI-2 command, it's limited to storage devices
- * of at most 2TB. It assumes sectors of 512 bytes.
- *
  * @param dev device to access
  * @param start first sector to access
  * @param n number of sectors to access
@@ -398,16 +412,19 @@ readwrite_chunk (usbdev_t *dev, int start, int n, cbw_direction dir, u8 *buf)
  * @return 0 on success, 1 on failure
  */
 int
-readwrite_blocks (usbdev_t *dev, int start, int n, cbw_direction dir, u8 *buf)
+readwrite_blocks (usbdev_t *dev, u64 start, int n, cbw_direction dir, u8 *buf)
 {
-	int chunk_size = MAX_CHUNK_BYTES / MSC_INST(dev)->blocksize;
+	/* READ(10) takes a 16-bit block count */
+	const int chunk_size = MIN(MAX_CHUNK_BYTES / MSC_INST(dev)->blocksize,
+				   0xffff);
+	const int chunk_bytes = chunk_size * MSC_INST(dev)->blocksize;
 	int chunk;
 
 	/* Read as many full chunks as needed. */
 	for (chunk = 0; chunk < (n / chunk_size); chunk++) {
 		if (readwrite_chunk (dev, start + (chunk * chunk_size),
 				     chunk_size, dir,
-				     buf + (chunk * MAX_CHUNK_BYTES))
+				     buf + (chunk * chunk_bytes))
 		    != MSC_COMMAND_OK)
 			return 1;
 	}
@@ -416,7 +433,7 @@ readwrite_blocks (usbdev_t *dev, int start, int n, cbw_direction dir, u8 *buf)
 	if (n % chunk_size) {
 		if (readwrite_chunk (dev, start + (chunk * chunk_size),
 				     n % chunk_size, dir,
-				     buf + (chunk * MAX_CHUNK_BYTES))
+				     buf + (chunk * chunk_bytes))
 		    != MSC_COMMAND_OK)
 			return 1;
 	}
@@ -490,6 +507,28 @@ spin_up (usbdev_t *dev)
 				sizeof (cb), 0, 0, 0);
 }
 
+static int
+read_capacity_16 (usbdev_t *dev)
+{
+	cmdblock16_t cb;
+	memset (&cb, 0, sizeof (cb));
+	cb.command = 0x9e;	// service action in (16)
+	cb.res1 = 0x10;		// read capacity (16)
+	cb.numblocks = htonl (32);
+	u32 buf[8];
+
+	usb_debug ("Reading 64-bit capacity of mass storage device.\n");
+	int ret = execute_command (dev, cbw_direction_data_in, (u8 *) &cb,
+				   sizeof (cb), (u8 *)buf, sizeof (buf), 1);
+	if (ret != MSC_COMMAND_OK)
+		return ret;
+
+	MSC_INST (dev)->numblocks = ((u64)ntohl(buf[0]) << 32 | ntohl(buf[1]))
+				    + 1;
+	MSC_INST (dev)->blocksize = ntohl(buf[2]);
+	return MSC_COMMAND_OK;
+}
+
 static int
 read_capacity (usbdev_t *dev)
 {
@@ -518,16 +557,20 @@ read_capacity (usbdev_t *dev)
 		usb_debug ("  assuming 2 TB with 512-byte sectors as READ CAPACITY didn't answer.\n");
 		MSC_INST (dev)->numblocks = 0xffffffff;
 		MSC_INST (dev)->blocksize = 512;
+	} else if (ntohl(buf[0]) == 0xffffffff) {
+		/* Too large for READ CAPACITY(10), the device must support
+		   READ CAPACITY(16) then. */
+		ret = read_capacity_16 (dev);
+		if (ret != MSC_COMMAND_OK)
+			return ret;
 	} else {
 		MSC_INST (dev)->numblocks = ntohl(buf[0]) + 1;
 		MSC_INST (dev)->blocksize = ntohl(buf[1]);
 	}
-	usb_debug ("  %d %d-byte sectors (%d MB)\n", MSC_INST (dev)->numblocks,
-		MSC_INST (dev)->blocksize,
-		/* round down high block counts to avoid integer overflow */
-		MSC_INST (dev)->numblocks > 1000000
-			? (MSC_INST (dev)->numblocks / 1000) * MSC_INST (dev)->blocksize / 1000 :
-		MSC_INST (dev)->numblocks * MSC_INST (dev)->blocksize / 1000 / 1000);
+	usb_debug ("  %llu %d-byte sectors (%llu MB)\n",
+		MSC_INST (dev)->numblocks, MSC_INST (dev)->blocksize,
+		MSC_INST (dev)->numblocks * MSC_INST (dev)->blocksize
+			/ 1000 / 1000);
 	return MSC_COMMAND_OK;
 }
 
@@ -257,6 +257,8 @@ xhci_init (unsigned long physical_bar)
 			xhci_debug("Not enough memory for DMA bounce buffer\n");
 			goto _free_xhci_structs;
 		}
+		xhci->bounce[0] = xhci->dma_buffer;
+		xhci->bounce_slabs = 1;
 	}
 
 	/* Now start working on the hardware */
@@ -440,6 +442,8 @@ xhci_shutdown(hci_t *const controller)
 		}
 	}
 	free(xhci->sp_ptrs);
+	for (i = 1; i < xhci->bounce_slabs; ++i)
+		free(xhci->bounce[i]);
 	free(xhci->dma_buffer);
 	free(xhci->dcbaa);
 	free(xhci->dev);
@@ -545,21 +549,32 @@ xhci_ring_doorbell(endpoint_t *const ep)
 		xhci_ep_id(ep);
 }
 
+/*
+ * Enqueue a single TD that gathers the data from the given segments. Each
+ * segment is split into TRBs at 64KiB boundaries, so it takes up to
+ * (len + 0xffff) / 0x10000 + 1 TRBs on the ring.
+ */
 static void
-xhci_enqueue_td(transfer_ring_t *const tr, const int ep, const size_t mps,
-		const int dalen, void *const data, const int dir)
+xhci_enqueue_td_sg(transfer_ring_t *const tr, const int ep, const size_t mps,
+		   const xhci_sg_t *seg, const int dalen, const int dir)
 {
 	trb_t *trb = NULL;				/* cur TRB */
-	u8 *cur_start = data;				/* cur data pointer */
+	u8 *cur_start = seg->data;			/* cur data pointer */
+	size_t seg_left = seg->len;			/* remaining in segment */
 	size_t length = dalen;				/* remaining bytes */
 	size_t packets = (length + mps - 1) / mps;	/* remaining packets */
 	size_t residue = 0;				/* residue from last TRB */
 	size_t trb_count = 0;				/* TRBs added so far */
 
 	while (length || !trb_count /* enqueue at least one */) {
+		if (!seg_left && length) {
+			++seg;
+			cur_start = seg->data;
+			seg_left = seg->len;
+		}
 		const size_t cur_end = ((size_t)cur_start + 0x10000) & ~0xffff;
-		size_t cur_length = cur_end - (size_t)cur_start;
-		if (length < cur_length) {
+		size_t cur_length = MIN(cur_end - (size_t)cur_start, seg_left);
+		if (length <= cur_length) {
 			cur_length = length;
 			packets = 0;
 			length = 0;
@@ -607,6 +622,7 @@ xhci_enqueue_td(transfer_ring_t *const tr, const int ep, const size_t mps,
 		xhci_enqueue_trb(tr);
 
 		cur_start += cur_length;
+		seg_left -= cur_length;
 		++trb_count;
 	}
 
@@ -619,6 +635,14 @@ xhci_enqueue_td(transfer_ring_t *const tr, const int ep, const size_t mps,
 	xhci_enqueue_trb(tr);
 }
 
+static void
+xhci_enqueue_td(transfer_ring_t *const tr, const int ep, const size_t mps,
+		const int dalen, void *const data, const int dir)
+{
+	const xhci_sg_t seg = { .data = data, .len = dalen };
+	xhci_enqueue_td_sg(tr, ep, mps, &seg, dalen, dir);
+}
+
 static int
 xhci_control(usbdev_t *const dev, const direction_t dir,
 	     const int drlen, void *const devreq,
@@ -715,48 +739,58 @@ xhci_control(usbdev_t *const dev, const direction_t dir,
 	return transferred;
 }
 
-/* finalize == 1: if data is of packet aligned size, add a zero length packet */
-static int
-xhci_bulk(endpoint_t *const ep, const int size, u8 *const src,
-	  const int finalize)
+/* Make sure there are enough bounce slabs for size bytes, if possible.
+   Returns the number of bytes that can be bounced in one TD. */
+static size_t
+xhci_bounce_capacity(xhci_t *const xhci, const size_t size)
 {
-	/* finalize: Hopefully the xHCI controller always does this.
-		     We have no control over the packets. */
+	while (xhci->bounce_slabs < BOUNCE_SLABS &&
+	       (size_t)xhci->bounce_slabs * DMA_SIZE < size) {
+		/* TRBs are split at 64KiB boundaries, slabs needn't be
+		   aligned to them. */
+		void *const slab = dma_memalign(64, DMA_SIZE);
+		if (!slab)
+			break;
+		xhci->bounce[xhci->bounce_slabs++] = slab;
+	}
+	return (size_t)xhci->bounce_slabs * DMA_SIZE;
+}
 
-	u8 *data = src;
+/* Transfer one TD of at most one ring's worth of data. */
+static int
+xhci_bulk_td(endpoint_t *const ep, const int size, u8 *const src,
+	     const int bounce)
+{
 	xhci_t *const xhci = XHCI_INST(ep->dev->controller);
 	const int slot_id = ep->dev->address;
 	const int ep_id = xhci_ep_id(ep);
 	epctx_t *const epctx = xhci->dev[slot_id].ctx.ep[ep_id];
 	transfer_ring_t *const tr = xhci->dev[slot_id].transfer_rings[ep_id];
-
-	const size_t off = (size_t)data & 0xffff;
-	if ((off + size) > ((TRANSFER_RING_SIZE - 2) << 16)) {
-		xhci_debug("Unsupported transfer size\n");
-		return -1;
-	}
-
-	if (!dma_coherent(src)) {
-		data = xhci->dma_buffer;
-		if (size > DMA_SIZE) {
-			xhci_debug("Bulk transfer too large: %d\n", size);
-			return -1;
-		}
-		if (ep->direction == OUT)
-			memcpy(data, src, size);
-	}
-
-	/* Reset endpoint if it's not running */
-	const unsigned ep_state = EC_GET(STATE, epctx);
-	if (ep_state > 1) {
-		if (xhci_reset_endpoint(ep->dev, ep))
-			return -1;
+	xhci_sg_t segs[BOUNCE_SLABS];
+	int nsegs = 0, i;
+
+	if (bounce) {
+		/* Gather the bounce slabs into one TD */
+		int left = size;
+		do {
+			segs[nsegs].data = xhci->bounce[nsegs];
+			segs[nsegs].len = MIN(left, DMA_SIZE);
+			if (ep->direction == OUT)
+				memcpy(segs[nsegs].data,
+				       src + nsegs * DMA_SIZE, segs[nsegs].len);
+			left -= segs[nsegs].len;
+			++nsegs;
+		} while (left);
+	} else {
+		segs[0].data = src;
+		segs[0].len = size;
+		nsegs = 1;
 	}
 
 	/* Enqueue transfer and ring doorbell */
 	const unsigned mps = EC_GET(MPS, epctx);
 	const unsigned dir = (ep->direction == OUT) ? TRB_DIR_OUT : TRB_DIR_IN;
-	xhci_enqueue_td(tr, ep_id, mps, size, data, dir);
+	xhci_enqueue_td_sg(tr, ep_id, mps, segs, size, dir);
 	xhci_ring_doorbell(ep);
 
 	/* Wait for transfer event */
@@ -768,19 +802,76 @@ xhci_bulk(endpoint_t *const ep, const int size, u8 *const src,
 			xhci_cmd_stop_endpoint(xhci, ep->dev->address, ep_id);
 		}
 		xhci_debug("Bulk transfer failed: %d\n"
-			   "  ep state: %d -> %d\n"
+			   "  ep state: %d\n"
 			   "  usbsts:   0x%08"PRIx32"\n",
-			   ret, ep_state,
-			   EC_GET(STATE, epctx),
+			   ret, EC_GET(STATE, epctx),
 			   xhci->opreg->usbsts);
 		return ret;
 	}
 
-	if (ep->direction == IN && data != src)
-		memcpy(src, data, ret);
+	if (bounce && ep->direction == IN) {
+		int left = ret;
+		for (i = 0; left > 0; ++i) {
+			const int len = MIN(left, DMA_SIZE);
+			memcpy(src + i * DMA_SIZE, segs[i].data, len);
+			left -= len;
+		}
+	}
 	return ret;
 }
 
+/* finalize == 1: if data is of packet aligned size, add a zero length packet */
+static int
+xhci_bulk(endpoint_t *const ep, const int size, u8 *const src,
+	  const int finalize)
+{
+	/* finalize: Hopefully the xHCI controller always does this.
+		     We have no control over the packets. */
+
+	xhci_t *const xhci = XHCI_INST(ep->dev->controller);
+	const int slot_id = ep->dev->address;
+	const int ep_id = xhci_ep_id(ep);
+	epctx_t *const epctx = xhci->dev[slot_id].ctx.ep[ep_id];
+	const int bounce = !dma_coherent(src);
+	size_t max_td;
+
+	/*
+	 * Coherent buffers are used in place. A TD may take up the whole ring
+	 * except for the link TRB, the event data TRB and the partial 64KiB
+	 * chunks at either end. Other buffers are gathered from the bounce
+	 * slabs, which may cross a 64KiB boundary and take two TRBs each.
+	 * Both limits are multiples of the max packet size, so only the last
+	 * TD may end with a short packet.
+	 */
+	if (bounce)
+		max_td = xhci_bounce_capacity(xhci, MIN((size_t)size,
+			(size_t)(TRANSFER_RING_SIZE - 2) / 2 * DMA_SIZE));
+	else
+		max_td = (TRANSFER_RING_SIZE - 4) << 16;
+
+	/* Reset endpoint if it's not running */
+	const unsigned ep_state = EC_GET(STATE, epctx);
+	if (ep_state > 1) {
+		if (xhci_reset_endpoint(ep->dev, ep))
+			return -1;
+	}
+
+	/* Split large transfers into TDs and stop at the first short one */
+	int transferred = 0;
+	do {
+		const int len = MIN((size_t)(size - transferred), max_td);
+		const int ret = xhci_bulk_td(ep, len, src + transferred,
+					     bounce);
+		if (ret < 0)
+			return ret;
+		transferred += ret;
+		if (ret < len)
+			break;
+	} while (transferred < size);
+
+	return transferred;
+}
+
 static trb_t *
 xhci_next_trb(trb_t *cur, int *const pcs)
 {
@@ -167,6 +167,12 @@ typedef struct {
 	u8 pcs;
 } __packed transfer_ring_t;
 
+/* One piece of a scatter-gather transfer */
+typedef struct {
+	u8 *data;
+	size_t len;
+} xhci_sg_t;
+
 #define COMMAND_RING_SIZE 4
 typedef transfer_ring_t command_ring_t;
 
@@ -483,6 +489,11 @@ typedef struct xhci {
 
 #define DMA_SIZE (64 * 1024)
 	void *dma_buffer;
+	/* Bounce slabs for bulk transfers, bounce[0] is dma_buffer. More
+	   slabs are allocated on demand when a large transfer comes in. */
+#define BOUNCE_SLABS 16
+	void *bounce[BOUNCE_SLABS];
+	int bounce_slabs;
 } xhci_t;
 
 #define XHCI_INST(controller) ((xhci_t*)((controller)->instance))
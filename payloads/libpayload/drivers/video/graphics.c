@@ -48,6 +48,14 @@ static struct rect screen;
 static struct cb_framebuffer *fbinfo;
 static uint8_t *fbaddr;
 
+/*
+ * Off-screen copy of the framebuffer that drawing goes to while it's enabled,
+ * and the area of it (in framebuffer coordinates) that has been drawn to
+ * since the last flush.
+ */
+static uint8_t *fbbuffer;
+static struct rect dirty;
+
 #define LOG(x...)	printf("CBGFX: " x)
 #define PIVOT_H_MASK	(PIVOT_H_LEFT|PIVOT_H_CENTER|PIVOT_H_RIGHT)
 #define PIVOT_V_MASK	(PIVOT_V_TOP|PIVOT_V_CENTER|PIVOT_V_BOTTOM)
@@ -121,40 +129,106 @@ static inline uint32_t calculate_color(const struct rgb_color *rgb,
 	return color;
 }
 
+/* Map a screen coordinate to the framebuffer's, which may be rotated. */
+static inline void fb_coord(const struct vector *coord, struct vector *rcoord)
+{
+	switch (fbinfo->orientation) {
+	case CB_FB_ORIENTATION_NORMAL:
+	default:
+		rcoord->x = coord->x;
+		rcoord->y = coord->y;
+		break;
+	case CB_FB_ORIENTATION_BOTTOM_UP:
+		rcoord->x = screen.size.width - 1 - coord->x;
+		rcoord->y = screen.size.height - 1 - coord->y;
+		break;
+	case CB_FB_ORIENTATION_LEFT_UP:
+		rcoord->x = coord->y;
+		rcoord->y = screen.size.width - 1 - coord->x;
+		break;
+	case CB_FB_ORIENTATION_RIGHT_UP:
+		rcoord->x = screen.size.height - 1 - coord->y;
+		rcoord->y = coord->x;
+		break;
+	}
+}
+
+/* Grow the dirty area to include the framebuffer pixels from a to b. */
+static void mark_dirty(const struct vector *a, const struct vector *b)
+{
+	int32_t x0 = MIN(a->x, b->x), x1 = MAX(a->x, b->x) + 1;
+	int32_t y0 = MIN(a->y, b->y), y1 = MAX(a->y, b->y) + 1;
+
+	if (!fbbuffer)
+		return;
+
+	if (dirty.size.width) {
+		x0 = MIN(x0, dirty.offset.x);
+		y0 = MIN(y0, dirty.offset.y);
+		x1 = MAX(x1, dirty.offset.x + dirty.size.width);
+		y1 = MAX(y1, dirty.offset.y + dirty.size.height);
+	}
+	dirty.offset.x = x0;
+	dirty.offset.y = y0;
+	dirty.size.width = x1 - x0;
+	dirty.size.height = y1 - y0;
+}
+
 /*
- * Plot a pixel in a framebuffer. This is called from tight loops. Keep it slim
- * and do the validation at callers' site.
+ * Plot a run of pixels going right from coord, taking the colors from
+ * 'colors' or repeating 'fill' if it's NULL. All drawing goes through here,
+ * so the framebuffer address and rotation are worked out once per run
+ * instead of once per pixel. Keep it slim and do the validation at callers'
+ * site.
  */
-static inline void set_pixel(struct vector *coord, uint32_t color)
+static void put_pixels(const struct vector *coord, int count,
+		       const uint32_t *colors, uint32_t fill)
 {
-	const int bpp = fbinfo->bits_per_pixel;
+	const int bytes = fbinfo->bits_per_pixel / 8;
 	const int bpl = fbinfo->bytes_per_line;
-	struct vector rcoord;
-	int i;
+	const struct vector last = {
+		.x = coord->x + count - 1,
+		.y = coord->y,
+	};
+	struct vector start, end;
+	uint8_t *pixel;
+	long step;
+	int i, j;
+
+	if (count <= 0)
+		return;
 
+	fb_coord(coord, &start);
+	fb_coord(&last, &end);
 	switch (fbinfo->orientation) {
 	case CB_FB_ORIENTATION_NORMAL:
 	default:
-		rcoord.x = coord->x;
-		rcoord.y = coord->y;
+		step = bytes;
 		break;
 	case CB_FB_ORIENTATION_BOTTOM_UP:
-		rcoord.x = screen.size.width - 1 - coord->x;
-		rcoord.y = screen.size.height - 1 - coord->y;
+		step = -bytes;
 		break;
 	case CB_FB_ORIENTATION_LEFT_UP:
-		rcoord.x = coord->y;
-		rcoord.y = screen.size.width - 1 - coord->x;
+		step = -bpl;
 		break;
 	case CB_FB_ORIENTATION_RIGHT_UP:
-		rcoord.x = screen.size.height - 1 - coord->y;
-		rcoord.y = coord->x;
+		step = bpl;
 		break;
 	}
-
-	uint8_t * const pixel = fbaddr + rcoord.y * bpl + rcoord.x * bpp / 8;
-	for (i = 0; i < bpp / 8; i++)
-		pixel[i] = (color >> (i * 8));
+	mark_dirty(&start, &end);
+
+	pixel = (fbbuffer ? fbbuffer : fbaddr) + start.y * bpl + start.x * bytes;
+	if (CONFIG(LP_LITTLE_ENDIAN) && bytes == 4 &&
+	    !((uintptr_t)pixel & 3) && !(step & 3)) {
+		for (i = 0; i < count; i++, pixel += step)
+			*(uint32_t *)pixel = colors ? colors[i] : fill;
+		return;
+	}
+	for (i = 0; i < count; i++, pixel += step) {
+		const uint32_t color = colors ? colors[i] : fill;
+		for (j = 0; j < bytes; j++)
+			pixel[j] = color >> (j * 8);
+	}
 }
 
 /*
@@ -236,9 +310,9 @@ int draw_box(const struct rect *box, const struct rgb_color *rgb)
 		return CBGFX_ERROR_BOUNDARY;
 	}
 
+	p.x = top_left.x;
 	for (p.y = top_left.y; p.y < t.y; p.y++)
-		for (p.x = top_left.x; p.x < t.x; p.x++)
-			set_pixel(&p, color);
+		put_pixels(&p, t.x - top_left.x, NULL, color);
 
 	return CBGFX_SUCCESS;
 }
@@ -268,16 +342,22 @@ int clear_screen(const struct rgb_color *rgb)
 	uint32_t color = calculate_color(rgb, 0);
 	const int bpp = fbinfo->bits_per_pixel;
 	const int bpl = fbinfo->bytes_per_line;
+	const struct vector fb_end = {
+		.x = fbinfo->x_resolution - 1,
+		.y = fbinfo->y_resolution - 1,
+	};
 
 	/* If all significant bytes in color are equal, fastpath through memset.
 	 * We assume that for 32bpp the high byte gets ignored anyway. */
 	if ((((color >> 8) & 0xff) == (color & 0xff)) && (bpp == 16 ||
 	    (((color >> 16) & 0xff) == (color & 0xff)))) {
-		memset(fbaddr, color & 0xff, fbinfo->y_resolution * bpl);
+		memset(fbbuffer ? fbbuffer : fbaddr, color & 0xff,
+		       fbinfo->y_resolution * bpl);
+		mark_dirty(&vzero, &fb_end);
 	} else {
+		p.x = 0;
 		for (p.y = 0; p.y < screen.size.height; p.y++)
-			for (p.x = 0; p.x < screen.size.width; p.x++)
-				set_pixel(&p, color);
+			put_pixels(&p, screen.size.width, NULL, color);
 	}
 
 	return CBGFX_SUCCESS;
@@ -286,18 +366,37 @@ int clear_screen(const struct rgb_color *rgb)
 /*
  * Bi-linear Interpolation
  *
- * It estimates the value of a middle point (tx, ty) using the values from four
- * adjacent points (q00, q01, q10, q11).
+ * Colors are blended as 0x00RRGGBB words, red and blue with one multiply and
+ * green with another, which keeps the inner loop to a handful of integer
+ * operations without depending on a vector unit. w is the weight of c1 in
+ * 1/256 steps.
  */
-static uint32_t bli(uint32_t q00, uint32_t q10, uint32_t q01, uint32_t q11,
-		    struct fraction *tx, struct fraction *ty)
+static inline uint32_t blend(uint32_t c0, uint32_t c1, uint32_t w)
 {
-	uint32_t r0 = (tx->n * q10 + (tx->d - tx->n) * q00) / tx->d;
-	uint32_t r1 = (tx->n * q11 + (tx->d - tx->n) * q01) / tx->d;
-	uint32_t p = (ty->n * r1 + (ty->d - ty->n) * r0) / ty->d;
-	return p;
+	const uint32_t rb = (c0 & 0xff00ff) * (256 - w) + (c1 & 0xff00ff) * w;
+	const uint32_t g = (c0 & 0xff00) * (256 - w) + (c1 & 0xff00) * w;
+
+	return ((rb >> 8) & 0xff00ff) | ((g >> 8) & 0xff00);
 }
 
+static inline uint32_t calculate_color_rgb(uint32_t rgb, uint8_t invert)
+{
+	const struct rgb_color c = {
+		.red = rgb >> 16,
+		.green = rgb >> 8,
+		.blue = rgb,
+	};
+
+	return calculate_color(&c, invert);
+}
+
+/* Where a column of the image on canvas is sampled from in the bitmap. */
+struct blit_column {
+	int32_t s0;		/* left sample */
+	int32_t s1;		/* right sample */
+	uint32_t w;		/* weight of s1, in 1/256 */
+};
+
 static int draw_bitmap_v3(const struct vector *top_left,
 			  const struct scale *scale,
 			  const struct vector *dim,
@@ -308,8 +407,13 @@ static int draw_bitmap_v3(const struct vector *top_left,
 			  uint8_t invert)
 {
 	const int bpp = header->bits_per_pixel;
-	int32_t dir;
+	const int check_colors = header->colors_used < 256;
+	uint32_t pal_rgb[256], pal_color[256];
+	struct blit_column *cols;
+	uint32_t *row;
+	int32_t dir, x;
 	struct vector p;
+	int sampled = 1;
 
 	if (header->compression) {
 		LOG("Compressed bitmaps are not supported\n");
@@ -345,10 +449,27 @@ static int draw_bitmap_v3(const struct vector *top_left,
 		p.y += dim->height - 1;
 		dir = -1;
 	}
+
+	cols = malloc(dim->width * sizeof(*cols));
+	row = malloc(dim->width * sizeof(*row));
+	if (!cols || !row) {
+		LOG("Not enough memory to scale bitmap\n");
+		free(cols);
+		free(row);
+		return CBGFX_ERROR_UNKNOWN;
+	}
+
+	/* Convert the palette once instead of for every pixel. */
+	for (x = 0; x < MIN(header->colors_used, 256); x++) {
+		pal_rgb[x] = pal[x].red << 16 | pal[x].green << 8 | pal[x].blue;
+		pal_color[x] = calculate_color_rgb(pal_rgb[x], invert);
+	}
+
 	/*
 	 * Plot pixels scaled by the bilinear interpolation. We scan over the
 	 * image on canvas (using d) and find the corresponding pixel in the
-	 * bitmap data (using s0, s1).
+	 * bitmap data (using s0, s1). The horizontal mapping is the same for
+	 * every row, so it is worked out once up front.
 	 *
 	 * When d hits the right bottom corner, s0 also hits the right bottom
 	 * corner of the pixel array because that's how scale->x and scale->y
@@ -356,51 +477,72 @@ static int draw_bitmap_v3(const struct vector *top_left,
 	 * parse_bitmap_header_v3, s0 is guranteed not to exceed pixel array
 	 * boundary.
 	 */
+	for (x = 0; x < dim->width; x++) {
+		cols[x].s0 = x * scale->x.d / scale->x.n;
+		cols[x].s1 = cols[x].s0;
+		if (cols[x].s1 + 1 < dim_org->width)
+			cols[x].s1++;
+		cols[x].w = (x * scale->x.d) % scale->x.n * 256 / scale->x.n;
+		if (cols[x].w)
+			sampled = 0;
+	}
+
 	struct vector s0, s1, d;
-	struct fraction tx, ty;
+	uint32_t wy;
+	p.x = top_left->x;
 	for (d.y = 0; d.y < dim->height; d.y++, p.y += dir) {
 		s0.y = d.y * scale->y.d / scale->y.n;
 		s1.y = s0.y;
 		if (s1.y + 1 < dim_org->height)
 			s1.y++;
-		ty.d = scale->y.n;
-		ty.n = (d.y * scale->y.d) % scale->y.n;
+		wy = (d.y * scale->y.d) % scale->y.n * 256 / scale->y.n;
 		const uint8_t *data0 = pixel_array + s0.y * y_stride;
 		const uint8_t *data1 = pixel_array + s1.y * y_stride;
-		p.x = top_left->x;
-		for (d.x = 0; d.x < dim->width; d.x++, p.x++) {
-			s0.x = d.x * scale->x.d / scale->x.n;
-			s1.x = s0.x;
-			if (s1.x + 1 < dim_org->width)
-				s1.x++;
-			tx.d = scale->x.n;
-			tx.n = (d.x * scale->x.d) % scale->x.n;
-			uint8_t c00 = data0[s0.x];
-			uint8_t c10 = data0[s1.x];
-			uint8_t c01 = data1[s0.x];
-			uint8_t c11 = data1[s1.x];
-			if (c00 >= header->colors_used
-					|| c10 >= header->colors_used
-					|| c01 >= header->colors_used
-					|| c11 >= header->colors_used) {
+
+		if (check_colors) {
+			for (x = 0; x < dim->width; x++) {
+				if (data0[cols[x].s0] >= header->colors_used
+				    || data0[cols[x].s1] >= header->colors_used
+				    || data1[cols[x].s0] >= header->colors_used
+				    || data1[cols[x].s1] >= header->colors_used)
+					break;
+			}
+			if (x < dim->width) {
 				LOG("Color index exceeds palette boundary\n");
+				free(cols);
+				free(row);
 				return CBGFX_ERROR_BITMAP_DATA;
 			}
-			const struct rgb_color rgb = {
-				.red = bli(pal[c00].red, pal[c10].red,
-					   pal[c01].red, pal[c11].red,
-					   &tx, &ty),
-				.green = bli(pal[c00].green, pal[c10].green,
-					     pal[c01].green, pal[c11].green,
-					     &tx, &ty),
-				.blue = bli(pal[c00].blue, pal[c10].blue,
-					    pal[c01].blue, pal[c11].blue,
-					    &tx, &ty),
-			};
-			set_pixel(&p, calculate_color(&rgb, invert));
 		}
+
+		if (sampled && !wy) {
+			/* 1:1 and integer downscaling land on whole pixels. */
+			for (x = 0; x < dim->width; x++)
+				row[x] = pal_color[data0[cols[x].s0]];
+		} else {
+			for (x = 0; x < dim->width; x++) {
+				const struct blit_column *c = &cols[x];
+				uint32_t q0, q1;
+
+				if (!c->w && !wy) {
+					row[x] = pal_color[data0[c->s0]];
+					continue;
+				}
+				q0 = blend(pal_rgb[data0[c->s0]],
+					   pal_rgb[data0[c->s1]], c->w);
+				if (wy) {
+					q1 = blend(pal_rgb[data1[c->s0]],
+						   pal_rgb[data1[c->s1]], c->w);
+					q0 = blend(q0, q1, wy);
+				}
+				row[x] = calculate_color_rgb(q0, invert);
+			}
+		}
+		put_pixels(&p, dim->width, row, 0);
 	}
 
+	free(cols);
+	free(row);
 	return CBGFX_SUCCESS;
 }
 
@@ -700,3 +842,58 @@ int get_bitmap_dimension(const void *bitmap, size_t sz, struct scale *dim_rel)
 
 	return CBGFX_SUCCESS;
 }
+
+int enable_graphics_buffer(void)
+{
+	size_t size;
+
+	if (cbgfx_init())
+		return CBGFX_ERROR_INIT;
+
+	if (fbbuffer)
+		return CBGFX_SUCCESS;
+
+	size = fbinfo->y_resolution * fbinfo->bytes_per_line;
+	fbbuffer = malloc(size);
+	if (!fbbuffer) {
+		LOG("Failed to allocate graphics buffer\n");
+		return CBGFX_ERROR_GRAPHICS_BUFFER;
+	}
+	/* Start from what's on screen so partial redraws work. */
+	memcpy(fbbuffer, fbaddr, size);
+	dirty.size.width = 0;
+	dirty.size.height = 0;
+
+	return CBGFX_SUCCESS;
+}
+
+int flush_graphics_buffer(void)
+{
+	const int bytes = fbinfo ? fbinfo->bits_per_pixel / 8 : 0;
+	int32_t y;
+
+	if (!fbbuffer)
+		return CBGFX_SUCCESS;
+
+	for (y = dirty.offset.y; y < dirty.offset.y + dirty.size.height; y++) {
+		const size_t offset = y * fbinfo->bytes_per_line +
+				      dirty.offset.x * bytes;
+		memcpy(fbaddr + offset, fbbuffer + offset,
+		       dirty.size.width * bytes);
+	}
+	dirty.size.width = 0;
+	dirty.size.height = 0;
+
+	return CBGFX_SUCCESS;
+}
+
+int disable_graphics_buffer(void)
+{
+	int rv;
+
+	rv = flush_graphics_buffer();
+	free(fbbuffer);
+	fbbuffer = NULL;
+
+	return rv;
+}
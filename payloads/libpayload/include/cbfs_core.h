@@ -276,6 +276,10 @@ struct cbfs_handle {
  * Caller is responsible to free() returned handle after use. */
 struct cbfs_handle *cbfs_get_handle(struct cbfs_media *media, const char *name);
 
+/* Drops the directory index cbfs_get_handle() keeps for the last media it
+ * searched. Must be called when the contents of that media change. */
+void cbfs_index_invalidate(void);
+
 /* Given a cbfs_handle and an attribute tag, return a mapping for the first
  * instance of the attribute or NULL if none found. */
 void *cbfs_get_attr(struct cbfs_handle *handle, uint32_t tag);
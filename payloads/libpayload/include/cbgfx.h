@@ -57,6 +57,8 @@
 #define CBGFX_ERROR_FRAMEBUFFER_ADDR	0x15
 /* portrait screen not supported */
 #define CBGFX_ERROR_PORTRAIT_SCREEN	0x16
+/* failed to allocate the graphics buffer */
+#define CBGFX_ERROR_GRAPHICS_BUFFER	0x17
 
 struct fraction {
 	int32_t n;
@@ -192,3 +194,28 @@ int draw_bitmap_direct(const void *bitmap, size_t size,
  * in the original size are returned.
  */
 int get_bitmap_dimension(const void *bitmap, size_t sz, struct scale *dim_rel);
+
+/**
+ * Draw into a copy of the framebuffer in memory instead of the framebuffer
+ * itself. Nothing drawn shows up on screen until flush_graphics_buffer() is
+ * called, which copies only the area drawn to since the previous flush.
+ *
+ * @return CBGFX_* error codes
+ */
+int enable_graphics_buffer(void);
+
+/**
+ * Copy what has been drawn to the graphics buffer onto the screen. Does
+ * nothing if the graphics buffer is not enabled.
+ *
+ * @return CBGFX_* error codes
+ */
+int flush_graphics_buffer(void);
+
+/**
+ * Flush and free the graphics buffer and draw to the framebuffer directly
+ * again.
+ *
+ * @return CBGFX_* error codes
+ */
+int disable_graphics_buffer(void);
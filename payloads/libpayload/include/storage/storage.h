@@ -45,6 +45,7 @@ typedef enum {
 	PORT_TYPE_IDE	= (1 << 0),
 	PORT_TYPE_SATA	= (1 << 1),
 	PORT_TYPE_USB	= (1 << 2),
+	PORT_TYPE_NVME	= (1 << 3),
 } storage_port_t;
 
 typedef enum {
@@ -56,16 +57,39 @@ typedef enum {
 } storage_poll_t;
 
 
+/* One read of a batch, `ret` is set to the number of blocks read. */
+typedef struct storage_read_req {
+	lba_t start;
+	size_t count;
+	unsigned char *buf;
+	ssize_t ret;
+} storage_read_req_t;
+
+/* Block cache statistics, counted in cache lines. */
+typedef struct storage_cache_stats {
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long readahead;	/* lines read ahead */
+	unsigned long readahead_hits;	/* of those, lines used later */
+	unsigned long bypassed;		/* reads too large to be cached */
+} storage_cache_stats_t;
+
 struct storage_dev;
+struct storage_cache;
 
 typedef struct storage_dev {
 	storage_port_t port_type;
 
 	storage_poll_t (*poll)(struct storage_dev *);
 	ssize_t (*read_blocks512)(struct storage_dev *, lba_t start, size_t count, unsigned char *buf);
+	/* optional, returns 0 if all requests completed, -1 otherwise */
+	int (*read_blocks512_queued)(struct storage_dev *, storage_read_req_t *reqs, size_t num);
 	ssize_t (*write_blocks512)(struct storage_dev *, lba_t start, size_t count, const unsigned char *buf);
 
 	void (*detach_device)(struct storage_dev *);
+
+	/* private to the block cache */
+	struct storage_cache *cache;
 } storage_dev_t;
 
 int storage_device_count(void);
@@ -74,5 +98,7 @@ int storage_attach_device(storage_dev_t *dev);
 
 storage_poll_t storage_probe(size_t dev_num);
 ssize_t storage_read_blocks512(size_t dev_num, lba_t start, size_t count, unsigned char *buf);
+int storage_read_blocks512_queued(size_t dev_num, storage_read_req_t *reqs, size_t num);
+int storage_cache_stats(size_t dev_num, storage_cache_stats_t *stats);
 
 #endif
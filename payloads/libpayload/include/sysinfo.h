@@ -128,6 +128,8 @@ struct sysinfo_t {
 	uint32_t mtc_size;
 	void	*chromeos_vpd;
 	int	mmc_early_wake_status;
+	/* Card and controller state, if coreboot fully initialized it. */
+	struct cb_mmc_info *mmc_info;
 
 	/* Pointer to FMAP cache in CBMEM */
 	void	*fmap_cache;
@@ -105,6 +105,11 @@ static void cb_parse_mmc_info(unsigned char *ptr, struct sysinfo_t *info)
 	struct cb_mmc_info *mmc_info = (struct cb_mmc_info *)ptr;
 
 	info->mmc_early_wake_status = mmc_info->early_cmd1_status;
+
+	/* Older coreboot only passes the early CMD1 status. */
+	if (mmc_info->size >= sizeof(*mmc_info)
+	    && (mmc_info->flags & CB_MMC_INFO_MEDIA_READY))
+		info->mmc_info = mmc_info;
 }
 
 static void cb_parse_gpios(unsigned char *ptr, struct sysinfo_t *info)
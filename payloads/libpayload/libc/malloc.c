@@ -29,10 +29,12 @@
  */
 
 /*
- * This is a classically weak malloc() implementation. We have a relatively
- * small and static heap, so we take the easy route with an O(N) loop
- * through the tree for every malloc() and free(). Obviously, this doesn't
- * scale past a few hundred KB (if that).
+ * This is a simple segregated-fit allocator. Every block starts with a header
+ * holding its size and flags, so the blocks of a region form a chain from
+ * type->start to type->end. Free blocks additionally carry a copy of their
+ * header at the end and are kept on doubly linked lists, one per size class.
+ * Small sizes get a class of their own, so most allocations pop the head of
+ * a list, and free() merges with both neighbours in constant time.
  *
  * We're also susceptible to the usual buffer overrun poisoning, though the
  * risk is within acceptable ranges for this implementation (don't overrun
@@ -43,10 +45,30 @@
 #include <libpayload.h>
 #include <stdint.h>
 
+typedef u64 hdrtype_t;
+#define HDRSIZE (sizeof(hdrtype_t))
+
+/* Free blocks below SMALL_LIMIT bytes go to the bin for their exact size,
+ * larger ones to a bin per power of two. */
+#define SMALL_LIMIT	512
+#define NUM_SMALL_BINS	(SMALL_LIMIT / HDRSIZE)
+#define NUM_LARGE_BINS	32
+#define NUM_BINS	(NUM_SMALL_BINS + NUM_LARGE_BINS)
+#define BINMAP_WORDS	((NUM_BINS + 31) / 32)
+
+/* Stored in the first bytes of the data area of a free block. */
+struct free_block {
+	struct free_block *next;
+	struct free_block *prev;
+};
+
 struct memory_type {
 	void *start;
 	void *end;
 	struct align_region_t* align_regions;
+	struct free_block *bins[NUM_BINS];
+	/* Bit n is set if bins[n] is not empty. */
+	u32 binmap[BINMAP_WORDS];
 #if CONFIG(LP_DEBUG_MALLOC)
 	int magic_initialized;
 	size_t minimal_free;
@@ -56,23 +78,27 @@ struct memory_type {
 
 extern char _heap, _eheap;	/* Defined in the ldscript. */
 
-static struct memory_type default_type =
-	{ (void *)&_heap, (void *)&_eheap, NULL
+static struct memory_type default_type = {
+	.start = (void *)&_heap,
+	.end = (void *)&_eheap,
 #if CONFIG(LP_DEBUG_MALLOC)
-	, 0, 0, "HEAP"
+	.name = "HEAP",
 #endif
-	};
+};
 static struct memory_type *const heap = &default_type;
 static struct memory_type *dma = &default_type;
 
-typedef u64 hdrtype_t;
-#define HDRSIZE (sizeof(hdrtype_t))
-
-#define SIZE_BITS ((HDRSIZE << 3) - 7)
-#define MAGIC     (((hdrtype_t)0x2a) << (SIZE_BITS + 1))
+#define SIZE_BITS ((HDRSIZE << 3) - 8)
+#define MAGIC     (((hdrtype_t)0x2a) << (SIZE_BITS + 2))
 #define FLAG_FREE (((hdrtype_t)0x01) << (SIZE_BITS + 0))
+/* The previous block in the chain is free and has a trailing header. */
+#define FLAG_PREV_FREE (((hdrtype_t)0x01) << (SIZE_BITS + 1))
 #define MAX_SIZE  ((((hdrtype_t)0x01) << SIZE_BITS) - 1)
 
+/* Smallest data area, big enough to hold the free list links and the
+ * trailing header once the block is freed. */
+#define MIN_SIZE  ALIGN_UP(sizeof(struct free_block) + HDRSIZE, HDRSIZE)
+
 #define SIZE(_h) ((_h) & MAX_SIZE)
 
 #define _HEADER(_s, _f) ((hdrtype_t) (MAGIC | (_f) | ((_s) & MAX_SIZE)))
@@ -100,6 +126,7 @@ void init_dma_memory(void *start, u32 size)
 	*(hdrtype_t *)start = 0;
 
 	dma = malloc(sizeof(*dma));
+	memset(dma, 0, sizeof(*dma));
 	dma->start = start;
 	dma->end = start + size;
 	dma->align_regions = NULL;
@@ -124,105 +151,213 @@ int dma_coherent(void *ptr)
 	return !dma_initialized() || (dma->start <= ptr && dma->end > ptr);
 }
 
-static void *alloc(int len, struct memory_type *type)
+static inline hdrtype_t *next_block(hdrtype_t *ptr)
 {
-	hdrtype_t header;
-	hdrtype_t volatile *ptr = (hdrtype_t volatile *)type->start;
+	return (void *)ptr + HDRSIZE + SIZE(*ptr);
+}
 
-	/* Align the size. */
-	len = ALIGN_UP(len, HDRSIZE);
+static inline hdrtype_t *block_of(struct free_block *fb)
+{
+	return (void *)fb - HDRSIZE;
+}
 
-	if (!len || len > MAX_SIZE)
-		return (void *)NULL;
+static int bin_index(size_t size)
+{
+	int index;
 
-	/* Make sure the region is setup correctly. */
-	if (!HAS_MAGIC(*ptr)) {
-		size_t size = (type->end - type->start) - HDRSIZE;
-		*ptr = FREE_BLOCK(size);
+	if (size < SMALL_LIMIT)
+		return size / HDRSIZE;
+	if (size > UINT32_MAX)
+		return NUM_BINS - 1;
+
+	index = NUM_SMALL_BINS + log2(size) - log2(SMALL_LIMIT);
+	return MIN(index, NUM_BINS - 1);
+}
+
+/* Return the first non-empty bin at or above index, or -1 if none. */
+static int next_bin(struct memory_type *type, int index)
+{
+	int word;
+
+	for (word = index / 32; word < BINMAP_WORDS; word++) {
+		u32 map = type->binmap[word];
+
+		if (word == index / 32)
+			map &= ~0U << (index % 32);
+		if (map)
+			return word * 32 + __ffs(map);
+	}
+
+	return -1;
+}
+
+static void bin_insert(struct memory_type *type, hdrtype_t *ptr)
+{
+	struct free_block *fb = (void *)ptr + HDRSIZE;
+	int index = bin_index(SIZE(*ptr));
+
+	fb->prev = NULL;
+	fb->next = type->bins[index];
+	if (fb->next)
+		fb->next->prev = fb;
+	type->bins[index] = fb;
+	type->binmap[index / 32] |= 1U << (index % 32);
+}
+
+static void bin_remove(struct memory_type *type, hdrtype_t *ptr)
+{
+	struct free_block *fb = (void *)ptr + HDRSIZE;
+	int index = bin_index(SIZE(*ptr));
+
+	if (fb->prev)
+		fb->prev->next = fb->next;
+	else
+		type->bins[index] = fb->next;
+	if (fb->next)
+		fb->next->prev = fb->prev;
+
+	if (type->bins[index] == NULL)
+		type->binmap[index / 32] &= ~(1U << (index % 32));
+}
+
+/* Turn ptr into a free block of the given size and put it on its bin. The
+ * caller makes sure that neither neighbour is free. */
+static void set_free(struct memory_type *type, hdrtype_t *ptr, size_t size)
+{
+	hdrtype_t *next;
+
+	*ptr = FREE_BLOCK(size);
+	next = next_block(ptr);
+	next[-1] = *ptr;
+	bin_insert(type, ptr);
+
+	if ((void *)next < type->end)
+		*next |= FLAG_PREV_FREE;
+}
+
+static void heap_panic(hdrtype_t header)
+{
+	printf("memory allocator panic. (%s%s)\n",
+	       !HAS_MAGIC(header) ? " no magic " : "",
+	       SIZE(header) == 0 ? " size=0 " : "");
+	halt();
+}
+
+static void heap_init(struct memory_type *type)
+{
+	size_t size = (type->end - type->start) - HDRSIZE;
+
+	memset(type->bins, 0, sizeof(type->bins));
+	memset(type->binmap, 0, sizeof(type->binmap));
+	set_free(type, type->start, size);
 #if CONFIG(LP_DEBUG_MALLOC)
-		type->magic_initialized = 1;
-		type->minimal_free = size;
+	type->magic_initialized = 1;
+	type->minimal_free = size;
 #endif
-	}
+}
 
-	/* Find some free space. */
-	do {
-		header = *ptr;
-		int size = SIZE(header);
-
-		if (!HAS_MAGIC(header) || size == 0) {
-			printf("memory allocator panic. (%s%s)\n",
-			       !HAS_MAGIC(header) ? " no magic " : "",
-				   size == 0 ? " size=0 " : "");
-			halt();
-		}
+/* Find a free block with at least len bytes. */
+static hdrtype_t *find_free(struct memory_type *type, size_t len)
+{
+	struct free_block *fb;
+	int index = bin_index(len);
 
-		if (header & FLAG_FREE) {
-			if (len <= size) {
-				hdrtype_t volatile *nptr = (hdrtype_t volatile *)((uintptr_t)ptr + HDRSIZE + len);
-				int nsize = size - (HDRSIZE + len);
-
-				/* If there is still room in this block,
-				 * then mark it as such otherwise account
-				 * the whole space for that block.
-				 */
-
-				if (nsize > 0) {
-					/* Mark the block as used. */
-					*ptr = USED_BLOCK(len);
-
-					/* Create a new free block. */
-					*nptr = FREE_BLOCK(nsize);
-				} else {
-					/* Mark the block as used. */
-					*ptr = USED_BLOCK(size);
-				}
+	/* Only large bins hold blocks of different sizes. */
+	for (fb = type->bins[index]; fb != NULL; fb = fb->next) {
+		if (SIZE(*block_of(fb)) >= len)
+			return block_of(fb);
+	}
 
-				return (void *)((uintptr_t)ptr + HDRSIZE);
-			}
-		}
+	/* Any block in a higher bin is big enough. */
+	index = next_bin(type, index + 1);
+	if (index < 0)
+		return NULL;
 
-		ptr = (hdrtype_t volatile *)((uintptr_t)ptr + HDRSIZE + size);
+	return block_of(type->bins[index]);
+}
+
+/* Shrink the used block at ptr to len bytes if the rest is big enough to
+ * form a block of its own. */
+static void release(struct memory_type *type, hdrtype_t *ptr);
+static void trim_block(struct memory_type *type, hdrtype_t *ptr, size_t len)
+{
+	size_t size = SIZE(*ptr);
+	hdrtype_t *rest;
 
-	} while (ptr < (hdrtype_t *) type->end);
+	if (size - len < HDRSIZE + MIN_SIZE)
+		return;
 
-	/* Nothing available. */
-	return (void *)NULL;
+	*ptr = USED_BLOCK(len) | (*ptr & FLAG_PREV_FREE);
+	rest = next_block(ptr);
+	*rest = USED_BLOCK(size - len - HDRSIZE);
+	release(type, rest);
 }
 
-static void _consolidate(struct memory_type *type)
+static void *alloc(size_t len, struct memory_type *type)
 {
-	void *ptr = type->start;
+	hdrtype_t *ptr = (hdrtype_t *)type->start;
+	hdrtype_t *next;
 
-	while (ptr < type->end) {
-		void *nptr;
-		hdrtype_t hdr = *((hdrtype_t *) ptr);
-		unsigned int size = 0;
+	/* Align the size. */
+	len = ALIGN_UP(len, HDRSIZE);
 
-		if (!IS_FREE(hdr)) {
-			ptr += HDRSIZE + SIZE(hdr);
-			continue;
-		}
+	if (!len || len > MAX_SIZE)
+		return (void *)NULL;
 
-		size = SIZE(hdr);
-		nptr = ptr + HDRSIZE + SIZE(hdr);
+	len = MAX(len, MIN_SIZE);
 
-		while (nptr < type->end) {
-			hdrtype_t nhdr = *((hdrtype_t *) nptr);
+	/* Make sure the region is setup correctly. */
+	if (!HAS_MAGIC(*ptr))
+		heap_init(type);
+
+	/* Find some free space. */
+	ptr = find_free(type, len);
+	if (ptr == NULL)
+		return (void *)NULL;
 
-			if (!(IS_FREE(nhdr)))
-				break;
+	if (!IS_FREE(*ptr) || SIZE(*ptr) == 0)
+		heap_panic(*ptr);
 
-			size += SIZE(nhdr) + HDRSIZE;
+	/* Mark the block as used. Its predecessor can't be free. */
+	bin_remove(type, ptr);
+	*ptr = USED_BLOCK(SIZE(*ptr));
+	next = next_block(ptr);
+	if ((void *)next < type->end)
+		*next &= ~FLAG_PREV_FREE;
 
-			*((hdrtype_t *) nptr) = 0;
+	/* If there is still room in this block, then return it as a new
+	 * free block. */
+	trim_block(type, ptr, len);
 
-			nptr += (HDRSIZE + SIZE(nhdr));
-		}
+	return (void *)ptr + HDRSIZE;
+}
+
+/* Free the used block at ptr and merge it with free neighbours. */
+static void release(struct memory_type *type, hdrtype_t *ptr)
+{
+	hdrtype_t hdr = *ptr;
+	hdrtype_t *next = next_block(ptr);
+	size_t size = SIZE(hdr);
+
+	if ((void *)next < type->end && IS_FREE(*next)) {
+		bin_remove(type, next);
+		size += HDRSIZE + SIZE(*next);
+		*next = 0;
+	}
+
+	if (hdr & FLAG_PREV_FREE) {
+		hdrtype_t *prev = (void *)ptr - HDRSIZE - SIZE(ptr[-1]);
+
+		if (!IS_FREE(*prev) || *prev != ptr[-1])
+			heap_panic(*prev);
 
-		*((hdrtype_t *) ptr) = FREE_BLOCK(size);
-		ptr = nptr;
+		bin_remove(type, prev);
+		size += HDRSIZE + SIZE(*prev);
+		*ptr = 0;
+		ptr = prev;
 	}
+
+	set_free(type, ptr, size);
 }
 
 void free(void *ptr)
@@ -250,8 +385,7 @@ void free(void *ptr)
 	if (hdr & FLAG_FREE)
 		return;
 
-	*((hdrtype_t *) ptr) = FREE_BLOCK(SIZE(hdr));
-	_consolidate(type);
+	release(type, ptr);
 }
 
 void *malloc(size_t size)
@@ -277,8 +411,9 @@ void *calloc(size_t nmemb, size_t size)
 
 void *realloc(void *ptr, size_t size)
 {
-	void *ret, *pptr;
-	unsigned int osize;
+	void *ret;
+	hdrtype_t *pptr, *next;
+	size_t osize, len;
 	struct memory_type *type = heap;
 
 	if (ptr == NULL)
@@ -286,32 +421,50 @@ void *realloc(void *ptr, size_t size)
 
 	pptr = ptr - HDRSIZE;
 
-	if (!HAS_MAGIC(*((hdrtype_t *) pptr)))
+	if (!HAS_MAGIC(*pptr))
 		return NULL;
 
 	if (ptr < type->start || ptr >= type->end)
 		type = dma;
 
+	if (size == 0) {
+		free(ptr);
+		return NULL;
+	}
+
+	len = MAX(ALIGN_UP(size, HDRSIZE), MIN_SIZE);
+	if (len > MAX_SIZE)
+		return NULL;
+
+	/* Grow into the following block if it is free and big enough. */
+	next = next_block(pptr);
+	if (len > SIZE(*pptr) && (void *)next < type->end && IS_FREE(*next)
+	    && SIZE(*pptr) + HDRSIZE + SIZE(*next) >= len) {
+		bin_remove(type, next);
+		*pptr = USED_BLOCK(SIZE(*pptr) + HDRSIZE + SIZE(*next))
+			| (*pptr & FLAG_PREV_FREE);
+		*next = 0;
+		next = next_block(pptr);
+		if ((void *)next < type->end)
+			*next &= ~FLAG_PREV_FREE;
+	}
+
+	/* Resize in place, no copy needed. */
+	if (len <= SIZE(*pptr)) {
+		trim_block(type, pptr, len);
+		return ptr;
+	}
+
 	/* Get the original size of the block. */
-	osize = SIZE(*((hdrtype_t *) pptr));
+	osize = SIZE(*pptr);
 
-	/*
-	 * Free the memory to update the tables - this won't touch the actual
-	 * memory, so we can still use it for the copy after we have
-	 * reallocated the new space.
-	 */
-	free(ptr);
 	ret = alloc(size, type);
-
-	/*
-	 * if ret == NULL, then doh - failure.
-	 * if ret == ptr then woo-hoo! no copy needed.
-	 */
-	if (ret == NULL || ret == ptr)
-		return ret;
+	if (ret == NULL)
+		return NULL;
 
 	/* Copy the memory to the new location. */
 	memcpy(ret, ptr, osize > size ? size : osize);
+	free(ptr);
 
 	return ret;
 }
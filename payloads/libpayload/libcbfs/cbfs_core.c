@@ -136,36 +136,21 @@ static int get_cbfs_range(uint32_t *offset, uint32_t *cbfs_end,
 	return 0;
 }
 
-/* public API starts here*/
-struct cbfs_handle *cbfs_get_handle(struct cbfs_media *media, const char *name)
+/*
+ * Calls fn() for every file header between offset and cbfs_end, with the
+ * header in CBFS byte order and the mapped file name, until fn() returns
+ * non-zero. Returns that value, or 0 if the walk reached the end.
+ */
+typedef int (*cbfs_walk_fn)(void *arg, uint32_t offset,
+			    const struct cbfs_file *file, const char *name);
+
+static int cbfs_walk(struct cbfs_media *media, uint32_t offset,
+		     uint32_t cbfs_end, cbfs_walk_fn fn, void *arg)
 {
 	const char *vardata;
-	uint32_t offset, cbfs_end, vardata_len;
+	uint32_t vardata_len;
 	struct cbfs_file file;
-	struct cbfs_handle *handle = malloc(sizeof(*handle));
-
-	if (!handle)
-		return NULL;
-
-	if (get_cbfs_range(&offset, &cbfs_end, media)) {
-		ERROR("Failed to find cbfs range\n");
-		free(handle);
-		return NULL;
-	}
-
-	if (media == CBFS_DEFAULT_MEDIA) {
-		media = &handle->media;
-		if (init_default_cbfs_media(media) != 0) {
-			ERROR("Failed to initialize default media.\n");
-			free(handle);
-			return NULL;
-		}
-	} else {
-		memcpy(&handle->media, media, sizeof(*media));
-	}
-
-	DEBUG("CBFS location: 0x%x~0x%x\n", offset, cbfs_end);
-	DEBUG("Looking for '%s' starting from 0x%x.\n", name, offset);
+	int ret = 0;
 
 	media->open(media);
 	while (offset < cbfs_end &&
@@ -191,24 +176,11 @@ struct cbfs_handle *cbfs_get_handle(struct cbfs_media *media, const char *name)
 				media, offset + sizeof(file), vardata_len);
 		if (vardata == CBFS_MEDIA_INVALID_MAP_ADDRESS) {
 			ERROR("ERROR: Failed to get filename: 0x%x.\n", offset);
-		} else if (strcmp(vardata, name) == 0) {
-			int file_offset = ntohl(file.offset),
-			    file_len = ntohl(file.len);
-			DEBUG("Found file (offset=0x%x, len=%d).\n",
-			    offset + file_offset, file_len);
-			media->unmap(media, vardata);
-			media->close(media);
-			handle->type = ntohl(file.type);
-			handle->media_offset = offset;
-			handle->content_offset = file_offset;
-			handle->content_size = file_len;
-			handle->attribute_offset =
-				ntohl(file.attributes_offset);
-			return handle;
 		} else {
-			DEBUG(" (unmatched file @0x%x: %s)\n", offset,
-			      vardata);
+			ret = fn(arg, offset, &file, vardata);
 			media->unmap(media, vardata);
+			if (ret)
+				break;
 		}
 
 		// Move to next file.
@@ -217,6 +189,247 @@ struct cbfs_handle *cbfs_get_handle(struct cbfs_media *media, const char *name)
 			offset += CBFS_ALIGNMENT - (offset % CBFS_ALIGNMENT);
 	}
 	media->close(media);
+	return ret;
+}
+
+/*
+ * Directory index. The first lookup walks the whole CBFS once and records
+ * every file header in a hash table keyed by name, so that later lookups
+ * on the same media don't have to read it again. Only one media is indexed
+ * at a time; it is identified by its context and read() callback, and the
+ * index is dropped by cbfs_index_invalidate() whenever the default media
+ * is set up again or a new RAM media is initialized, since its context
+ * may be allocated where an earlier one was.
+ */
+struct cbfs_index_entry {
+	const char *name;		/* NULL for empty slots */
+	uint32_t hash;
+	uint32_t media_offset;
+	struct cbfs_file file;		/* header in CBFS byte order */
+};
+
+static struct cbfs_index {
+	void *context;
+	size_t (*read)(struct cbfs_media *media, void *dest, size_t offset,
+		       size_t count);
+	int is_default;			/* range came from lib_sysinfo */
+	size_t count;
+	size_t mask;			/* table size - 1 */
+	struct cbfs_index_entry *table;
+	char *names;
+} cbfs_index;
+
+/* Temporary list the walk collects headers into. */
+struct cbfs_index_build {
+	struct cbfs_index_entry *entries;
+	size_t count, alloc;
+	char *names;
+	size_t names_len, names_alloc;
+	int failed;
+};
+
+void cbfs_index_invalidate(void)
+{
+	free(cbfs_index.table);
+	free(cbfs_index.names);
+	memset(&cbfs_index, 0, sizeof(cbfs_index));
+}
+
+static uint32_t cbfs_index_hash(const char *name)
+{
+	uint32_t hash = 2166136261U;	/* FNV-1a */
+
+	while (*name)
+		hash = (hash ^ (uint8_t)*name++) * 16777619U;
+	return hash;
+}
+
+static int cbfs_index_valid(struct cbfs_media *media, int is_default)
+{
+	return cbfs_index.table && cbfs_index.context == media->context &&
+	       cbfs_index.read == media->read &&
+	       cbfs_index.is_default == is_default;
+}
+
+static int cbfs_index_collect(void *arg, uint32_t offset,
+			      const struct cbfs_file *file, const char *name)
+{
+	struct cbfs_index_build *b = arg;
+	size_t len = strnlen(name, ntohl(file->offset) - sizeof(*file));
+	struct cbfs_index_entry *e;
+
+	if (b->count == b->alloc) {
+		size_t alloc = b->alloc ? b->alloc * 2 : 64;
+		e = realloc(b->entries, alloc * sizeof(*e));
+		if (!e)
+			goto fail;
+		b->entries = e;
+		b->alloc = alloc;
+	}
+	if (b->names_len + len + 1 > b->names_alloc) {
+		size_t alloc = MAX(b->names_alloc * 2, b->names_len + len + 1);
+		char *names = realloc(b->names, alloc);
+		if (!names)
+			goto fail;
+		b->names = names;
+		b->names_alloc = alloc;
+	}
+
+	e = &b->entries[b->count++];
+	/* Names are stored as pool offsets until the pool stops moving. */
+	e->name = (const char *)b->names_len;
+	e->media_offset = offset;
+	memcpy(&e->file, file, sizeof(*file));
+	memcpy(b->names + b->names_len, name, len);
+	b->names[b->names_len + len] = '\0';
+	b->names_len += len + 1;
+	return 0;
+
+fail:
+	b->failed = 1;
+	return 1;
+}
+
+static const struct cbfs_index_entry *cbfs_index_find(const char *name)
+{
+	uint32_t hash = cbfs_index_hash(name);
+	size_t i;
+
+	for (i = hash & cbfs_index.mask; cbfs_index.table[i].name;
+	     i = (i + 1) & cbfs_index.mask) {
+		if (cbfs_index.table[i].hash == hash &&
+		    strcmp(cbfs_index.table[i].name, name) == 0)
+			return &cbfs_index.table[i];
+	}
+	return NULL;
+}
+
+static void cbfs_index_build(struct cbfs_media *media, int is_default,
+			     uint32_t offset, uint32_t cbfs_end)
+{
+	struct cbfs_index_build b = { 0 };
+	size_t size = 16, i;
+
+	cbfs_index_invalidate();
+	cbfs_walk(media, offset, cbfs_end, cbfs_index_collect, &b);
+	if (b.failed)
+		goto out;
+
+	/* Keep the load factor at or below one half. */
+	while (size < b.count * 2)
+		size *= 2;
+	cbfs_index.table = calloc(size, sizeof(*cbfs_index.table));
+	if (!cbfs_index.table)
+		goto out;
+	cbfs_index.mask = size - 1;
+	cbfs_index.names = b.names;
+	b.names = NULL;
+
+	for (i = 0; i < b.count; i++) {
+		struct cbfs_index_entry *e = &b.entries[i];
+		size_t slot;
+
+		e->name = cbfs_index.names + (uintptr_t)e->name;
+		/* The walk returns the first of several files with the same
+		 * name, so the index has to as well. */
+		if (cbfs_index_find(e->name))
+			continue;
+		e->hash = cbfs_index_hash(e->name);
+		for (slot = e->hash & cbfs_index.mask; cbfs_index.table[slot].name;
+		     slot = (slot + 1) & cbfs_index.mask)
+			;
+		cbfs_index.table[slot] = *e;
+		cbfs_index.count++;
+	}
+
+	cbfs_index.context = media->context;
+	cbfs_index.read = media->read;
+	cbfs_index.is_default = is_default;
+	DEBUG("Indexed %zu CBFS files.\n", cbfs_index.count);
+out:
+	free(b.entries);
+	free(b.names);
+}
+
+static void cbfs_fill_handle(struct cbfs_handle *handle, uint32_t offset,
+			     const struct cbfs_file *file)
+{
+	DEBUG("Found file (offset=0x%x, len=%d).\n",
+	      offset + ntohl(file->offset), ntohl(file->len));
+	handle->type = ntohl(file->type);
+	handle->media_offset = offset;
+	handle->content_offset = ntohl(file->offset);
+	handle->content_size = ntohl(file->len);
+	handle->attribute_offset = ntohl(file->attributes_offset);
+}
+
+struct cbfs_find_args {
+	const char *name;
+	struct cbfs_handle *handle;
+};
+
+static int cbfs_find_one(void *arg, uint32_t offset,
+			 const struct cbfs_file *file, const char *name)
+{
+	struct cbfs_find_args *args = arg;
+
+	if (strcmp(name, args->name) != 0) {
+		DEBUG(" (unmatched file @0x%x: %s)\n", offset, name);
+		return 0;
+	}
+	cbfs_fill_handle(args->handle, offset, file);
+	return 1;
+}
+
+/* public API starts here*/
+struct cbfs_handle *cbfs_get_handle(struct cbfs_media *media, const char *name)
+{
+	const int is_default = media == CBFS_DEFAULT_MEDIA;
+	const struct cbfs_index_entry *entry;
+	struct cbfs_find_args args;
+	uint32_t offset = 0, cbfs_end = 0;
+	struct cbfs_handle *handle = malloc(sizeof(*handle));
+
+	if (!handle)
+		return NULL;
+
+	if (is_default) {
+		if (init_default_cbfs_media(&handle->media) != 0) {
+			ERROR("Failed to initialize default media.\n");
+			free(handle);
+			return NULL;
+		}
+	} else {
+		memcpy(&handle->media, media, sizeof(*media));
+	}
+
+	if (!cbfs_index_valid(&handle->media, is_default)) {
+		if (get_cbfs_range(&offset, &cbfs_end, media)) {
+			ERROR("Failed to find cbfs range\n");
+			free(handle);
+			return NULL;
+		}
+		DEBUG("CBFS location: 0x%x~0x%x\n", offset, cbfs_end);
+		cbfs_index_build(&handle->media, is_default, offset, cbfs_end);
+	}
+
+	if (cbfs_index_valid(&handle->media, is_default)) {
+		entry = cbfs_index_find(name);
+		if (entry) {
+			cbfs_fill_handle(handle, entry->media_offset,
+					 &entry->file);
+			return handle;
+		}
+	} else {
+		/* Out of memory for the index, walk the CBFS instead. */
+		DEBUG("Looking for '%s' starting from 0x%x.\n", name, offset);
+		args.name = name;
+		args.handle = handle;
+		if (cbfs_walk(&handle->media, offset, cbfs_end, cbfs_find_one,
+			      &args))
+			return handle;
+	}
+
 	LOG("WARNING: '%s' not found.\n", name);
 	free(handle);
 	return NULL;
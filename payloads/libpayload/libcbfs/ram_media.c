@@ -85,6 +85,8 @@ int init_cbfs_ram_media(struct cbfs_media *media, void *start, size_t size) {
 	media->map = ram_map;
 	media->unmap = ram_unmap;
 	media->read = ram_read;
+	/* A new context may reuse the address of one the index was built for. */
+	cbfs_index_invalidate();
 	return 0;
 }
 
@@ -102,6 +104,7 @@ int setup_cbfs_from_ram(void *start, uint32_t size) {
 extern int libpayload_init_default_cbfs_media(struct cbfs_media *media);
 int setup_cbfs_from_flash(void) {
 	int result = libpayload_init_default_cbfs_media(&default_cbfs_media);
+	cbfs_index_invalidate();
 	if (result == 0)
 	    is_default_cbfs_media_initialized = 1;
 	return result;
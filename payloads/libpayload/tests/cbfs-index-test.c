@@ -0,0 +1,188 @@
+/* system headers */
+#include <arpa/inet.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Build libcbfs on the host and look files up in a generated CBFS image
+ * held in RAM, once by walking the CBFS for every lookup (which is what
+ * every lookup cost before the index existed) and once through the index.
+ */
+#define _LIBPAYLOAD_H
+#define _SYSINFO_H
+#define CONFIG(x) 0
+#define ALIGN_UP(x, a) (((x) + (a) - 1) & ~((__typeof__(x))(a) - 1))
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+typedef uint8_t u8;
+typedef uint32_t u32;
+#define DEBUG(x...)
+#define LOG(x...)
+#define ERROR(x...) printf(x)
+
+struct sysinfo_t {
+	unsigned long cbfs_offset;
+	unsigned long cbfs_size;
+} lib_sysinfo;
+
+#include "../libcbfs/cbfs_core.c"
+#include "../libcbfs/ram_media.c"
+
+int libpayload_init_default_cbfs_media(struct cbfs_media *media)
+{
+	return -1;
+}
+
+#define ROM_SIZE	(4 << 20)
+#define FILES		500
+#define ROUNDS		20
+
+static unsigned char rom[ROM_SIZE];
+
+int fail(const char* str)
+{
+	fprintf(stderr, "%s", str);
+	exit(1);
+}
+
+static void file_name(char *buf, size_t size, int i)
+{
+	snprintf(buf, size, "%s/file-%d", i % 2 ? "fallback" : "normal", i);
+}
+
+/* Lay out FILES raw files with a few bytes of contents each, the master
+ * header at the end of the image and the pointer to it in the last word. */
+static void build_rom(void)
+{
+	struct cbfs_header *header;
+	uint32_t offset = 0;
+	int32_t rel;
+	int i;
+
+	memset(rom, 0xff, sizeof(rom));
+	for (i = 0; i < FILES; i++) {
+		struct cbfs_file *file = (void *)&rom[offset];
+		char name[32];
+		uint32_t hdr_len;
+
+		file_name(name, sizeof(name), i);
+		hdr_len = ALIGN_UP(sizeof(*file) + strlen(name) + 1, 16);
+		memcpy(file->magic, CBFS_FILE_MAGIC, sizeof(file->magic));
+		file->len = htonl(sizeof(i));
+		file->type = htonl(CBFS_TYPE_RAW);
+		file->attributes_offset = 0;
+		file->offset = htonl(hdr_len);
+		memset(file->filename, 0, hdr_len - sizeof(*file));
+		strcpy(file->filename, name);
+		memcpy(&rom[offset + hdr_len], &i, sizeof(i));
+		offset = ALIGN_UP(offset + hdr_len + sizeof(i), CBFS_ALIGNMENT);
+	}
+
+	header = (void *)&rom[ROM_SIZE - 2 * sizeof(*header)];
+	header->magic = htonl(CBFS_HEADER_MAGIC);
+	header->version = htonl(CBFS_HEADER_VERSION);
+	header->romsize = htonl(offset);
+	header->bootblocksize = 0;
+	header->align = htonl(CBFS_ALIGNMENT);
+	header->offset = 0;
+	header->architecture = htonl(CBFS_ARCHITECTURE_X86);
+	rel = -2 * (int32_t)sizeof(*header);
+	memcpy(&rom[ROM_SIZE - sizeof(rel)], &rel, sizeof(rel));
+}
+
+/* The lookup cbfs_get_handle() did before it had an index. */
+static struct cbfs_handle *walk_get_handle(const char *name)
+{
+	struct cbfs_handle *handle = malloc(sizeof(*handle));
+	struct cbfs_find_args args = { name, handle };
+	uint32_t offset, cbfs_end;
+
+	if (init_default_cbfs_media(&handle->media) ||
+	    get_cbfs_range(&offset, &cbfs_end, &handle->media) ||
+	    !cbfs_walk(&handle->media, offset, cbfs_end, cbfs_find_one, &args)) {
+		free(handle);
+		return NULL;
+	}
+	return handle;
+}
+
+static void *get_content(const char *name, size_t *size, int walk)
+{
+	struct cbfs_handle *handle;
+	void *data;
+
+	if (!walk)
+		return cbfs_get_file_content(CBFS_DEFAULT_MEDIA, name,
+					     CBFS_TYPE_RAW, size);
+	handle = walk_get_handle(name);
+	if (!handle)
+		return NULL;
+	data = cbfs_get_contents(handle, size, 0);
+	free(handle);
+	return data;
+}
+
+/* Looks every file up in a shuffled order and checks its contents. */
+static double lookup_all(const char *label, int walk)
+{
+	struct timespec start, end;
+	unsigned long lookups = 0;
+	int round, i;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (round = 0; round < ROUNDS; round++) {
+		for (i = 0; i < FILES; i++) {
+			int n = (i * 7919 + round) % FILES, *data;
+			char name[32];
+			size_t size;
+
+			file_name(name, sizeof(name), n);
+			data = get_content(name, &size, walk);
+			if (!data || size != sizeof(*data) || *data != n)
+				fail("wrong contents\n");
+			free(data);
+			lookups++;
+		}
+		if (get_content("missing", NULL, walk))
+			fail("found a file that doesn't exist\n");
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	double s = (end.tv_sec - start.tv_sec) +
+		   (end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("%s: %lu lookups, %.0f lookups/sec\n", label, lookups,
+	       lookups / s);
+	return lookups / s;
+}
+
+int main(int argc, char** argv)
+{
+	struct cbfs_handle *handle;
+	double walk, indexed;
+
+	build_rom();
+	if (setup_cbfs_from_ram(rom, sizeof(rom)) != 0)
+		fail("could not setup CBFS in RAM\n");
+
+	walk = lookup_all("linear walk", 1);
+	indexed = lookup_all("indexed", 0);
+	if (cbfs_index.count != FILES)
+		fail("index is missing files\n");
+
+	/* Changed contents must not be served from the old index. */
+	((struct cbfs_file *)rom)->filename[strlen("normal/file-")] = 'X';
+	cbfs_index_invalidate();
+	if (cbfs_get_file_content(CBFS_DEFAULT_MEDIA, "normal/file-0",
+				  CBFS_TYPE_RAW, NULL))
+		fail("stale index after media change\n");
+	handle = cbfs_get_handle(CBFS_DEFAULT_MEDIA, "normal/file-X");
+	if (!handle)
+		fail("renamed file not found\n");
+	free(handle);
+
+	printf("speedup: %.1fx\n", indexed / walk);
+	exit(0);
+}
@@ -0,0 +1,315 @@
+/* system headers */
+#include <endian.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Build cbgfx on the host and draw into a framebuffer in memory. Scaled
+ * bitmaps are compared against the per-pixel renderer cbgfx used to have,
+ * which is also timed as the baseline.
+ */
+#define _LIBPAYLOAD_H
+#define _ARCH_TYPES_H
+#define __IPCHKSUM_H__
+#define _SYSINFO_H
+#define _CBFS_H_
+#define CONFIG(x) CONFIG_##x
+#define CONFIG_LP_LITTLE_ENDIAN (__BYTE_ORDER == __LITTLE_ENDIAN)
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+#define __packed __attribute__((packed))
+#define phys_to_virt(x) ((void *)(uintptr_t)(x))
+
+#include <coreboot_tables.h>
+#include <cbgfx.h>
+
+struct sysinfo_t {
+	struct cb_framebuffer *framebuffer;
+} lib_sysinfo;
+
+#include "../drivers/video/graphics.c"
+
+#define WIDTH		3840
+#define HEIGHT		2160
+#define IMAGE_SIZE	480
+#define ROUNDS		5
+
+static struct cb_framebuffer fb = {
+	.x_resolution = WIDTH,
+	.y_resolution = HEIGHT,
+	.bytes_per_line = WIDTH * 4,
+	.bits_per_pixel = 32,
+	.red_mask_pos = 16,
+	.red_mask_size = 8,
+	.green_mask_pos = 8,
+	.green_mask_size = 8,
+	.blue_mask_pos = 0,
+	.blue_mask_size = 8,
+};
+static uint32_t pixels[WIDTH * HEIGHT];
+static uint32_t reference[WIDTH * HEIGHT];
+
+int fail(const char* str)
+{
+	fprintf(stderr, "%s", str);
+	exit(1);
+}
+
+/* A 256-color gradient image with a noisy band, as a BMP file. */
+static uint8_t *make_bitmap(size_t *size)
+{
+	const size_t pal_size = 256 * sizeof(struct bitmap_palette_element_v3);
+	const size_t offset = sizeof(struct bitmap_file_header) +
+			      sizeof(struct bitmap_header_v3) + pal_size;
+	struct bitmap_file_header *fh;
+	struct bitmap_header_v3 *h;
+	struct bitmap_palette_element_v3 *pal;
+	uint8_t *bmp, *data;
+	int x, y;
+
+	*size = offset + IMAGE_SIZE * IMAGE_SIZE;
+	bmp = calloc(1, *size);
+	fh = (void *)bmp;
+	h = (void *)(fh + 1);
+	pal = (void *)(h + 1);
+	data = bmp + offset;
+
+	fh->signature[0] = 'B';
+	fh->signature[1] = 'M';
+	fh->file_size = htole32(*size);
+	fh->bitmap_offset = htole32(offset);
+	h->header_size = htole32(sizeof(*h));
+	h->width = htole32(IMAGE_SIZE);
+	h->height = htole32(IMAGE_SIZE);
+	h->planes = htole16(1);
+	h->bits_per_pixel = htole16(8);
+	h->size = htole32(IMAGE_SIZE * IMAGE_SIZE);
+	h->colors_used = htole32(256);
+	for (x = 0; x < 256; x++) {
+		pal[x].red = x;
+		pal[x].green = 255 - x;
+		pal[x].blue = x * 7;
+	}
+	for (y = 0; y < IMAGE_SIZE; y++)
+		for (x = 0; x < IMAGE_SIZE; x++)
+			data[y * IMAGE_SIZE + x] = y / 4 % 3 ? (x + y) & 0xff :
+						   rand() & 0xff;
+	return bmp;
+}
+
+/* The renderer cbgfx had before draw_bitmap_v3() worked row by row. */
+static uint32_t old_bli(uint32_t q00, uint32_t q10, uint32_t q01, uint32_t q11,
+			struct fraction *tx, struct fraction *ty)
+{
+	uint32_t r0 = (tx->n * q10 + (tx->d - tx->n) * q00) / tx->d;
+	uint32_t r1 = (tx->n * q11 + (tx->d - tx->n) * q01) / tx->d;
+	return (ty->n * r1 + (ty->d - ty->n) * r0) / ty->d;
+}
+
+static void old_draw(const uint8_t *bmp, size_t size, int dim_size)
+{
+	struct bitmap_header_v3 header;
+	const struct bitmap_palette_element_v3 *pal;
+	const uint8_t *pixel_array;
+	struct vector dim_org, s0, s1, d, p;
+	struct fraction tx, ty;
+	const struct vector dim = { .width = dim_size, .height = dim_size };
+	const struct scale scale = {
+		.x = { .n = dim_size, .d = IMAGE_SIZE },
+		.y = { .n = dim_size, .d = IMAGE_SIZE },
+	};
+
+	if (parse_bitmap_header_v3(bmp, size, &header, &pal, &pixel_array,
+				   &dim_org))
+		fail("could not parse bitmap\n");
+
+	const int32_t y_stride = ROUNDUP(dim_org.width, 4);
+	p.y = canvas.offset.y + dim.height - 1;
+	for (d.y = 0; d.y < dim.height; d.y++, p.y--) {
+		s0.y = d.y * scale.y.d / scale.y.n;
+		s1.y = s0.y;
+		if (s1.y + 1 < dim_org.height)
+			s1.y++;
+		ty.d = scale.y.n;
+		ty.n = (d.y * scale.y.d) % scale.y.n;
+		const uint8_t *data0 = pixel_array + s0.y * y_stride;
+		const uint8_t *data1 = pixel_array + s1.y * y_stride;
+		p.x = canvas.offset.x;
+		for (d.x = 0; d.x < dim.width; d.x++, p.x++) {
+			s0.x = d.x * scale.x.d / scale.x.n;
+			s1.x = s0.x;
+			if (s1.x + 1 < dim_org.width)
+				s1.x++;
+			tx.d = scale.x.n;
+			tx.n = (d.x * scale.x.d) % scale.x.n;
+			uint8_t c00 = data0[s0.x];
+			uint8_t c10 = data0[s1.x];
+			uint8_t c01 = data1[s0.x];
+			uint8_t c11 = data1[s1.x];
+			const struct rgb_color rgb = {
+				.red = old_bli(pal[c00].red, pal[c10].red,
+					       pal[c01].red, pal[c11].red,
+					       &tx, &ty),
+				.green = old_bli(pal[c00].green, pal[c10].green,
+						 pal[c01].green, pal[c11].green,
+						 &tx, &ty),
+				.blue = old_bli(pal[c00].blue, pal[c10].blue,
+						pal[c01].blue, pal[c11].blue,
+						&tx, &ty),
+			};
+			struct vector rcoord;
+			fb_coord(&p, &rcoord);
+			uint8_t *pixel = fbaddr + rcoord.y * fb.bytes_per_line +
+					 rcoord.x * 4;
+			uint32_t color = calculate_color(&rgb, 0);
+			int i;
+			for (i = 0; i < 4; i++)
+				pixel[i] = color >> (i * 8);
+		}
+	}
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int channel_diff(uint32_t a, uint32_t b)
+{
+	int i, diff = 0;
+
+	for (i = 0; i < 24; i += 8)
+		diff = MAX(diff, abs((int)((a >> i) & 0xff) -
+				     (int)((b >> i) & 0xff)));
+	return diff;
+}
+
+/* Draws the bitmap to fill the canvas with both renderers and compares. */
+static void bench_scaled(const uint8_t *bmp, size_t size)
+{
+	const struct scale pos = { .x = { 0, 1 }, .y = { 0, 1 } };
+	const struct scale dim = { .x = { 1, 1 }, .y = { 1, 1 } };
+	double t, old_ms, new_ms;
+	size_t i;
+	int r, diff = 0;
+
+	t = now();
+	for (r = 0; r < ROUNDS; r++)
+		old_draw(bmp, size, canvas.size.width);
+	old_ms = (now() - t) * 1000 / ROUNDS;
+	memcpy(reference, pixels, sizeof(pixels));
+
+	memset(pixels, 0, sizeof(pixels));
+	t = now();
+	for (r = 0; r < ROUNDS; r++)
+		if (draw_bitmap(bmp, size, &pos, &dim,
+				PIVOT_H_LEFT | PIVOT_V_TOP))
+			fail("draw_bitmap failed\n");
+	new_ms = (now() - t) * 1000 / ROUNDS;
+
+	for (i = 0; i < WIDTH * HEIGHT; i++)
+		diff = MAX(diff, channel_diff(pixels[i], reference[i]));
+	if (diff > 2)
+		fail("scaled bitmap differs from the old renderer\n");
+
+	printf("%dx%d -> %dx%d: %.1f ms per draw (was %.1f ms), "
+	       "max channel difference %d\n", IMAGE_SIZE, IMAGE_SIZE,
+	       canvas.size.width, canvas.size.height, new_ms, old_ms, diff);
+}
+
+/* An unscaled bitmap must come out exactly as its palette says. */
+static void check_direct(const uint8_t *bmp, size_t size)
+{
+	const struct bitmap_palette_element_v3 *pal;
+	const uint8_t *data;
+	const struct vector pos = { .x = 100, .y = 50 };
+	int x, y;
+
+	pal = (void *)(bmp + sizeof(struct bitmap_file_header) +
+		       sizeof(struct bitmap_header_v3));
+	data = bmp + size - IMAGE_SIZE * IMAGE_SIZE;
+	if (draw_bitmap_direct(bmp, size, &pos))
+		fail("draw_bitmap_direct failed\n");
+	for (y = 0; y < IMAGE_SIZE; y++) {
+		for (x = 0; x < IMAGE_SIZE; x++) {
+			const struct bitmap_palette_element_v3 *c =
+				&pal[data[(IMAGE_SIZE - 1 - y) * IMAGE_SIZE + x]];
+			if (pixels[(pos.y + y) * WIDTH + pos.x + x] !=
+			    (uint32_t)(c->red << 16 | c->green << 8 | c->blue))
+				fail("unscaled bitmap is wrong\n");
+		}
+	}
+}
+
+/* Drawing to the graphics buffer only shows up after a flush, and only the
+ * dirty area is copied. */
+static void check_buffer(void)
+{
+	const struct rect box = {
+		.offset = { .x = 10, .y = 10 },
+		.size = { .width = 20, .height = 20 },
+	};
+	const struct rgb_color white = { 0xff, 0xff, 0xff };
+	const struct rgb_color black = { 0, 0, 0 };
+	int x, y, inside, w, h;
+	double t;
+
+	clear_screen(&black);
+	if (enable_graphics_buffer())
+		fail("could not enable the graphics buffer\n");
+	draw_box(&box, &white);
+	if (pixels[HEIGHT / 4 * WIDTH + canvas.offset.x + canvas.size.width / 4])
+		fail("drawing went to the screen\n");
+	if (dirty.size.width != canvas.size.width / 5 ||
+	    dirty.size.height != canvas.size.height / 5)
+		fail("wrong dirty area\n");
+
+	w = dirty.size.width;
+	h = dirty.size.height;
+	t = now();
+	flush_graphics_buffer();
+	printf("flushing a %dx%d box: %.3f ms\n", w, h, (now() - t) * 1000);
+	for (y = 0; y < HEIGHT; y++) {
+		for (x = 0; x < WIDTH; x++) {
+			inside = x >= canvas.offset.x + canvas.size.width / 10 &&
+				 x < canvas.offset.x + canvas.size.width * 3 / 10 &&
+				 y >= canvas.size.height / 10 &&
+				 y < canvas.size.height * 3 / 10;
+			if ((pixels[y * WIDTH + x] & 0xffffff) !=
+			    (inside ? 0xffffff : 0))
+				fail("flush copied the wrong area\n");
+		}
+	}
+	if (dirty.size.width)
+		fail("dirty area not reset by flush\n");
+	disable_graphics_buffer();
+}
+
+int main(int argc, char** argv)
+{
+	uint8_t *bmp;
+	size_t size;
+
+	fb.physical_address = (uintptr_t)pixels;
+	lib_sysinfo.framebuffer = &fb;
+	if (cbgfx_init())
+		fail("could not initialize cbgfx\n");
+
+	bmp = make_bitmap(&size);
+	bench_scaled(bmp, size);
+	check_direct(bmp, size);
+	check_buffer();
+	free(bmp);
+
+	exit(0);
+}
@@ -0,0 +1,241 @@
+/* system headers */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Build the libpayload allocator on the host. Its entry points are renamed
+ * so they don't replace the host's malloc(), and the few libpayload helpers
+ * it needs are provided here instead of pulling in <libpayload.h>.
+ */
+#define _LIBPAYLOAD_H
+#define CONFIG(x) 0
+#define ALIGN_UP(x, a) (((x) + (a) - 1) & ~((__typeof__(x))(a) - 1))
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define halt() abort()
+typedef uint8_t u8;
+typedef uint32_t u32;
+typedef int32_t s32;
+typedef uint64_t u64;
+#define log2 lp_log2
+static inline int log2(u32 x) { return 31 - __builtin_clz(x); }
+static inline int __ffs(u32 x) { return __builtin_ctz(x); }
+
+#define malloc lp_malloc
+#define free lp_free
+#define calloc lp_calloc
+#define realloc lp_realloc
+#define memalign lp_memalign
+#define dma_malloc lp_dma_malloc
+#define dma_memalign lp_dma_memalign
+void *malloc(size_t size);
+void free(void *ptr);
+void *memalign(size_t align, size_t size);
+int dma_initialized(void);
+void init_dma_memory(void *start, u32 size);
+
+#define DMA_SIZE	(256 << 10)
+
+/* The heap boundaries normally come from the linker script. */
+__asm__(".data\n"
+	".balign 16\n"
+	".globl _heap\n"
+	"_heap:\n"
+	".space 0x100000\n"
+	".globl _eheap\n"
+	"_eheap:\n"
+	".text\n");
+
+#include "../libc/malloc.c"
+
+#undef malloc
+#undef free
+#undef calloc
+#undef realloc
+#undef memalign
+
+#define SLOTS	4096
+#define ROUNDS	200000
+
+struct slot {
+	unsigned char *ptr;
+	size_t size;
+	unsigned char pattern;
+	int aligned;
+};
+
+static struct slot slots[SLOTS];
+static unsigned char dma_area[DMA_SIZE] __attribute__((aligned(4096)));
+
+int fail(const char* str)
+{
+	fprintf(stderr, "%s", str);
+	exit(1);
+}
+
+static void check_slot(struct slot *s)
+{
+	size_t i;
+
+	for (i = 0; i < s->size; i++)
+		if (s->ptr[i] != s->pattern)
+			fail("allocation was overwritten\n");
+}
+
+static void fill_slot(struct slot *s, void *ptr, size_t size)
+{
+	s->ptr = ptr;
+	s->size = size;
+	s->pattern = rand();
+	memset(ptr, s->pattern, size);
+}
+
+/* Mostly small sizes, like USB descriptors and file system metadata, with
+ * the occasional larger buffer. */
+static size_t random_size(void)
+{
+	if (rand() % 16)
+		return 1 + rand() % 256;
+	return 1 + rand() % 16384;
+}
+
+/* Walk the block chain and check it against the free lists. */
+static void check_heap(struct memory_type *type)
+{
+	hdrtype_t *ptr = type->start;
+	unsigned long chain = 0, listed = 0;
+	int prev_free = 0, i;
+
+	if (!HAS_MAGIC(*ptr))
+		return;
+
+	while ((void *)ptr < type->end) {
+		if (!HAS_MAGIC(*ptr) || SIZE(*ptr) < MIN_SIZE)
+			fail("corrupted block header\n");
+		if (!!(*ptr & FLAG_PREV_FREE) != prev_free)
+			fail("stale FLAG_PREV_FREE\n");
+		prev_free = IS_FREE(*ptr);
+		if (prev_free) {
+			if (*ptr & FLAG_PREV_FREE)
+				fail("adjacent free blocks were not merged\n");
+			if (next_block(ptr)[-1] != *ptr)
+				fail("bad trailing header\n");
+			chain++;
+		}
+		ptr = next_block(ptr);
+	}
+	if ((void *)ptr != type->end)
+		fail("block chain overruns the region\n");
+
+	for (i = 0; i < NUM_BINS; i++) {
+		struct free_block *fb;
+
+		if (!!type->bins[i] != !!(type->binmap[i / 32] & (1U << (i % 32))))
+			fail("bin map out of sync\n");
+		for (fb = type->bins[i]; fb != NULL; fb = fb->next) {
+			if (bin_index(SIZE(*block_of(fb))) != i)
+				fail("free block in the wrong bin\n");
+			listed++;
+		}
+	}
+	if (chain != listed)
+		fail("free lists don't match the block chain\n");
+}
+
+static double stress(const char *name, void *(*alloc_fn)(size_t),
+		     void *(*align_fn)(size_t, size_t))
+{
+	struct timespec start, end;
+	unsigned long ops = 0, failed = 0;
+	int round, i;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (round = 0; round < ROUNDS; round++) {
+		struct slot *s = &slots[rand() % SLOTS];
+		void *ptr;
+		size_t size;
+
+		if (round % 10000 == 0)
+			check_heap(alloc_fn == lp_malloc ? heap : dma);
+
+		if (s->ptr) {
+			check_slot(s);
+			/* realloc() only supports blocks from malloc(). */
+			if (rand() % 4 == 0 && alloc_fn == lp_malloc &&
+			    !s->aligned) {
+				size = random_size();
+				ptr = lp_realloc(s->ptr, size);
+				if (ptr == NULL) {
+					failed++;
+					continue;
+				}
+				s->ptr = ptr;
+				s->size = MIN(s->size, size);
+				check_slot(s);
+				fill_slot(s, ptr, size);
+			} else {
+				lp_free(s->ptr);
+				s->ptr = NULL;
+			}
+			ops++;
+			continue;
+		}
+
+		size = random_size();
+		s->aligned = rand() % 8 == 0;
+		if (s->aligned) {
+			size_t align = 16 << (rand() % 6);
+
+			ptr = align_fn(align, size);
+			if (ptr && ((uintptr_t)ptr & (align - 1)))
+				fail("memalign returned a misaligned pointer\n");
+		} else {
+			ptr = alloc_fn(size);
+			if (ptr && ((uintptr_t)ptr & (HDRSIZE - 1)))
+				fail("malloc returned a misaligned pointer\n");
+		}
+		ops++;
+		if (ptr == NULL) {
+			failed++;
+			continue;
+		}
+		fill_slot(s, ptr, size);
+	}
+
+	for (i = 0; i < SLOTS; i++) {
+		if (slots[i].ptr == NULL)
+			continue;
+		check_slot(&slots[i]);
+		lp_free(slots[i].ptr);
+		slots[i].ptr = NULL;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	check_heap(alloc_fn == lp_malloc ? heap : dma);
+
+	double ns = (end.tv_sec - start.tv_sec) * 1e9 +
+		    (end.tv_nsec - start.tv_nsec);
+	printf("%s: %lu operations (%lu out of memory), %.1f ns/op\n",
+	       name, ops, failed, ns / ops);
+	return ns / ops;
+}
+
+
+int main(int argc, char** argv)
+{
+	srand(1);
+
+	stress("malloc", lp_malloc, lp_memalign);
+
+	init_dma_memory(dma_area, sizeof(dma_area));
+	if (!dma_initialized())
+		fail("could not set up DMA memory\n");
+
+	stress("dma_malloc", lp_dma_malloc, lp_dma_memalign);
+
+	exit(0);
+}
@@ -0,0 +1,147 @@
+/* system headers */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Build the storage block cache on the host and replay access traces on a
+ * device backed by memory. The device counts what actually reaches it,
+ * so the cache's effect shows without real hardware.
+ */
+#define _LIBPAYLOAD_H
+#define CONFIG(x) 0
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+typedef uint8_t u8;
+typedef uint32_t u32;
+#define CONFIG_LP_STORAGE_CACHE_SIZE_KB		512
+#define CONFIG_LP_STORAGE_CACHE_READAHEAD_KB	128
+
+#include "../drivers/storage/cache.c"
+
+#define DISK_BLOCKS	(64 * 1024)	/* 32MiB */
+
+struct mem_dev {
+	storage_dev_t storage_dev;
+	unsigned char *data;
+	unsigned long calls, blocks;
+};
+
+static struct mem_dev disk;
+
+int fail(const char* str)
+{
+	fprintf(stderr, "%s", str);
+	exit(1);
+}
+
+static ssize_t mem_read512(storage_dev_t *const dev, const lba_t start,
+			   const size_t count, unsigned char *const buf)
+{
+	struct mem_dev *const mem = (struct mem_dev *)dev;
+	const size_t n = start >= DISK_BLOCKS ? 0
+			 : MIN(count, DISK_BLOCKS - start);
+
+	mem->calls++;
+	mem->blocks += n;
+	memcpy(buf, mem->data + start * 512, n * 512);
+	return n;
+}
+
+static void check_read(lba_t start, size_t count)
+{
+	static unsigned char buf[1024 * 512];
+	const size_t expect = start >= DISK_BLOCKS ? 0
+			      : MIN(count, DISK_BLOCKS - start);
+
+	if (storage_cache_read(&disk.storage_dev, start, count, buf) != expect)
+		fail("short read\n");
+	if (memcmp(buf, disk.data + start * 512, expect * 512))
+		fail("wrong data\n");
+}
+
+/* Kernel or initramfs: large sequential reads. */
+static void trace_sequential_large(void)
+{
+	lba_t b;
+
+	for (b = 0; b < 16 * 1024; b += 256)
+		check_read(b, 256);
+}
+
+/* Reading a file through a file system, block by block. */
+static void trace_sequential_small(void)
+{
+	lba_t b;
+
+	for (b = 20000; b < 28000; b += 8)
+		check_read(b, 8);
+}
+
+/* FAT chains, inodes and directories: a small hot set read over and
+   over, mixed with scattered data blocks. */
+static void trace_metadata(void)
+{
+	int i;
+
+	for (i = 0; i < 20000; i++) {
+		if (rand() % 4)
+			check_read(32 + (rand() % 64) * 2, 2);
+		else
+			check_read(rand() % (DISK_BLOCKS - 16), 1 + rand() % 16);
+	}
+}
+
+/* Unaligned reads at the end of the device. */
+static void trace_device_end(void)
+{
+	check_read(DISK_BLOCKS - 3, 3);
+	check_read(DISK_BLOCKS - 9, 5);
+	check_read(DISK_BLOCKS - 4, 4);
+}
+
+static void replay(const char *name, void (*trace)(void))
+{
+	struct timespec start, end;
+	storage_cache_stats_t stats;
+
+	storage_cache_invalidate(&disk.storage_dev);
+	if (disk.storage_dev.cache)
+		memset(&disk.storage_dev.cache->stats, 0,
+		       sizeof(disk.storage_dev.cache->stats));
+	disk.calls = disk.blocks = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	trace();
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	storage_cache_get_stats(&disk.storage_dev, &stats);
+	printf("%-18s %6lu hits %6lu misses %5lu/%5lu read ahead used, "
+	       "%4lu bypassed, %6lu device reads (%lu blocks), %.1f ms\n",
+	       name, stats.hits, stats.misses, stats.readahead_hits,
+	       stats.readahead, stats.bypassed, disk.calls, disk.blocks,
+	       (end.tv_sec - start.tv_sec) * 1e3 +
+	       (end.tv_nsec - start.tv_nsec) / 1e6);
+}
+
+int main(int argc, char** argv)
+{
+	size_t i;
+
+	disk.data = malloc(DISK_BLOCKS * 512);
+	if (!disk.data)
+		fail("out of memory\n");
+	srand(1);
+	for (i = 0; i < DISK_BLOCKS * 512; i++)
+		disk.data[i] = rand();
+	disk.storage_dev.read_blocks512 = mem_read512;
+
+	replay("sequential large", trace_sequential_large);
+	replay("sequential small", trace_sequential_small);
+	replay("metadata", trace_metadata);
+	replay("device end", trace_device_end);
+
+	exit(0);
+}
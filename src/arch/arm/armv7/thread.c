@@ -115,7 +115,12 @@ switch_to_thread(uintptr_t new_stack, uintptr_t *saved_stack)
 	);
 }
 
-void *arch_get_thread_stackbase(void)
+void arch_init_thread_stack(struct thread *t)
 {
-	return (void *)CONFIG_STACK_BOTTOM;
+	t->stack_orig = (uintptr_t)t->stack_base + CONFIG_THREAD_STACK_SIZE;
+}
+
+unsigned long arch_thread_cpu_id(void)
+{
+	return 0;
 }
@@ -0,0 +1,68 @@
+/*
+ * This file is part of the coreboot project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <arch/mpidr.h>
+#include <commonlib/helpers.h>
+#include <string.h>
+#include <thread.h>
+
+/* The stack frame looks like the following after switch_to_thread() saved
+ * the callee-saved registers. This needs to match thread_switch.S. */
+struct pushed_regs {
+	uint64_t x19; /* Offset 0x00 */
+	uint64_t x20; /* Offset 0x08 */
+	uint64_t x21; /* Offset 0x10 */
+	uint64_t x22; /* Offset 0x18 */
+	uint64_t x23; /* Offset 0x20 */
+	uint64_t x24; /* Offset 0x28 */
+	uint64_t x25; /* Offset 0x30 */
+	uint64_t x26; /* Offset 0x38 */
+	uint64_t x27; /* Offset 0x40 */
+	uint64_t x28; /* Offset 0x48 */
+	uint64_t x29; /* Offset 0x50 */
+	uint64_t x30; /* Offset 0x58 */
+};
+
+/* Defined in thread_switch.S. Calls x20(x19) with a zeroed frame record. */
+void arm64_thread_trampoline(void);
+
+void arch_prepare_thread(struct thread *t,
+			 asmlinkage void (*thread_entry)(void *), void *arg)
+{
+	struct pushed_regs *regs;
+	uintptr_t stack = t->stack_current;
+
+	/* The stack pointer has to stay 16-byte aligned. */
+	stack = ALIGN_DOWN(stack, 16);
+	stack -= sizeof(*regs);
+	regs = (void *)stack;
+
+	/* switch_to_thread() returns into the trampoline which passes arg
+	 * to thread_entry(). thread_entry() is assumed to never return. */
+	memset(regs, 0, sizeof(*regs));
+	regs->x19 = (uintptr_t)arg;
+	regs->x20 = (uintptr_t)thread_entry;
+	regs->x30 = (uintptr_t)arm64_thread_trampoline;
+
+	t->stack_current = stack;
+}
+
+void arch_init_thread_stack(struct thread *t)
+{
+	t->stack_orig = (uintptr_t)t->stack_base + CONFIG_THREAD_STACK_SIZE;
+}
+
+unsigned long arch_thread_cpu_id(void)
+{
+	return read_affinity_mpidr();
+}
@@ -23,14 +23,9 @@ struct cpu_driver {
 	const struct cpu_device_id *id_table;
 };
 
-struct thread;
-
 struct cpu_info {
 	struct device *cpu;
 	unsigned long index;
-#if CONFIG(COOP_MULTITASKING)
-	struct thread *thread;
-#endif
 };
 
 struct cpuinfo_ppc64 {
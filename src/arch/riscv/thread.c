@@ -0,0 +1,76 @@
+/*
+ * This file is part of the coreboot project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <arch/encoding.h>
+#include <commonlib/helpers.h>
+#include <mcall.h>
+#include <string.h>
+#include <thread.h>
+
+/* The stack frame looks like the following after switch_to_thread() saved
+ * the callee-saved registers. This needs to match thread_switch.S. */
+struct pushed_regs {
+	uintptr_t ra;
+	uintptr_t s[12];
+	uintptr_t pad[3];
+#if defined(__riscv_float_abi_double)
+	uint64_t fs[12];
+#endif
+};
+
+_Static_assert(sizeof(struct pushed_regs) % 16 == 0,
+	"Thread switch frame must keep the stack 16-byte aligned");
+
+/* Defined in thread_switch.S. Calls s1(s0) with a zeroed return address. */
+void riscv_thread_trampoline(void);
+
+void arch_prepare_thread(struct thread *t,
+			 asmlinkage void (*thread_entry)(void *), void *arg)
+{
+	struct pushed_regs *regs;
+	uintptr_t stack = t->stack_current;
+
+	stack = ALIGN_DOWN(stack, 16);
+	stack -= sizeof(*regs);
+	regs = (void *)stack;
+
+	/* switch_to_thread() returns into the trampoline which passes arg
+	 * to thread_entry(). thread_entry() is assumed to never return. */
+	memset(regs, 0, sizeof(*regs));
+	regs->s[0] = (uintptr_t)arg;
+	regs->s[1] = (uintptr_t)thread_entry;
+	regs->ra = (uintptr_t)riscv_thread_trampoline;
+
+	t->stack_current = stack;
+}
+
+void arch_init_thread_stack(struct thread *t)
+{
+	hls_t *hls;
+
+	/*
+	 * HLS() is found at the top of the page the stack pointer is in, so
+	 * every thread stack carries a copy of the hart-local storage. Note
+	 * that OTHER_HLS() is only valid on the hart's original stack.
+	 */
+	hls = (void *)((uintptr_t)t->stack_base + CONFIG_THREAD_STACK_SIZE -
+		       HLS_SIZE);
+	memcpy(hls, HLS(), HLS_SIZE);
+
+	t->stack_orig = (uintptr_t)hls;
+}
+
+unsigned long arch_thread_cpu_id(void)
+{
+	return read_csr(mhartid);
+}
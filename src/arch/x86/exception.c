@@ -394,6 +394,15 @@ void x86_exception(struct eregs *info);
 
 void x86_exception(struct eregs *info)
 {
+#if ENV_RAMSTAGE && CONFIG(RAMSTAGE_PROFILER)
+	if (info->vector == LAPIC_PROFILER_VECTOR) {
+		lapic_profiler_interrupt(info->eip);
+		return;
+	}
+	/* Spurious interrupts don't take an EOI. */
+	if (info->vector == LAPIC_SPURIOUS_VECTOR)
+		return;
+#endif
 #if CONFIG(GDB_STUB)
 	int signo;
 	memcpy(gdb_stub_registers, info, 8*sizeof(uint32_t));
@@ -560,6 +569,7 @@ struct intr_gate {
 extern u8 vec0[], vec1[], vec2[], vec3[], vec4[], vec5[], vec6[], vec7[];
 extern u8 vec8[], vec9[], vec10[], vec11[], vec12[], vec13[], vec14[], vec15[];
 extern u8 vec16[], vec17[], vec18[], vec19[];
+extern u8 vec32[], vec47[];
 
 static const uintptr_t intr_entries[] = {
 	(uintptr_t)vec0, (uintptr_t)vec1, (uintptr_t)vec2, (uintptr_t)vec3,
@@ -567,6 +577,11 @@ static const uintptr_t intr_entries[] = {
 	(uintptr_t)vec8, (uintptr_t)vec9, (uintptr_t)vec10, (uintptr_t)vec11,
 	(uintptr_t)vec12, (uintptr_t)vec13, (uintptr_t)vec14, (uintptr_t)vec15,
 	(uintptr_t)vec16, (uintptr_t)vec17, (uintptr_t)vec18, (uintptr_t)vec19,
+#if ENV_RAMSTAGE && CONFIG(RAMSTAGE_PROFILER)
+	/* 20 to 31 stay not present, 32 is the profiler's timer. */
+	[LAPIC_PROFILER_VECTOR] = (uintptr_t)vec32,
+	[LAPIC_SPURIOUS_VECTOR] = (uintptr_t)vec47,
+#endif
 };
 
 static struct intr_gate idt[ARRAY_SIZE(intr_entries)] __aligned(8) CAR_GLOBAL;
@@ -627,6 +642,8 @@ asmlinkage void exception_init(void)
 
 	/* Initialize IDT. */
 	for (i = 0; i < ARRAY_SIZE(idt); i++) {
+		if (!intr_entries[i])
+			continue;
 		gates[i].offset_0 = intr_entries[i];
 		gates[i].segsel = segment;
 		gates[i].flags = IGATE_FLAGS;
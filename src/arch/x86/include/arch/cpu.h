@@ -237,14 +237,9 @@ struct cpu_driver {
 
 struct cpu_driver *find_cpu_driver(struct device *cpu);
 
-struct thread;
-
 struct cpu_info {
 	struct device *cpu;
 	unsigned int index;
-#if CONFIG(COOP_MULTITASKING)
-	struct thread *thread;
-#endif
 };
 
 static inline struct cpu_info *cpu_info(void)
@@ -11,6 +11,7 @@
  * GNU General Public License for more details.
  */
 
+#include <arch/cpu.h>
 #include <thread.h>
 
 /* The stack frame looks like the following after a pushad instruction. */
@@ -51,9 +52,19 @@ void arch_prepare_thread(struct thread *t,
 	t->stack_current = stack;
 }
 
-void *arch_get_thread_stackbase(void)
+void arch_init_thread_stack(struct thread *t)
 {
-	/* defined in c_start.S */
-	extern u8 thread_stacks[];
-	return &thread_stacks[0];
+	struct cpu_info *ci;
+
+	/* cpu_info() is located just under the top of the aligned stack. */
+	ci = (void *)((uintptr_t)t->stack_base + CONFIG_THREAD_STACK_SIZE -
+		      sizeof(struct cpu_info));
+	*ci = *cpu_info();
+
+	t->stack_orig = (uintptr_t)ci;
+}
+
+unsigned long arch_thread_cpu_id(void)
+{
+	return cpu_info()->index;
 }
@@ -0,0 +1,127 @@
+/*
+ * This file is part of the coreboot project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef __BINLOG_SERIALIZED_H__
+#define __BINLOG_SERIALIZED_H__
+
+#include <stdint.h>
+
+/*
+ * The binary log keeps printk() messages unformatted: each record holds the
+ * address of the format string and the raw arguments. util/cbmem formats
+ * them later, reading the format strings from the stage's ELF file.
+ *
+ * Records are stored back to back in a ring and never split. When a record
+ * doesn't fit before the end of the body, `end` marks where the records of
+ * that pass stop and writing restarts at 0. After a wrap the log reads from
+ * `head` to `end` and then from 0 to `tail`.
+ */
+#define BINLOG_MAGIC		0x474f4c42	/* "BLOG" */
+#define BINLOG_WRAPPED		(1 << 0)
+
+/* Records are padded to a multiple of this. */
+#define BINLOG_ALIGN		4
+/* Largest record, header included. Longer messages are logged as text. */
+#define BINLOG_MAX_RECORD	256
+
+enum binlog_stage {
+	BINLOG_STAGE_RAMSTAGE = 1,
+};
+
+struct binlog {
+	uint32_t magic;
+	uint32_t size;		/* size of body */
+	uint32_t head;		/* oldest record, if wrapped */
+	uint32_t tail;		/* where the next record goes */
+	uint32_t end;		/* end of the records before the last wrap */
+	uint32_t flags;
+	uint32_t ramstage_base;	/* run-time address of ramstage's _program */
+	uint16_t tick_freq_mhz;	/* of the record timestamps */
+	uint8_t ptr_size;	/* sizeof(void *) in the stages */
+	uint8_t reserved;
+	uint8_t body[0];
+} __packed;
+
+/*
+ * The arguments follow the header in format string order. Strings (%s) are
+ * stored NUL-terminated, everything else, including '*' widths and
+ * precisions, as a 64-bit little-endian value. Signed conversions are sign
+ * extended.
+ */
+struct binlog_record {
+	uint16_t size;		/* whole record, padded to BINLOG_ALIGN */
+	uint8_t level;
+	uint8_t stage;		/* enum binlog_stage */
+	uint32_t fmt;		/* run-time address of the format string */
+	uint64_t timestamp;	/* timestamp_get() */
+	uint8_t args[0];
+} __packed;
+
+/* One conversion of a format string, as printk() parses it. */
+struct binlog_spec {
+	int len;		/* characters from '%' to the conversion */
+	int prefix_len;		/* characters from '%' to the qualifier */
+	int width_arg;		/* width is given as an argument */
+	int precision_arg;	/* precision is given as an argument */
+	char qualifier;		/* 'h', 'H' (hh), 'l', 'L' (ll), 'z', 'j' or 0 */
+	char conversion;
+};
+
+/* Parse the conversion at fmt, which points at a '%'. */
+static inline void binlog_parse_spec(const char *fmt, struct binlog_spec *spec)
+{
+	const char *p = fmt + 1;
+
+	spec->width_arg = 0;
+	spec->precision_arg = 0;
+	spec->qualifier = 0;
+
+	while (*p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0')
+		p++;
+
+	if (*p == '*') {
+		spec->width_arg = 1;
+		p++;
+	} else {
+		while (*p >= '0' && *p <= '9')
+			p++;
+	}
+
+	if (*p == '.') {
+		p++;
+		if (*p == '*') {
+			spec->precision_arg = 1;
+			p++;
+		} else {
+			while (*p >= '0' && *p <= '9')
+				p++;
+		}
+	}
+
+	spec->prefix_len = p - fmt;
+	if (*p == 'h' || *p == 'l' || *p == 'L' || *p == 'z' || *p == 'j') {
+		spec->qualifier = *p++;
+		if (*p == 'l') {
+			spec->qualifier = 'L';
+			p++;
+		} else if (*p == 'h') {
+			spec->qualifier = 'H';
+			p++;
+		}
+	}
+
+	spec->conversion = *p;
+	spec->len = p - fmt + (*p ? 1 : 0);
+}
+
+#endif
@@ -0,0 +1,78 @@
+/*
+ * This file is part of the coreboot project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef __CBMEM_CONSOLE_SERIALIZED_H__
+#define __CBMEM_CONSOLE_SERIALIZED_H__
+
+#include <stdint.h>
+
+/*
+ * Message metadata for the CBMEM console.
+ *
+ * The console text stays a plain byte ring, so readers that don't know
+ * about metadata keep working. When the cursor has CBMEM_CONSOLE_META set,
+ * struct cbmem_console_meta follows the body (at body + size) and records
+ * where each printk() message starts, with its log level, stage, CPU and
+ * timestamp.
+ *
+ * Message positions count the bytes coreboot has written to the body. The
+ * byte before meta->cursor is at position written - 1, so a message that
+ * started written - pos bytes before meta->cursor is still in the ring as
+ * long as that distance doesn't exceed the amount of text held. Payloads may
+ * append text after meta->cursor without updating the metadata.
+ *
+ * The console can hold more than one boot. The first message bootblock logs
+ * has CBMEM_CONSOLE_MSG_BOOT set in its level. Stages don't run in order
+ * within a boot, e.g. bootblock continues after verstage returns to it.
+ */
+#define CBMEM_CONSOLE_META		(1UL << 30)	/* cursor flag */
+#define CBMEM_CONSOLE_META_MAGIC	0x4154454d	/* "META" */
+
+/* cbmem_console_meta.flags: the next message starts a new boot */
+#define CBMEM_CONSOLE_META_NEW_BOOT	(1 << 0)
+
+/* cbmem_console_msg.level */
+#define CBMEM_CONSOLE_MSG_LEVEL_MASK	0x0f
+#define CBMEM_CONSOLE_MSG_BOOT		(1 << 7)	/* first of a boot */
+
+enum cbmem_console_stage {
+	CBMEM_CONSOLE_STAGE_UNKNOWN,
+	CBMEM_CONSOLE_STAGE_BOOTBLOCK,
+	CBMEM_CONSOLE_STAGE_VERSTAGE,
+	CBMEM_CONSOLE_STAGE_ROMSTAGE,
+	CBMEM_CONSOLE_STAGE_POSTCAR,
+	CBMEM_CONSOLE_STAGE_RAMSTAGE,
+	CBMEM_CONSOLE_STAGE_SMM,
+};
+
+struct cbmem_console_msg {
+	uint32_t pos;		/* value of written when the message started */
+	uint8_t level;		/* BIOS_* log level and CBMEM_CONSOLE_MSG_* */
+	uint8_t stage;		/* enum cbmem_console_stage */
+	uint16_t cpu;
+	uint64_t timestamp;	/* raw timestamp_get() ticks */
+} __packed;
+
+struct cbmem_console_meta {
+	uint32_t magic;
+	uint32_t written;	/* bytes coreboot wrote to the body, wraps */
+	uint32_t count;		/* size of msgs[] */
+	uint32_t next;		/* messages recorded, the next one goes to
+				   msgs[next % count] */
+	uint32_t tick_freq_mhz;
+	uint32_t cursor;	/* body cursor when written was last updated */
+	uint32_t flags;		/* CBMEM_CONSOLE_META_* */
+	struct cbmem_console_msg msgs[0];
+} __packed;
+
+#endif
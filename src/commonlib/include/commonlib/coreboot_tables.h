@@ -420,6 +420,26 @@ struct lb_mmc_info {
 	 * passes 1 on success
 	 */
 	int32_t early_cmd1_status;
+	/*
+	 * The following fields are valid if MEDIA_READY is set in flags.
+	 * The card was fully initialized and left selected in transfer
+	 * state, so the payload may skip card identification and the speed
+	 * switch and program its host controller with the settings below.
+	 * If TUNED is set, the controller holds the HS200/HS400 tuning
+	 * results and must not be reset.
+	 */
+	uint32_t flags;
+#define LB_MMC_INFO_MEDIA_READY	(1 << 0)
+#define LB_MMC_INFO_TUNED		(1 << 1)
+	uint32_t version;
+	uint32_t rca;
+	uint32_t caps;		/* DRVR_CAP_xxx supported by card and host */
+	uint32_t bus_width;
+	uint32_t bus_hz;
+	uint32_t timing;	/* BUS_TIMING_xxx */
+	uint32_t read_bl_len;
+	uint32_t partition_config;
+	struct lb_uint64 capacity;
 };
 
 struct lb_macs {
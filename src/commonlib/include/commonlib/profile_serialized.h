@@ -0,0 +1,40 @@
+/*
+ * This file is part of the coreboot project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef __PROFILE_SERIALIZED_H__
+#define __PROFILE_SERIALIZED_H__
+
+#include <stdint.h>
+
+/*
+ * Sampling profile of ramstage. A timer interrupt counts the address it
+ * interrupted in a histogram over ramstage's code: counts[i] holds the
+ * samples between text_start + (i << shift) and the next bucket. Addresses
+ * are run-time ones, ramstage_base is where _program was, so they can be
+ * matched against the stage's ELF file.
+ */
+#define PROFILE_MAGIC		0x464f5250	/* "PROF" */
+
+struct profile {
+	uint32_t magic;
+	uint32_t ramstage_base;	/* run-time address of _program */
+	uint32_t text_start;
+	uint32_t shift;		/* log2 of the bytes per bucket */
+	uint32_t buckets;
+	uint32_t period_us;	/* between two samples */
+	uint32_t samples;
+	uint32_t outside;	/* samples that didn't hit ramstage's code */
+	uint32_t counts[0];
+} __packed;
+
+#endif
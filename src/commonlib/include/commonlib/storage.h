@@ -144,4 +144,35 @@ int storage_set_partition(struct storage_media *media,
 
 void storage_display_setup(struct storage_media *media);
 
+/*
+ * Card and controller state left behind by firmware for the payload. It is
+ * kept in CBMEM as CBMEM_ID_MMC_STATUS and exported as LB_TAG_MMC_INFO.
+ */
+struct storage_media_state {
+	/* 1 if CMD0 and CMD1 were sent to the card early in boot. */
+	int32_t early_cmd1_status;
+	uint32_t flags;
+
+/* The card is selected and in transfer state with the settings below. */
+#define STORAGE_STATE_MEDIA_READY	(1 << 0)
+/* The controller holds the results of HS200/HS400 tuning. */
+#define STORAGE_STATE_TUNED		(1 << 1)
+
+	uint32_t version;
+	uint32_t rca;
+	uint32_t caps;
+	uint32_t bus_width;
+	uint32_t bus_hz;
+	uint32_t timing;
+	uint32_t read_bl_len;
+	uint32_t partition_config;
+	/* Capacity of the user partition in bytes. */
+	uint32_t capacity_lo;
+	uint32_t capacity_hi;
+};
+
+/* Record the state of an initialized card and its controller. */
+void storage_save_state(struct storage_media *media,
+	struct storage_media_state *state);
+
 #endif /* __COMMONLIB_STORAGE_H__ */
@@ -63,6 +63,10 @@ enum timestamp_id {
 	TS_SELFBOOT_JUMP = 99,
 	TS_START_POSTCAR = 100,
 	TS_END_POSTCAR = 101,
+	TS_READ_UCODE_START = 112,
+	TS_READ_UCODE_END = 113,
+	TS_AP_UCODE_LOAD_START = 114,
+	TS_AP_UCODE_LOAD_END = 115,
 
 	/* 500+ reserved for vendorcode extensions (500-600: google/chromeos) */
 	TS_START_COPYVER = 501,
@@ -259,6 +263,10 @@ static const struct timestamp_id_to_name {
 		"returning from FspNotify(EndOfFirmware)" },
 	{ TS_START_POSTCAR,	"start of postcar" },
 	{ TS_END_POSTCAR,	"end of postcar" },
+	{ TS_READ_UCODE_START,	"starting to locate microcode update" },
+	{ TS_READ_UCODE_END,	"finished locating microcode update" },
+	{ TS_AP_UCODE_LOAD_START, "first AP started loading microcode" },
+	{ TS_AP_UCODE_LOAD_END,	"last AP finished loading microcode" },
 };
 
 #endif
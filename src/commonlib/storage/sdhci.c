@@ -23,6 +23,7 @@
 #include "sdhci.h"
 #include "sd_mmc.h"
 #include "storage.h"
+#include <thread.h>
 #include <timer.h>
 #include <commonlib/stdlib.h>
 
@@ -38,19 +39,13 @@ __weak void *dma_malloc(size_t length_in_bytes)
 
 void sdhci_reset(struct sdhci_ctrlr *sdhci_ctrlr, u8 mask)
 {
-	struct stopwatch sw;
+	sdhci_writeb(sdhci_ctrlr, mask, SDHCI_SOFTWARE_RESET);
 
 	/* Wait max 100 ms */
-	stopwatch_init_msecs_expire(&sw, 100);
-
-	sdhci_writeb(sdhci_ctrlr, mask, SDHCI_SOFTWARE_RESET);
-	while (sdhci_readb(sdhci_ctrlr, SDHCI_SOFTWARE_RESET) & mask) {
-		if (stopwatch_expired(&sw)) {
-			sdhc_error("Reset 0x%x never completed.\n", (int)mask);
-			return;
-		}
-		udelay(1000);
-	}
+	if (!thread_wait_us(100 * USECS_PER_MSEC, 1000,
+			    !(sdhci_readb(sdhci_ctrlr, SDHCI_SOFTWARE_RESET) &
+			      mask)))
+		sdhc_error("Reset 0x%x never completed.\n", (int)mask);
 }
 
 void sdhci_cmd_done(struct sdhci_ctrlr *sdhci_ctrlr, struct mmc_command *cmd)
@@ -138,7 +133,6 @@ static int sdhci_send_command_bounced(struct sd_mmc_ctrlr *ctrlr,
 	int ret = 0;
 	u32 mask, flags;
 	unsigned int timeout, start_addr = 0;
-	struct stopwatch sw;
 
 	/* Wait max 1 s */
 	timeout = 1000;
@@ -215,30 +209,26 @@ static int sdhci_send_command_bounced(struct sd_mmc_ctrlr *ctrlr,
 	if (DMA_AVAILABLE && (mode & SDHCI_TRNS_DMA))
 		return sdhci_complete_adma(sdhci_ctrlr, cmd);
 
-	stopwatch_init_msecs_expire(&sw, 2550);
-	do {
-		stat = sdhci_readl(sdhci_ctrlr, SDHCI_INT_STATUS);
-		if (stat & SDHCI_INT_ERROR) {
-			sdhc_trace("Error - IntStatus: 0x%08x\n", stat);
-			break;
-		}
-
-		if (stat & SDHCI_INT_DATA_AVAIL) {
-			sdhci_writel(sdhci_ctrlr, stat, SDHCI_INT_STATUS);
+	/* Apply max timeout for R1b-type CMD defined in eMMC ext_csd
+	   except for erase ones. Other threads run while the command is in
+	   flight. */
+	if (!thread_wait_us(2550 * USECS_PER_MSEC, 10,
+			    ((stat = sdhci_readl(sdhci_ctrlr, SDHCI_INT_STATUS))
+			     & (SDHCI_INT_ERROR | SDHCI_INT_DATA_AVAIL)) ||
+			    (stat & mask) == mask)) {
+		if (ctrlr->caps & DRVR_CAP_BROKEN_R1B)
 			return 0;
-		}
+		sdhc_error("Timeout for status update!  IntStatus: 0x%08x\n",
+			stat);
+		return CARD_TIMEOUT;
+	}
 
-		/* Apply max timeout for R1b-type CMD defined in eMMC ext_csd
-		   except for erase ones */
-		if (stopwatch_expired(&sw)) {
-			if (ctrlr->caps & DRVR_CAP_BROKEN_R1B)
-				return 0;
-			sdhc_error(
-				"Timeout for status update!  IntStatus: 0x%08x\n",
-				stat);
-			return CARD_TIMEOUT;
-		}
-	} while ((stat & mask) != mask);
+	if (stat & SDHCI_INT_ERROR) {
+		sdhc_trace("Error - IntStatus: 0x%08x\n", stat);
+	} else if (stat & SDHCI_INT_DATA_AVAIL) {
+		sdhci_writel(sdhci_ctrlr, stat, SDHCI_INT_STATUS);
+		return 0;
+	}
 
 	if ((stat & (SDHCI_INT_ERROR | mask)) == mask) {
 		if (cmd->cmdidx)
@@ -209,6 +209,28 @@ int storage_setup_media(struct storage_media *media, struct sd_mmc_ctrlr *ctrlr)
 	return storage_startup(media);
 }
 
+void storage_save_state(struct storage_media *media,
+	struct storage_media_state *state)
+{
+	struct sd_mmc_ctrlr *ctrlr = media->ctrlr;
+
+	state->flags = STORAGE_STATE_MEDIA_READY;
+	if (ctrlr->timing == BUS_TIMING_MMC_HS200
+	    || ctrlr->timing == BUS_TIMING_MMC_HS400
+	    || ctrlr->timing == BUS_TIMING_UHS_SDR104)
+		state->flags |= STORAGE_STATE_TUNED;
+	state->version = media->version;
+	state->rca = media->rca;
+	state->caps = media->caps;
+	state->bus_width = ctrlr->bus_width;
+	state->bus_hz = ctrlr->bus_hz;
+	state->timing = ctrlr->timing;
+	state->read_bl_len = media->read_bl_len;
+	state->partition_config = media->partition_config;
+	state->capacity_lo = media->capacity[MMC_PARTITION_USER];
+	state->capacity_hi = media->capacity[MMC_PARTITION_USER] >> 32;
+}
+
 static int storage_read(struct storage_media *media, void *dest, uint32_t start,
 	uint32_t block_count)
 {
@@ -0,0 +1,324 @@
+/*
+ * This file is part of the coreboot project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <cbmem.h>
+#include <commonlib/binlog_serialized.h>
+#include <commonlib/helpers.h>
+#include <console/binlog.h>
+#include <ctype.h>
+#include <stddef.h>
+#include <string.h>
+#include <symbols.h>
+#include <timestamp.h>
+
+static struct binlog *binlog;
+
+static void binlog_init(int is_recovery)
+{
+	const size_t size = CONFIG_CONSOLE_CBMEM_BINARY_LOG_SIZE;
+	struct binlog *log = cbmem_add(CBMEM_ID_BINLOG, size);
+
+	if (!log)
+		return;
+
+	/* Every boot starts a new log, the ELF it refers to may have changed. */
+	memset(log, 0, sizeof(*log));
+	log->magic = BINLOG_MAGIC;
+	log->size = ALIGN_DOWN(size - sizeof(*log), BINLOG_ALIGN);
+	log->ramstage_base = (uintptr_t)_program;
+	log->tick_freq_mhz = timestamp_tick_freq_mhz();
+	log->ptr_size = sizeof(void *);
+	binlog = log;
+}
+RAMSTAGE_CBMEM_INIT_HOOK(binlog_init)
+
+static void binlog_write(const struct binlog_record *rec)
+{
+	struct binlog *log = binlog;
+	const u32 len = rec->size;
+
+	if (log->tail + len > log->size) {
+		log->end = log->tail;
+		log->head = 0;
+		log->tail = 0;
+		log->flags |= BINLOG_WRAPPED;
+	}
+
+	/* Drop the oldest records this one is going to overwrite. */
+	if (log->flags & BINLOG_WRAPPED) {
+		while (log->head < log->end && log->head < log->tail + len) {
+			const struct binlog_record *old =
+				(void *)&log->body[log->head];
+			log->head += old->size;
+		}
+	}
+
+	memcpy(&log->body[log->tail], rec, len);
+	log->tail += len;
+}
+
+static int put_u64(u8 *buf, size_t *pos, u64 value)
+{
+	if (*pos + sizeof(value) > BINLOG_MAX_RECORD)
+		return -1;
+	memcpy(&buf[*pos], &value, sizeof(value));
+	*pos += sizeof(value);
+	return 0;
+}
+
+static int put_string(u8 *buf, size_t *pos, const char *s)
+{
+	size_t len;
+
+	if (!s)
+		s = "<NULL>";
+	len = strnlen(s, BINLOG_MAX_RECORD) + 1;
+	if (*pos + len > BINLOG_MAX_RECORD)
+		return -1;
+	memcpy(&buf[*pos], s, len - 1);
+	buf[*pos + len - 1] = '\0';
+	*pos += len;
+	return 0;
+}
+
+/* The conversion flags, named as in vtxprintf(). */
+#define ZEROPAD	1
+#define SIGN	2
+#define PLUS	4
+#define SPACE	8
+#define LEFT	16
+#define SPECIAL	32
+
+struct binlog_field {
+	int flags;
+	int width;		/* -1 if not given */
+	int precision;		/* -1 if not given */
+};
+
+/* Parse flags and literal width and precision of the conversion at fmt. */
+static void parse_field(const char *fmt, struct binlog_field *field)
+{
+	const char *p = fmt + 1;
+
+	field->flags = 0;
+	field->width = -1;
+	field->precision = -1;
+
+	for (;; p++) {
+		if (*p == '-')
+			field->flags |= LEFT;
+		else if (*p == '+')
+			field->flags |= PLUS;
+		else if (*p == ' ')
+			field->flags |= SPACE;
+		else if (*p == '#')
+			field->flags |= SPECIAL;
+		else if (*p == '0')
+			field->flags |= ZEROPAD;
+		else
+			break;
+	}
+
+	if (isdigit(*p)) {
+		field->width = 0;
+		while (isdigit(*p))
+			field->width = field->width * 10 + *p++ - '0';
+	} else if (*p == '*') {
+		p++;
+	}
+
+	if (*p == '.') {
+		p++;
+		field->precision = 0;
+		while (isdigit(*p))
+			field->precision = field->precision * 10 + *p++ - '0';
+	}
+}
+
+/* Characters vtxprintf() prints for a number, see number() there. */
+static int number_len(u64 num, int base, const struct binlog_field *field)
+{
+	int len = 0, digits = 0;
+
+	if (field->flags & SIGN) {
+		if ((s64)num < 0) {
+			num = -(s64)num;
+			len++;
+		} else if (field->flags & (PLUS | SPACE)) {
+			len++;
+		}
+	}
+	if (field->flags & SPECIAL)
+		len += base == 16 ? 2 : base == 8 ? 1 : 0;
+
+	do {
+		num /= base;
+		digits++;
+	} while (num);
+
+	len += MAX(digits, field->precision);
+	return MAX(len, field->width);
+}
+
+/*
+ * Pull one conversion's argument out of args, the way vtxprintf() would,
+ * and add the number of characters it would print to *len.
+ */
+static int put_arg(u8 *buf, size_t *pos, const struct binlog_spec *spec,
+		   struct binlog_field *field, va_list *args, int *len)
+{
+	int base = 10;
+	const char *s;
+	u64 value;
+
+	switch (spec->conversion) {
+	case 's':
+		s = va_arg(*args, const char *);
+		*len += MAX((int)strnlen(s ? s : "<NULL>",
+					 (size_t)field->precision),
+			    field->width);
+		return put_string(buf, pos, s);
+	case 'c':
+		*len += MAX(1, field->width);
+		return put_u64(buf, pos, (unsigned char)va_arg(*args, int));
+	case 'p':
+		value = (uintptr_t)va_arg(*args, void *);
+		if (field->width == -1) {
+			field->width = 2 * sizeof(void *);
+			field->flags |= ZEROPAD;
+		}
+		*len += number_len(value, 16, field);
+		return put_u64(buf, pos, value);
+	case 'd':
+	case 'i':
+		field->flags |= SIGN;
+		break;
+	case 'o':
+		base = 8;
+		break;
+	case 'x':
+	case 'X':
+		base = 16;
+		break;
+	case 'u':
+		break;
+	case '%':
+		*len += 1;
+		return 0;
+	default:
+		/* Unknown conversions print as they are and take no argument. */
+		*len += spec->conversion ? 2 : 1;
+		return 0;
+	}
+
+	switch (spec->qualifier) {
+	case 'L':
+		value = va_arg(*args, unsigned long long);
+		break;
+	case 'l':
+		value = va_arg(*args, unsigned long);
+		/* vtxprintf() doesn't sign extend longs, the host printf() does. */
+		*len += number_len(value, base, field);
+		if (field->flags & SIGN)
+			value = (long)value;
+		return put_u64(buf, pos, value);
+	case 'z':
+		value = va_arg(*args, size_t);
+		break;
+	case 'j':
+		value = va_arg(*args, uintmax_t);
+		break;
+	case 'h':
+		value = (unsigned short)va_arg(*args, int);
+		if (field->flags & SIGN)
+			value = (short)value;
+		break;
+	case 'H':
+		value = (unsigned char)va_arg(*args, int);
+		if (field->flags & SIGN)
+			value = (signed char)value;
+		break;
+	default:
+		if (field->flags & SIGN)
+			value = va_arg(*args, int);
+		else
+			value = va_arg(*args, unsigned int);
+		break;
+	}
+	*len += number_len(value, base, field);
+	return put_u64(buf, pos, value);
+}
+
+int binlog_vprintk(int msg_level, const char *fmt, va_list args)
+{
+	u8 buf[BINLOG_MAX_RECORD] __aligned(8);
+	struct binlog_record *rec = (void *)buf;
+	struct binlog_spec spec;
+	struct binlog_field field;
+	size_t pos = sizeof(*rec);
+	const char *p;
+	va_list ap;
+	int len = 0;
+	int ret = 0;
+
+	if (!binlog)
+		return -1;
+
+	va_copy(ap, args);
+	for (p = fmt; *p && ret == 0; p++) {
+		if (*p != '%') {
+			len++;
+			continue;
+		}
+		binlog_parse_spec(p, &spec);
+		/* %n stores into the caller's memory, only text can do that. */
+		if (spec.conversion == 'n') {
+			ret = -1;
+			break;
+		}
+		parse_field(p, &field);
+		if (spec.width_arg) {
+			field.width = va_arg(ap, int);
+			ret = put_u64(buf, &pos, field.width);
+			if (field.width < 0) {
+				field.width = -field.width;
+				field.flags |= LEFT;
+			}
+		}
+		if (spec.precision_arg && ret == 0) {
+			field.precision = va_arg(ap, int);
+			ret = put_u64(buf, &pos, field.precision);
+			if (field.precision < 0)
+				field.precision = 0;
+		}
+		if (ret == 0)
+			ret = put_arg(buf, &pos, &spec, &field, &ap, &len);
+		if (spec.len > 1)
+			p += spec.len - 1;
+	}
+	va_end(ap);
+	if (ret)
+		return ret;
+
+	if (ALIGN_UP(pos, BINLOG_ALIGN) > binlog->size)
+		return -1;
+
+	rec->size = ALIGN_UP(pos, BINLOG_ALIGN);
+	memset(&buf[pos], 0, rec->size - pos);
+	rec->level = msg_level;
+	rec->stage = BINLOG_STAGE_RAMSTAGE;
+	rec->fmt = (uintptr_t)fmt;
+	rec->timestamp = timestamp_get();
+	binlog_write(rec);
+	return len;
+}
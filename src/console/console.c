@@ -12,6 +12,7 @@
  */
 
 #include <console/cbmem_console.h>
+#include <console/console.h>
 #include <console/ne2k.h>
 #include <console/qemu_debugcon.h>
 #include <console/spkmodem.h>
@@ -20,6 +21,8 @@
 #include <console/usb.h>
 #include <console/spi.h>
 #include <console/flash.h>
+#include <string.h>
+#include <timer.h>
 
 void console_hw_init(void)
 {
@@ -55,6 +58,112 @@ void console_tx_byte(unsigned char byte)
 	__flashconsole_tx_byte(byte);
 }
 
+enum console_sink {
+	SINK_CBMEM,
+	SINK_SPKMODEM,
+	SINK_QEMU_DEBUGCON,
+	SINK_UART,
+	SINK_NE2K,
+	SINK_USB,
+	SINK_SPI,
+	SINK_FLASH,
+	SINK_COUNT
+};
+
+static const char *const sink_names[SINK_COUNT] = {
+	[SINK_CBMEM] = "cbmem",
+	[SINK_SPKMODEM] = "spkmodem",
+	[SINK_QEMU_DEBUGCON] = "qemu debugcon",
+	[SINK_UART] = "uart",
+	[SINK_NE2K] = "ne2k",
+	[SINK_USB] = "usb",
+	[SINK_SPI] = "spi",
+	[SINK_FLASH] = "flash",
+};
+
+static long sink_usecs[SINK_COUNT];
+
+/* Run call if the console is built into this stage, and account the time
+ * it took to that console. */
+#define SINK_TX(sink, enable, call) do {				\
+	if (enable) {							\
+		struct mono_time start, stop;				\
+		if (TRACK_CONSOLE_TIME)					\
+			timer_monotonic_get(&start);			\
+		call;							\
+		if (TRACK_CONSOLE_TIME) {				\
+			timer_monotonic_get(&stop);			\
+			sink_usecs[sink] +=				\
+				mono_time_diff_microseconds(&start, &stop); \
+		}							\
+	}								\
+} while (0)
+
+/* For consoles that only take single bytes. */
+#define TX_BYTES(tx_byte, buf, len) do {				\
+	size_t i;							\
+	for (i = 0; i < (len); i++)					\
+		tx_byte((buf)[i]);					\
+} while (0)
+
+/* Send a block to the UART with the newline conversion console_tx_byte()
+ * does, keeping the runs between newlines in one piece. */
+static void uart_tx_lines(const unsigned char *buf, size_t len)
+{
+	const unsigned char *nl;
+
+	while (len && (nl = memchr(buf, '\n', len)) != NULL) {
+		__uart_tx_block(buf, nl - buf);
+		__uart_tx_block((const unsigned char *)"\r\n", 2);
+		len -= nl - buf + 1;
+		buf = nl + 1;
+	}
+	__uart_tx_block(buf, len);
+}
+
+static void usb_tx_lines(const unsigned char *buf, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		if (buf[i] == '\n')
+			__usb_tx_byte('\r');
+		__usb_tx_byte(buf[i]);
+	}
+}
+
+void console_tx_block(const unsigned char *buf, size_t len)
+{
+	SINK_TX(SINK_CBMEM, __CBMEM_CONSOLE_ENABLE__,
+		__cbmemc_tx_block(buf, len));
+	SINK_TX(SINK_SPKMODEM, __SPKMODEM_ENABLE__,
+		TX_BYTES(__spkmodem_tx_byte, buf, len));
+	SINK_TX(SINK_QEMU_DEBUGCON, __QEMU_DEBUGCON_ENABLE__,
+		TX_BYTES(__qemu_debugcon_tx_byte, buf, len));
+	SINK_TX(SINK_UART, __CONSOLE_SERIAL_ENABLE__, uart_tx_lines(buf, len));
+	SINK_TX(SINK_NE2K, __NE2K_ENABLE__, __ne2k_tx_block(buf, len));
+	SINK_TX(SINK_USB, __CONSOLE_USB_ENABLE__, usb_tx_lines(buf, len));
+	SINK_TX(SINK_SPI, __CONSOLE_SPI_ENABLE__,
+		TX_BYTES(__spiconsole_tx_byte, buf, len));
+	SINK_TX(SINK_FLASH, __CONSOLE_FLASH_ENABLE__,
+		TX_BYTES(__flashconsole_tx_byte, buf, len));
+}
+
+void console_sink_time_report(void)
+{
+	int i;
+
+	if (!TRACK_CONSOLE_TIME)
+		return;
+
+	for (i = 0; i < SINK_COUNT; i++) {
+		if (!sink_usecs[i])
+			continue;
+		printk(BIOS_DEBUG, "  %s: %ld ms\n", sink_names[i],
+		       DIV_ROUND_CLOSEST(sink_usecs[i], USECS_PER_MSEC));
+	}
+}
+
 void console_tx_flush(void)
 {
 	__uart_tx_flush();
@@ -72,8 +181,7 @@ void console_write_line(uint8_t *buffer, size_t number_of_bytes)
 	}
 
 	/* Output the console data */
-	while (number_of_bytes--)
-		console_tx_byte(*buffer++);
+	console_tx_block(buffer, number_of_bytes);
 }
 
 
@@ -13,6 +13,7 @@
  * blatantly copied from linux/kernel/printk.c
  */
 
+#include <console/binlog.h>
 #include <console/cbmem_console.h>
 #include <console/console.h>
 #include <console/streams.h>
@@ -27,9 +28,6 @@
 DECLARE_SPIN_LOCK(console_lock)
 #endif
 
-#define TRACK_CONSOLE_TIME (CONFIG(HAVE_MONOTONIC_TIMER) && \
-	(ENV_RAMSTAGE || !CONFIG(CAR_GLOBAL_MIGRATION)))
-
 static struct mono_time mt_start, mt_stop;
 static long console_usecs;
 
@@ -54,6 +52,7 @@ void console_time_report(void)
 
 	printk(BIOS_DEBUG, "Accumulated console time in " ENV_STRING " %ld ms\n",
 		DIV_ROUND_CLOSEST(console_usecs, USECS_PER_MSEC));
+	console_sink_time_report();
 }
 
 long console_time_get_and_reset(void)
@@ -73,54 +72,119 @@ void do_putchar(unsigned char byte)
 	console_time_stop();
 }
 
-static void wrap_putchar(unsigned char byte, void *data)
+static void console_lock_take(void)
 {
-	console_tx_byte(byte);
+#ifdef __PRE_RAM__
+#if CONFIG(HAVE_ROMSTAGE_CONSOLE_SPINLOCK)
+	spin_lock(romstage_console_lock());
+#endif
+#else
+	spin_lock(&console_lock);
+#endif
+}
+
+static void console_lock_release(void)
+{
+#ifdef __PRE_RAM__
+#if CONFIG(HAVE_ROMSTAGE_CONSOLE_SPINLOCK)
+	spin_unlock(romstage_console_lock());
+#endif
+#else
+	spin_unlock(&console_lock);
+#endif
 }
 
-static void wrap_putchar_cbmemc(unsigned char byte, void *data)
+/*
+ * A message is formatted into a buffer on the stack of the CPU printing it
+ * and handed to the consoles a line or block at a time. The console lock is
+ * taken on the first flush and held until the message is complete, so a
+ * message never interleaves with one from another CPU, but formatting runs
+ * without holding it.
+ */
+#define CONSOLE_LINE_SIZE 128
+
+struct console_line {
+	int level;
+	int log_this;
+	int locked;
+	int started;
+	size_t len;
+	unsigned char buf[CONSOLE_LINE_SIZE];
+};
+
+static void console_line_flush(struct console_line *line)
 {
-	__cbmemc_tx_byte(byte);
+	if (!line->locked) {
+		console_lock_take();
+		line->locked = 1;
+	}
+
+	if (!line->len)
+		return;
+
+	if (!line->started) {
+		__cbmemc_msg_start(line->level);
+		line->started = 1;
+	}
+
+	if (line->log_this == CONSOLE_LOG_FAST)
+		__cbmemc_tx_block(line->buf, line->len);
+	else
+		console_tx_block(line->buf, line->len);
+	line->len = 0;
+}
+
+static void wrap_putchar(unsigned char byte, void *data)
+{
+	struct console_line *line = data;
+
+	line->buf[line->len++] = byte;
+	if (line->len == sizeof(line->buf))
+		console_line_flush(line);
 }
 
 int do_vprintk(int msg_level, const char *fmt, va_list args)
 {
-	int i, log_this;
+	struct console_line line;
+	struct mono_time start, stop;
+	int i;
 
 	if (CONFIG(SQUELCH_EARLY_SMP) && ENV_ROMSTAGE_OR_BEFORE && !boot_cpu())
 		return 0;
 
-	log_this = console_log_level(msg_level);
-	if (log_this < CONSOLE_LOG_FAST)
+	line.log_this = console_log_level(msg_level);
+	if (line.log_this < CONSOLE_LOG_FAST)
 		return 0;
+	line.level = msg_level;
+	line.locked = 0;
+	line.started = 0;
+	line.len = 0;
 
 	DISABLE_TRACE;
-#ifdef __PRE_RAM__
-#if CONFIG(HAVE_ROMSTAGE_CONSOLE_SPINLOCK)
-	spin_lock(romstage_console_lock());
-#endif
-#else
-	spin_lock(&console_lock);
-#endif
 
-	console_time_run();
+	if (TRACK_CONSOLE_TIME)
+		timer_monotonic_get(&start);
 
-	if (log_this == CONSOLE_LOG_FAST) {
-		i = vtxprintf(wrap_putchar_cbmemc, fmt, args, NULL);
-	} else {
-		i = vtxprintf(wrap_putchar, fmt, args, NULL);
-		console_tx_flush();
+	i = -1;
+	if (__BINLOG_ENABLE__ && line.log_this == CONSOLE_LOG_FAST) {
+		/* Nothing to format, just take the lock. */
+		console_line_flush(&line);
+		i = binlog_vprintk(msg_level, fmt, args);
 	}
 
-	console_time_stop();
+	if (i < 0) {
+		i = vtxprintf(wrap_putchar, fmt, args, &line);
+		console_line_flush(&line);
+		if (line.log_this != CONSOLE_LOG_FAST)
+			console_tx_flush();
+	}
 
-#ifdef __PRE_RAM__
-#if CONFIG(HAVE_ROMSTAGE_CONSOLE_SPINLOCK)
-	spin_unlock(romstage_console_lock());
-#endif
-#else
-	spin_unlock(&console_lock);
-#endif
+	if (TRACK_CONSOLE_TIME) {
+		timer_monotonic_get(&stop);
+		console_usecs += mono_time_diff_microseconds(&start, &stop);
+	}
+
+	console_lock_release();
 	ENABLE_TRACE;
 
 	return i;
@@ -25,6 +25,7 @@
 #include <cpu/x86/msr.h>
 #include <cpu/intel/microcode.h>
 #include <smp/spinlock.h>
+#include <timestamp.h>
 
 DECLARE_SPIN_LOCK(microcode_lock)
 
@@ -132,7 +133,7 @@ uint32_t get_microcode_checksum(const void *microcode)
 	return ((struct microcode *)microcode)->cksum;
 }
 
-const void *intel_microcode_find(void)
+static const void *find_cbfs_microcode(void)
 {
 	const struct microcode *ucode_updates;
 	size_t microcode_len;
@@ -205,6 +206,35 @@ const void *intel_microcode_find(void)
 	return (void *)0;
 }
 
+#if ENV_RAMSTAGE
+/*
+ * The BSP looks up the patch once and every later caller (APs, SoC
+ * get_microcode_info() callbacks, per-cpu init) reuses the cached pointer
+ * instead of rescanning the CBFS blob. All CPUs in a package share the same
+ * signature and platform id, so a single lookup is valid for all of them.
+ */
+static const void *microcode_patch;
+static int microcode_patch_cached;
+
+const void *intel_microcode_find(void)
+{
+	if (microcode_patch_cached)
+		return microcode_patch;
+
+	timestamp_add_now(TS_READ_UCODE_START);
+	microcode_patch = find_cbfs_microcode();
+	timestamp_add_now(TS_READ_UCODE_END);
+	microcode_patch_cached = 1;
+
+	return microcode_patch;
+}
+#else
+const void *intel_microcode_find(void)
+{
+	return find_cbfs_microcode();
+}
+#endif
+
 void intel_update_microcode_from_cbfs(void)
 {
 	const void *patch = intel_microcode_find();
@@ -27,6 +27,9 @@
 
 static void init_timer(void)
 {
+	if (lapic_profiler_owns_timer())
+		return;
+
 	/* Set the APIC timer to no interrupts and periodic mode */
 	lapic_write(LAPIC_LVTT, (1 << 17) | (1 << 16) | (0 << 12) | (0 << 0));
 
@@ -35,10 +35,12 @@ void do_lapic_init(void)
 	lapic_write_around(LAPIC_TASKPRI,
 		lapic_read_around(LAPIC_TASKPRI) & ~LAPIC_TPRI_MASK);
 
-	/* Put the local APIC in virtual wire mode */
+	/* Put the local APIC in virtual wire mode. The profiler has a
+	   handler for its spurious vector, keep that one. */
 	lapic_write_around(LAPIC_SPIV,
 		(lapic_read_around(LAPIC_SPIV) & ~(LAPIC_VECTOR_MASK))
-		| LAPIC_SPIV_ENABLE);
+		| LAPIC_SPIV_ENABLE
+		| (lapic_profiler_owns_timer() ? LAPIC_SPURIOUS_VECTOR : 0));
 	lapic_write_around(LAPIC_LVT0,
 		(lapic_read_around(LAPIC_LVT0) &
 			~(LAPIC_LVT_MASKED | LAPIC_LVT_LEVEL_TRIGGER |
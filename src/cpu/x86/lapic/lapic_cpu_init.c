@@ -29,7 +29,6 @@
 #include <cpu/cpu.h>
 #include <cpu/intel/speedstep.h>
 #include <stdlib.h>
-#include <thread.h>
 
 /* This is a lot more paranoid now, since Linux can NOT handle
  * being told there is a CPU when none exists. So any errors
@@ -287,7 +286,6 @@ int start_cpu(struct device *cpu)
 	info->index = index;
 	info->cpu   = cpu;
 	cpu_add_map_entry(info->index);
-	thread_init_cpu_info_non_bsp(info);
 
 	/* Advertise the new stack and index to start_cpu */
 	secondary_stack = stack_top;
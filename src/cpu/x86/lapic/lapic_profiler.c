@@ -0,0 +1,96 @@
+/*
+ * This file is part of the coreboot project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <arch/io.h>
+#include <console/console.h>
+#include <cpu/x86/lapic.h>
+#include <delay.h>
+#include <pc80/i8259.h>
+#include <profiler.h>
+#include <stdint.h>
+
+static u32 ticks_per_us;
+static int timer_armed;
+static u32 timer_apic_id;
+
+/* udelay() doesn't use the APIC timer (see the Kconfig dependencies), so it
+   can measure the timer's frequency. */
+static u32 lapic_timer_ticks_per_us(void)
+{
+	u32 start;
+
+	lapic_write(LAPIC_LVTT, LAPIC_LVT_MASKED);
+	lapic_write(LAPIC_TDCR, LAPIC_TDR_DIV_1);
+	lapic_write(LAPIC_TMICT, 0xffffffff);
+	start = lapic_read(LAPIC_TMCCT);
+	udelay(1000);
+	return (start - lapic_read(LAPIC_TMCCT)) / 1000;
+}
+
+void arch_profiler_start(unsigned int period_us)
+{
+	/* The APIC has to be software enabled for its timer to interrupt. */
+	enable_lapic();
+	lapic_write(LAPIC_SPIV,
+		    (lapic_read(LAPIC_SPIV) & ~LAPIC_VECTOR_MASK) |
+		    LAPIC_SPIV_ENABLE | LAPIC_SPURIOUS_VECTOR);
+
+	if (!ticks_per_us) {
+		ticks_per_us = lapic_timer_ticks_per_us();
+		if (!ticks_per_us) {
+			printk(BIOS_ERR, "Profiler: APIC timer doesn't run.\n");
+			return;
+		}
+		printk(BIOS_DEBUG, "Profiler: APIC timer at %u MHz.\n",
+		       ticks_per_us);
+
+		/* Only the timer may interrupt ramstage, there are no
+		   handlers for anything the 8259 could deliver. */
+		outb(0xff, MASTER_PIC_OCW1);
+		outb(0xff, SLAVE_PIC_OCW1);
+	}
+
+	lapic_write(LAPIC_TDCR, LAPIC_TDR_DIV_1);
+	lapic_write(LAPIC_LVTT,
+		    LAPIC_LVT_TIMER_PERIODIC | LAPIC_PROFILER_VECTOR);
+	lapic_write(LAPIC_TMICT, period_us * ticks_per_us);
+	timer_apic_id = lapicid();
+	timer_armed = 1;
+	asm volatile ("sti" ::: "memory");
+}
+
+void arch_profiler_stop(void)
+{
+	const u32 lvtt = LAPIC_LVT_TIMER_PERIODIC | LAPIC_LVT_MASKED |
+			 LAPIC_VECTOR_MASK;
+
+	asm volatile ("cli" ::: "memory");
+	if (timer_armed && (lapic_read(LAPIC_LVTT) & lvtt) !=
+			(LAPIC_LVT_TIMER_PERIODIC | LAPIC_PROFILER_VECTOR))
+		printk(BIOS_WARNING, "Profiler: APIC timer was reprogrammed, "
+		       "samples are missing.\n");
+	timer_armed = 0;
+	lapic_write(LAPIC_LVTT, LAPIC_LVT_MASKED);
+	lapic_write(LAPIC_TMICT, 0);
+}
+
+int lapic_profiler_owns_timer(void)
+{
+	return timer_armed && lapicid() == timer_apic_id;
+}
+
+void lapic_profiler_interrupt(uintptr_t pc)
+{
+	profiler_sample(pc);
+	lapic_write(LAPIC_EOI, 0);
+}
@@ -35,7 +35,7 @@
 #include <smp/spinlock.h>
 #include <symbols.h>
 #include <timer.h>
-#include <thread.h>
+#include <timestamp.h>
 
 #define MAX_APIC_IDS 256
 
@@ -102,12 +102,22 @@ struct sipi_params {
 	uint32_t stack_size;
 	uint32_t microcode_lock; /* 0xffffffff means parallel loading. */
 	uint32_t microcode_ptr;
+	uint32_t microcode_time_ptr;
 	uint32_t msr_table_ptr;
 	uint32_t msr_count;
 	uint32_t c_handler;
 	atomic_t ap_count;
 } __packed;
 
+/* This needs to match the per-CPU record the SIPI vector writes. Index is
+ * the CPU number handed out by the SIPI vector. Times are raw TSC values. */
+struct microcode_load_time {
+	uint64_t start;
+	uint64_t end;
+} __packed;
+
+static struct microcode_load_time microcode_load_times[CONFIG_MAX_CPUS];
+
 /* This also needs to match the assembly code for saved MSR encoding. */
 struct saved_msr {
 	uint32_t index;
@@ -201,7 +211,6 @@ static void asmlinkage ap_init(unsigned int cpu)
 	info->cpu = cpus_dev[cpu];
 
 	cpu_add_map_entry(info->index);
-	thread_init_cpu_info_non_bsp(info);
 
 	/* Fix up APIC id with reality. */
 	info->cpu->path.apic.apic_id = lapicid();
@@ -352,11 +361,13 @@ static atomic_t *load_sipi_vector(struct mp_params *mp_params)
 	sp->msr_count = num_msrs;
 	/* Provide pointer to microcode patch. */
 	sp->microcode_ptr = (uint32_t)mp_params->microcode_pointer;
-	/* Pass on abiility to load microcode in parallel. */
+	/* Pass on ability to load microcode in parallel. */
 	if (mp_params->parallel_microcode_load)
-		sp->microcode_lock = 0;
-	else
 		sp->microcode_lock = ~0;
+	else
+		sp->microcode_lock = 0;
+	memset(microcode_load_times, 0, sizeof(microcode_load_times));
+	sp->microcode_time_ptr = (uint32_t)&microcode_load_times[0];
 	sp->c_handler = (uint32_t)&ap_init;
 	ap_count = &sp->ap_count;
 	atomic_set(ap_count, 0);
@@ -513,6 +524,40 @@ static int start_aps(struct bus *cpu_bus, int ap_count, atomic_t *num_aps)
 	return 0;
 }
 
+/*
+ * Report how long each AP spent applying its microcode update in the SIPI
+ * vector. The timestamp table only records the overall window as it can't
+ * hold an entry pair per thread on large systems.
+ */
+static void report_microcode_load_times(int num_cpus)
+{
+	uint64_t first_start = 0;
+	uint64_t last_end = 0;
+	int i;
+
+	for (i = 1; i < num_cpus && i < CONFIG_MAX_CPUS; i++) {
+		const struct microcode_load_time *t = &microcode_load_times[i];
+
+		/* Skipped, either already up-to-date or no patch. */
+		if (t->end == 0)
+			continue;
+
+		printk(BIOS_SPEW, "microcode: CPU %d load took %llu ticks\n",
+		       i, t->end - t->start);
+
+		if (first_start == 0 || t->start < first_start)
+			first_start = t->start;
+		if (t->end > last_end)
+			last_end = t->end;
+	}
+
+	if (last_end == 0)
+		return;
+
+	timestamp_add(TS_AP_UCODE_LOAD_START, first_start);
+	timestamp_add(TS_AP_UCODE_LOAD_END, last_end);
+}
+
 static int bsp_do_flight_plan(struct mp_params *mp_params)
 {
 	int i;
@@ -644,6 +689,10 @@ static int mp_init(struct bus *cpu_bus, struct mp_params *p)
 		return -1;
 	}
 
+	/* All APs have passed the SIPI vector, so their microcode is in. */
+	if (p->microcode_pointer != NULL)
+		report_microcode_load_times(p->num_cpus);
+
 	/* Walk the flight plan for the BSP. */
 	return bsp_do_flight_plan(p);
 }
@@ -692,6 +741,8 @@ struct mp_state {
 	size_t perm_smsize;
 	size_t smm_save_state_size;
 	int do_smm;
+	int smm_parallel_relocation;
+	int bsp_smm_relocated;
 } mp_state;
 
 static int is_smm_enabled(void)
@@ -800,6 +851,22 @@ static int install_permanent_handler(int num_cpus, uintptr_t smbase,
 	return 0;
 }
 
+/*
+ * Run the relocation handler on the BSP alone. It either relocates the BSP,
+ * or sets up per-CPU save state so that all CPUs can relocate at once.
+ */
+static void probe_parallel_smm_relocation(void)
+{
+	smm_initiate_relocation();
+
+	mp_state.smm_parallel_relocation =
+		mp_state.ops.smm_relocation_is_parallel();
+	mp_state.bsp_smm_relocated = !mp_state.smm_parallel_relocation;
+
+	if (mp_state.smm_parallel_relocation)
+		printk(BIOS_DEBUG, "Doing parallel SMM relocation.\n");
+}
+
 /* Load SMM handlers as part of MP flight record. */
 static void load_smm_handlers(void)
 {
@@ -831,6 +898,9 @@ static void load_smm_handlers(void)
 	 */
 	if (is_smm_enabled() && mp_state.ops.pre_mp_smm_init != NULL)
 		mp_state.ops.pre_mp_smm_init();
+
+	if (is_smm_enabled() && mp_state.ops.smm_relocation_is_parallel != NULL)
+		probe_parallel_smm_relocation();
 }
 
 /* Trigger SMM as part of MP flight record. */
@@ -843,6 +913,25 @@ static void trigger_smm_relocation(void)
 	mp_state.ops.per_cpu_smm_trigger();
 }
 
+static void bsp_trigger_smm_relocation(void)
+{
+	/* The BSP may have been relocated while probing already. */
+	if (!mp_state.bsp_smm_relocated)
+		trigger_smm_relocation();
+}
+
+/*
+ * Default SMM trigger. CPUs serialize on the relocation lock unless the
+ * probe on the BSP found that they can all relocate at the same time.
+ */
+static void smm_initiate_relocation_default(void)
+{
+	if (mp_state.smm_parallel_relocation)
+		smm_initiate_relocation_parallel();
+	else
+		smm_initiate_relocation();
+}
+
 static struct mp_callback *ap_callbacks[CONFIG_MAX_CPUS];
 
 static struct mp_callback *read_callback(struct mp_callback **slot)
@@ -998,7 +1087,7 @@ static struct mp_flight_record mp_steps[] = {
 	/* Once the APs are up load the SMM handlers. */
 	MP_FR_BLOCK_APS(NULL, load_smm_handlers),
 	/* Perform SMM relocation. */
-	MP_FR_NOBLOCK_APS(trigger_smm_relocation, trigger_smm_relocation),
+	MP_FR_NOBLOCK_APS(trigger_smm_relocation, bsp_trigger_smm_relocation),
 	/* Initialize each CPU through the driver framework. */
 	MP_FR_BLOCK_APS(mp_initialize_cpu, mp_initialize_cpu),
 	/* Wait for APs to finish then optionally start looking for work. */
@@ -1021,12 +1110,16 @@ static void fill_mp_state(struct mp_state *state, const struct mp_ops *ops)
 					&state->smm_save_state_size);
 
 	/*
-	 * Default to smm_initiate_relocation() if trigger callback isn't
-	 * provided.
+	 * Default to smm_initiate_relocation_default() if trigger callback
+	 * isn't provided. Probing for parallel relocation only works with
+	 * the default trigger.
 	 */
 	if (CONFIG(HAVE_SMI_HANDLER) &&
 		ops->per_cpu_smm_trigger == NULL)
-		mp_state.ops.per_cpu_smm_trigger = smm_initiate_relocation;
+		mp_state.ops.per_cpu_smm_trigger =
+			smm_initiate_relocation_default;
+	else
+		mp_state.ops.smm_relocation_is_parallel = NULL;
 }
 
 int mp_init_with_smm(struct bus *cpu_bus, const struct mp_ops *mp_ops)
@@ -92,13 +92,16 @@ static void smm_place_jmp_instructions(void *entry_start, size_t stride,
 		uint32_t disp = (uintptr_t)jmp_target;
 
 		disp -= sizeof(entry) + (uintptr_t)cur;
-		printk(BIOS_DEBUG,
-		       "SMM Module: placing jmp sequence at %p rel16 0x%04x\n",
-		       cur, disp);
 		entry.rel16 = disp;
 		memcpy(cur, &entry, sizeof(entry));
 		cur -= stride;
 	}
+
+	/* One line for all entries, printing each one doesn't scale with
+	 * high CPU counts. */
+	if (num)
+		printk(BIOS_DEBUG, "SMM Module: placed %zu jmp sequences "
+		       "from %p down to %p\n", num, entry_start, cur + stride);
 }
 
 /* Place stacks in base -> base + size region, but ensure the stacks don't
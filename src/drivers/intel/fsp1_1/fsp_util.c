@@ -17,6 +17,7 @@
 #include <console/console.h>
 #include <console/streams.h>
 #include <fsp/util.h>
+#include <profiler.h>
 #include <timestamp.h>
 
 /* Locate the FSP binary in the coreboot filesystem */
@@ -152,7 +153,9 @@ void fsp_notify(u32 phase)
 		post_code(POST_FSP_NOTIFY_BEFORE_ENUMERATE);
 	}
 
+	profiler_pause();
 	status = notify_phase_proc(&notify_phase_params);
+	profiler_resume();
 
 	timestamp_add_now(phase == EnumInitPhaseReadyToBoot ?
 		TS_FSP_AFTER_FINALIZE : TS_FSP_AFTER_ENUMERATE);
@@ -18,6 +18,7 @@
 #include <fsp/ramstage.h>
 #include <fsp/util.h>
 #include <lib.h>
+#include <profiler.h>
 #include <stage_cache.h>
 #include <string.h>
 #include <timestamp.h>
@@ -117,7 +118,9 @@ void fsp_run_silicon_init(FSP_INFO_HEADER *fsp_info_header, int is_s3_wakeup)
 	printk(BIOS_DEBUG, "Calling FspSiliconInit(0x%p) at 0x%p\n",
 		&silicon_init_params, fsp_silicon_init);
 	post_code(POST_FSP_SILICON_INIT);
+	profiler_pause();
 	status = fsp_silicon_init(&silicon_init_params);
+	profiler_resume();
 	timestamp_add_now(TS_FSP_SILICON_INIT_END);
 	printk(BIOS_DEBUG, "FspSiliconInit returned 0x%08x\n", status);
 
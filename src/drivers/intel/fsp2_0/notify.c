@@ -16,6 +16,7 @@
 #include <console/console.h>
 #include <cpu/x86/mtrr.h>
 #include <fsp/util.h>
+#include <profiler.h>
 #include <timestamp.h>
 
 static void fsp_notify(enum fsp_notify_phase phase)
@@ -42,7 +43,9 @@ static void fsp_notify(enum fsp_notify_phase phase)
 		post_code(POST_FSP_NOTIFY_BEFORE_END_OF_FIRMWARE);
 	}
 
+	profiler_pause();
 	ret = fspnotify(&notify_params);
+	profiler_resume();
 
 	if (phase == AFTER_PCI_ENUM) {
 		timestamp_add_now(TS_FSP_AFTER_ENUMERATE);
@@ -19,6 +19,7 @@
 #include <console/console.h>
 #include <fsp/api.h>
 #include <fsp/util.h>
+#include <profiler.h>
 #include <program_loading.h>
 #include <soc/intel/common/vbt.h>
 #include <stage_cache.h>
@@ -63,7 +64,9 @@ static void do_silicon_init(struct fsp_header *hdr)
 
 	timestamp_add_now(TS_FSP_SILICON_INIT_START);
 	post_code(POST_FSP_SILICON_INIT);
+	profiler_pause();
 	status = silicon_init(upd);
+	profiler_resume();
 	timestamp_add_now(TS_FSP_SILICON_INIT_END);
 	post_code(POST_FSP_SILICON_EXIT);
 
@@ -21,6 +21,7 @@
 #include <string.h>
 #include <spi-generic.h>
 #include <spi_flash.h>
+#include <thread.h>
 #include <timer.h>
 #include <types.h>
 
@@ -171,29 +172,47 @@ static int spi_flash_read_chunked(const struct spi_flash *flash, u32 offset,
 	return 0;
 }
 
-int spi_flash_cmd_poll_bit(const struct spi_flash *flash, unsigned long timeout,
-			   u8 cmd, u8 poll_bit)
-{
-	const struct spi_slave *spi = &flash->spi;
+struct spi_flash_poll {
+	const struct spi_slave *spi;
+	u8 cmd;
+	u8 poll_bit;
 	int ret;
+};
+
+/* Done once the bit is clear or reading the status failed. */
+static int spi_flash_poll_status(void *arg)
+{
+	struct spi_flash_poll *p = arg;
 	u8 status;
-	struct mono_time current, end;
 
-	timer_monotonic_get(&current);
-	end = current;
-	mono_time_add_msecs(&end, timeout);
+	p->ret = do_spi_flash_cmd(p->spi, &p->cmd, 1, &status, 1);
+	return p->ret || (status & p->poll_bit) == 0;
+}
 
-	do {
-		ret = do_spi_flash_cmd(spi, &cmd, 1, &status, 1);
-		if (ret)
-			return -1;
-		if ((status & poll_bit) == 0)
-			return 0;
-		timer_monotonic_get(&current);
-	} while (!mono_time_after(&current, &end));
+int spi_flash_cmd_poll_bit(const struct spi_flash *flash, unsigned long timeout,
+			   u8 cmd, u8 poll_bit)
+{
+	struct spi_flash_poll p = {
+		.spi = &flash->spi,
+		.cmd = cmd,
+		.poll_bit = poll_bit,
+	};
+	int done;
+
+	/* Let other threads run while the flash is busy. */
+	if (CONFIG(SPI_FLASH_YIELD_WHILE_BUSY))
+		done = !thread_poll(spi_flash_poll_status, &p,
+				    SPI_FLASH_POLL_YIELD_US,
+				    timeout * USECS_PER_MSEC);
+	else
+		done = wait_ms(timeout, spi_flash_poll_status(&p));
+
+	if (!done) {
+		printk(BIOS_DEBUG, "SF: timeout at %ld msec\n", timeout);
+		return -1;
+	}
 
-	printk(BIOS_DEBUG, "SF: timeout at %ld msec\n",timeout);
-	return -1;
+	return p.ret ? -1 : 0;
 }
 
 int spi_flash_cmd_wait_ready(const struct spi_flash *flash,
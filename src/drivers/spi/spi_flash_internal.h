@@ -36,6 +36,9 @@
 /* Common status */
 #define STATUS_WIP			0x01
 
+/* Interval between status polls when yielding during WIP */
+#define SPI_FLASH_POLL_YIELD_US		10
+
 /* Send a single-byte command to the device and read the response */
 int spi_flash_cmd(const struct spi_slave *spi, u8 cmd, void *response, size_t len);
 
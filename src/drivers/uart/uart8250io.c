@@ -14,6 +14,7 @@
 #include <stdlib.h>
 #include <arch/io.h>
 #include <boot/coreboot_tables.h>
+#include <commonlib/helpers.h>
 #include <console/uart.h>
 #include <trace.h>
 #include "uart8250reg.h"
@@ -41,6 +42,28 @@ static void uart8250_tx_byte(unsigned int base_port, unsigned char data)
 	outb(data, base_port + UART8250_TBR);
 }
 
+/* With the FIFO enabled THRE means the whole FIFO is empty, so it can take
+ * a burst of bytes per poll. Plain 8250 and 16450 parts take one. */
+static void uart8250_tx_block(unsigned int base_port, const unsigned char *data,
+			      size_t len)
+{
+	size_t burst = 1;
+
+	if ((inb(base_port + UART8250_IIR) & UART8250_IIR_FIFO) ==
+	    UART8250_IIR_FIFO)
+		burst = UART8250_FIFO_SIZE;
+
+	while (len) {
+		unsigned long int i = FIFO_TIMEOUT;
+		size_t n = MIN(len, burst);
+
+		while (i-- && !uart8250_can_tx_byte(base_port));
+		len -= n;
+		while (n--)
+			outb(*data++, base_port + UART8250_TBR);
+	}
+}
+
 static void uart8250_tx_flush(unsigned int base_port)
 {
 	unsigned long int i = FIFO_TIMEOUT;
@@ -111,6 +134,11 @@ void uart_tx_byte(int idx, unsigned char data)
 	uart8250_tx_byte(uart_platform_base(idx), data);
 }
 
+void uart_tx_block(int idx, const unsigned char *buf, size_t len)
+{
+	uart8250_tx_block(uart_platform_base(idx), buf, len);
+}
+
 unsigned char uart_rx_byte(int idx)
 {
 	return uart8250_rx_byte(uart_platform_base(idx));
@@ -13,6 +13,7 @@
 
 #include <device/mmio.h>
 #include <boot/coreboot_tables.h>
+#include <commonlib/helpers.h>
 #include <console/uart.h>
 #include <device/device.h>
 #include <delay.h>
@@ -63,6 +64,29 @@ static void uart8250_mem_tx_byte(void *base, unsigned char data)
 	uart8250_write(base, UART8250_TBR, data);
 }
 
+/* With the FIFO enabled THRE means the whole FIFO is empty, so it can take
+ * a burst of bytes per poll. Plain 8250 and 16450 parts take one. */
+static void uart8250_mem_tx_block(void *base, const unsigned char *data,
+				  size_t len)
+{
+	size_t burst = 1;
+
+	if ((uart8250_read(base, UART8250_IIR) & UART8250_IIR_FIFO) ==
+	    UART8250_IIR_FIFO)
+		burst = UART8250_FIFO_SIZE;
+
+	while (len) {
+		unsigned long int i = FIFO_TIMEOUT;
+		size_t n = MIN(len, burst);
+
+		while (i-- && !uart8250_mem_can_tx_byte(base))
+			udelay(1);
+		len -= n;
+		while (n--)
+			uart8250_write(base, UART8250_TBR, *data++);
+	}
+}
+
 static void uart8250_mem_tx_flush(void *base)
 {
 	unsigned long int i = FIFO_TIMEOUT;
@@ -128,6 +152,14 @@ void uart_tx_byte(int idx, unsigned char data)
 	uart8250_mem_tx_byte(base, data);
 }
 
+void uart_tx_block(int idx, const unsigned char *buf, size_t len)
+{
+	void *base = uart_platform_baseptr(idx);
+	if (!base)
+		return;
+	uart8250_mem_tx_block(base, buf, len);
+}
+
 unsigned char uart_rx_byte(int idx)
 {
 	void *base = uart_platform_baseptr(idx);
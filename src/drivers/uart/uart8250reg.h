@@ -33,6 +33,10 @@
 #define   UART8250_IIR_THRI	0x02 /* Transmitter holding register empty */
 #define   UART8250_IIR_RDI	0x04 /* Receiver data interrupt */
 #define   UART8250_IIR_RLSI	0x06 /* Receiver line status interrupt */
+#define   UART8250_IIR_FIFO	0xc0 /* FIFOs enabled (16550A and later) */
+
+/* Transmit FIFO depth of a 16550A */
+#define UART8250_FIFO_SIZE 16
 
 #define UART8250_FCR 0x02
 #define   UART8250_FCR_FIFO_EN		0x01 /* Fifo enable */
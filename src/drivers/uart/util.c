@@ -15,6 +15,12 @@
 #include <types.h>
 #include <timer.h>
 
+void __weak uart_tx_block(int idx, const unsigned char *buf, size_t len)
+{
+	while (len--)
+		uart_tx_byte(idx, *buf++);
+}
+
 /* Calculate divisor. Do not floor but round to nearest integer. */
 unsigned int uart_baudrate_divisor(unsigned int baudrate,
 	unsigned int refclk, unsigned int oversample)
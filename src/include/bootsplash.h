@@ -25,6 +25,7 @@
  * and >0 on jpeg errors.
  */
 void set_bootsplash(unsigned char *framebuffer, unsigned int x_resolution,
-		    unsigned int y_resolution, unsigned int fb_resolution);
+		    unsigned int y_resolution, unsigned int bytes_per_line,
+		    unsigned int fb_resolution);
 
 #endif
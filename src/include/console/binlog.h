@@ -0,0 +1,36 @@
+/*
+ * This file is part of the coreboot project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _CONSOLE_BINLOG_H_
+#define _CONSOLE_BINLOG_H_
+
+#include <console/vtxprintf.h>
+
+#define __BINLOG_ENABLE__	(CONFIG(CONSOLE_CBMEM_BINARY_LOG) && ENV_RAMSTAGE)
+
+/*
+ * Store a message in the binary log without formatting it. Returns the
+ * number of characters it would have printed if it was logged, or -1 if the
+ * caller has to format it as text: before CBMEM is up, or for messages the
+ * log can't hold.
+ */
+#if __BINLOG_ENABLE__
+int binlog_vprintk(int msg_level, const char *fmt, va_list args);
+#else
+static inline int binlog_vprintk(int msg_level, const char *fmt, va_list args)
+{
+	return -1;
+}
+#endif
+
+#endif /* _CONSOLE_BINLOG_H_ */
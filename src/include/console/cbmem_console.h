@@ -15,10 +15,14 @@
 #ifndef _CONSOLE_CBMEM_CONSOLE_H_
 #define _CONSOLE_CBMEM_CONSOLE_H_
 
+#include <stddef.h>
 #include <stdint.h>
 
 void cbmemc_init(void);
 void cbmemc_tx_byte(unsigned char data);
+void cbmemc_tx_block(const void *buf, size_t len);
+/* Record that a printk() message at the given level starts here. */
+void cbmemc_msg_start(int level);
 
 #define __CBMEM_CONSOLE_ENABLE__	(CONFIG(CONSOLE_CBMEM) && \
 	(ENV_RAMSTAGE || ENV_VERSTAGE || ENV_POSTCAR  || ENV_ROMSTAGE || \
@@ -27,9 +31,20 @@ void cbmemc_tx_byte(unsigned char data);
 #if __CBMEM_CONSOLE_ENABLE__
 static inline void __cbmemc_init(void)	{ cbmemc_init(); }
 static inline void __cbmemc_tx_byte(u8 data)	{ cbmemc_tx_byte(data); }
+static inline void __cbmemc_tx_block(const u8 *buf, size_t len)
+{
+	cbmemc_tx_block(buf, len);
+}
+static inline void __cbmemc_msg_start(int level)
+{
+	if (CONFIG(CONSOLE_CBMEM_METADATA))
+		cbmemc_msg_start(level);
+}
 #else
 static inline void __cbmemc_init(void)	{}
 static inline void __cbmemc_tx_byte(u8 data)	{}
+static inline void __cbmemc_tx_block(const u8 *buf, size_t len) {}
+static inline void __cbmemc_msg_start(int level)	{}
 #endif
 
 void cbmem_dump_console(void);
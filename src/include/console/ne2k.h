@@ -16,13 +16,16 @@
 #ifndef _NE2K_H__
 #define _NE2K_H__
 
+#include <stddef.h>
 #include <stdint.h>
 
 void ne2k_append_data(unsigned char *d, int len, unsigned int base);
 int ne2k_init(unsigned int eth_nic_base);
 void ne2k_transmit(unsigned int eth_nic_base);
 
-#if CONFIG(CONSOLE_NE2K) && (ENV_ROMSTAGE || ENV_RAMSTAGE)
+#define __NE2K_ENABLE__	(CONFIG(CONSOLE_NE2K) && (ENV_ROMSTAGE || ENV_RAMSTAGE))
+
+#if __NE2K_ENABLE__
 static inline void __ne2k_init(void)
 {
 	ne2k_init(CONFIG_CONSOLE_NE2K_IO_PORT);
@@ -31,6 +34,11 @@ static inline void __ne2k_tx_byte(u8 data)
 {
 	ne2k_append_data(&data, 1, CONFIG_CONSOLE_NE2K_IO_PORT);
 }
+static inline void __ne2k_tx_block(const u8 *data, size_t len)
+{
+	ne2k_append_data((unsigned char *)data, len,
+			 CONFIG_CONSOLE_NE2K_IO_PORT);
+}
 static inline void __ne2k_tx_flush(void)
 {
 	ne2k_transmit(CONFIG_CONSOLE_NE2K_IO_PORT);
@@ -38,6 +46,7 @@ static inline void __ne2k_tx_flush(void)
 #else
 static inline void __ne2k_init(void)		{}
 static inline void __ne2k_tx_byte(u8 data)	{}
+static inline void __ne2k_tx_block(const u8 *data, size_t len) {}
 static inline void __ne2k_tx_flush(void)	{}
 #endif
 
@@ -6,7 +6,9 @@
 void spkmodem_init(void);
 void spkmodem_tx_byte(unsigned char c);
 
-#if CONFIG(SPKMODEM) && (ENV_ROMSTAGE || ENV_RAMSTAGE)
+#define __SPKMODEM_ENABLE__	(CONFIG(SPKMODEM) && (ENV_ROMSTAGE || ENV_RAMSTAGE))
+
+#if __SPKMODEM_ENABLE__
 static inline void __spkmodem_init(void)		{ spkmodem_init(); }
 static inline void __spkmodem_tx_byte(u8 data)	{ spkmodem_tx_byte(data); }
 #else
@@ -21,6 +21,18 @@ void console_hw_init(void);
 void console_tx_byte(unsigned char byte);
 void console_tx_flush(void);
 
+/*
+ * Send len bytes to every console. Each console gets the whole block at
+ * once, which lets drivers burst it out instead of polling per byte.
+ */
+void console_tx_block(const unsigned char *buf, size_t len);
+
+#define TRACK_CONSOLE_TIME (CONFIG(HAVE_MONOTONIC_TIMER) && \
+	(ENV_RAMSTAGE || !CONFIG(CAR_GLOBAL_MIGRATION)))
+
+/* Print how long each console spent on console_tx_block(). */
+void console_sink_time_report(void);
+
 /*
  * Write number_of_bytes data bytes from buffer to the serial device.
  * If number_of_bytes is zero, wait until all serial data is output.
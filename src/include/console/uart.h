@@ -16,6 +16,7 @@
 #ifndef CONSOLE_UART_H
 #define CONSOLE_UART_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 /* Return the clock frequency UART uses as reference clock for
@@ -50,6 +51,9 @@ void uart_bitbang_tx_byte(unsigned char data, void (*set_tx)(int line_state));
 
 void uart_init(int idx);
 void uart_tx_byte(int idx, unsigned char data);
+/* Send len bytes. Drivers with a transmit FIFO fill it in bursts, the
+ * default implementation sends the bytes one by one. */
+void uart_tx_block(int idx, const unsigned char *buf, size_t len);
 void uart_tx_flush(int idx);
 unsigned char uart_rx_byte(int idx);
 
@@ -76,6 +80,10 @@ static inline void __uart_tx_byte(u8 data)
 {
 	uart_tx_byte(CONFIG_UART_FOR_CONSOLE, data);
 }
+static inline void __uart_tx_block(const u8 *buf, size_t len)
+{
+	uart_tx_block(CONFIG_UART_FOR_CONSOLE, buf, len);
+}
 static inline void __uart_tx_flush(void)
 {
 	uart_tx_flush(CONFIG_UART_FOR_CONSOLE);
@@ -83,6 +91,7 @@ static inline void __uart_tx_flush(void)
 #else
 static inline void __uart_init(void)		{}
 static inline void __uart_tx_byte(u8 data)	{}
+static inline void __uart_tx_block(const u8 *buf, size_t len) {}
 static inline void __uart_tx_flush(void)	{}
 #endif
 
@@ -27,6 +27,7 @@ void northbridge_write_smram(u8 smram);
 
 void smm_lock(void);
 void smm_relocate(void);
+int smm_relocation_is_parallel(void);
 
 /* The initialization of the southbridge is split into 2 components. One is
  * for clearing the state in the SMM registers. The other is for enabling
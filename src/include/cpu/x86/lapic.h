@@ -130,4 +130,24 @@ static inline void setup_lapic(void)
 struct device;
 int start_cpu(struct device *cpu);
 
+/* Interrupt vector of the APIC timer when RAMSTAGE_PROFILER samples. */
+#define LAPIC_PROFILER_VECTOR	32
+/* Spurious interrupt vector meanwhile. P6 family CPUs force its low four
+   bits to 1. */
+#define LAPIC_SPURIOUS_VECTOR	47
+
+/* Called by the exception handler for LAPIC_PROFILER_VECTOR. */
+void lapic_profiler_interrupt(uintptr_t pc);
+
+/* Returns 1 if the profiler samples with the APIC timer of this CPU. Code
+   that sets up the timer has to leave it alone then. */
+#if CONFIG(RAMSTAGE_PROFILER) && ENV_RAMSTAGE
+int lapic_profiler_owns_timer(void);
+#else
+static inline int lapic_profiler_owns_timer(void)
+{
+	return 0;
+}
+#endif
+
 #endif /* CPU_X86_LAPIC_H */
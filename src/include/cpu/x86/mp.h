@@ -76,9 +76,22 @@ struct mp_ops {
 	void (*pre_mp_smm_init)(void);
 	/*
 	 * Optional function to use to trigger SMM to perform relocation. If
-	 * not provided, smm_initiate_relocation() is used.
+	 * not provided, smm_initiate_relocation() is used, or
+	 * smm_initiate_relocation_parallel() when smm_relocation_is_parallel()
+	 * allows it.
 	 */
 	void (*per_cpu_smm_trigger)(void);
+	/*
+	 * Optional function to enable parallel SMM relocation. It is ignored
+	 * if per_cpu_smm_trigger() is provided. When set, the BSP runs
+	 * relocation_handler() on its own first. That pass can either
+	 * relocate the BSP, or only set up per-CPU save state (e.g. in MSRs)
+	 * so that the CPUs no longer share the save state at the default
+	 * SMBASE. Return non-zero in the latter case: all CPUs, the BSP
+	 * included, then run relocation_handler() at the same time.
+	 * Otherwise the APs relocate one after the other.
+	 */
+	int (*smm_relocation_is_parallel)(void);
 	/*
 	 * This function is called while each CPU is in the SMM relocation
 	 * handler. Its primary purpose is to adjust the SMBASE for the
@@ -109,10 +122,11 @@ struct mp_ops {
  * 6. adjust_smm_params(is_perm = 0)
  * 7. adjust_smm_params(is_perm = 1)
  * 8. pre_mp_smm_init()
- * 9. per_cpu_smm_trigger() in parallel for all cpus which calls
+ * 9. smm_relocation_is_parallel() after relocation_handler() ran on the BSP
+ * 10. per_cpu_smm_trigger() in parallel for all cpus which calls
  *    relocation_handler() in SMM.
- * 10. mp_initialize_cpu() for each cpu
- * 11. post_mp_init()
+ * 11. mp_initialize_cpu() for each cpu
+ * 12. post_mp_init()
  */
 int mp_init_with_smm(struct bus *cpu_bus, const struct mp_ops *mp_ops);
 
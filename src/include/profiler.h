@@ -0,0 +1,43 @@
+/*
+ * This file is part of the coreboot project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+
+#if CONFIG(RAMSTAGE_PROFILER) && ENV_RAMSTAGE
+
+/* Count one sample at pc. Called from the timer interrupt. */
+void profiler_sample(uintptr_t pc);
+
+/*
+ * Stop sampling around code that runs with its own interrupt setup, like
+ * FSP. Calls nest.
+ */
+void profiler_pause(void);
+void profiler_resume(void);
+
+/* Provided by the architecture: interrupt every period_us microseconds and
+   pass the interrupted pc to profiler_sample(), or stop doing so. */
+void arch_profiler_start(unsigned int period_us);
+void arch_profiler_stop(void);
+
+#else
+
+static inline void profiler_pause(void) {}
+static inline void profiler_resume(void) {}
+
+#endif
+
+#endif /* PROFILER_H */
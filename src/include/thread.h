@@ -18,26 +18,37 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <bootstate.h>
+#include <timer.h>
 #include <arch/cpu.h>
 
+/* A completion is signalled once and can be waited on by any number of
+ * threads. Waiting threads are parked until thread_complete() is called. */
+struct thread_completion {
+	int done;
+	struct thread *waiters;
+};
+
+/* Tracks a thread started with thread_start() so it can be joined. */
+struct thread_handle {
+	struct thread_completion done;
+};
+
 #if ENV_RAMSTAGE && CONFIG(COOP_MULTITASKING)
 
 struct thread {
 	int id;
 	uintptr_t stack_current;
 	uintptr_t stack_orig;
+	void *stack_base;
 	struct thread *next;
 	void (*entry)(void *);
 	void *entry_arg;
 	int can_yield;
+	struct thread_handle *handle;
 };
 
+
 void threads_initialize(void);
-/* Get the base of the thread stacks.
- * Returns pointer to CONFIG_NUM_THREADS*CONFIG_STACK_SIZE contiguous bytes
- * aligned to CONFIG_STACK_SIZE, or NULL.
- */
-void *arch_get_thread_stackbase(void);
 /* Run func(arrg) on a new thread. Return 0 on successful start of thread, < 0
  * when thread could not be started. Note that the thread will block the
  * current state in the boot state machine until it is complete. */
@@ -47,22 +58,39 @@ int thread_run(void (*func)(void *), void *arg);
  * machine. */
 int thread_run_until(void (*func)(void *), void *arg,
 		     boot_state_t state, boot_state_sequence_t seq);
+/* Run func(arg) on a new thread without blocking the boot state machine.
+ * The handle is signalled when func returns and can be waited on with
+ * thread_join(). Return 0 on successful start of thread, < 0 otherwise. */
+int thread_start(struct thread_handle *handle, void (*func)(void *),
+		 void *arg);
+/* Wait for the thread tracked by handle to finish. Return 0 once it has
+ * finished, < 0 if the current context can't yield while it is still
+ * running. */
+int thread_join(struct thread_handle *handle);
 /* Return 0 on successful yield for the given amount of time, < 0 when thread
  * did not yield. */
 int thread_yield_microseconds(unsigned int microsecs);
+/* Call poll(arg) every interval_us until it returns non-zero or timeout_us
+ * elapsed. The polling is done from the timer queue and the current thread
+ * sleeps in between, so other threads run. Contexts that can't yield poll
+ * in a busy loop instead. Return 0 once poll() succeeded, < 0 on timeout. */
+int thread_poll(int (*poll)(void *arg), void *arg, unsigned long interval_us,
+		unsigned long timeout_us);
+
+void thread_completion_init(struct thread_completion *c);
+/* Mark c as done and make all waiting threads runnable. */
+void thread_complete(struct thread_completion *c);
+/* Block until c is done. Return 0 once done, < 0 if the current context
+ * can't yield while c is still pending. */
+int thread_wait(struct thread_completion *c);
 
 /* Allow and prevent thread cooperation on current running thread. By default
  * all threads are marked to be cooperative. That means a thread can yield
- * to another thread at a pre-determined switch point. Current there is
- * only a single place where switching may occur: a call to udelay(). */
+ * to another thread at a pre-determined switch point. Switching may occur
+ * in a call to udelay() or when waiting on a completion. */
 void thread_cooperate(void);
 void thread_prevent_coop(void);
 
-static inline void thread_init_cpu_info_non_bsp(struct cpu_info *ci)
-{
-	ci->thread = NULL;
-}
-
 /* Architecture specific thread functions. */
 asmlinkage void switch_to_thread(uintptr_t new_stack, uintptr_t *saved_stack);
 /* Set up the stack frame for a new thread so that a switch_to_thread() call
@@ -70,17 +98,78 @@ asmlinkage void switch_to_thread(uintptr_t new_stack, uintptr_t *saved_stack);
  * saved_stack field in the struct thread needs to be updated accordingly. */
 void arch_prepare_thread(struct thread *t,
 			 asmlinkage void (*thread_entry)(void *), void *arg);
+/* Prepare the CONFIG_THREAD_STACK_SIZE bytes at t->stack_base, aligned to
+ * their size, for running on the current CPU and set t->stack_orig. Any
+ * per-CPU state the architecture keeps at the top of the stack is copied
+ * from the current stack. */
+void arch_init_thread_stack(struct thread *t);
+/* Return an identifier of the currently executing CPU. Only the CPU that
+ * called threads_initialize() switches between threads. */
+unsigned long arch_thread_cpu_id(void);
 #else
 static inline void threads_initialize(void) {}
 static inline int thread_run(void (*func)(void *), void *arg) { return -1; }
+static inline int thread_run_until(void (*func)(void *), void *arg,
+				   boot_state_t state,
+				   boot_state_sequence_t seq)
+{
+	return -1;
+}
+static inline int thread_start(struct thread_handle *handle,
+			       void (*func)(void *), void *arg)
+{
+	return -1;
+}
+static inline int thread_join(struct thread_handle *handle) { return 0; }
 static inline int thread_yield_microseconds(unsigned int microsecs)
 {
 	return -1;
 }
+static inline int thread_poll(int (*poll)(void *arg), void *arg,
+			      unsigned long interval_us,
+			      unsigned long timeout_us)
+{
+	return wait_us(timeout_us, poll(arg)) ? 0 : -1;
+}
+static inline void thread_completion_init(struct thread_completion *c)
+{
+	c->done = 0;
+}
+static inline void thread_complete(struct thread_completion *c)
+{
+	c->done = 1;
+}
+static inline int thread_wait(struct thread_completion *c)
+{
+	return c->done ? 0 : -1;
+}
 static inline void thread_cooperate(void) {}
 static inline void thread_prevent_coop(void) {}
-struct cpu_info;
-static inline void thread_init_cpu_info_non_bsp(struct cpu_info *ci) { }
 #endif
 
+/*
+ * Helper macro to wait until a condition becomes true or a timeout elapses,
+ * like wait_us(). Between checks the current thread yields for poll_us so
+ * other threads make progress. Contexts that can't yield simply spin.
+ *
+ * Returns 0 if the condition still evaluates to false after the timeout
+ * elapsed, non-zero otherwise.
+ */
+#define thread_wait_us(timeout_us, poll_us, condition)			\
+({									\
+	int __ret = 0;							\
+	struct stopwatch __sw;						\
+	stopwatch_init_usecs_expire(&__sw, timeout_us);			\
+	while (1) {							\
+		if (condition) {					\
+			__ret = 1;					\
+			break;						\
+		}							\
+		if (stopwatch_expired(&__sw))				\
+			break;						\
+		thread_yield_microseconds(poll_us);			\
+	}								\
+	__ret;								\
+})
+
 #endif /* THREAD_H_ */
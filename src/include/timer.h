@@ -62,6 +62,33 @@ int timers_run(void);
  * 0 returned on success, < 0 on error. */
 int timer_sched_callback(struct timeout_callback *tocb, unsigned long us);
 
+/* Remove a scheduled callback before it has been called. 0 returned on
+ * success, < 0 if the callback wasn't queued. */
+int timer_cancel_callback(struct timeout_callback *tocb);
+
+/*
+ * A timer_poll checks a condition from the timer queue instead of spinning
+ * on it. poll() is called every interval_us until it returns non-zero or the
+ * timeout elapses. done() is then called once with 0 on success or < 0 on
+ * timeout. Both are called from timers_run(), so they must not block.
+ */
+struct timer_poll {
+	int (*poll)(struct timer_poll *tp);
+	void (*done)(struct timer_poll *tp, int status);
+	void *priv;
+	/* Not for public use. */
+	struct timeout_callback tocb;
+	unsigned long interval_us;
+	struct mono_time expiration;
+};
+
+/* Start polling. 0 returned on success, < 0 on error. */
+int timer_poll_start(struct timer_poll *tp, unsigned long interval_us,
+		     unsigned long timeout_us);
+/* Stop polling without calling done(). 0 returned on success, < 0 if the
+ * poll wasn't active. */
+int timer_poll_cancel(struct timer_poll *tp);
+
 /* Set an absolute time to a number of microseconds. */
 static inline void mono_time_set_usecs(struct mono_time *mt, long us)
 {
@@ -24,7 +24,8 @@
 
 
 void set_bootsplash(unsigned char *framebuffer, unsigned int x_resolution,
-		    unsigned int y_resolution, unsigned int fb_resolution)
+		    unsigned int y_resolution, unsigned int bytes_per_line,
+		    unsigned int fb_resolution)
 {
 	printk(BIOS_INFO, "Setting up bootsplash in %dx%d@%d\n", x_resolution, y_resolution,
 	       fb_resolution);
@@ -42,8 +43,9 @@ void set_bootsplash(unsigned char *framebuffer, unsigned int x_resolution,
 	printk(BIOS_DEBUG, "Bootsplash image resolution: %dx%d\n", image_width, image_height);
 
 	decdata = malloc(sizeof(*decdata));
-	int ret = jpeg_decode(jpeg, framebuffer, x_resolution, y_resolution, fb_resolution,
-			      decdata);
+	int ret = jpeg_decode_fb(jpeg, framebuffer, x_resolution, y_resolution,
+				 bytes_per_line, fb_resolution, decdata);
+	free(decdata);
 	if (ret != 0) {
 		printk(BIOS_ERR, "Bootsplash could not be decoded. jpeg_decode returned %d.\n",
 		       ret);
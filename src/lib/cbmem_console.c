@@ -16,8 +16,15 @@
 #include <console/cbmem_console.h>
 #include <console/uart.h>
 #include <cbmem.h>
+#include <commonlib/helpers.h>
+#include <string.h>
 #include <arch/early_variables.h>
+#include <commonlib/cbmem_console_serialized.h>
 #include <symbols.h>
+#include <timestamp.h>
+#if ENV_RAMSTAGE && ENV_X86
+#include <arch/cpu.h>
+#endif
 
 /*
  * Structure describing console buffer. It is overlaid on a flat memory area,
@@ -27,6 +34,11 @@
  * storage allows this, the buffer will persist across multiple boots and append
  * to the previous log.
  *
+ * With CONSOLE_CBMEM_METADATA the cursor also has CBMEM_CONSOLE_META set and
+ * the end of the area holds per-message metadata after the body, see
+ * commonlib/cbmem_console_serialized.h. The body and the meaning of size and
+ * cursor don't change, so readers that don't know about it are unaffected.
+ *
  * NOTE: These are known implementations accessing this console that need to be
  * updated in case of structure/API changes:
  *
@@ -75,25 +87,97 @@ static void current_console_set(struct cbmem_console *new_console_p)
 	car_set_ptr(cbmem_console_p, new_console_p);
 }
 
+/* A quarter of the area holds metadata, one entry per 48 bytes of text is
+ * about what an average printk() message takes. */
+#define META_SHARE 4
+
+static u32 meta_space(u32 total_space)
+{
+	if (!CONFIG(CONSOLE_CBMEM_METADATA))
+		return 0;
+	return ALIGN_DOWN(total_space / META_SHARE,
+			  sizeof(struct cbmem_console_msg));
+}
+
+static u32 body_size(u32 total_space)
+{
+	u32 size = total_space - sizeof(struct cbmem_console);
+
+	/* Keep the metadata after the body 8 byte aligned. */
+	if (CONFIG(CONSOLE_CBMEM_METADATA))
+		size = ALIGN_DOWN(size - meta_space(total_space), 8);
+	return size;
+}
+
+static struct cbmem_console_meta *console_meta(struct cbmem_console *cbm_cons_p)
+{
+	if (!CONFIG(CONSOLE_CBMEM_METADATA) ||
+	    !(cbm_cons_p->cursor & CBMEM_CONSOLE_META))
+		return NULL;
+	return (void *)&cbm_cons_p->body[cbm_cons_p->size];
+}
+
+static u32 meta_count(u32 total_space)
+{
+	return (total_space - sizeof(struct cbmem_console) -
+		body_size(total_space) - sizeof(struct cbmem_console_meta)) /
+	       sizeof(struct cbmem_console_msg);
+}
+
 static int buffer_valid(struct cbmem_console *cbm_cons_p, u32 total_space)
 {
-	return (cbm_cons_p->cursor & CURSOR_MASK) < cbm_cons_p->size &&
-	       cbm_cons_p->size <= MAX_SIZE &&
-	       cbm_cons_p->size == total_space - sizeof(struct cbmem_console);
+	struct cbmem_console_meta *meta;
+
+	if ((cbm_cons_p->cursor & CURSOR_MASK) >= cbm_cons_p->size ||
+	    cbm_cons_p->size > MAX_SIZE ||
+	    cbm_cons_p->size != body_size(total_space))
+		return 0;
+
+	if (!CONFIG(CONSOLE_CBMEM_METADATA))
+		return 1;
+
+	meta = console_meta(cbm_cons_p);
+	return meta && meta->magic == CBMEM_CONSOLE_META_MAGIC &&
+	       meta->count == meta_count(total_space);
 }
 
 static void init_console_ptr(void *storage, u32 total_space)
 {
 	struct cbmem_console *cbm_cons_p = storage;
+	struct cbmem_console_meta *meta;
 
-	if (!cbm_cons_p || total_space <= sizeof(struct cbmem_console)) {
+	if (!cbm_cons_p || total_space <= sizeof(struct cbmem_console) ||
+	    (CONFIG(CONSOLE_CBMEM_METADATA) && meta_space(total_space) <
+	     sizeof(struct cbmem_console_meta) +
+	     sizeof(struct cbmem_console_msg))) {
 		current_console_set(NULL);
 		return;
 	}
 
 	if (!buffer_valid(cbm_cons_p, total_space)) {
-		cbm_cons_p->size = total_space - sizeof(struct cbmem_console);
+		cbm_cons_p->size = body_size(total_space);
 		cbm_cons_p->cursor = 0;
+		if (CONFIG(CONSOLE_CBMEM_METADATA)) {
+			cbm_cons_p->cursor = CBMEM_CONSOLE_META;
+			meta = console_meta(cbm_cons_p);
+			meta->magic = CBMEM_CONSOLE_META_MAGIC;
+			meta->written = 0;
+			meta->count = meta_count(total_space);
+			meta->next = 0;
+			meta->tick_freq_mhz = timestamp_tick_freq_mhz();
+			meta->cursor = 0;
+			meta->flags = 0;
+		}
+	}
+
+	/* Payloads append to the console without counting what they write.
+	   Catch up, so the positions of new messages line up with the text. */
+	meta = console_meta(cbm_cons_p);
+	if (meta) {
+		u32 cursor = cbm_cons_p->cursor & CURSOR_MASK;
+		meta->written += (cursor + cbm_cons_p->size - meta->cursor) %
+				 cbm_cons_p->size;
+		meta->cursor = cursor;
 	}
 
 	current_console_set(cbm_cons_p);
@@ -101,6 +185,9 @@ static void init_console_ptr(void *storage, u32 total_space)
 
 void cbmemc_init(void)
 {
+	struct cbmem_console *cbm_cons_p;
+	struct cbmem_console_meta *meta;
+
 	if (ENV_ROMSTAGE_OR_BEFORE) {
 		/* Pre-RAM environments use special buffer placed by linker script. */
 		init_console_ptr(_preram_cbmem_console, REGION_SIZE(preram_cbmem_console));
@@ -108,6 +195,17 @@ void cbmemc_init(void)
 		/* Post-RAM uses static (BSS) buffer before CBMEM is reinitialized. */
 		init_console_ptr(static_console, sizeof(static_console));
 	}
+
+	/* Every boot starts in bootblock, and it sets up the console only
+	   once, even if it runs again after verstage returns. */
+	if (!ENV_BOOTBLOCK)
+		return;
+	cbm_cons_p = current_console();
+	if (cbm_cons_p && cbm_cons_p->size) {
+		meta = console_meta(cbm_cons_p);
+		if (meta)
+			meta->flags |= CBMEM_CONSOLE_META_NEW_BOOT;
+	}
 }
 
 void cbmemc_tx_byte(unsigned char data)
@@ -127,34 +225,175 @@ void cbmemc_tx_byte(unsigned char data)
 	}
 
 	cbm_cons_p->cursor = flags | cursor;
+
+	struct cbmem_console_meta *meta = console_meta(cbm_cons_p);
+	if (meta) {
+		meta->written++;
+		meta->cursor = cursor;
+	}
+}
+
+void cbmemc_tx_block(const void *buf, size_t len)
+{
+	struct cbmem_console *cbm_cons_p = current_console();
+	const u8 *data = buf;
+
+	if (!cbm_cons_p || !cbm_cons_p->size)
+		return;
+
+	u32 flags = cbm_cons_p->cursor & ~CURSOR_MASK;
+	u32 cursor = cbm_cons_p->cursor & CURSOR_MASK;
+	struct cbmem_console_meta *meta = console_meta(cbm_cons_p);
+
+	/* Copy up to the end of the ring, then wrap around. */
+	while (len) {
+		size_t n = MIN(len, (size_t)(cbm_cons_p->size - cursor));
+
+		memcpy(&cbm_cons_p->body[cursor], data, n);
+		data += n;
+		len -= n;
+		cursor += n;
+		if (cursor >= cbm_cons_p->size) {
+			cursor = 0;
+			flags |= OVERFLOW;
+		}
+	}
+
+	cbm_cons_p->cursor = flags | cursor;
+	if (meta) {
+		meta->written += data - (const u8 *)buf;
+		meta->cursor = cursor;
+	}
+}
+
+static u8 current_stage(void)
+{
+	if (ENV_BOOTBLOCK)
+		return CBMEM_CONSOLE_STAGE_BOOTBLOCK;
+	if (ENV_VERSTAGE)
+		return CBMEM_CONSOLE_STAGE_VERSTAGE;
+	if (ENV_ROMSTAGE)
+		return CBMEM_CONSOLE_STAGE_ROMSTAGE;
+	if (ENV_POSTCAR)
+		return CBMEM_CONSOLE_STAGE_POSTCAR;
+	if (ENV_RAMSTAGE)
+		return CBMEM_CONSOLE_STAGE_RAMSTAGE;
+	if (ENV_SMM)
+		return CBMEM_CONSOLE_STAGE_SMM;
+	return CBMEM_CONSOLE_STAGE_UNKNOWN;
+}
+
+static u16 current_cpu(void)
+{
+#if ENV_RAMSTAGE && ENV_X86
+	return cpu_index();
+#else
+	return 0;
+#endif
+}
+
+static struct cbmem_console_msg *add_msg(struct cbmem_console_meta *meta)
+{
+	return &meta->msgs[meta->next++ % meta->count];
+}
+
+void cbmemc_msg_start(int level)
+{
+	struct cbmem_console *cbm_cons_p = current_console();
+	struct cbmem_console_meta *meta;
+	struct cbmem_console_msg *msg;
+
+	if (!cbm_cons_p || !cbm_cons_p->size)
+		return;
+
+	meta = console_meta(cbm_cons_p);
+	if (!meta)
+		return;
+
+	msg = add_msg(meta);
+	msg->pos = meta->written;
+	msg->level = level & CBMEM_CONSOLE_MSG_LEVEL_MASK;
+	if (meta->flags & CBMEM_CONSOLE_META_NEW_BOOT) {
+		msg->level |= CBMEM_CONSOLE_MSG_BOOT;
+		meta->flags &= ~CBMEM_CONSOLE_META_NEW_BOOT;
+	}
+	msg->stage = current_stage();
+	msg->cpu = current_cpu();
+	msg->timestamp = timestamp_get();
+}
+
+/*
+ * Carry the metadata of the messages that are still in the source console
+ * over. The text that was in the source starts at text_start in the target.
+ */
+static void copy_console_meta(struct cbmem_console *src_cons_p, u32 text_start)
+{
+	struct cbmem_console_meta *src = console_meta(src_cons_p);
+	struct cbmem_console_meta *dst;
+	struct cbmem_console *cbm_cons_p = current_console();
+	u32 held, oldest, i;
+
+	if (!src || !cbm_cons_p || !cbm_cons_p->size)
+		return;
+	dst = console_meta(cbm_cons_p);
+	if (!dst)
+		return;
+	/* Bootblock logged nothing to mark the boot with yet. */
+	dst->flags |= src->flags & CBMEM_CONSOLE_META_NEW_BOOT;
+
+	if (src_cons_p->cursor & OVERFLOW)
+		held = src_cons_p->size;
+	else
+		held = src_cons_p->cursor & CURSOR_MASK;
+	oldest = src->written - held;
+
+	i = src->next > src->count ? src->next - src->count : 0;
+	for (; i < src->next; i++) {
+		const struct cbmem_console_msg *msg = &src->msgs[i % src->count];
+		struct cbmem_console_msg *copy;
+
+		/* Its text was overwritten. */
+		if (msg->pos - oldest > held)
+			continue;
+		copy = add_msg(dst);
+		*copy = *msg;
+		copy->pos = text_start + (msg->pos - oldest);
+	}
 }
 
 /*
  * Copy the current console buffer (either from the cache as RAM area or from
  * the static buffer, pointed at by src_cons_p) into the newly initialized CBMEM
- * console. The use of cbmemc_tx_byte() ensures that all special cases for the
+ * console. The use of cbmemc_tx_block() ensures that all special cases for the
  * target console (e.g. overflow) will be handled. If there had been an
  * overflow in the source console, log a message to that effect.
  */
 static void copy_console_buffer(struct cbmem_console *src_cons_p)
 {
-	u32 c;
+	struct cbmem_console_meta *meta;
+	u32 cursor, text_start = 0;
 
 	if (!src_cons_p)
 		return;
 
+	cursor = src_cons_p->cursor & CURSOR_MASK;
 	if (src_cons_p->cursor & OVERFLOW) {
 		const char overflow_warning[] = "\n*** Pre-CBMEM " ENV_STRING
 			" console overflowed, log truncated! ***\n";
-		for (c = 0; c < sizeof(overflow_warning) - 1; c++)
-			cbmemc_tx_byte(overflow_warning[c]);
-		for (c = src_cons_p->cursor & CURSOR_MASK;
-		     c < src_cons_p->size; c++)
-			cbmemc_tx_byte(src_cons_p->body[c]);
+		cbmemc_tx_block(overflow_warning, sizeof(overflow_warning) - 1);
+	}
+
+	if (current_console()) {
+		meta = console_meta(current_console());
+		if (meta)
+			text_start = meta->written;
 	}
 
-	for (c = 0; c < (src_cons_p->cursor & CURSOR_MASK); c++)
-		cbmemc_tx_byte(src_cons_p->body[c]);
+	if (src_cons_p->cursor & OVERFLOW)
+		cbmemc_tx_block(&src_cons_p->body[cursor],
+				src_cons_p->size - cursor);
+	cbmemc_tx_block(src_cons_p->body, cursor);
+	copy_console_meta(src_cons_p, text_start);
 
 	/* Invalidate the source console, so it will be reinitialized on the
 	   next reboot. Otherwise, we might copy the same bytes again. */
@@ -30,6 +30,7 @@
 #include <stdlib.h>
 #include <cbfs.h>
 #include <cbmem.h>
+#include <commonlib/storage.h>
 #include <bootmem.h>
 #include <bootsplash.h>
 #include <spi_flash.h>
@@ -150,8 +151,9 @@ static void lb_framebuffer(struct lb_header *header)
 		uint8_t *fb_ptr = (uint8_t *)(uintptr_t)framebuffer->physical_address;
 		unsigned int width = framebuffer->x_resolution;
 		unsigned int height = framebuffer->y_resolution;
+		unsigned int bytes_per_line = framebuffer->bytes_per_line;
 		unsigned int depth = framebuffer->bits_per_pixel;
-		set_bootsplash(fb_ptr, width, height, depth);
+		set_bootsplash(fb_ptr, width, height, bytes_per_line, depth);
 	}
 }
 
@@ -314,7 +316,7 @@ static void lb_sku_id(struct lb_header *header)
 static void lb_mmc_info(struct lb_header *header)
 {
 	struct lb_mmc_info *rec;
-	int32_t *ms_cbmem;
+	struct storage_media_state *ms_cbmem;
 
 	ms_cbmem = cbmem_find(CBMEM_ID_MMC_STATUS);
 	if (!ms_cbmem)
@@ -324,7 +326,18 @@ static void lb_mmc_info(struct lb_header *header)
 
 	rec->tag = LB_TAG_MMC_INFO;
 	rec->size = sizeof(*rec);
-	rec->early_cmd1_status = *ms_cbmem;
+	rec->early_cmd1_status = ms_cbmem->early_cmd1_status;
+	rec->flags = ms_cbmem->flags;
+	rec->version = ms_cbmem->version;
+	rec->rca = ms_cbmem->rca;
+	rec->caps = ms_cbmem->caps;
+	rec->bus_width = ms_cbmem->bus_width;
+	rec->bus_hz = ms_cbmem->bus_hz;
+	rec->timing = ms_cbmem->timing;
+	rec->read_bl_len = ms_cbmem->read_bl_len;
+	rec->partition_config = ms_cbmem->partition_config;
+	rec->capacity.lo = ms_cbmem->capacity_lo;
+	rec->capacity.hi = ms_cbmem->capacity_hi;
 }
 
 static void add_cbmem_pointers(struct lb_header *header)
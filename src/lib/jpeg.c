@@ -100,6 +100,7 @@ static void initcol __P((PREC[][64]));
 static void col221111 __P((int *, unsigned char *, int));
 static void col221111_16 __P((int *, unsigned char *, int));
 static void col221111_32 __P((int *, unsigned char *, int));
+static void col221111_scaled __P((int *, unsigned char *, int, int, int));
 
 /*********************************/
 
@@ -279,15 +280,11 @@ int jpeg_check_size(unsigned char *buf, int width, int height)
 	return 1;
 }
 
-int jpeg_decode(unsigned char *buf, unsigned char *pic,
-		int width, int height, int depth, struct jpeg_decdata *decdata)
+/* Parses everything up to the start of the scan. */
+static int dec_header(unsigned char *buf, int *width, int *height)
 {
 	int i, j, m, tac, tdc;
-	int mcusx, mcusy, mx, my;
-	int max[6];
 
-	if (!decdata || !buf || !pic)
-		return -1;
 	datap = buf;
 	if (getbyte() != 0xff)
 		return ERR_NO_SOI;
@@ -299,11 +296,9 @@ int jpeg_decode(unsigned char *buf, unsigned char *pic,
 	i = getbyte();
 	if (i != 8)
 		return ERR_NOT_8BIT;
-	if (((getword() + 15) & ~15) != height)
-		return ERR_HEIGHT_MISMATCH;
-	if (((getword() + 15) & ~15) != width)
-		return ERR_WIDTH_MISMATCH;
-	if ((height & 15) || (width & 15))
+	*height = getword();
+	*width = getword();
+	if (*width <= 0 || *height <= 0)
 		return ERR_BAD_WIDTH_OR_HEIGHT;
 	info.nc = getbyte();
 	if (info.nc > MAXCOMP)
@@ -358,9 +353,29 @@ int jpeg_decode(unsigned char *buf, unsigned char *pic,
 		|| dscans[2].hv != 0x11)
 		return ERR_NOT_YCBCR_221111;
 
-	mcusx = width >> 4;
-	mcusy = height >> 4;
+	return 0;
+}
+
+/*
+ * Decodes the scan dec_header() stopped at into pic, with stride bytes
+ * between lines. The image is reduced by 1 << shift in both directions,
+ * where shift is 0 to 3. At a reduction of 8 only the DC coefficients are
+ * needed, so the IDCT is skipped. MCUs that reach past the right or bottom
+ * edge of the image go through decdata->mcu, so that only the part inside
+ * the image is written.
+ */
+static int dec_image(unsigned char *pic, int stride, int depth, int shift,
+		     int width, int height, struct jpeg_decdata *decdata)
+{
+	const int mcusize = 16 >> shift;
+	const int bytes = depth / 8;
+	const int mcusx = (width + 15) >> 4;
+	const int mcusy = (height + 15) >> 4;
+	int mx, my, max[6], w, h, i, pstride;
+	unsigned char *p, *out;
 
+	if (depth != 16 && depth != 24 && depth != 32)
+		return ERR_DEPTH_MISMATCH;
 
 	idctqtab(quant[dscans[0].tq], decdata->dquant[0]);
 	idctqtab(quant[dscans[1].tq], decdata->dquant[1]);
@@ -387,6 +402,9 @@ int jpeg_decode(unsigned char *buf, unsigned char *pic,
 					return ERR_WRONG_MARKER;
 
 			decode_mcus(&glob_in, decdata->dcts, 6, dscans, max);
+			if (shift == 3)
+				max[0] = max[1] = max[2] = max[3] = max[4] =
+					max[5] = 1;
 			idct(decdata->dcts, decdata->out, decdata->dquant[0],
 				IFIX(128.5), max[0]);
 			idct(decdata->dcts + 64, decdata->out + 64,
@@ -400,35 +418,104 @@ int jpeg_decode(unsigned char *buf, unsigned char *pic,
 			idct(decdata->dcts + 320, decdata->out + 320,
 				decdata->dquant[2], IFIX(0.5), max[5]);
 
-			switch (depth) {
-			case 32:
-				col221111_32(decdata->out, pic
-					+ (my * 16 * mcusx + mx) * 16 * 4,
-					mcusx * 16 * 4);
-				break;
-			case 24:
-				col221111(decdata->out, pic
-					+ (my * 16 * mcusx + mx) * 16 * 3,
-					mcusx * 16 * 3);
-				break;
-			case 16:
-				col221111_16(decdata->out, pic
-					+ (my * 16 * mcusx + mx) * (16 * 2),
-					mcusx * (16 * 2));
-				break;
-			default:
-				return ERR_DEPTH_MISMATCH;
+			out = pic + my * mcusize * stride + mx * mcusize * bytes;
+			w = (width >> shift) - mx * mcusize;
+			h = (height >> shift) - my * mcusize;
+			if (w > mcusize)
+				w = mcusize;
+			if (h > mcusize)
+				h = mcusize;
+			if (w == mcusize && h == mcusize) {
+				p = out;
+				pstride = stride;
+			} else {
+				p = decdata->mcu;
+				pstride = mcusize * bytes;
 			}
+
+			if (shift) {
+				col221111_scaled(decdata->out, p, pstride,
+						 depth, shift);
+			} else {
+				switch (depth) {
+				case 32:
+					col221111_32(decdata->out, p, pstride);
+					break;
+				case 24:
+					col221111(decdata->out, p, pstride);
+					break;
+				case 16:
+					col221111_16(decdata->out, p, pstride);
+					break;
+				}
+			}
+
+			if (p == out || w <= 0)
+				continue;
+			for (i = 0; i < h; i++)
+				memcpy(out + i * stride, p + i * pstride,
+				       w * bytes);
 		}
 	}
 
-	m = dec_readmarker(&glob_in);
-	if (m != M_EOI)
+	if (dec_readmarker(&glob_in) != M_EOI)
 		return ERR_NO_EOI;
 
 	return 0;
 }
 
+int jpeg_decode(unsigned char *buf, unsigned char *pic,
+		int width, int height, int depth, struct jpeg_decdata *decdata)
+{
+	int image_width, image_height, ret;
+
+	if (!decdata || !buf || !pic)
+		return -1;
+	ret = dec_header(buf, &image_width, &image_height);
+	if (ret)
+		return ret;
+	if (image_height != height)
+		return ERR_HEIGHT_MISMATCH;
+	if (image_width != width)
+		return ERR_WIDTH_MISMATCH;
+
+	return dec_image(pic, width * depth / 8, depth, 0, width, height,
+			 decdata);
+}
+
+/* Finds the smallest reduction by a power of two that fits the image. */
+static int fit_shift(int width, int height, int fb_width, int fb_height)
+{
+	int shift;
+
+	for (shift = 0; shift <= 3; shift++)
+		if ((width >> shift) <= fb_width &&
+		    (height >> shift) <= fb_height)
+			return shift;
+	return -1;
+}
+
+int jpeg_decode_fb(unsigned char *buf, unsigned char *fb, int fb_width,
+		   int fb_height, int bytes_per_line, int depth,
+		   struct jpeg_decdata *decdata)
+{
+	int width, height, shift, ret;
+
+	if (!decdata || !buf || !fb)
+		return -1;
+	ret = dec_header(buf, &width, &height);
+	if (ret)
+		return ret;
+	shift = fit_shift(width, height, fb_width, fb_height);
+	if (shift < 0)
+		return ERR_IMAGE_TOO_LARGE;
+
+	fb += (fb_height - (height >> shift)) / 2 * bytes_per_line +
+	      (fb_width - (width >> shift)) / 2 * (depth / 8);
+	return dec_image(fb, bytes_per_line, depth, shift, width, height,
+			 decdata);
+}
+
 /****************************************************************/
 /**************       huffman decoder             ***************/
 /****************************************************************/
@@ -733,7 +820,11 @@ void idct(int *in, int *out, PREC *lquant, PREC off, int max)
 		t3 = in[j] * lquant[j];
 		j = *zig2p++;
 		t6 = in[j] * lquant[j];
-		IDCT;
+		/* Most columns of a smooth image have no AC coefficients. */
+		if (t1 | t2 | t3 | t4 | t5 | t6 | t7)
+			IDCT;
+		else
+			t1 = t2 = t3 = t4 = t5 = t6 = t7 = t0;
 		tmpp[0 * 8] = t0;
 		tmpp[1 * 8] = t1;
 		tmpp[2 * 8] = t2;
@@ -1017,3 +1108,67 @@ static void col221111_32(int *out, unsigned char *pic, int width)
 		outy += 64 * 2 - 16 * 4;
 	}
 }
+
+/*
+ * Color conversion for reduced decoding: every output pixel is the average
+ * of the (1 << shift) square of luma samples and the matching chroma
+ * samples it covers.
+ */
+static void col221111_scaled(int *out, unsigned char *pic, int width,
+			     int depth, int shift)
+{
+	const int n = 8 >> shift;	/* output pixels per block and line */
+	const int step = 1 << shift;
+	const int cstep = step / 2;
+	int ox, oy, i, j;
+	int *outy, *outc;
+	int cr, cg, cb, y;
+	unsigned char *p;
+
+	for (oy = 0; oy < 2 * n; oy++) {
+		p = pic + oy * width;
+		for (ox = 0; ox < 2 * n; ox++) {
+			outy = out + (oy / n * 2 + ox / n) * 64 +
+			       oy % n * step * 8 + ox % n * step;
+			outc = out + 64 * 4 + oy * cstep * 8 + ox * cstep;
+			y = cb = cr = 0;
+			for (i = 0; i < step; i++)
+				for (j = 0; j < step; j++)
+					y += outy[i * 8 + j];
+			for (i = 0; i < cstep; i++) {
+				for (j = 0; j < cstep; j++) {
+					cb += outc[i * 8 + j];
+					cr += outc[64 + i * 8 + j];
+				}
+			}
+			y >>= 2 * shift;
+			cb >>= 2 * (shift - 1);
+			cr >>= 2 * (shift - 1);
+			cg = (50 * cb + 130 * cr + 128) >> 8;
+
+			switch (depth) {
+			case 32:
+				STORECLAMP(p[0], y + cr);
+				STORECLAMP(p[1], y - cg);
+				STORECLAMP(p[2], y + cb);
+				p[3] = 0;
+				p += 4;
+				break;
+			case 24:
+				STORECLAMP(p[0], y + cr);
+				STORECLAMP(p[1], y - cg);
+				STORECLAMP(p[2], y + cb);
+				p += 3;
+				break;
+			case 16:
+				y = ((CLAMP(y + cr) & 0xf8) << 8) |
+				    ((CLAMP(y - cg) & 0xfc) << 3) |
+				    (CLAMP(y + cb) >> 3);
+				p[0] = y & 0xff;
+				p[1] = y >> 8;
+				p += 2;
+				break;
+			}
+		}
+	}
+}
@@ -37,16 +37,26 @@
 #define ERR_NO_EOI 13
 #define ERR_BAD_TABLES 14
 #define ERR_DEPTH_MISMATCH 15
+#define ERR_IMAGE_TOO_LARGE 16
 
 struct jpeg_decdata {
 	int dcts[6 * 64 + 16];
 	int out[64 * 6];
 	int dquant[3][64];
+	unsigned char mcu[16 * 16 * 4];	/* an MCU clipped at the edge */
 };
 
 int jpeg_decode(unsigned char *, unsigned char *, int, int, int,
 	struct jpeg_decdata *);
 void jpeg_fetch_size(unsigned char *buf, int *width, int *height);
 int jpeg_check_size(unsigned char *, int, int);
+/*
+ * Decode straight into a framebuffer of the given geometry. The image is
+ * centered, and reduced by 2, 4 or 8 if it doesn't fit otherwise. Only the
+ * image itself is drawn, not the padding to whole MCUs.
+ */
+int jpeg_decode_fb(unsigned char *buf, unsigned char *fb, int fb_width,
+		   int fb_height, int bytes_per_line, int depth,
+		   struct jpeg_decdata *decdata);
 
 #endif
@@ -0,0 +1,94 @@
+/*
+ * This file is part of the coreboot project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <bootstate.h>
+#include <cbmem.h>
+#include <commonlib/profile_serialized.h>
+#include <console/console.h>
+#include <profiler.h>
+#include <string.h>
+#include <symbols.h>
+
+/* Eight bytes per bucket are plenty to tell functions apart. */
+#define PROFILE_SHIFT	3
+
+extern u8 _etext[];
+
+static struct profile *profile;
+static int paused;
+
+void profiler_sample(uintptr_t pc)
+{
+	struct profile *p = profile;
+	uintptr_t bucket = (pc - p->text_start) >> p->shift;
+
+	p->samples++;
+	if (pc < p->text_start || bucket >= p->buckets)
+		p->outside++;
+	else
+		p->counts[bucket]++;
+}
+
+static void profiler_init(int is_recovery)
+{
+	const size_t buckets =
+		((uintptr_t)_etext - (uintptr_t)_program + (1 << PROFILE_SHIFT)
+		 - 1) >> PROFILE_SHIFT;
+	struct profile *p;
+
+	p = cbmem_add(CBMEM_ID_PROFILE,
+		      sizeof(*p) + buckets * sizeof(p->counts[0]));
+	if (!p) {
+		printk(BIOS_ERR, "Profiler: no room in CBMEM.\n");
+		return;
+	}
+
+	memset(p, 0, sizeof(*p) + buckets * sizeof(p->counts[0]));
+	p->magic = PROFILE_MAGIC;
+	p->ramstage_base = (uintptr_t)_program;
+	p->text_start = (uintptr_t)_program;
+	p->shift = PROFILE_SHIFT;
+	p->buckets = buckets;
+	p->period_us = CONFIG_RAMSTAGE_PROFILER_PERIOD_US;
+	profile = p;
+
+	arch_profiler_start(p->period_us);
+}
+RAMSTAGE_CBMEM_INIT_HOOK(profiler_init)
+
+void profiler_pause(void)
+{
+	if (profile && paused++ == 0)
+		arch_profiler_stop();
+}
+
+void profiler_resume(void)
+{
+	if (profile && --paused == 0)
+		arch_profiler_start(profile->period_us);
+}
+
+/* Whatever runs next sets up interrupts its own way. */
+static void profiler_finish(void *unused)
+{
+	if (!profile)
+		return;
+
+	arch_profiler_stop();
+	printk(BIOS_DEBUG, "Profiler: %u samples, %u outside ramstage code.\n",
+	       profile->samples, profile->outside);
+	profile = NULL;
+}
+
+BOOT_STATE_INIT_ENTRY(BS_OS_RESUME, BS_ON_ENTRY, profiler_finish, NULL);
+BOOT_STATE_INIT_ENTRY(BS_PAYLOAD_BOOT, BS_ON_ENTRY, profiler_finish, NULL);
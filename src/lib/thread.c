@@ -18,6 +18,7 @@
 #include <stdlib.h>
 #include <arch/cpu.h>
 #include <bootstate.h>
+#include <commonlib/helpers.h>
 #include <console/console.h>
 #include <thread.h>
 #include <timer.h>
@@ -30,30 +31,31 @@ static void idle_thread_init(void);
 /* Storage space for the thread structs .*/
 static struct thread all_threads[TOTAL_NUM_THREADS];
 
+/* Number of thread structs handed out so far. Stacks are only allocated
+ * from the heap once a thread is first needed and are then reused. */
+static int num_threads_allocated;
+
 /* All runnable (but not running) and free threads are kept on their
  * respective lists. */
 static struct thread *runnable_threads;
 static struct thread *free_threads;
 
-static inline struct cpu_info *thread_cpu_info(const struct thread *t)
-{
-	return (void *)(t->stack_orig);
-}
+/* The thread running on the CPU which called threads_initialize(). */
+static struct thread *running_thread;
+static unsigned long thread_cpu;
 
 static inline int thread_can_yield(const struct thread *t)
 {
 	return (t != NULL && t->can_yield);
 }
 
-/* Assumes current CPU info can switch. */
-static inline struct thread *cpu_info_to_thread(const struct cpu_info *ci)
-{
-	return ci->thread;
-}
-
 static inline struct thread *current_thread(void)
 {
-	return cpu_info_to_thread(cpu_info());
+	/* Other CPUs don't take part in cooperative multitasking. */
+	if (running_thread == NULL || arch_thread_cpu_id() != thread_cpu)
+		return NULL;
+
+	return running_thread;
 }
 
 static inline int thread_list_empty(struct thread **list)
@@ -87,26 +89,42 @@ static inline struct thread *pop_runnable(void)
 	return pop_thread(&runnable_threads);
 }
 
-static inline struct thread *get_free_thread(void)
+static struct thread *alloc_thread(void)
 {
 	struct thread *t;
-	struct cpu_info *ci;
-	struct cpu_info *new_ci;
 
-	if (thread_list_empty(&free_threads))
+	if (num_threads_allocated >= TOTAL_NUM_THREADS)
+		return NULL;
+
+	t = &all_threads[num_threads_allocated];
+	t->stack_base = memalign(CONFIG_THREAD_STACK_SIZE,
+				 CONFIG_THREAD_STACK_SIZE);
+	if (t->stack_base == NULL) {
+		printk(BIOS_ERR, "No heap left for a thread stack!\n");
 		return NULL;
+	}
+	t->id = num_threads_allocated++;
+
+	return t;
+}
 
-	t = pop_thread(&free_threads);
+static inline struct thread *get_free_thread(void)
+{
+	struct thread *t;
 
-	ci = cpu_info();
+	if (thread_list_empty(&free_threads))
+		t = alloc_thread();
+	else
+		t = pop_thread(&free_threads);
 
-	/* Initialize the cpu_info structure on the new stack. */
-	new_ci = thread_cpu_info(t);
-	*new_ci = *ci;
-	new_ci->thread = t;
+	if (t == NULL)
+		return NULL;
 
-	/* Reset the current stack value to the original. */
+	/* Set up the per-CPU state on the stack and reset the current stack
+	 * value to the original. */
+	arch_init_thread_stack(t);
 	t->stack_current = t->stack_orig;
+	t->handle = NULL;
 
 	return t;
 }
@@ -140,11 +158,14 @@ static void schedule(struct thread *t)
 		/* current is still runnable. */
 		push_runnable(current);
 	}
+	running_thread = t;
 	switch_to_thread(t->stack_current, &current->stack_current);
 }
 
 static void terminate_thread(struct thread *t)
 {
+	if (t->handle != NULL)
+		thread_complete(&t->handle->done);
 	free_thread(t);
 	schedule(NULL);
 }
@@ -253,30 +274,16 @@ static void *thread_alloc_space(struct thread *t, size_t bytes)
 
 void threads_initialize(void)
 {
-	int i;
 	struct thread *t;
-	u8 *stack_top;
-	struct cpu_info *ci;
-	u8 *thread_stacks;
-
-	thread_stacks = arch_get_thread_stackbase();
 
-	/* Initialize the BSP thread first. The cpu_info structure is assumed
-	 * to be just under the top of the stack. */
+	/* The main thread keeps running on the stack it was entered on. It is
+	 * never terminated, so its stack fields are never used. */
 	t = &all_threads[0];
-	ci = cpu_info();
-	ci->thread = t;
-	t->stack_orig = (uintptr_t)ci;
 	t->id = 0;
+	num_threads_allocated = 1;
 
-	stack_top = &thread_stacks[CONFIG_STACK_SIZE] - sizeof(struct cpu_info);
-	for (i = 1; i < TOTAL_NUM_THREADS; i++) {
-		t = &all_threads[i];
-		t->stack_orig = (uintptr_t)stack_top;
-		t->id = i;
-		stack_top += CONFIG_STACK_SIZE;
-		free_thread(t);
-	}
+	thread_cpu = arch_thread_cpu_id();
+	running_thread = t;
 
 	idle_thread_init();
 }
@@ -338,6 +345,76 @@ int thread_run_until(void (*func)(void *), void *arg,
 	return 0;
 }
 
+int thread_start(struct thread_handle *handle, void (*func)(void *),
+		 void *arg)
+{
+	struct thread *current;
+	struct thread *t;
+
+	current = current_thread();
+
+	if (!thread_can_yield(current)) {
+		printk(BIOS_ERR,
+		       "thread_start() called from non-yielding context!\n");
+		return -1;
+	}
+
+	t = get_free_thread();
+
+	if (t == NULL) {
+		printk(BIOS_ERR, "thread_start() No more threads!\n");
+		return -1;
+	}
+
+	thread_completion_init(&handle->done);
+	t->handle = handle;
+	prepare_thread(t, func, arg, call_wrapper, NULL);
+	schedule(t);
+
+	return 0;
+}
+
+int thread_join(struct thread_handle *handle)
+{
+	return thread_wait(&handle->done);
+}
+
+void thread_completion_init(struct thread_completion *c)
+{
+	c->done = 0;
+	c->waiters = NULL;
+}
+
+void thread_complete(struct thread_completion *c)
+{
+	c->done = 1;
+
+	while (!thread_list_empty(&c->waiters))
+		push_runnable(pop_thread(&c->waiters));
+}
+
+int thread_wait(struct thread_completion *c)
+{
+	struct thread *current;
+
+	if (c->done)
+		return 0;
+
+	current = current_thread();
+
+	if (!thread_can_yield(current)) {
+		printk(BIOS_ERR,
+		       "thread_wait() called from non-yielding context!\n");
+		return -1;
+	}
+
+	/* thread_complete() moves us back to the runnable list. */
+	push_thread(&c->waiters, current);
+	schedule(NULL);
+
+	return 0;
+}
+
 int thread_yield_microseconds(unsigned int microsecs)
 {
 	struct thread *current;
@@ -354,6 +431,58 @@ int thread_yield_microseconds(unsigned int microsecs)
 	return 0;
 }
 
+struct thread_poll {
+	struct timer_poll tp;
+	int (*poll)(void *arg);
+	void *arg;
+	struct thread *waiter;
+	int status;
+};
+
+static int thread_poll_check(struct timer_poll *tp)
+{
+	struct thread_poll *p = container_of(tp, struct thread_poll, tp);
+
+	return p->poll(p->arg);
+}
+
+static void thread_poll_done(struct timer_poll *tp, int status)
+{
+	struct thread_poll *p = container_of(tp, struct thread_poll, tp);
+
+	p->status = status;
+	schedule(p->waiter);
+}
+
+int thread_poll(int (*poll)(void *arg), void *arg, unsigned long interval_us,
+		unsigned long timeout_us)
+{
+	struct thread *current;
+	struct thread_poll p;
+
+	if (poll(arg))
+		return 0;
+
+	current = current_thread();
+
+	if (!thread_can_yield(current))
+		return wait_us(timeout_us, poll(arg)) ? 0 : -1;
+
+	p.tp.poll = thread_poll_check;
+	p.tp.done = thread_poll_done;
+	p.poll = poll;
+	p.arg = arg;
+	p.waiter = current;
+
+	if (timer_poll_start(&p.tp, interval_us, timeout_us))
+		return wait_us(timeout_us, poll(arg)) ? 0 : -1;
+
+	/* thread_poll_done() wakes us up again. */
+	schedule(NULL);
+
+	return p.status;
+}
+
 void thread_cooperate(void)
 {
 	struct thread *current;
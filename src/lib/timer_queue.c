@@ -13,6 +13,7 @@
  * GNU General Public License for more details.
  */
 #include <stddef.h>
+#include <commonlib/helpers.h>
 #include <timer.h>
 
 #define MAX_TIMER_QUEUE_ENTRIES 64
@@ -48,18 +49,10 @@ static inline struct timeout_callback *timer_queue_head(struct timer_queue *tq)
 	return tq->queue[0];
 }
 
-static int timer_queue_insert(struct timer_queue *tq,
-			      struct timeout_callback *tocb)
+/* Bubble the entry at index up the tree until its parent is smaller. */
+static void timer_queue_sift_up(struct timer_queue *tq, int index)
 {
-	int index;
-
-	/* No more slots. */
-	if (timer_queue_full(tq))
-		return -1;
-
-	index = tq->num_entries;
-	tq->num_entries++;
-	tq->queue[index] = tocb;
+	struct timeout_callback *tocb = tq->queue[index];
 
 	while (index != 0) {
 		struct timeout_callback *parent;
@@ -78,6 +71,22 @@ static int timer_queue_insert(struct timer_queue *tq,
 
 		index = parent_index;
 	}
+}
+
+static int timer_queue_insert(struct timer_queue *tq,
+			      struct timeout_callback *tocb)
+{
+	int index;
+
+	/* No more slots. */
+	if (timer_queue_full(tq))
+		return -1;
+
+	index = tq->num_entries;
+	tq->num_entries++;
+	tq->queue[index] = tocb;
+
+	timer_queue_sift_up(tq, index);
 
 	return 0;
 }
@@ -105,18 +114,27 @@ static int timer_queue_min_child_index(struct timer_queue *tq, int index)
 	return right_child_index;
 }
 
-static void timer_queue_remove_head(struct timer_queue *tq)
+static void timer_queue_remove(struct timer_queue *tq, int index)
 {
-	int index;
 	struct timeout_callback *tocb;
 
-	/* In order to remove the head the deepest child is replaced in the
-	 * head slot and bubbled down the tree. */
+	/* In order to remove an entry the deepest child is placed in its
+	 * slot and bubbled down the tree. If it ended up in another subtree
+	 * it may also need to move up instead. */
 	tq->num_entries--;
 	tocb = tq->queue[tq->num_entries];
-	tq->queue[0] = tocb;
 
-	index = 0;
+	if (index == tq->num_entries)
+		return;
+
+	tq->queue[index] = tocb;
+
+	if (index != 0 && mono_time_before(&tocb->expiration,
+				&tq->queue[(index - 1) / 2]->expiration)) {
+		timer_queue_sift_up(tq, index);
+		return;
+	}
+
 	while (1) {
 		int min_child_index;
 		struct timeout_callback *child;
@@ -156,7 +174,7 @@ timer_queue_expired(struct timer_queue *tq, struct mono_time *current_time)
 	if (mono_time_before(current_time, &tocb->expiration))
 		return NULL;
 
-	timer_queue_remove_head(tq);
+	timer_queue_remove(tq, 0);
 
 	return tocb;
 }
@@ -179,6 +197,59 @@ int timer_sched_callback(struct timeout_callback *tocb, unsigned long us)
 	return timer_queue_insert(&global_timer_queue, tocb);
 }
 
+int timer_cancel_callback(struct timeout_callback *tocb)
+{
+	struct timer_queue *tq = &global_timer_queue;
+	int i;
+
+	for (i = 0; i < tq->num_entries; i++) {
+		if (tq->queue[i] != tocb)
+			continue;
+		timer_queue_remove(tq, i);
+		return 0;
+	}
+
+	return -1;
+}
+
+static void timer_poll_callback(struct timeout_callback *tocb)
+{
+	struct timer_poll *tp = container_of(tocb, struct timer_poll, tocb);
+	struct mono_time current_time;
+
+	if (tp->poll(tp)) {
+		tp->done(tp, 0);
+		return;
+	}
+
+	timer_monotonic_get(&current_time);
+	if (!mono_time_before(&current_time, &tp->expiration)) {
+		tp->done(tp, -1);
+		return;
+	}
+
+	if (timer_sched_callback(&tp->tocb, tp->interval_us))
+		tp->done(tp, -1);
+}
+
+int timer_poll_start(struct timer_poll *tp, unsigned long interval_us,
+		     unsigned long timeout_us)
+{
+	timer_monotonic_get(&tp->expiration);
+	mono_time_add_usecs(&tp->expiration, timeout_us);
+
+	tp->interval_us = interval_us;
+	tp->tocb.callback = timer_poll_callback;
+
+	/* Check the condition on the next timers_run() invocation. */
+	return timer_sched_callback(&tp->tocb, 0);
+}
+
+int timer_poll_cancel(struct timer_poll *tp)
+{
+	return timer_cancel_callback(&tp->tocb);
+}
+
 int timers_run(void)
 {
 	struct timeout_callback *tocb;
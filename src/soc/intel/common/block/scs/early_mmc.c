@@ -15,6 +15,7 @@
 
 #include <arch/acpi.h>
 #include <cbmem.h>
+#include <commonlib/storage.h>
 #include <commonlib/storage/sd_mmc.h>
 #include <commonlib/sd_mmc_ctrlr.h>
 #include <commonlib/sdhci.h>
@@ -57,9 +58,9 @@ static void disable_mmc_controller_bar(void)
 
 static void set_early_mmc_wake_status(int32_t status)
 {
-	int32_t *ms_cbmem;
+	struct storage_media_state *ms_cbmem;
 
-	ms_cbmem = cbmem_add(CBMEM_ID_MMC_STATUS, sizeof(int));
+	ms_cbmem = cbmem_add(CBMEM_ID_MMC_STATUS, sizeof(*ms_cbmem));
 
 	if (ms_cbmem == NULL) {
 		printk(BIOS_ERR,
@@ -68,7 +69,8 @@ static void set_early_mmc_wake_status(int32_t status)
 		return;
 	}
 
-	*ms_cbmem = status;
+	memset(ms_cbmem, 0, sizeof(*ms_cbmem));
+	ms_cbmem->early_cmd1_status = status;
 }
 
 int early_mmc_wake_hw(void)
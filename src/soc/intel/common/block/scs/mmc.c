@@ -13,11 +13,19 @@
  * GNU General Public License for more details.
  */
 
+#include <bootstate.h>
+#include <cbmem.h>
+#include <commonlib/sdhci.h>
+#include <commonlib/storage.h>
 #include <device/pci.h>
 #include <device/pci_ids.h>
+#include <device/pci_ops.h>
 #include <console/console.h>
 #include <intelblocks/cfg.h>
 #include <intelblocks/mmc.h>
+#include <string.h>
+#include <thread.h>
+#include <timer.h>
 
 static int mmc_write_dll_reg(void *bar, uint32_t reg, uint32_t val)
 {
@@ -64,15 +72,81 @@ int set_mmc_dll(void *bar)
 	return 0;
 }
 
-static void mmc_soc_init(struct device *dev)
+static struct storage_media media;
+
+static void mmc_media_init(void *arg)
 {
-	const struct resource *res;
+	struct sd_mmc_ctrlr *ctrlr = arg;
+	struct storage_media_state *state;
+	struct stopwatch sw;
 
-	if (!CONFIG(SOC_INTEL_COMMON_MMC_OVERRIDE))
+	stopwatch_init(&sw);
+	if (storage_setup_media(&media, ctrlr)) {
+		printk(BIOS_ERR, "MMC: media initialization failed\n");
 		return;
+	}
+	printk(BIOS_DEBUG, "MMC: media ready after %ld us\n",
+		stopwatch_duration_usecs(&sw));
+
+	/* Keep the early CMD1 status if romstage already added the entry. */
+	state = cbmem_find(CBMEM_ID_MMC_STATUS);
+	if (state == NULL) {
+		state = cbmem_add(CBMEM_ID_MMC_STATUS, sizeof(*state));
+		if (state == NULL) {
+			printk(BIOS_ERR, "MMC: failed to add state to cbmem\n");
+			return;
+		}
+		memset(state, 0, sizeof(*state));
+	}
+	storage_save_state(&media, state);
+}
+
+static struct thread_handle mmc_init_thread;
+
+/* The card state goes into the coreboot tables. */
+static void mmc_wait_media_init(void *unused)
+{
+	thread_join(&mmc_init_thread);
+}
+
+static BOOT_STATE_CALLBACK(mmc_wait_media_init_cb, mmc_wait_media_init, NULL);
+
+/*
+ * Bring the card up to its final bus width and speed so the payload can
+ * start issuing reads right away. This runs on its own thread if possible,
+ * and the coreboot tables aren't written until it is done.
+ */
+static void mmc_start_media_init(struct device *dev)
+{
+	struct resource *res;
+	struct sd_mmc_ctrlr *ctrlr;
 
 	res = find_resource(dev, PCI_BASE_ADDRESS_0);
-	set_mmc_dll((void *)(uintptr_t)(res->base));
+	pci_or_config16(dev, PCI_COMMAND, PCI_COMMAND_MASTER);
+
+	ctrlr = new_mem_sdhci_controller(res2mmio(res, 0, 0));
+	if (ctrlr == NULL)
+		return;
+
+	if (thread_start(&mmc_init_thread, mmc_media_init, ctrlr) < 0) {
+		mmc_media_init(ctrlr);
+		return;
+	}
+
+	boot_state_sched_on_entry(&mmc_wait_media_init_cb, BS_WRITE_TABLES);
+}
+
+static void mmc_soc_init(struct device *dev)
+{
+	const struct resource *res;
+
+	if (CONFIG(SOC_INTEL_COMMON_MMC_OVERRIDE)) {
+		res = find_resource(dev, PCI_BASE_ADDRESS_0);
+		set_mmc_dll((void *)(uintptr_t)(res->base));
+	}
+
+	if (CONFIG(SOC_INTEL_COMMON_MMC_BACKGROUND_INIT))
+		mmc_start_media_init(dev);
 }
 
 static struct device_operations dev_ops = {
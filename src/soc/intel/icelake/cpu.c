@@ -218,12 +218,6 @@ void soc_core_init(struct device *cpu)
 	enable_turbo();
 }
 
-static void per_cpu_smm_trigger(void)
-{
-	/* Relocate the SMM handler. */
-	smm_relocate();
-}
-
 static void post_mp_init(void)
 {
 	/* Set Max Ratio */
@@ -250,7 +244,7 @@ static const struct mp_ops mp_ops = {
 	.get_smm_info = smm_info,
 	.get_microcode_info = get_microcode_info,
 	.pre_mp_smm_init = smm_initialize,
-	.per_cpu_smm_trigger = per_cpu_smm_trigger,
+	.smm_relocation_is_parallel = smm_relocation_is_parallel,
 	.relocation_handler = smm_relocation_handler,
 	.post_mp_init = post_mp_init,
 };
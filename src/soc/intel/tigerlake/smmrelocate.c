@@ -235,29 +235,17 @@ void smm_initialize(void)
 {
 	/* Clear the SMM state in the southbridge. */
 	smm_southbridge_clear_state();
-
-	/*
-	 * Run the relocation handler for on the BSP to check and set up
-	 * parallel SMM relocation.
-	 */
-	smm_initiate_relocation();
-
-	if (smm_reloc_params.smm_save_state_in_msrs)
-		printk(BIOS_DEBUG, "Doing parallel SMM relocation.\n");
 }
 
-void smm_relocate(void)
+int smm_relocation_is_parallel(void)
 {
 	/*
-	 * If smm_save_state_in_msrs is non-zero then parallel SMM relocation
-	 * shall take place. Run the relocation handler a second time on the
-	 * BSP to do * the final move. For APs, a relocation handler always
-	 * needs to be run.
+	 * The first pass through the relocation handler on the BSP moved the
+	 * save state into MSRs if the CPU supports that. Then all CPUs can
+	 * relocate in parallel, the BSP included. Otherwise it has already
+	 * been relocated.
 	 */
-	if (smm_reloc_params.smm_save_state_in_msrs)
-		smm_initiate_relocation_parallel();
-	else if (!boot_cpu())
-		smm_initiate_relocation();
+	return smm_reloc_params.smm_save_state_in_msrs;
 }
 
 void smm_lock(void)
@@ -1638,6 +1638,49 @@ int cbfs_print_parseable_directory(struct cbfs_image *image)
 	return 0;
 }
 
+static int cbfs_count_usage(struct cbfs_image *image, struct cbfs_file *entry,
+			    void *arg)
+{
+	struct cbfs_usage *usage = arg;
+	uint32_t addr = cbfs_get_entry_addr(image, entry);
+	uint32_t end = cbfs_get_entry_addr(image,
+					   cbfs_find_next_entry(image, entry));
+	uint32_t len = ntohl(entry->offset) + ntohl(entry->len);
+
+	/* The last entry may be rounded up past the end of the buffer. */
+	end = MIN(end, image->buffer.size);
+
+	if (ntohl(entry->type) == CBFS_COMPONENT_DELETED ||
+	    ntohl(entry->type) == CBFS_COMPONENT_NULL) {
+		uint32_t size = end - addr;
+
+		/* Count all but the largest one as holes. */
+		if (size > usage->largest_free) {
+			uint32_t largest = size;
+			size = usage->largest_free;
+			usage->largest_free = largest;
+		}
+		if (size) {
+			usage->holes++;
+			usage->hole_bytes += size;
+		}
+		return 0;
+	}
+
+	usage->files++;
+	usage->used += len;
+	if (end > addr + len)
+		usage->padding += end - addr - len;
+	return 0;
+}
+
+int cbfs_get_usage(struct cbfs_image *image, struct cbfs_usage *usage)
+{
+	memset(usage, 0, sizeof(*usage));
+	cbfs_walk(image, cbfs_count_usage, usage);
+	return 0;
+}
+
 int cbfs_merge_empty_entry(struct cbfs_image *image, struct cbfs_file *entry,
 			   unused void *arg)
 {
@@ -1820,13 +1863,33 @@ struct cbfs_file *cbfs_create_file_header(int type,
 	return entry;
 }
 
+/* Like memset(), but leaves alone the 4K chunks that already hold the value.
+ * Images are mapped from their file where possible, and an empty entry can
+ * span most of one: its pages shouldn't be copied, compared and written back
+ * when they are still erased. */
+static void fill_if_changed(void *dest, int value, size_t len)
+{
+	uint8_t *p = dest;
+
+	while (len) {
+		size_t chunk = len < 4096 ? len : 4096;
+
+		/* All bytes are the same if the chunk equals itself moved
+		   by one. */
+		if (p[0] != (uint8_t)value || memcmp(p, p + 1, chunk - 1))
+			memset(p, value, chunk);
+		p += chunk;
+		len -= chunk;
+	}
+}
+
 int cbfs_create_empty_entry(struct cbfs_file *entry, int type,
 			    size_t len, const char *name)
 {
 	struct cbfs_file *tmp = cbfs_create_file_header(type, len, name);
 	memcpy(entry, tmp, ntohl(tmp->offset));
 	free(tmp);
-	memset(CBFS_SUBHEADER(entry), CBFS_CONTENT_DEFAULT_VALUE, len);
+	fill_if_changed(CBFS_SUBHEADER(entry), CBFS_CONTENT_DEFAULT_VALUE, len);
 	return 0;
 }
 
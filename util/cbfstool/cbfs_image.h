@@ -178,6 +178,21 @@ int cbfs_print_header_info(struct cbfs_image *image);
 int cbfs_print_entry_info(struct cbfs_image *image, struct cbfs_file *entry,
 			  void *arg);
 
+/* How the space in a CBFS is used. Space that is neither used nor in the
+ * largest empty entry is wasted: it's fragmented into holes, or it pads
+ * files up to the next entry's alignment. */
+struct cbfs_usage {
+	size_t files;
+	size_t used;		/* by the files' metadata and data */
+	size_t padding;
+	size_t largest_free;	/* size of the largest empty entry */
+	size_t holes;		/* the other empty entries */
+	size_t hole_bytes;
+};
+
+/* Fills in usage for the CBFS. Returns 0 on success, otherwise non-zero. */
+int cbfs_get_usage(struct cbfs_image *image, struct cbfs_usage *usage);
+
 /* Merge empty entries starting from given entry.
  * Returns 0 on success, otherwise non-zero. */
 int cbfs_merge_empty_entry(struct cbfs_image *image, struct cbfs_file *entry,
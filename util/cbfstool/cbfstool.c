@@ -25,12 +25,14 @@
 #include <ctype.h>
 #include <unistd.h>
 #include <getopt.h>
+#include <sys/stat.h>
 #include "common.h"
 #include "cbfs.h"
 #include "cbfs_image.h"
 #include "cbfs_sections.h"
 #include "elfparsing.h"
 #include "partitioned_file.h"
+#include "conversion_cache.h"
 #include <commonlib/fsp.h>
 #include <commonlib/endian.h>
 #include <commonlib/helpers.h>
@@ -50,6 +52,14 @@ struct command {
 	bool modifies_region;
 };
 
+/* How a batch orders the files it adds, see pack_batch(). */
+enum pack_strategy {
+	PACK_OFF,
+	PACK_KEEP,	/* keep the order, only report the space used */
+	PACK_SIZE,	/* least space lost to alignment and holes */
+	PACK_BOOT,	/* stages, payloads and FSPs next to each other */
+};
+
 static struct param {
 	partitioned_file_t *image_file;
 	struct buffer *image_region;
@@ -86,6 +96,7 @@ static struct param {
 	bool machine_parseable;
 	bool unprocessed;
 	bool ibb;
+	enum pack_strategy pack;
 	enum comp_algo compression;
 	int precompression;
 	enum vb2_hash_algorithm hash;
@@ -216,6 +227,9 @@ static int do_cbfs_locate(int32_t *cbfs_addr, size_t metadata_size,
 typedef int (*convert_buffer_t)(struct buffer *buffer, uint32_t *offset,
 	struct cbfs_file *header);
 
+static int convert_component(convert_buffer_t convert, struct buffer *buffer,
+			     uint32_t *offset, struct cbfs_file *header);
+
 static int cbfs_add_integer_component(const char *name,
 			      uint64_t u64val,
 			      uint32_t offset,
@@ -494,7 +508,7 @@ static int cbfs_add_component(const char *filename,
 	struct cbfs_file *header =
 		cbfs_create_file_header(type, buffer.size, name);
 
-	if (convert && convert(&buffer, &offset, header) != 0) {
+	if (convert && convert_component(convert, &buffer, &offset, header)) {
 		ERROR("Failed to parse file '%s'.\n", filename);
 		buffer_delete(&buffer);
 		return 1;
@@ -802,6 +816,71 @@ static int cbfstool_convert_mkflatpayload(struct buffer *buffer,
 	return 0;
 }
 
+/* Puts everything a converter reads besides its input buffer into the key.
+ * Returns false for conversions that aren't worth caching or that depend on
+ * where in the image the file goes. */
+static bool conversion_cache_key_for(struct conversion_cache_key *key,
+			convert_buffer_t convert, const struct buffer *buffer,
+			uint32_t offset)
+{
+	if (convert == cbfstool_convert_mkstage && !param.stage_xip) {
+		/* A base address trims the data in front of it. */
+		conversion_cache_key_init(key, "stage");
+		conversion_cache_key_add(key, &offset, sizeof(offset));
+		conversion_cache_key_add(key, &param.baseaddress_assigned,
+					 sizeof(param.baseaddress_assigned));
+		conversion_cache_key_add_string(key, param.ignore_section);
+	} else if (convert == cbfstool_convert_mkpayload) {
+		conversion_cache_key_init(key, "payload");
+		conversion_cache_key_add_string(key, param.cmdline);
+		conversion_cache_key_add_string(key, param.initrd);
+		if (param.initrd &&
+		    conversion_cache_key_add_file(key, param.initrd))
+			return false;
+	} else if (convert == cbfstool_convert_fsp) {
+		/* XIP FSPs are relocated to their memory-mapped address. */
+		uint32_t top = param.stage_xip ?
+			convert_to_from_absolute_top_aligned(
+						param.image_region, 0) : 0;
+
+		conversion_cache_key_init(key, "fsp");
+		conversion_cache_key_add(key, &offset, sizeof(offset));
+		conversion_cache_key_add(key, &top, sizeof(top));
+		conversion_cache_key_add(key, &param.baseaddress,
+					 sizeof(param.baseaddress));
+		conversion_cache_key_add(key, &param.baseaddress_assigned,
+					 sizeof(param.baseaddress_assigned));
+		conversion_cache_key_add(key, &param.stage_xip,
+					 sizeof(param.stage_xip));
+		conversion_cache_key_add(key, &param.precompression,
+					 sizeof(param.precompression));
+	} else {
+		return false;
+	}
+
+	conversion_cache_key_add(key, &param.compression,
+				 sizeof(param.compression));
+	conversion_cache_key_add(key, buffer_get(buffer), buffer_size(buffer));
+	return true;
+}
+
+static int convert_component(convert_buffer_t convert, struct buffer *buffer,
+			     uint32_t *offset, struct cbfs_file *header)
+{
+	struct conversion_cache_key key;
+
+	if (!conversion_cache_enabled() ||
+	    !conversion_cache_key_for(&key, convert, buffer, *offset))
+		return convert(buffer, offset, header);
+
+	if (conversion_cache_lookup(&key, buffer, offset, header))
+		return 0;
+	if (convert(buffer, offset, header))
+		return 1;
+	conversion_cache_store(&key, buffer, *offset, header);
+	return 0;
+}
+
 static int cbfs_add(void)
 {
 	int32_t address;
@@ -1270,6 +1349,8 @@ static int cbfs_truncate(void)
 	return result;
 }
 
+static int cbfs_batch(void);
+
 static const struct command commands[] = {
 	{"add", "H:r:f:n:t:c:b:a:p:yvA:j:gh?", cbfs_add, true, true},
 	{"add-flat-binary", "H:r:f:n:l:e:c:b:p:vA:gh?", cbfs_add_flat_binary,
@@ -1280,6 +1361,7 @@ static const struct command commands[] = {
 				true, true},
 	{"add-int", "H:r:i:n:b:vgh?", cbfs_add_integer, true, true},
 	{"add-master-header", "H:r:vh?j:", cbfs_add_master_header, true, true},
+	{"batch", "f:vh?", cbfs_batch, false, true},
 	{"compact", "r:h?", cbfs_compact, true, true},
 	{"copy", "r:R:h?", cbfs_copy, true, true},
 	{"create", "M:r:s:B:b:H:o:m:vh?", cbfs_create, true, true},
@@ -1296,6 +1378,7 @@ static const struct command commands[] = {
 enum {
 	/* begin after ASCII characters */
 	LONGOPT_IBB = 256,
+	LONGOPT_PACK,
 };
 
 static struct option long_options[] = {
@@ -1337,6 +1420,7 @@ static struct option long_options[] = {
 	{"mach-parseable",no_argument,       0, 'k' },
 	{"unprocessed",   no_argument,       0, 'U' },
 	{"ibb",           no_argument,       0, LONGOPT_IBB },
+	{"pack",          required_argument, 0, LONGOPT_PACK },
 	{NULL,            0,                 0,  0  }
 };
 
@@ -1433,6 +1517,8 @@ static void usage(char *name)
 			"Add a legacy CBFS master header\n"
 	     " remove [-r image,regions] -n NAME                           "
 			"Remove a component\n"
+	     " batch [-f] FILE [--pack keep|size|boot]                     "
+			"Run the commands in FILE, one per line\n"
 	     " compact -r image,regions                                    "
 			"Defragment CBFS image.\n"
 	     " copy -r image,regions -R source-region                      "
@@ -1489,354 +1575,743 @@ static void usage(char *name)
 	     SECTION_NAME_FMAP, SECTION_NAME_PRIMARY_CBFS,
 	     SECTION_NAME_PRIMARY_CBFS
 	     );
+	printf(
+	     "\nIf %s names a directory, converted stages, payloads and FSPs\n"
+	     "are kept there and reused when the same input is added again\n"
+	     "with the same options.\n", CONVERSION_CACHE_ENV);
 }
 
-int main(int argc, char **argv)
+static int parse_arguments(const struct command *command, int argc,
+								char **argv)
 {
-	size_t i;
 	int c;
 
-	if (argc < 3) {
-		usage(argv[0]);
-		return 1;
-	}
-
-	char *image_name = argv[1];
-	char *cmd = argv[2];
-	optind += 2;
+	while (1) {
+		char *suffix = NULL;
+		int option_index = 0;
+
+		c = getopt_long(argc, argv, command->optstring,
+					long_options, &option_index);
+		if (c == -1) {
+			// batch also takes its file without -f.
+			if (command->function == cbfs_batch &&
+					!param.filename && optind == argc - 1)
+				param.filename = argv[optind++];
+			if (optind < argc) {
+				ERROR("%s: excessive argument -- '%s'"
+					"\n", argv[0], argv[optind]);
+				return 1;
+			}
+			break;
+		}
 
-	for (i = 0; i < ARRAY_SIZE(commands); i++) {
-		if (strcmp(cmd, commands[i].name) != 0)
-			continue;
+		/* Filter out illegal long options */
+		if (c == LONGOPT_PACK ? command->function != cbfs_batch :
+				strchr(command->optstring, c) == NULL) {
+			/* TODO maybe print actual long option instead */
+			ERROR("%s: invalid option -- '%c'\n",
+			      argv[0], c);
+			c = '?';
+		}
 
-		while (1) {
-			char *suffix = NULL;
-			int option_index = 0;
-
-			c = getopt_long(argc, argv, commands[i].optstring,
-						long_options, &option_index);
-			if (c == -1) {
-				if (optind < argc) {
-					ERROR("%s: excessive argument -- '%s'"
-						"\n", argv[0], argv[optind]);
-					return 1;
-				}
+		switch(c) {
+		case 'n':
+			param.name = optarg;
+			break;
+		case 't':
+			if (intfiletype(optarg) != ((uint64_t) - 1))
+				param.type = intfiletype(optarg);
+			else
+				param.type = strtoul(optarg, NULL, 0);
+			if (param.type == 0)
+				WARN("Unknown type '%s' ignored\n",
+						optarg);
+			break;
+		case 'c': {
+			if (strcmp(optarg, "precompression") == 0) {
+				param.precompression = 1;
 				break;
 			}
-
-			/* Filter out illegal long options */
-			if (strchr(commands[i].optstring, c) == NULL) {
-				/* TODO maybe print actual long option instead */
-				ERROR("%s: invalid option -- '%c'\n",
-				      argv[0], c);
-				c = '?';
+			int algo = cbfs_parse_comp_algo(optarg);
+			if (algo >= 0)
+				param.compression = algo;
+			else
+				WARN("Unknown compression '%s' ignored.\n",
+								optarg);
+			break;
+		}
+		case 'A': {
+			int algo = cbfs_parse_hash_algo(optarg);
+			if (algo >= 0)
+				param.hash = algo;
+			else {
+				ERROR("Unknown hash algorithm '%s'.\n",
+					optarg);
+				return 1;
 			}
-
-			switch(c) {
-			case 'n':
-				param.name = optarg;
-				break;
-			case 't':
-				if (intfiletype(optarg) != ((uint64_t) - 1))
-					param.type = intfiletype(optarg);
-				else
-					param.type = strtoul(optarg, NULL, 0);
-				if (param.type == 0)
-					WARN("Unknown type '%s' ignored\n",
-							optarg);
-				break;
-			case 'c': {
-				if (strcmp(optarg, "precompression") == 0) {
-					param.precompression = 1;
-					break;
-				}
-				int algo = cbfs_parse_comp_algo(optarg);
-				if (algo >= 0)
-					param.compression = algo;
-				else
-					WARN("Unknown compression '%s' ignored.\n",
-									optarg);
-				break;
+			break;
+		}
+		case 'M':
+			param.fmap = optarg;
+			break;
+		case 'r':
+			param.region_name = optarg;
+			break;
+		case 'R':
+			param.source_region = optarg;
+			break;
+		case 'b':
+			param.baseaddress = strtoul(optarg, &suffix, 0);
+			if (!*optarg || (suffix && *suffix)) {
+				ERROR("Invalid base address '%s'.\n",
+					optarg);
+				return 1;
 			}
-			case 'A': {
-				int algo = cbfs_parse_hash_algo(optarg);
-				if (algo >= 0)
-					param.hash = algo;
-				else {
-					ERROR("Unknown hash algorithm '%s'.\n",
-						optarg);
-					return 1;
-				}
-				break;
+			// baseaddress may be zero on non-x86, so we
+			// need an explicit "baseaddress_assigned".
+			param.baseaddress_assigned = 1;
+			break;
+		case 'l':
+			param.loadaddress = strtoul(optarg, &suffix, 0);
+			if (!*optarg || (suffix && *suffix)) {
+				ERROR("Invalid load address '%s'.\n",
+					optarg);
+				return 1;
 			}
-			case 'M':
-				param.fmap = optarg;
-				break;
-			case 'r':
-				param.region_name = optarg;
-				break;
-			case 'R':
-				param.source_region = optarg;
-				break;
-			case 'b':
-				param.baseaddress = strtoul(optarg, &suffix, 0);
-				if (!*optarg || (suffix && *suffix)) {
-					ERROR("Invalid base address '%s'.\n",
-						optarg);
-					return 1;
-				}
-				// baseaddress may be zero on non-x86, so we
-				// need an explicit "baseaddress_assigned".
-				param.baseaddress_assigned = 1;
-				break;
-			case 'l':
-				param.loadaddress = strtoul(optarg, &suffix, 0);
-				if (!*optarg || (suffix && *suffix)) {
-					ERROR("Invalid load address '%s'.\n",
-						optarg);
-					return 1;
-				}
-				break;
-			case 'e':
-				param.entrypoint = strtoul(optarg, &suffix, 0);
-				if (!*optarg || (suffix && *suffix)) {
-					ERROR("Invalid entry point '%s'.\n",
-						optarg);
-					return 1;
-				}
-				break;
-			case 's':
-				param.size = strtoul(optarg, &suffix, 0);
-				if (!*optarg) {
-					ERROR("Empty size specified.\n");
-					return 1;
-				}
-				switch (tolower((int)suffix[0])) {
-				case 'k':
-					param.size *= 1024;
-					break;
-				case 'm':
-					param.size *= 1024 * 1024;
-					break;
-				case '\0':
-					break;
-				default:
-					ERROR("Invalid suffix for size '%s'.\n",
-						optarg);
-					return 1;
-				}
-				break;
-			case 'B':
-				param.bootblock = optarg;
-				break;
-			case 'H':
-				param.headeroffset = strtoul(
-						optarg, &suffix, 0);
-				if (!*optarg || (suffix && *suffix)) {
-					ERROR("Invalid header offset '%s'.\n",
-						optarg);
-					return 1;
-				}
-				param.headeroffset_assigned = 1;
-				break;
-			case 'a':
-				param.alignment = strtoul(optarg, &suffix, 0);
-				if (!*optarg || (suffix && *suffix)) {
-					ERROR("Invalid alignment '%s'.\n",
-						optarg);
-					return 1;
-				}
-				break;
-			case 'p':
-				param.padding = strtoul(optarg, &suffix, 0);
-				if (!*optarg || (suffix && *suffix)) {
-					ERROR("Invalid pad size '%s'.\n",
-						optarg);
-					return 1;
-				}
-				break;
-			case 'P':
-				param.pagesize = strtoul(optarg, &suffix, 0);
-				if (!*optarg || (suffix && *suffix)) {
-					ERROR("Invalid page size '%s'.\n",
-						optarg);
-					return 1;
-				}
-				break;
-			case 'o':
-				param.cbfsoffset = strtoul(optarg, &suffix, 0);
-				if (!*optarg || (suffix && *suffix)) {
-					ERROR("Invalid cbfs offset '%s'.\n",
-						optarg);
-					return 1;
-				}
-				param.cbfsoffset_assigned = 1;
-				break;
-			case 'f':
-				param.filename = optarg;
-				break;
-			case 'F':
-				param.force = 1;
-				break;
-			case 'i':
-				param.u64val = strtoull(optarg, &suffix, 0);
-				param.u64val_assigned = 1;
-				if (!*optarg || (suffix && *suffix)) {
-					ERROR("Invalid int parameter '%s'.\n",
-						optarg);
-					return 1;
-				}
-				break;
-			case 'u':
-				param.fill_partial_upward = true;
-				break;
-			case 'd':
-				param.fill_partial_downward = true;
-				break;
-			case 'w':
-				param.show_immutable = true;
-				break;
-			case 'j':
-				param.topswap_size = strtol(optarg, NULL, 0);
-				if (!is_valid_topswap())
-					return 1;
-				break;
-			case 'q':
-				param.ucode_region = optarg;
-				break;
-			case 'v':
-				verbose++;
-				break;
-			case 'm':
-				param.arch = string_to_arch(optarg);
-				break;
-			case 'I':
-				param.initrd = optarg;
-				break;
-			case 'C':
-				param.cmdline = optarg;
-				break;
-			case 'S':
-				param.ignore_section = optarg;
-				break;
-			case 'y':
-				param.stage_xip = true;
-				break;
-			case 'g':
-				param.autogen_attr = true;
-				break;
+			break;
+		case 'e':
+			param.entrypoint = strtoul(optarg, &suffix, 0);
+			if (!*optarg || (suffix && *suffix)) {
+				ERROR("Invalid entry point '%s'.\n",
+					optarg);
+				return 1;
+			}
+			break;
+		case 's':
+			param.size = strtoul(optarg, &suffix, 0);
+			if (!*optarg) {
+				ERROR("Empty size specified.\n");
+				return 1;
+			}
+			switch (tolower((int)suffix[0])) {
 			case 'k':
-				param.machine_parseable = true;
+				param.size *= 1024;
 				break;
-			case 'U':
-				param.unprocessed = true;
+			case 'm':
+				param.size *= 1024 * 1024;
 				break;
-			case LONGOPT_IBB:
-				param.ibb = true;
+			case '\0':
 				break;
-			case 'h':
-			case '?':
-				usage(argv[0]);
-				return 1;
 			default:
-				break;
+				ERROR("Invalid suffix for size '%s'.\n",
+					optarg);
+				return 1;
 			}
-		}
-
-		if (commands[i].function == cbfs_create) {
-			if (param.fmap) {
-				struct buffer flashmap;
-				if (buffer_from_file(&flashmap, param.fmap))
-					return 1;
-				param.image_file = partitioned_file_create(
-							image_name, &flashmap);
-				buffer_delete(&flashmap);
-			} else if (param.size) {
-				param.image_file = partitioned_file_create_flat(
-							image_name, param.size);
-			} else {
-				ERROR("You need to specify a valid -M/--flashmap or -s/--size.\n");
+			break;
+		case 'B':
+			param.bootblock = optarg;
+			break;
+		case 'H':
+			param.headeroffset = strtoul(
+					optarg, &suffix, 0);
+			if (!*optarg || (suffix && *suffix)) {
+				ERROR("Invalid header offset '%s'.\n",
+					optarg);
 				return 1;
 			}
-		} else {
-			bool write_access = commands[i].modifies_region;
+			param.headeroffset_assigned = 1;
+			break;
+		case 'a':
+			param.alignment = strtoul(optarg, &suffix, 0);
+			if (!*optarg || (suffix && *suffix)) {
+				ERROR("Invalid alignment '%s'.\n",
+					optarg);
+				return 1;
+			}
+			break;
+		case 'p':
+			param.padding = strtoul(optarg, &suffix, 0);
+			if (!*optarg || (suffix && *suffix)) {
+				ERROR("Invalid pad size '%s'.\n",
+					optarg);
+				return 1;
+			}
+			break;
+		case 'P':
+			param.pagesize = strtoul(optarg, &suffix, 0);
+			if (!*optarg || (suffix && *suffix)) {
+				ERROR("Invalid page size '%s'.\n",
+					optarg);
+				return 1;
+			}
+			break;
+		case 'o':
+			param.cbfsoffset = strtoul(optarg, &suffix, 0);
+			if (!*optarg || (suffix && *suffix)) {
+				ERROR("Invalid cbfs offset '%s'.\n",
+					optarg);
+				return 1;
+			}
+			param.cbfsoffset_assigned = 1;
+			break;
+		case 'f':
+			param.filename = optarg;
+			break;
+		case 'F':
+			param.force = 1;
+			break;
+		case 'i':
+			param.u64val = strtoull(optarg, &suffix, 0);
+			param.u64val_assigned = 1;
+			if (!*optarg || (suffix && *suffix)) {
+				ERROR("Invalid int parameter '%s'.\n",
+					optarg);
+				return 1;
+			}
+			break;
+		case 'u':
+			param.fill_partial_upward = true;
+			break;
+		case 'd':
+			param.fill_partial_downward = true;
+			break;
+		case 'w':
+			param.show_immutable = true;
+			break;
+		case 'j':
+			param.topswap_size = strtol(optarg, NULL, 0);
+			if (!is_valid_topswap())
+				return 1;
+			break;
+		case 'q':
+			param.ucode_region = optarg;
+			break;
+		case 'v':
+			verbose++;
+			break;
+		case 'm':
+			param.arch = string_to_arch(optarg);
+			break;
+		case 'I':
+			param.initrd = optarg;
+			break;
+		case 'C':
+			param.cmdline = optarg;
+			break;
+		case 'S':
+			param.ignore_section = optarg;
+			break;
+		case 'y':
+			param.stage_xip = true;
+			break;
+		case 'g':
+			param.autogen_attr = true;
+			break;
+		case 'k':
+			param.machine_parseable = true;
+			break;
+		case 'U':
+			param.unprocessed = true;
+			break;
+		case LONGOPT_IBB:
+			param.ibb = true;
+			break;
+		case LONGOPT_PACK:
+			if (!strcmp(optarg, "keep"))
+				param.pack = PACK_KEEP;
+			else if (!strcmp(optarg, "size"))
+				param.pack = PACK_SIZE;
+			else if (!strcmp(optarg, "boot"))
+				param.pack = PACK_BOOT;
+			else {
+				ERROR("Unknown packing strategy '%s'.\n",
+					optarg);
+				return 1;
+			}
+			break;
+		case 'h':
+		case '?':
+			usage(argv[0]);
+			return 1;
+		default:
+			break;
+		}
+	}
+
+	return 0;
+}
 
-			param.image_file =
-				partitioned_file_reopen(image_name,
-							write_access);
+static const struct command *find_command(const char *name)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(commands); i++) {
+		if (strcmp(name, commands[i].name) == 0)
+			return &commands[i];
+	}
+	return NULL;
+}
+
+// While a batch runs, the regions its commands modified are only written
+// back once all of them succeeded.
+struct batch_region {
+	struct buffer buffer;
+	char *name;
+};
+
+static struct {
+	bool running;
+	struct batch_region *regions;
+	size_t num_regions;
+} batch;
+
+static bool write_back_region(const struct buffer *region, const char *name)
+{
+	if (!batch.running)
+		return partitioned_file_write_region(param.image_file, region);
+
+	for (size_t i = 0; i < batch.num_regions; i++) {
+		if (batch.regions[i].buffer.offset == region->offset &&
+				batch.regions[i].buffer.size == region->size)
+			return true;
+	}
+	struct batch_region *regions = realloc(batch.regions,
+			(batch.num_regions + 1) * sizeof(*regions));
+	if (!regions) {
+		ERROR("Out of memory\n");
+		return false;
+	}
+	batch.regions = regions;
+	regions[batch.num_regions].buffer = *region;
+	regions[batch.num_regions].name = strdup(name);
+	if (!regions[batch.num_regions].name) {
+		ERROR("Out of memory\n");
+		return false;
+	}
+	++batch.num_regions;
+	return true;
+}
+
+static int run_command(const struct command *command)
+{
+	unsigned num_regions = 1;
+	for (const char *list = strchr(param.region_name, ','); list;
+					list = strchr(list + 1, ','))
+		++num_regions;
+
+	// If the action needs to read an image region, as indicated by
+	// having accesses_region set in its command struct, that
+	// region's buffer struct will be stored here and the client
+	// will receive a pointer to it via param.image_region. It
+	// need not write the buffer back to the image file itself,
+	// since this behavior can be requested via its modifies_region
+	// field. Additionally, it should never free the region buffer,
+	// as that is performed automatically once it completes.
+	struct buffer image_regions[num_regions];
+	const char *region_names[num_regions];
+	memset(image_regions, 0, sizeof(image_regions));
+
+	bool seen_primary_cbfs = false;
+	char region_name_scratch[strlen(param.region_name) + 1];
+	strcpy(region_name_scratch, param.region_name);
+	param.region_name = strtok(region_name_scratch, ",");
+	for (unsigned region = 0; region < num_regions; ++region) {
+		if (!param.region_name) {
+			ERROR("Encountered illegal degenerate region name in -r list\n");
+			ERROR("The image will be left unmodified.\n");
+			return 1;
 		}
-		if (!param.image_file)
+
+		if (strcmp(param.region_name, SECTION_NAME_PRIMARY_CBFS)
+								== 0)
+			seen_primary_cbfs = true;
+
+		region_names[region] = param.region_name;
+		param.image_region = image_regions + region;
+		if (dispatch_command(*command))
 			return 1;
 
-		unsigned num_regions = 1;
-		for (const char *list = strchr(param.region_name, ','); list;
-						list = strchr(list + 1, ','))
-			++num_regions;
-
-		// If the action needs to read an image region, as indicated by
-		// having accesses_region set in its command struct, that
-		// region's buffer struct will be stored here and the client
-		// will receive a pointer to it via param.image_region. It
-		// need not write the buffer back to the image file itself,
-		// since this behavior can be requested via its modifies_region
-		// field. Additionally, it should never free the region buffer,
-		// as that is performed automatically once it completes.
-		struct buffer image_regions[num_regions];
-		memset(image_regions, 0, sizeof(image_regions));
-
-		bool seen_primary_cbfs = false;
-		char region_name_scratch[strlen(param.region_name) + 1];
-		strcpy(region_name_scratch, param.region_name);
-		param.region_name = strtok(region_name_scratch, ",");
+		param.region_name = strtok(NULL, ",");
+	}
+
+	if (command->function == cbfs_create && !seen_primary_cbfs) {
+		ERROR("The creation -r list must include the mandatory '%s' section.\n",
+					SECTION_NAME_PRIMARY_CBFS);
+		ERROR("The image will be left unmodified.\n");
+		return 1;
+	}
+
+	if (command->modifies_region) {
+		assert(param.image_file);
 		for (unsigned region = 0; region < num_regions; ++region) {
-			if (!param.region_name) {
-				ERROR("Encountered illegal degenerate region name in -r list\n");
-				ERROR("The image will be left unmodified.\n");
-				partitioned_file_close(param.image_file);
+			if (!write_back_region(image_regions + region,
+							region_names[region]))
 				return 1;
-			}
+		}
+	}
+
+	return 0;
+}
+
+#define BATCH_MAX_ARGS 64
+
+// Split a line of a batch file into arguments at whitespace. Quotes group
+// words, and a '#' at the start of an argument comments out the rest of the
+// line. Returns the number of arguments, or -1 if the line is malformed.
+static int split_batch_line(char *line, char **args, int max_args)
+{
+	char *in = line, *out = line;
+	int count = 0;
+
+	while (true) {
+		while (isspace((unsigned char)*in))
+			++in;
+		if (*in == '\0' || *in == '#')
+			return count;
+		if (count == max_args - 1)
+			return -1;
 
-			if (strcmp(param.region_name, SECTION_NAME_PRIMARY_CBFS)
-									== 0)
-				seen_primary_cbfs = true;
+		char quote = '\0';
+		args[count++] = out;
+		for (; *in && (quote || !isspace((unsigned char)*in)); ++in) {
+			if (quote && *in == quote)
+				quote = '\0';
+			else if (!quote && (*in == '"' || *in == '\''))
+				quote = *in;
+			else
+				*out++ = *in;
+		}
+		if (quote)
+			return -1;
+		if (*in)
+			++in;
+		*out++ = '\0';
+		args[count] = NULL;
+	}
+}
+
+struct batch_line {
+	char *text;		// args point into it
+	char *args[BATCH_MAX_ARGS];
+	int argc;
+	unsigned number;
+	const struct command *command;
+	// Where the file it adds may go, for packing.
+	enum {
+		PACK_GROUP_FIXED,	// at a base address
+		PACK_GROUP_HOT,		// on the boot path
+		PACK_GROUP_ALIGNED,	// aligned or kept within a page
+		PACK_GROUP_OTHER,
+	} group;
+	uint32_t align;
+	size_t size;
+};
+
+static bool is_packable(const struct command *command)
+{
+	return command->function == cbfs_add ||
+		command->function == cbfs_add_stage ||
+		command->function == cbfs_add_payload ||
+		command->function == cbfs_add_flat_binary ||
+		command->function == cbfs_add_integer;
+}
+
+// Sort the files a batch adds by their placement constraints. The files with
+// a base address go first, so nothing else takes their place, then the ones
+// that need to be aligned, largest alignment first, then the rest, largest
+// first. Each file goes into the first hole that fits it, so the small ones
+// end up in the gaps alignment left in front of the large ones. This is the
+// first-fit decreasing heuristic, not an exact solution, which would have to
+// try every order. With PACK_BOOT, stages, payloads and FSPs go right after
+// the files at a base address, in the order given, so the boot path reads
+// them from one contiguous stretch of flash.
+static int compare_batch_lines(const void *a, const void *b)
+{
+	const struct batch_line *x = a, *y = b;
+
+	if (x->group != y->group)
+		return x->group < y->group ? -1 : 1;
+	if (x->group == PACK_GROUP_ALIGNED && x->align != y->align)
+		return x->align > y->align ? -1 : 1;
+	if (x->group >= PACK_GROUP_ALIGNED && x->size != y->size)
+		return x->size > y->size ? -1 : 1;
+	return x->number < y->number ? -1 : 1;
+}
+
+static int classify_batch_line(struct batch_line *line,
+			const struct param *defaults, enum pack_strategy pack)
+{
+	int (*function)(void) = line->command->function;
+	struct stat st;
+
+	param = *defaults;
+	optind = 0;
+	if (parse_arguments(line->command, line->argc, line->args))
+		return 1;
+
+	line->align = param.alignment;
+	if (function == cbfs_add && param.type == CBFS_COMPONENT_FSP &&
+						!param.baseaddress_assigned)
+		line->align = MAX(line->align, 4 * KiB);
+	if (param.stage_xip)
+		line->align = MAX(line->align, param.pagesize);
+
+	if (param.baseaddress_assigned)
+		line->group = PACK_GROUP_FIXED;
+	else if (pack == PACK_BOOT && function != cbfs_add_integer &&
+			(function != cbfs_add ||
+				param.type == CBFS_COMPONENT_FSP))
+		line->group = PACK_GROUP_HOT;
+	else if (line->align || param.stage_xip)
+		line->group = PACK_GROUP_ALIGNED;
+	else
+		line->group = PACK_GROUP_OTHER;
+
+	if (function == cbfs_add_integer)
+		line->size = sizeof(uint64_t);
+	else if (param.filename && stat(param.filename, &st) == 0)
+		line->size = st.st_size;
+	else
+		line->size = 0;
+	return 0;
+}
 
-			param.image_region = image_regions + region;
-			if (dispatch_command(commands[i])) {
-				partitioned_file_close(param.image_file);
+// Reorder each run of commands that add files, leaving every other command
+// where it is.
+static int pack_batch(struct batch_line *lines, size_t count,
+			const struct param *defaults, enum pack_strategy pack,
+			const char *script_name)
+{
+	int default_verbose = verbose;
+	size_t start = 0;
+
+	for (size_t i = 0; i <= count; i++) {
+		if (i < count && is_packable(lines[i].command)) {
+			if (classify_batch_line(&lines[i], defaults, pack)) {
+				ERROR("%s:%u: '%s' failed\n", script_name,
+					lines[i].number, lines[i].args[0]);
 				return 1;
 			}
+			verbose = default_verbose;
+			continue;
+		}
+		qsort(lines + start, i - start, sizeof(*lines),
+							compare_batch_lines);
+		start = i + 1;
+	}
+	return 0;
+}
 
-			param.region_name = strtok(NULL, ",");
+static void report_batch_usage(void)
+{
+	for (size_t i = 0; i < batch.num_regions; i++) {
+		struct buffer *region = &batch.regions[i].buffer;
+		struct cbfs_image image;
+		struct cbfs_usage usage;
+
+		// Skip raw regions; legacy images only have the one CBFS.
+		if (!buffer_check_magic(region, CBFS_FILE_MAGIC,
+						strlen(CBFS_FILE_MAGIC)) &&
+				(partitioned_file_is_partitioned(param.image_file)
+				|| strcmp(batch.regions[i].name,
+					SECTION_NAME_PRIMARY_CBFS) != 0))
+			continue;
+		if (cbfs_image_from_buffer(&image, region, param.headeroffset) ||
+				cbfs_get_usage(&image, &usage))
+			continue;
+
+		printf("%s: %zu files in %zu bytes, %zu bytes free, "
+			"%zu bytes wasted (%zu in %zu holes, %zu of padding)\n",
+			batch.regions[i].name, usage.files, usage.used,
+			usage.largest_free, usage.hole_bytes + usage.padding,
+			usage.hole_bytes, usage.holes, usage.padding);
+	}
+}
+
+static int cbfs_batch(void)
+{
+	if (!param.filename) {
+		ERROR("You need to specify -f/--filename.\n");
+		return 1;
+	}
+
+	FILE *script = strcmp(param.filename, "-") ?
+					fopen(param.filename, "r") : stdin;
+	if (!script) {
+		perror(param.filename);
+		return 1;
+	}
+
+	// Every command starts out with the defaults, not with what the one
+	// before it was given.
+	struct param defaults = param;
+	const char *script_name = param.filename;
+	enum pack_strategy pack = param.pack;
+	int default_verbose = verbose;
+	struct batch_line *lines = NULL;
+	size_t count = 0;
+	char text[4096];
+	unsigned line_number = 0;
+	int ret = 1;
+
+	defaults.filename = NULL;
+	defaults.pack = PACK_OFF;
+	// Read the whole script first, so it can be reordered.
+	while (fgets(text, sizeof(text), script)) {
+		size_t len = strlen(text);
+		struct batch_line line = { .number = ++line_number };
+
+		if (len && text[len - 1] == '\n')
+			text[len - 1] = '\0';
+		else if (!feof(script)) {
+			ERROR("%s:%u: Line too long\n", script_name,
+								line_number);
+			goto out;
 		}
 
-		if (commands[i].function == cbfs_create && !seen_primary_cbfs) {
-			ERROR("The creation -r list must include the mandatory '%s' section.\n",
-						SECTION_NAME_PRIMARY_CBFS);
-			ERROR("The image will be left unmodified.\n");
-			partitioned_file_close(param.image_file);
-			return 1;
+		line.text = strdup(text);
+		if (!line.text) {
+			ERROR("Out of memory\n");
+			goto out;
+		}
+		line.argc = split_batch_line(line.text, line.args,
+							ARRAY_SIZE(line.args));
+		if (line.argc <= 0) {
+			free(line.text);
+			if (line.argc == 0)
+				continue;
+			ERROR("%s:%u: Unbalanced quotes or too many arguments\n",
+						script_name, line_number);
+			goto out;
 		}
 
-		if (commands[i].modifies_region) {
-			assert(param.image_file);
-			for (unsigned region = 0; region < num_regions;
-								++region) {
-
-				if (!partitioned_file_write_region(
-							param.image_file,
-						image_regions + region)) {
-					partitioned_file_close(
-							param.image_file);
-					return 1;
-				}
-			}
+		line.command = find_command(line.args[0]);
+		if (!line.command) {
+			ERROR("%s:%u: Unknown command '%s'\n", script_name,
+						line_number, line.args[0]);
+			free(line.text);
+			goto out;
+		}
+		if (line.command->function == cbfs_create ||
+				line.command->function == cbfs_batch) {
+			ERROR("%s:%u: '%s' can't be used in a batch\n",
+				script_name, line_number, line.args[0]);
+			free(line.text);
+			goto out;
 		}
 
-		partitioned_file_close(param.image_file);
-		return 0;
+		struct batch_line *more = realloc(lines,
+						(count + 1) * sizeof(*lines));
+		if (!more) {
+			ERROR("Out of memory\n");
+			free(line.text);
+			goto out;
+		}
+		lines = more;
+		lines[count++] = line;
+	}
+	if (ferror(script)) {
+		ERROR("Failed to read %s\n", script_name);
+		goto out;
+	}
+
+	if (pack >= PACK_SIZE &&
+		pack_batch(lines, count, &defaults, pack, script_name))
+		goto out;
+
+	batch.running = true;
+	for (size_t i = 0; i < count; i++) {
+		param = defaults;
+		verbose = default_verbose;
+		// Make getopt start over.
+		optind = 0;
+		if (parse_arguments(lines[i].command, lines[i].argc,
+							lines[i].args) ||
+					run_command(lines[i].command)) {
+			ERROR("%s:%u: '%s' failed\n", script_name,
+					lines[i].number, lines[i].args[0]);
+			goto out;
+		}
 	}
 
-	ERROR("Unknown command '%s'.\n", cmd);
-	usage(argv[0]);
-	return 1;
+	batch.running = false;
+	for (size_t i = 0; i < batch.num_regions; i++) {
+		if (!partitioned_file_write_region(param.image_file,
+						&batch.regions[i].buffer))
+			goto out;
+	}
+	if (pack != PACK_OFF)
+		report_batch_usage();
+	ret = 0;
+
+out:
+	if (ret)
+		ERROR("The image will be left unmodified.\n");
+	batch.running = false;
+	for (size_t i = 0; i < batch.num_regions; i++)
+		free(batch.regions[i].name);
+	free(batch.regions);
+	batch.regions = NULL;
+	batch.num_regions = 0;
+	for (size_t i = 0; i < count; i++)
+		free(lines[i].text);
+	free(lines);
+	if (script != stdin)
+		fclose(script);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 3) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	char *image_name = argv[1];
+	char *cmd = argv[2];
+	optind += 2;
+
+	const struct command *command = find_command(cmd);
+	if (!command) {
+		ERROR("Unknown command '%s'.\n", cmd);
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (parse_arguments(command, argc, argv))
+		return 1;
+
+	if (command->function == cbfs_create) {
+		if (param.fmap) {
+			struct buffer flashmap;
+			if (buffer_from_file(&flashmap, param.fmap))
+				return 1;
+			param.image_file = partitioned_file_create(
+						image_name, &flashmap);
+			buffer_delete(&flashmap);
+		} else if (param.size) {
+			param.image_file = partitioned_file_create_flat(
+						image_name, param.size);
+		} else {
+			ERROR("You need to specify a valid -M/--flashmap or -s/--size.\n");
+			return 1;
+		}
+	} else {
+		bool write_access = command->modifies_region;
+
+		param.image_file =
+			partitioned_file_reopen(image_name,
+						write_access);
+	}
+	if (!param.image_file)
+		return 1;
+
+	int ret;
+	if (command->function == cbfs_batch)
+		ret = cbfs_batch();
+	else
+		ret = run_command(command);
+
+	partitioned_file_close(param.image_file);
+	conversion_cache_print_stats();
+	return ret;
 }
@@ -0,0 +1,314 @@
+/*
+ * conversion_cache.c, reuse converted components across cbfstool runs
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "conversion_cache.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <fcntl.h>
+#include <io.h>
+/* Windows' mkdir() takes no mode. */
+#define mkdir(path, mode) _mkdir(path)
+#define SELF_EXE _pgmptr
+#else
+#define SELF_EXE "/proc/self/exe"
+#endif
+
+/* Bump this when the format of the entries changes. */
+#define CACHE_ENTRY_MAGIC	0x31434343	/* "CCC1" */
+
+struct cache_entry {
+	uint32_t magic;
+	uint32_t type;			/* as in the cbfs_file header */
+	uint32_t offset;
+	uint32_t attributes_size;
+	uint32_t data_size;
+};
+
+static struct {
+	bool checked;
+	const char *dir;
+	/* Identifies this build of cbfstool. */
+	uint8_t version[VB2_SHA256_DIGEST_SIZE];
+	unsigned hits;
+	unsigned misses;
+	size_t bytes_reused;
+} cache;
+
+/* Like mkstemp(), which Windows doesn't have. */
+static int create_temp_file(char *template)
+{
+#ifdef _WIN32
+	if (_mktemp_s(template, strlen(template) + 1))
+		return -1;
+	return open(template, O_WRONLY | O_CREAT | O_EXCL | O_BINARY, 0666);
+#else
+	return mkstemp(template);
+#endif
+}
+
+static int hash_file(const char *filename, uint8_t *digest, size_t size)
+{
+	struct vb2_digest_context ctx;
+	uint8_t chunk[64 * KiB];
+	size_t len;
+	FILE *fp = fopen(filename, "rb");
+
+	if (!fp)
+		return -1;
+	vb2_digest_init(&ctx, VB2_HASH_SHA256);
+	while ((len = fread(chunk, 1, sizeof(chunk), fp)) > 0)
+		vb2_digest_extend(&ctx, chunk, len);
+	if (ferror(fp)) {
+		fclose(fp);
+		return -1;
+	}
+	fclose(fp);
+	vb2_digest_finalize(&ctx, digest, size);
+	return 0;
+}
+
+bool conversion_cache_enabled(void)
+{
+	if (cache.checked)
+		return cache.dir != NULL;
+	cache.checked = true;
+
+	const char *dir = getenv(CONVERSION_CACHE_ENV);
+	if (!dir || !*dir)
+		return false;
+
+	/* There is no version number that changes with every change to
+	 * cbfstool or the libraries it uses, so use the executable itself. */
+	if (hash_file(SELF_EXE, cache.version, sizeof(cache.version))) {
+		WARN("%s is set, but cbfstool can't read its executable to tell "
+		     "its version. Not using the cache.\n",
+		     CONVERSION_CACHE_ENV);
+		return false;
+	}
+	if (mkdir(dir, 0777) && errno != EEXIST) {
+		WARN("Can't create %s: %s. Not using the cache.\n", dir,
+		     strerror(errno));
+		return false;
+	}
+	cache.dir = dir;
+	return true;
+}
+
+void conversion_cache_key_init(struct conversion_cache_key *key,
+			       const char *name)
+{
+	uint32_t magic = CACHE_ENTRY_MAGIC;
+
+	vb2_digest_init(&key->ctx, VB2_HASH_SHA256);
+	conversion_cache_key_add(key, &magic, sizeof(magic));
+	conversion_cache_key_add(key, cache.version, sizeof(cache.version));
+	conversion_cache_key_add_string(key, name);
+}
+
+void conversion_cache_key_add(struct conversion_cache_key *key,
+			      const void *data, size_t size)
+{
+	vb2_digest_extend(&key->ctx, data, size);
+}
+
+void conversion_cache_key_add_string(struct conversion_cache_key *key,
+				     const char *str)
+{
+	/* Tell NULL from "" apart, and "ab", "c" from "a", "bc". */
+	uint8_t present = str != NULL;
+
+	conversion_cache_key_add(key, &present, sizeof(present));
+	if (str)
+		conversion_cache_key_add(key, str, strlen(str) + 1);
+}
+
+int conversion_cache_key_add_file(struct conversion_cache_key *key,
+				  const char *filename)
+{
+	uint8_t digest[VB2_SHA256_DIGEST_SIZE];
+
+	if (hash_file(filename, digest, sizeof(digest)))
+		return -1;
+	conversion_cache_key_add(key, digest, sizeof(digest));
+	return 0;
+}
+
+/* The entry for digest goes to DIR/xx/yyyy..., with the digest in hex. The
+ * subdirectory is only created when create is set. */
+static char *entry_path(const uint8_t *digest, bool create)
+{
+	size_t dir_len = strlen(cache.dir);
+	char *path = malloc(dir_len + 2 * VB2_SHA256_DIGEST_SIZE + 3);
+
+	if (!path)
+		return NULL;
+	strcpy(path, cache.dir);
+	sprintf(path + dir_len, "/%02x", digest[0]);
+	if (create && mkdir(path, 0777) && errno != EEXIST) {
+		free(path);
+		return NULL;
+	}
+	path[dir_len + 3] = '/';
+	for (size_t i = 1; i < VB2_SHA256_DIGEST_SIZE; i++)
+		sprintf(path + dir_len + 2 + 2 * i, "%02x", digest[i]);
+	return path;
+}
+
+static bool read_entry(FILE *fp, struct buffer *buffer, uint32_t *offset,
+		       struct cbfs_file *header)
+{
+	struct cache_entry entry;
+	struct stat st;
+	uint32_t header_size = ntohl(header->offset);
+	struct buffer data;
+
+	if (fread(&entry, sizeof(entry), 1, fp) != 1 ||
+	    entry.magic != CACHE_ENTRY_MAGIC ||
+	    fstat(fileno(fp), &st) ||
+	    (uint64_t)st.st_size != sizeof(entry) +
+				(uint64_t)entry.attributes_size +
+				entry.data_size ||
+	    entry.attributes_size > MAX_CBFS_FILE_HEADER_BUFFER - header_size)
+		return false;
+
+	if (buffer_create(&data, entry.data_size, buffer->name))
+		return false;
+	/* Attributes go where cbfs_add_file_attr() would have put them on the
+	 * fresh header the converter was given. */
+	if (fread((uint8_t *)header + header_size, 1, entry.attributes_size,
+		  fp) != entry.attributes_size ||
+	    fread(buffer_get(&data), 1, entry.data_size, fp) !=
+							entry.data_size) {
+		buffer_delete(&data);
+		return false;
+	}
+
+	if (entry.attributes_size) {
+		header->attributes_offset = header->offset;
+		header->offset = htonl(header_size + entry.attributes_size);
+	}
+	header->type = entry.type;
+	header->len = htonl(entry.data_size);
+	*offset = entry.offset;
+	buffer_delete(buffer);
+	*buffer = data;
+	return true;
+}
+
+bool conversion_cache_lookup(struct conversion_cache_key *key,
+			     struct buffer *buffer, uint32_t *offset,
+			     struct cbfs_file *header)
+{
+	bool hit = false;
+
+	vb2_digest_finalize(&key->ctx, key->digest, sizeof(key->digest));
+
+	char *path = entry_path(key->digest, false);
+	if (!path)
+		return false;
+	FILE *fp = fopen(path, "rb");
+	if (fp) {
+		hit = read_entry(fp, buffer, offset, header);
+		fclose(fp);
+	}
+	DEBUG("Conversion cache %s: %s\n", hit ? "hit" : "miss", path);
+	free(path);
+
+	if (hit) {
+		cache.hits++;
+		cache.bytes_reused += buffer_size(buffer);
+	} else {
+		cache.misses++;
+	}
+	return hit;
+}
+
+void conversion_cache_store(const struct conversion_cache_key *key,
+			    const struct buffer *buffer, uint32_t offset,
+			    const struct cbfs_file *header)
+{
+	struct cache_entry entry = {
+		.magic = CACHE_ENTRY_MAGIC,
+		.type = header->type,
+		.offset = offset,
+		.data_size = buffer_size(buffer),
+	};
+	const uint8_t *attributes = NULL;
+
+	if (header->attributes_offset) {
+		attributes = (const uint8_t *)header +
+					ntohl(header->attributes_offset);
+		entry.attributes_size = ntohl(header->offset) -
+					ntohl(header->attributes_offset);
+	}
+
+	char *path = entry_path(key->digest, true);
+	if (!path) {
+		WARN("Can't create a conversion cache entry in %s.\n",
+		     cache.dir);
+		return;
+	}
+
+	/* Write to a temporary file and rename it, so that nobody reads an
+	 * entry that is only half written. */
+	char tmp[strlen(path) + sizeof(".XXXXXX")];
+	sprintf(tmp, "%s.XXXXXX", path);
+	int fd = create_temp_file(tmp);
+	FILE *fp = fd >= 0 ? fdopen(fd, "wb") : NULL;
+	bool ok = fp &&
+		fwrite(&entry, sizeof(entry), 1, fp) == 1 &&
+		fwrite(attributes, 1, entry.attributes_size, fp) ==
+						entry.attributes_size &&
+		fwrite(buffer_get(buffer), 1, entry.data_size, fp) ==
+						entry.data_size;
+	if (fp) {
+		if (fclose(fp))
+			ok = false;
+	} else if (fd >= 0) {
+		close(fd);
+	}
+	if (ok && rename(tmp, path)) {
+#ifdef _WIN32
+		/* Windows' rename() doesn't replace files. An entry another
+		 * cbfstool stored in the meantime is just as good. */
+		if (errno == EEXIST) {
+			unlink(tmp);
+			free(path);
+			return;
+		}
+#endif
+		ok = false;
+	}
+	if (!ok) {
+		WARN("Can't write conversion cache entry %s.\n", path);
+		if (fd >= 0)
+			unlink(tmp);
+	}
+	free(path);
+}
+
+void conversion_cache_print_stats(void)
+{
+	if (!cache.hits && !cache.misses)
+		return;
+	INFO("Conversion cache: %u hits, %u misses, %zu bytes reused\n",
+	     cache.hits, cache.misses, cache.bytes_reused);
+}
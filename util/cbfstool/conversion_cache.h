@@ -0,0 +1,80 @@
+/*
+ * conversion_cache.h, reuse converted components across cbfstool runs
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef CONVERSION_CACHE_H_
+#define CONVERSION_CACHE_H_
+
+#include "common.h"
+#include "cbfs.h"
+
+#include <vb2_sha.h>
+
+/*
+ * Turning an ELF into a stage or payload, or relocating an FSP, and then
+ * compressing the result gives the same bytes every time for the same input
+ * and options. When the environment variable CBFSTOOL_CACHE names a
+ * directory, converted components are stored there under a hash of
+ * everything that went into them, and later runs use them instead of
+ * converting again.
+ *
+ * The caller puts the converter's name, the options it reads and its input
+ * into the key. The cbfstool executable itself is always part of it, so a
+ * rebuilt cbfstool starts over. Entries are written atomically, the
+ * directory can be shared by parallel builds and deleted at any time.
+ */
+
+#define CONVERSION_CACHE_ENV	"CBFSTOOL_CACHE"
+
+struct conversion_cache_key {
+	struct vb2_digest_context ctx;
+	uint8_t digest[VB2_SHA256_DIGEST_SIZE];
+};
+
+/* Returns whether CBFSTOOL_CACHE is set and the cache can be used. */
+bool conversion_cache_enabled(void);
+
+/* Starts a key for the converter called name. */
+void conversion_cache_key_init(struct conversion_cache_key *key,
+			       const char *name);
+
+void conversion_cache_key_add(struct conversion_cache_key *key,
+			      const void *data, size_t size);
+
+/* Adds a string, which may be NULL. */
+void conversion_cache_key_add_string(struct conversion_cache_key *key,
+				     const char *str);
+
+/* Adds the contents of a file. Returns 0 on success, otherwise non-zero. */
+int conversion_cache_key_add_file(struct conversion_cache_key *key,
+				  const char *filename);
+
+/*
+ * Looks up the conversion described by key, which is finished by this and
+ * can't be added to anymore. On a hit, the input in buffer is replaced by the
+ * converted data, and the attributes, type, length and offset the converter
+ * set on the freshly created header and offset are applied again.
+ * Returns true on a hit.
+ */
+bool conversion_cache_lookup(struct conversion_cache_key *key,
+			     struct buffer *buffer, uint32_t *offset,
+			     struct cbfs_file *header);
+
+/* Stores the result of a conversion that missed the cache. */
+void conversion_cache_store(const struct conversion_cache_key *key,
+			    const struct buffer *buffer, uint32_t offset,
+			    const struct cbfs_file *header);
+
+/* Prints how many lookups hit, if there were any, in verbose mode. */
+void conversion_cache_print_stats(void);
+
+#endif
@@ -21,10 +21,24 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 struct partitioned_file {
 	struct fmap *fmap;
 	struct buffer buffer;
 	FILE *stream;
+	/*
+	 * Set if buffer is a private (copy-on-write) mapping of the file
+	 * rather than a copy of it. Only the pages a command touches are then
+	 * read, and for a file opened for writing, original is a shared
+	 * mapping that tells which pages need writing back.
+	 */
+	bool mapped;
+	char *original;
 };
 
 static bool fill_ones_through(struct partitioned_file *file)
@@ -49,6 +63,62 @@ static unsigned count_selected_fmap_entries(const struct fmap *fmap,
 	return count;
 }
 
+#ifndef _WIN32
+static bool map_flat_file(struct partitioned_file *file, const char *filename,
+							bool write_access)
+{
+	assert(file);
+	assert(file->stream);
+
+	int fd = fileno(file->stream);
+	struct stat st;
+	if (fstat(fd, &st) || !S_ISREG(st.st_mode) || st.st_size <= 0)
+		return false;
+
+	void *data = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE,
+							MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED)
+		return false;
+
+	if (write_access) {
+		void *original = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED,
+									fd, 0);
+		if (original == MAP_FAILED) {
+			munmap(data, st.st_size);
+			return false;
+		}
+		file->original = original;
+	}
+
+	buffer_init(&file->buffer, strdup(filename), data, st.st_size);
+	file->mapped = true;
+	return true;
+}
+
+static void unmap_flat_file(struct partitioned_file *file)
+{
+	assert(file);
+
+	munmap(file->buffer.data, file->buffer.size);
+	if (file->original)
+		munmap(file->original, file->buffer.size);
+	free(file->buffer.name);
+	memset(&file->buffer, 0, sizeof(file->buffer));
+	file->original = NULL;
+	file->mapped = false;
+}
+#else
+static bool map_flat_file(unused struct partitioned_file *file,
+			unused const char *filename, unused bool write_access)
+{
+	return false;
+}
+
+static void unmap_flat_file(unused struct partitioned_file *file)
+{
+}
+#endif
+
 static partitioned_file_t *reopen_flat_file(const char *filename,
 					    bool write_access)
 {
@@ -61,11 +131,6 @@ static partitioned_file_t *reopen_flat_file(const char *filename,
 		return NULL;
 	}
 
-	if (buffer_from_file(&file->buffer, filename)) {
-		free(file);
-		return NULL;
-	}
-
 	access_mode = write_access ?  "rb+" : "rb";
 	file->stream = fopen(filename, access_mode);
 
@@ -75,6 +140,12 @@ static partitioned_file_t *reopen_flat_file(const char *filename,
 		return NULL;
 	}
 
+	if (!map_flat_file(file, filename, write_access) &&
+				buffer_from_file(&file->buffer, filename)) {
+		partitioned_file_close(file);
+		return NULL;
+	}
+
 	return file;
 }
 
@@ -212,6 +283,64 @@ partitioned_file_t *partitioned_file_reopen(const char *filename,
 	return file;
 }
 
+static bool write_range(partitioned_file_t *file, size_t offset, size_t size)
+{
+	assert(file);
+	assert(file->stream);
+
+	if (fseek(file->stream, offset, SEEK_SET)) {
+		ERROR("Failed to seek within image file\n");
+		return false;
+	}
+	if (!fwrite(file->buffer.data + offset, size, 1, file->stream)) {
+		ERROR("Failed to write to image file\n");
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Write back the pages of the range that differ from the file. The pages
+ * nobody wrote to are still the file's own, so this only reads what is
+ * shared with the page cache anyway.
+ */
+static bool write_changed_pages(partitioned_file_t *file, size_t offset,
+								size_t size)
+{
+	assert(file);
+	assert(file->original);
+
+	const size_t page = 4096;
+	const size_t end = offset + size;
+	size_t run_start = end;
+
+	while (offset < end) {
+		size_t chunk = page - offset % page;
+		if (chunk > end - offset)
+			chunk = end - offset;
+
+		bool changed = memcmp(file->buffer.data + offset,
+					file->original + offset, chunk) != 0;
+		if (changed && run_start == end)
+			run_start = offset;
+		if (!changed && run_start != end) {
+			if (!write_range(file, run_start, offset - run_start))
+				return false;
+			run_start = end;
+		}
+		offset += chunk;
+	}
+	if (run_start != end && !write_range(file, run_start, end - run_start))
+		return false;
+
+	/* Keep the shared mapping in step for the next write-back. */
+	if (fflush(file->stream)) {
+		ERROR("Failed to write to image file\n");
+		return false;
+	}
+	return true;
+}
+
 bool partitioned_file_write_region(partitioned_file_t *file,
 						const struct buffer *buffer)
 {
@@ -229,15 +358,9 @@ bool partitioned_file_write_region(partitioned_file_t *file,
 		return false;
 	}
 
-	if (fseek(file->stream, buffer->offset, SEEK_SET)) {
-		ERROR("Failed to seek within image file\n");
-		return false;
-	}
-	if (!fwrite(buffer->data, buffer->size, 1, file->stream)) {
-		ERROR("Failed to write to image file\n");
-		return false;
-	}
-	return true;
+	if (file->original)
+		return write_changed_pages(file, buffer->offset, buffer->size);
+	return write_range(file, buffer->offset, buffer->size);
 }
 
 bool partitioned_file_read_region(struct buffer *dest,
@@ -278,7 +401,10 @@ void partitioned_file_close(partitioned_file_t *file)
 		return;
 
 	file->fmap = NULL;
-	buffer_delete(&file->buffer);
+	if (file->mapped)
+		unmap_flat_file(file);
+	else
+		buffer_delete(&file->buffer);
 	if (file->stream) {
 		fclose(file->stream);
 		file->stream = NULL;
@@ -67,6 +67,9 @@ partitioned_file_t *partitioned_file_create(const char *filename,
  * contents. If the image contains an FMAP, it will be opened as a
  * full partitioned file; otherwise, it will be opened as a flat file as
  * if it had been created by partitioned_file_create_flat().
+ * Where the host supports it, the buffer is a private mapping of the file
+ * instead: only the parts that are used get read, and writing a region back
+ * only writes the pages that changed.
  * The partitioned_file_t returned from this function is separately owned by the
  * caller, and must later be passed to partitioned_file_close();
  *
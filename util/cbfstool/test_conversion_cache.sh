@@ -0,0 +1,72 @@
+#!/bin/sh
+#
+# This file is part of the coreboot project.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; version 2 of the License.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+# Checks that images built with CBFSTOOL_CACHE set are the same as images
+# built without it, also when the same input is added with different options.
+#
+# Usage: test_conversion_cache.sh <cbfstool>
+
+set -e
+
+CBFSTOOL="$1"
+HOSTCC="${HOSTCC:-cc}"
+
+if [ ! -x "$CBFSTOOL" ]; then
+	echo "usage: $0 <cbfstool>" >&2
+	exit 1
+fi
+
+TMP="$(mktemp -d)"
+trap 'rm -rf "$TMP"' EXIT
+
+cat > "$TMP/stage.c" <<EOF
+int data[3000] = { 1 };
+void _start(void) { for (;;); }
+EOF
+"$HOSTCC" -o "$TMP/stage.elf" "$TMP/stage.c" -nostdlib -static -fno-pic \
+	-Wl,-N -Wl,-Ttext=0x100000 -Wl,--build-id=none 2> /dev/null
+
+FAILED=0
+
+# Builds $TMP/<name>.rom with the stage added by "add-stage <options>".
+build()
+{
+	name="$1"
+	shift
+	rm -f "$TMP/$name.rom"
+	"$CBFSTOOL" "$TMP/$name.rom" create -m x86 -s 1M > /dev/null 2>&1
+	"$CBFSTOOL" "$TMP/$name.rom" add-stage -f "$TMP/stage.elf" -n stage \
+		"$@" > /dev/null
+}
+
+# Adds the stage with the given options without and with the cache, which
+# already holds the results of the earlier checks.
+check()
+{
+	build uncached "$@"
+	CBFSTOOL_CACHE="$TMP/cache" build cached "$@"
+	if cmp -s "$TMP/uncached.rom" "$TMP/cached.rom"; then
+		echo "PASS: add-stage $*"
+	else
+		echo "FAIL: add-stage $*"
+		FAILED=1
+	fi
+}
+
+check
+check -c lzma
+check -b 0x1000
+check -b 0x8000
+check -b 0x8000 -c lzma
+
+exit $FAILED
@@ -0,0 +1,241 @@
+/*
+ * This file is part of the coreboot project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <commonlib/binlog_serialized.h>
+
+#include "binlog.h"
+#include "stage_elf.h"
+
+/* Look up the format string at run-time address addr. */
+static const char *binlog_format(const struct binlog *log, uint32_t addr)
+{
+	const char *fmt;
+	size_t avail;
+
+	if (!stage_elf_loaded())
+		return NULL;
+
+	fmt = stage_elf_data(stage_elf_link_addr(addr, log->ramstage_base),
+			     &avail);
+	/* The string has to end inside the section. */
+	if (!fmt || !memchr(fmt, '\0', avail))
+		return NULL;
+	return fmt;
+}
+
+struct arg_reader {
+	const uint8_t *pos;
+	const uint8_t *end;
+};
+
+static int64_t next_value(struct arg_reader *args)
+{
+	uint64_t value = 0;
+	int i;
+
+	if (args->end - args->pos < 8) {
+		args->pos = args->end;
+		return 0;
+	}
+	for (i = 0; i < 8; i++)
+		value |= (uint64_t)args->pos[i] << (8 * i);
+	args->pos += 8;
+	return value;
+}
+
+static const char *next_string(struct arg_reader *args)
+{
+	const uint8_t *nul = memchr(args->pos, '\0', args->end - args->pos);
+	const char *s = (const char *)args->pos;
+
+	if (!nul) {
+		args->pos = args->end;
+		return "<corrupt>";
+	}
+	args->pos = nul + 1;
+	return s;
+}
+
+/* Print one conversion with the host's printf(), which understands the same
+ * flags, width and precision syntax as printk(). */
+static void print_conversion(FILE *out, const struct binlog *log,
+			     const char *fmt, const struct binlog_spec *spec,
+			     struct arg_reader *args)
+{
+	char host_fmt[64];
+	int width = 0, precision = 0, n;
+	const char *conv;
+
+	if (spec->prefix_len + 4 > (int)sizeof(host_fmt))
+		return;
+
+	if (spec->width_arg)
+		width = next_value(args);
+	if (spec->precision_arg) {
+		precision = next_value(args);
+		/* printk() treats a negative precision as 0. */
+		if (precision < 0)
+			precision = 0;
+	}
+
+	switch (spec->conversion) {
+	case '%':
+		fputc('%', out);
+		return;
+	case 's':
+		conv = "s";
+		break;
+	case 'c':
+		conv = "c";
+		break;
+	case 'p':
+		conv = "llx";
+		break;
+	case 'd':
+	case 'i':
+		conv = "lld";
+		break;
+	case 'u':
+		conv = "llu";
+		break;
+	case 'o':
+		conv = "llo";
+		break;
+	case 'x':
+		conv = "llx";
+		break;
+	case 'X':
+		conv = "llX";
+		break;
+	default:
+		fputc('%', out);
+		if (spec->conversion)
+			fputc(spec->conversion, out);
+		return;
+	}
+
+	/* Like printk(), %p without a width is zero padded to pointer size. */
+	if (spec->conversion == 'p' && spec->prefix_len == 1)
+		n = snprintf(host_fmt, sizeof(host_fmt), "%%0%d%s",
+			     2 * log->ptr_size, conv);
+	else
+		n = snprintf(host_fmt, sizeof(host_fmt), "%.*s%s",
+			     spec->prefix_len, fmt, conv);
+	if (n < 0 || n >= (int)sizeof(host_fmt))
+		return;
+
+#define PRINT_ARG(arg) do {						\
+	if (spec->width_arg && spec->precision_arg)			\
+		fprintf(out, host_fmt, width, precision, arg);		\
+	else if (spec->width_arg)					\
+		fprintf(out, host_fmt, width, arg);			\
+	else if (spec->precision_arg)					\
+		fprintf(out, host_fmt, precision, arg);			\
+	else								\
+		fprintf(out, host_fmt, arg);				\
+} while (0)
+
+	if (spec->conversion == 's') {
+		const char *s = next_string(args);
+		PRINT_ARG(s);
+	} else if (spec->conversion == 'c') {
+		int c = next_value(args);
+		PRINT_ARG(c);
+	} else {
+		long long value = next_value(args);
+		PRINT_ARG(value);
+	}
+#undef PRINT_ARG
+}
+
+static void print_record(FILE *out, const struct binlog *log,
+			 const struct binlog_record *rec, int timestamps)
+{
+	struct arg_reader args = {
+		.pos = rec->args,
+		.end = (const uint8_t *)rec + rec->size,
+	};
+	struct binlog_spec spec;
+	const char *fmt = binlog_format(log, rec->fmt);
+
+	if (timestamps)
+		fprintf(out, "[%" PRIu64 " us] ", log->tick_freq_mhz ?
+			rec->timestamp / log->tick_freq_mhz : rec->timestamp);
+
+	if (!fmt) {
+		fprintf(out, "<binary log: format string at 0x%08x, "
+			"level %d, %d bytes of arguments>\n", rec->fmt,
+			rec->level, (int)(args.end - args.pos));
+		return;
+	}
+
+	for (; *fmt; fmt++) {
+		if (*fmt != '%') {
+			fputc(*fmt, out);
+			continue;
+		}
+		binlog_parse_spec(fmt, &spec);
+		print_conversion(out, log, fmt, &spec, &args);
+		if (spec.len > 1)
+			fmt += spec.len - 1;
+	}
+}
+
+/* Print the records from offset start to end, returns < 0 if corrupt. */
+static int print_records(FILE *out, const struct binlog *log, uint32_t start,
+			 uint32_t end, int timestamps)
+{
+	while (start < end) {
+		const struct binlog_record *rec =
+			(const void *)&log->body[start];
+
+		if (end - start < sizeof(*rec) || rec->size < sizeof(*rec) ||
+		    rec->size % BINLOG_ALIGN || rec->size > end - start)
+			return -1;
+		print_record(out, log, rec, timestamps);
+		start += rec->size;
+	}
+	return 0;
+}
+
+void binlog_print(FILE *out, const void *buf, size_t size, int timestamps)
+{
+	const struct binlog *log = buf;
+	int ret = 0;
+
+	if (size < sizeof(*log) || log->magic != BINLOG_MAGIC ||
+	    log->size > size - sizeof(*log) || log->tail > log->size ||
+	    log->end > log->size || log->head > log->end) {
+		fprintf(stderr, "Binary log is corrupt.\n");
+		return;
+	}
+
+	if (!stage_elf_loaded())
+		fprintf(stderr, "No ramstage ELF given (-e), "
+			"binary log messages can't be formatted.\n");
+
+	if (log->flags & BINLOG_WRAPPED) {
+		fprintf(out, "*** Binary log overflowed, "
+			"oldest messages lost! ***\n");
+		ret = print_records(out, log, log->head, log->end, timestamps);
+	}
+	if (!ret)
+		ret = print_records(out, log, 0, log->tail, timestamps);
+	if (ret)
+		fprintf(stderr, "Binary log is corrupt, output truncated.\n");
+}
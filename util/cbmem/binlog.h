@@ -0,0 +1,24 @@
+/*
+ * This file is part of the coreboot project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef CBMEM_BINLOG_H
+#define CBMEM_BINLOG_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/* Format the messages in a copy of the binary log CBMEM entry. The format
+ * strings come from the ramstage ELF loaded with stage_elf_load(). */
+void binlog_print(FILE *out, const void *log, size_t size, int timestamps);
+
+#endif
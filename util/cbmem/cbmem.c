@@ -31,11 +31,16 @@
 #include <libgen.h>
 #include <assert.h>
 #include <regex.h>
+#include <commonlib/cbmem_console_serialized.h>
 #include <commonlib/cbmem_id.h>
+#include <commonlib/profile_serialized.h>
 #include <commonlib/timestamp_serialized.h>
 #include <commonlib/tcpa_log_serialized.h>
 #include <commonlib/coreboot_tables.h>
 
+#include "binlog.h"
+#include "stage_elf.h"
+
 #ifdef __OpenBSD__
 #include <sys/param.h>
 #include <sys/sysctl.h>
@@ -65,9 +70,13 @@ struct mapping {
 static int verbose = 0;
 #define debug(x...) if(verbose) printf(x)
 
-/* File handle used to access /dev/mem */
+/* File handle used to access /dev/mem, or a memory dump starting at mem_base */
 static int mem_fd;
+static unsigned long long mem_base;
+static unsigned long long mem_size;	/* of the dump, 0 for /dev/mem */
 static struct mapping lbtable_mapping;
+/* All of CBMEM, so the tables in it don't need a mapping each. */
+static struct mapping cbmem_mapping;
 
 static void die(const char *msg)
 {
@@ -109,6 +118,19 @@ static const void *map_memory(struct mapping *mapping, unsigned long long phys,
 	void *v;
 	unsigned long long page_size;
 
+	/* Hand out a piece of the CBMEM mapping when it covers the request.
+	 * virt_size stays 0 so that unmap_memory() leaves it alone. */
+	if (cbmem_mapping.virt && phys >= cbmem_mapping.phys &&
+	    phys + sz <= cbmem_mapping.phys + cbmem_mapping.size) {
+		mapping->virt = (u8 *)cbmem_mapping.virt +
+			cbmem_mapping.offset + (phys - cbmem_mapping.phys);
+		mapping->offset = 0;
+		mapping->virt_size = 0;
+		mapping->size = sz;
+		mapping->phys = phys;
+		return mapping_virt(mapping);
+	}
+
 	page_size = system_page_size();
 
 	mapping->virt = NULL;
@@ -126,8 +148,14 @@ static const void *map_memory(struct mapping *mapping, unsigned long long phys,
 			phys);
 	}
 
+	if (phys - mapping->offset < mem_base ||
+	    (mem_size && phys + sz > mem_base + mem_size)) {
+		debug("0x%llx is not in memory.\n", phys);
+		return NULL;
+	}
+
 	v = mmap(NULL, mapping->virt_size, PROT_READ, MAP_SHARED, mem_fd,
-			phys - mapping->offset);
+			phys - mapping->offset - mem_base);
 
 	if (v == MAP_FAILED) {
 		debug("Mapping failed %zuB of physical memory at 0x%llx.\n",
@@ -150,7 +178,8 @@ static int unmap_memory(struct mapping *mapping)
 	if (mapping->virt == NULL)
 		return -1;
 
-	munmap(mapping->virt, mapping->virt_size);
+	if (mapping->virt_size)
+		munmap(mapping->virt, mapping->virt_size);
 	mapping->virt = NULL;
 	mapping->offset = 0;
 	mapping->virt_size = 0;
@@ -603,19 +632,18 @@ static int compare_timestamp_entries(const void *a, const void *b)
 	return 0;
 }
 
-/* dump the timestamp table */
-static void dump_timestamps(int mach_readable)
+/* Return a copy of the timestamp table sorted by time, or NULL if there is
+ * none. */
+static struct timestamp_table *read_timestamps(void)
 {
 	const struct timestamp_table *tst_p;
 	struct timestamp_table *sorted_tst_p;
 	size_t size;
-	uint64_t prev_stamp;
-	uint64_t total_time;
 	struct mapping timestamp_mapping;
 
 	if (timestamps.tag != LB_TAG_TIMESTAMPS) {
 		fprintf(stderr, "No timestamps found in coreboot table.\n");
-		return;
+		return NULL;
 	}
 
 	size = sizeof(*tst_p);
@@ -625,8 +653,6 @@ static void dump_timestamps(int mach_readable)
 
 	timestamp_set_tick_freq(tst_p->tick_freq_mhz);
 
-	if (!mach_readable)
-		printf("%d entries total:\n\n", tst_p->num_entries);
 	size += tst_p->num_entries * sizeof(tst_p->entries[0]);
 
 	unmap_memory(&timestamp_mapping);
@@ -635,23 +661,42 @@ static void dump_timestamps(int mach_readable)
 	if (!tst_p)
 		die("Unable to map full timestamp table\n");
 
-	/* Report the base time within the table. */
-	prev_stamp = 0;
-	if (mach_readable)
-		timestamp_print_parseable_entry(0,  tst_p->base_time,
-						prev_stamp);
-	else
-		timestamp_print_entry(0,  tst_p->base_time, prev_stamp);
-	prev_stamp = tst_p->base_time;
-
 	sorted_tst_p = malloc(size);
 	if (!sorted_tst_p)
 		die("Failed to allocate memory");
 	aligned_memcpy(sorted_tst_p, tst_p, size);
 
+	unmap_memory(&timestamp_mapping);
+
 	qsort(&sorted_tst_p->entries[0], sorted_tst_p->num_entries,
 	      sizeof(struct timestamp_entry), compare_timestamp_entries);
 
+	return sorted_tst_p;
+}
+
+/* dump the timestamp table */
+static void dump_timestamps(int mach_readable)
+{
+	struct timestamp_table *sorted_tst_p;
+	uint64_t prev_stamp;
+	uint64_t total_time;
+
+	sorted_tst_p = read_timestamps();
+	if (!sorted_tst_p)
+		return;
+
+	if (!mach_readable)
+		printf("%d entries total:\n\n", sorted_tst_p->num_entries);
+
+	/* Report the base time within the table. */
+	prev_stamp = 0;
+	if (mach_readable)
+		timestamp_print_parseable_entry(0,  sorted_tst_p->base_time,
+						prev_stamp);
+	else
+		timestamp_print_entry(0,  sorted_tst_p->base_time, prev_stamp);
+	prev_stamp = sorted_tst_p->base_time;
+
 	total_time = 0;
 	for (uint32_t i = 0; i < sorted_tst_p->num_entries; i++) {
 		uint64_t stamp;
@@ -675,35 +720,46 @@ static void dump_timestamps(int mach_readable)
 		printf("\n");
 	}
 
-	unmap_memory(&timestamp_mapping);
 	free(sorted_tst_p);
 }
 
-/* dump the tcpa log table */
-static void dump_tcpa_log(void)
+/* Map the tcpa log table, returns NULL if there is none. */
+static const struct tcpa_table *map_tcpa_log(struct mapping *tcpa_mapping)
 {
 	const struct tcpa_table *tclt_p;
 	size_t size;
-	struct mapping tcpa_mapping;
 
 	if (tcpa_log.tag != LB_TAG_TCPA_LOG) {
 		fprintf(stderr, "No tcpa log found in coreboot table.\n");
-		return;
+		return NULL;
 	}
 
 	size = sizeof(*tclt_p);
-	tclt_p = map_memory(&tcpa_mapping, tcpa_log.cbmem_addr, size);
+	tclt_p = map_memory(tcpa_mapping, tcpa_log.cbmem_addr, size);
 	if (!tclt_p)
 		die("Unable to map tcpa log header\n");
 
 	size += tclt_p->num_entries * sizeof(tclt_p->entries[0]);
 
-	unmap_memory(&tcpa_mapping);
+	unmap_memory(tcpa_mapping);
 
-	tclt_p = map_memory(&tcpa_mapping, tcpa_log.cbmem_addr, size);
+	tclt_p = map_memory(tcpa_mapping, tcpa_log.cbmem_addr, size);
 	if (!tclt_p)
 		die("Unable to map full tcpa log table\n");
 
+	return tclt_p;
+}
+
+/* dump the tcpa log table */
+static void dump_tcpa_log(void)
+{
+	const struct tcpa_table *tclt_p;
+	struct mapping tcpa_mapping;
+
+	tclt_p = map_tcpa_log(&tcpa_mapping);
+	if (!tclt_p)
+		return;
+
 	printf("coreboot TCPA log:\n\n");
 
 	for (uint16_t i = 0; i < tclt_p->num_entries; i++) {
@@ -729,95 +785,505 @@ struct cbmem_console {
 #define CBMC_CURSOR_MASK ((1 << 28) - 1)
 #define CBMC_OVERFLOW (1 << 31)
 
-/* dump the cbmem console */
-static void dump_console(int one_boot_only)
+/* The console text as it sits in the ring. Text offsets count from the oldest
+ * byte, which is at body[start]. */
+struct console_text {
+	struct mapping mapping;
+	const struct cbmem_console *console;
+	size_t body_size;
+	size_t start;
+	size_t len;		/* bytes of text held */
+	size_t cursor;		/* where the next byte goes */
+	struct cbmem_console_meta *meta;
+};
+
+/* Receives the console text piece by piece. */
+typedef void (*console_out_fn)(void *arg, const char *buf, size_t len);
+
+static void console_out_stdout(__attribute__((unused)) void *arg,
+			       const char *buf, size_t len)
+{
+	fwrite(buf, 1, len, stdout);
+}
+
+static void console_out_copy(void *arg, const char *buf, size_t len)
+{
+	char **dest = arg;
+
+	memcpy(*dest, buf, len);
+	*dest += len;
+}
+
+/*
+ * Pass text[from, to) to out, read straight from the mapped ring through a
+ * small bounce buffer. The buffer keeps the reads from /dev/mem aligned.
+ */
+static void console_write(const struct console_text *t, size_t from,
+			  size_t to, console_out_fn out, void *arg)
+{
+	char buf[4096];
+
+	while (from < to) {
+		size_t pos = (t->start + from) % t->body_size;
+		size_t n = to - from;
+
+		if (n > t->body_size - pos)
+			n = t->body_size - pos;
+		if (n > sizeof(buf))
+			n = sizeof(buf);
+		aligned_memcpy(buf, t->console->body + pos, n);
+
+		/* Slight memory corruption may occur between reboots and give
+		   us a few unprintable characters like '\0'. Replace them with
+		   '?' on output. */
+		for (size_t i = 0; i < n; i++)
+			if (!isprint((u8)buf[i]) && !isspace((u8)buf[i]))
+				buf[i] = '?';
+
+		out(arg, buf, n);
+		from += n;
+	}
+}
+
+/* Console message filters, -1 means no filter. */
+static int console_max_level = -1;
+static int console_stage = -1;
+static int console_msg_times;
+
+static const char *const console_stage_names[] = {
+	[CBMEM_CONSOLE_STAGE_UNKNOWN] = "unknown",
+	[CBMEM_CONSOLE_STAGE_BOOTBLOCK] = "bootblock",
+	[CBMEM_CONSOLE_STAGE_VERSTAGE] = "verstage",
+	[CBMEM_CONSOLE_STAGE_ROMSTAGE] = "romstage",
+	[CBMEM_CONSOLE_STAGE_POSTCAR] = "postcar",
+	[CBMEM_CONSOLE_STAGE_RAMSTAGE] = "ramstage",
+	[CBMEM_CONSOLE_STAGE_SMM] = "smm",
+};
+
+static const char *console_stage_name(unsigned int stage)
+{
+	if (stage < ARRAY_SIZE(console_stage_names))
+		return console_stage_names[stage];
+	return "unknown";
+}
+
+static int parse_console_stage(const char *name)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(console_stage_names); i++)
+		if (!strcmp(name, console_stage_names[i]))
+			return i;
+	fprintf(stderr, "Unknown stage '%s'.\n", name);
+	exit(1);
+}
+
+/* Where one message's text is in the linearized console. */
+struct console_msg {
+	size_t start;
+	size_t end;
+	const struct cbmem_console_msg *meta;
+};
+
+/* Return a copy of the message metadata that follows the console body at
+ * addr, or NULL if there is none. */
+static struct cbmem_console_meta *read_console_meta(uint64_t addr)
+{
+	const struct cbmem_console_meta *meta_p;
+	struct cbmem_console_meta *meta;
+	struct mapping meta_mapping;
+	size_t size;
+
+	meta_p = map_memory(&meta_mapping, addr, sizeof(*meta_p));
+	if (!meta_p)
+		die("Unable to map console metadata.\n");
+	if (meta_p->magic != CBMEM_CONSOLE_META_MAGIC || !meta_p->count) {
+		unmap_memory(&meta_mapping);
+		return NULL;
+	}
+	size = sizeof(*meta_p) + meta_p->count * sizeof(meta_p->msgs[0]);
+	unmap_memory(&meta_mapping);
+
+	meta_p = map_memory(&meta_mapping, addr, size);
+	if (!meta_p)
+		die("Unable to map console metadata.\n");
+	meta = malloc(size);
+	if (!meta)
+		die("Not enough memory for console metadata.\n");
+	aligned_memcpy(meta, meta_p, size);
+	unmap_memory(&meta_mapping);
+	return meta;
+}
+
+/*
+ * Find the messages that are still in the text, which holds the last `held`
+ * bytes of a body of body_size bytes with the given cursor. Returns the
+ * number of messages, in the order they were logged.
+ */
+static size_t console_messages(const struct cbmem_console_meta *meta,
+			       size_t held, size_t body_size, size_t cursor,
+			       struct console_msg **msgs_out)
+{
+	struct console_msg *msgs;
+	size_t n = 0, extra, end;
+	uint32_t i;
+
+	/* Text payloads appended after coreboot's last message. */
+	extra = (cursor + body_size - meta->cursor % body_size) % body_size;
+	if (extra > held)
+		extra = 0;
+	end = held - extra;
+
+	msgs = calloc(meta->count, sizeof(*msgs));
+	if (!msgs)
+		die("Not enough memory for console metadata.\n");
+
+	i = meta->next > meta->count ? meta->next - meta->count : 0;
+	for (; i < meta->next; i++) {
+		const struct cbmem_console_msg *msg = &meta->msgs[i % meta->count];
+		uint32_t age = meta->written - msg->pos;
+
+		if (age > end)
+			continue;
+		msgs[n].start = end - age;
+		msgs[n].meta = msg;
+		if (n)
+			msgs[n - 1].end = msgs[n].start;
+		n++;
+	}
+	if (n)
+		msgs[n - 1].end = held;
+
+	*msgs_out = msgs;
+	return n;
+}
+
+/* Find where the last boot starts from the message bootblock marked. Returns
+ * 0 if no boot was marked, e.g. because bootblock has no CBMEM console. */
+static int console_last_boot(const struct console_msg *msgs, size_t n,
+			     size_t *from)
+{
+	for (size_t i = n; i-- > 0;) {
+		if (msgs[i].meta->level & CBMEM_CONSOLE_MSG_BOOT) {
+			*from = msgs[i].start;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void print_console_msgs(const struct console_text *t, size_t from,
+			       const struct console_msg *msgs, size_t n,
+			       unsigned long freq_mhz)
+{
+	int filtered = console_max_level >= 0 || console_stage >= 0;
+
+	/* Text from before the oldest message has no metadata. */
+	if (!filtered && (!n || from < msgs[0].start))
+		console_write(t, from, n ? msgs[0].start : t->len,
+			      console_out_stdout, NULL);
+
+	for (size_t i = 0; i < n; i++) {
+		const struct cbmem_console_msg *msg = msgs[i].meta;
+
+		if (msgs[i].start < from)
+			continue;
+		if (console_max_level >= 0 &&
+		    (msg->level & CBMEM_CONSOLE_MSG_LEVEL_MASK) >
+							console_max_level)
+			continue;
+		if (console_stage >= 0 && msg->stage != console_stage)
+			continue;
+		if (console_msg_times)
+			printf("[%9llu us %s:%u %u] ", (unsigned long long)
+			       (freq_mhz ? msg->timestamp / freq_mhz :
+				msg->timestamp),
+			       console_stage_name(msg->stage), msg->cpu,
+			       msg->level & CBMEM_CONSOLE_MSG_LEVEL_MASK);
+		console_write(t, msgs[i].start, msgs[i].end,
+			      console_out_stdout, NULL);
+	}
+}
+
+/* Format the ramstage messages that were kept in the binary log. The log
+ * is reset on every boot, so it always belongs to the last one. */
+static void dump_binlog(void)
+{
+	struct mapping binlog_mapping;
+	const void *binlog_p;
+	uint64_t addr;
+	size_t size;
+	void *buf;
+
+	if (find_cbmem_entry(CBMEM_ID_BINLOG, &addr, &size))
+		return;
+
+	binlog_p = map_memory(&binlog_mapping, addr, size);
+	if (!binlog_p)
+		die("Unable to map binary log.\n");
+
+	buf = malloc(size);
+	if (!buf)
+		die("Not enough memory for binary log.\n");
+	aligned_memcpy(buf, binlog_p, size);
+	unmap_memory(&binlog_mapping);
+
+	printf("\n--- ramstage messages from the binary log ---\n");
+	binlog_print(stdout, buf, size, verbose);
+	free(buf);
+}
+
+static void print_profile_line(const char *function, uint32_t addr,
+			       uint64_t count)
+{
+	if (function)
+		printf("ramstage;%s %" PRIu64 "\n", function, count);
+	else
+		printf("ramstage;0x%08x %" PRIu64 "\n", addr, count);
+}
+
+/* Print the ramstage profile in the "folded" format flamegraph.pl reads:
+ * one line per function with its number of samples. Without an ELF file
+ * (-e) the addresses of the buckets stand in for the function names. */
+static void dump_profile(void)
+{
+	struct mapping profile_mapping;
+	const void *profile_p;
+	struct profile *p;
+	const char *function = NULL;
+	uint32_t function_addr = 0;
+	uint64_t addr, count = 0;
+	size_t size;
+	uint32_t i;
+
+	if (find_cbmem_entry(CBMEM_ID_PROFILE, &addr, &size)) {
+		fprintf(stderr, "No profile found in CBMEM, was coreboot "
+			"built with RAMSTAGE_PROFILER?\n");
+		return;
+	}
+
+	profile_p = map_memory(&profile_mapping, addr, size);
+	if (!profile_p)
+		die("Unable to map profile.\n");
+
+	p = malloc(size);
+	if (!p)
+		die("Not enough memory for profile.\n");
+	aligned_memcpy(p, profile_p, size);
+	unmap_memory(&profile_mapping);
+
+	if (size < sizeof(*p) || p->magic != PROFILE_MAGIC || p->shift > 31 ||
+	    p->buckets > (size - sizeof(*p)) / sizeof(p->counts[0])) {
+		fprintf(stderr, "Profile is corrupt.\n");
+		free(p);
+		return;
+	}
+
+	fprintf(stderr, "%u samples, one every %u us, %u outside ramstage's "
+		"code.\n", p->samples, p->period_us, p->outside);
+	if (!stage_elf_loaded())
+		fprintf(stderr, "No ramstage ELF given (-e), "
+			"printing addresses instead of functions.\n");
+
+	/* Buckets go up in address order, so all of a function's are in a
+	   row. Add them up before printing. */
+	for (i = 0; i < p->buckets; i++) {
+		uint32_t bucket_addr = p->text_start + (i << p->shift);
+		const char *name = NULL;
+
+		if (!p->counts[i])
+			continue;
+		if (stage_elf_loaded())
+			name = stage_elf_function(stage_elf_link_addr(
+				bucket_addr, p->ramstage_base));
+		if (count && name && name == function) {
+			count += p->counts[i];
+			continue;
+		}
+		if (count)
+			print_profile_line(function, function_addr, count);
+		function = name;
+		function_addr = bucket_addr;
+		count = p->counts[i];
+	}
+	if (count)
+		print_profile_line(function, function_addr, count);
+	if (p->outside)
+		printf("[outside ramstage] %u\n", p->outside);
+
+	free(p);
+}
+
+/* Map the console, returns < 0 if there is none. */
+static int open_console(struct console_text *t)
 {
 	const struct cbmem_console *console_p;
-	char *console_c;
 	size_t size, cursor;
-	struct mapping console_mapping;
 
 	if (console.tag != LB_TAG_CBMEM_CONSOLE) {
 		fprintf(stderr, "No console found in coreboot table.\n");
-		return;
+		return -1;
 	}
 
-	size = sizeof(*console_p);
-	console_p = map_memory(&console_mapping, console.cbmem_addr, size);
+	console_p = map_memory(&t->mapping, console.cbmem_addr,
+			       sizeof(*console_p));
 	if (!console_p)
 		die("Unable to map console object.\n");
+	size = console_p->size;
+	unmap_memory(&t->mapping);
 
-	cursor = console_p->cursor & CBMC_CURSOR_MASK;
-	if (!(console_p->cursor & CBMC_OVERFLOW) && cursor < console_p->size)
-		size = cursor;
-	else
-		size = console_p->size;
-	unmap_memory(&console_mapping);
-
-	console_c = malloc(size + 1);
-	if (!console_c) {
-		fprintf(stderr, "Not enough memory for console.\n");
-		exit(1);
-	}
-	console_c[size] = '\0';
-
-	console_p = map_memory(&console_mapping, console.cbmem_addr,
-		size + sizeof(*console_p));
-
+	console_p = map_memory(&t->mapping, console.cbmem_addr,
+			       sizeof(*console_p) + size);
 	if (!console_p)
 		die("Unable to map full console object.\n");
 
-	if (console_p->cursor & CBMC_OVERFLOW) {
+	t->console = console_p;
+	t->body_size = size;
+	t->meta = NULL;
+	cursor = console_p->cursor & CBMC_CURSOR_MASK;
+	t->cursor = cursor;
+	if (!(console_p->cursor & CBMC_OVERFLOW)) {
+		t->start = 0;
+		t->len = cursor < size ? cursor : size;
+	} else {
 		if (cursor >= size) {
-			printf("cbmem: ERROR: CBMEM console struct is illegal, "
-			       "output may be corrupt or out of order!\n\n");
+			fprintf(stderr, "cbmem: ERROR: CBMEM console struct is "
+				"illegal, output may be corrupt or out of "
+				"order!\n\n");
 			cursor = 0;
 		}
-		aligned_memcpy(console_c, console_p->body + cursor,
-			       size - cursor);
-		aligned_memcpy(console_c + size - cursor,
-			       console_p->body, cursor);
-	} else {
-		aligned_memcpy(console_c, console_p->body, size);
+		t->start = cursor;
+		t->len = size;
 	}
 
-	/* Slight memory corruption may occur between reboots and give us a few
-	   unprintable characters like '\0'. Replace them with '?' on output. */
-	for (cursor = 0; cursor < size; cursor++)
-		if (!isprint(console_c[cursor]) && !isspace(console_c[cursor]))
-			console_c[cursor] = '?';
+	if ((console_p->cursor & CBMEM_CONSOLE_META) && size)
+		t->meta = read_console_meta(console.cbmem_addr +
+					    sizeof(*console_p) + size);
+	return 0;
+}
+
+static void close_console(struct console_text *t)
+{
+	free(t->meta);
+	unmap_memory(&t->mapping);
+}
+
+/* Find the last boot in a console without message metadata. */
+static size_t console_find_last_boot(const struct console_text *t)
+{
+	char *console_c, *end;
+	size_t cursor = 0;
+
+	/* regexec() needs the text in one piece. */
+	console_c = malloc(t->len + 1);
+	if (!console_c)
+		die("Not enough memory for console.\n");
+	end = console_c;
+	console_write(t, 0, t->len, console_out_copy, &end);
+	*end = '\0';
 
 	/* We detect the last boot by looking for a bootblock, romstage or
 	   ramstage banner, in that order (to account for platforms without
 	   CONFIG_BOOTBLOCK_CONSOLE and/or CONFIG_EARLY_CONSOLE). Once we find
 	   a banner, store the last match for that stage in cursor and stop. */
-	cursor = 0;
-	if (one_boot_only) {
 #define BANNER_REGEX(stage) \
-		"\n\ncoreboot-[^\n]* " stage " starting.*\\.\\.\\.\n"
+	"\n\ncoreboot-[^\n]* " stage " starting.*\\.\\.\\.\n"
 #define OVERFLOW_REGEX(stage) "\n\\*\\*\\* Pre-CBMEM " stage " console overflow"
-		const char *regex[] = { BANNER_REGEX("bootblock"),
-					BANNER_REGEX("verstage"),
-					OVERFLOW_REGEX("romstage"),
-					BANNER_REGEX("romstage"),
-					OVERFLOW_REGEX("ramstage"),
-					BANNER_REGEX("ramstage") };
-
-		for (size_t i = 0; !cursor && i < ARRAY_SIZE(regex); i++) {
-			regex_t re;
-			regmatch_t match;
-			assert(!regcomp(&re, regex[i], 0));
-
-			/* Keep looking for matches so we find the last one. */
-			while (!regexec(&re, console_c + cursor, 1, &match, 0))
-				cursor += match.rm_so + 1;
-			regfree(&re);
-		}
+	const char *regex[] = { BANNER_REGEX("bootblock"),
+				BANNER_REGEX("verstage"),
+				OVERFLOW_REGEX("romstage"),
+				BANNER_REGEX("romstage"),
+				OVERFLOW_REGEX("ramstage"),
+				BANNER_REGEX("ramstage") };
+
+	for (size_t i = 0; !cursor && i < ARRAY_SIZE(regex); i++) {
+		regex_t re;
+		regmatch_t match;
+		assert(!regcomp(&re, regex[i], 0));
+
+		/* Keep looking for matches so we find the last one. */
+		while (!regexec(&re, console_c + cursor, 1, &match, 0))
+			cursor += match.rm_so + 1;
+		regfree(&re);
 	}
 
-	puts(console_c + cursor);
 	free(console_c);
-	unmap_memory(&console_mapping);
+	return cursor;
+}
+
+/* dump the cbmem console */
+static void dump_console(int one_boot_only)
+{
+	struct console_text t;
+	struct console_msg *msgs = NULL;
+	size_t n = 0, from = 0;
+
+	if (open_console(&t))
+		return;
+
+	if (t.meta)
+		n = console_messages(t.meta, t.len, t.body_size, t.cursor,
+				     &msgs);
+
+	if (one_boot_only && !console_last_boot(msgs, n, &from))
+		from = console_find_last_boot(&t);
+
+	if (t.meta) {
+		print_console_msgs(&t, from, msgs, n, t.meta->tick_freq_mhz);
+	} else {
+		if (console_max_level >= 0 || console_stage >= 0 ||
+		    console_msg_times)
+			fprintf(stderr, "Console has no message metadata, "
+				"printing all of it.\n");
+		console_write(&t, from, t.len, console_out_stdout, NULL);
+	}
+	putchar('\n');
+	free(msgs);
+	close_console(&t);
+
+	dump_binlog();
+}
+
+#define CONSOLE_FOLLOW_INTERVAL_US	100000
+
+/*
+ * Keep printing the text that gets added to the console while the OS runs,
+ * until interrupted. SMM doesn't write to the CBMEM console, so that is what
+ * the firmware prints on resume from S3, which is appended to the same
+ * console. The console is polled, so more than a ring's worth of text
+ * between two polls is lost.
+ */
+static void follow_console(void)
+{
+	struct console_text t;
+	size_t last;
+
+	if (open_console(&t))
+		return;
+
+	if (!t.body_size) {
+		close_console(&t);
+		return;
+	}
+
+	last = t.cursor % t.body_size;
+	for (;;) {
+		uint32_t raw;
+		size_t cursor;
+
+		fflush(stdout);
+		usleep(CONSOLE_FOLLOW_INTERVAL_US);
+
+		aligned_memcpy(&raw, &t.console->cursor, sizeof(raw));
+		cursor = raw & CBMC_CURSOR_MASK;
+		if (cursor >= t.body_size || cursor == last)
+			continue;
+
+		/* Print from the old cursor on, wrapping if needed. */
+		t.start = last;
+		console_write(&t, 0,
+			      (cursor + t.body_size - last) % t.body_size,
+			      console_out_stdout, NULL);
+		last = cursor;
+	}
 }
 
 static void hexdump(unsigned long memory, int length)
@@ -929,10 +1395,10 @@ struct cbmem_id_to_name {
 static const struct cbmem_id_to_name cbmem_ids[] = { CBMEM_ID_TO_NAME_TABLE };
 
 #define MAX_STAGEx 10
-static void cbmem_print_entry(int n, uint32_t id, uint64_t base, uint64_t size)
+/* Returns NULL for unknown ids. stage_x holds the name of STAGEx entries. */
+static const char *cbmem_entry_name(uint32_t id, char *stage_x, size_t len)
 {
 	const char *name;
-	char stage_x[20];
 
 	name = NULL;
 	for (size_t i = 0; i < ARRAY_SIZE(cbmem_ids); i++) {
@@ -942,18 +1408,28 @@ static void cbmem_print_entry(int n, uint32_t id, uint64_t base, uint64_t size)
 		}
 		if (id >= CBMEM_ID_STAGEx_META &&
 			id < CBMEM_ID_STAGEx_META + MAX_STAGEx) {
-			snprintf(stage_x, sizeof(stage_x), "STAGE%d META",
+			snprintf(stage_x, len, "STAGE%d META",
 				(id - CBMEM_ID_STAGEx_META));
 			name = stage_x;
 		}
 		if (id >= CBMEM_ID_STAGEx_CACHE &&
 			id < CBMEM_ID_STAGEx_CACHE + MAX_STAGEx) {
-			snprintf(stage_x, sizeof(stage_x), "STAGE%d $  ",
+			snprintf(stage_x, len, "STAGE%d $  ",
 				(id - CBMEM_ID_STAGEx_CACHE));
 			name = stage_x;
 		}
 	}
 
+	return name;
+}
+
+static void cbmem_print_entry(int n, uint32_t id, uint64_t base, uint64_t size)
+{
+	const char *name;
+	char stage_x[20];
+
+	name = cbmem_entry_name(id, stage_x, sizeof(stage_x));
+
 	printf("%2d. ", n);
 	if (name == NULL)
 		printf("\t\t%08x", id);
@@ -996,6 +1472,196 @@ static void dump_cbmem_toc(void)
 	}
 }
 
+/*
+ * JSON export of the TOC, timestamps, console and TCPA log, for collecting
+ * boot data from many machines. With the CBMEM area mapped once, this reads
+ * everything from a single mapping.
+ */
+static int json_fields;
+
+static void json_field(const char *name)
+{
+	printf("%s\n  \"%s\": ", json_fields++ ? "," : "", name);
+}
+
+static void json_escape(__attribute__((unused)) void *arg, const char *buf,
+			size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		unsigned char c = buf[i];
+
+		if (c == '"' || c == '\\')
+			printf("\\%c", c);
+		else if (c == '\n')
+			printf("\\n");
+		else if (c == '\t')
+			printf("\\t");
+		else if (c < 0x20 || c >= 0x7f)
+			printf("\\u%04x", c);
+		else
+			putchar(c);
+	}
+}
+
+/* Print a string of at most len characters as a JSON string. */
+static void json_string(const char *s, size_t len)
+{
+	putchar('"');
+	json_escape(NULL, s, strnlen(s, len));
+	putchar('"');
+}
+
+static void json_toc(void)
+{
+	const uint8_t *table = mapping_virt(&lbtable_mapping);
+	size_t offset = 0;
+	int n = 0;
+
+	json_field("toc");
+	putchar('[');
+	while (offset < mapping_size(&lbtable_mapping)) {
+		const struct lb_record *lbr;
+		const struct lb_cbmem_entry *lbe;
+		const char *name;
+		char stage_x[20];
+
+		lbr = (const void *)(table + offset);
+		offset += lbr->size;
+
+		if (lbr->tag != LB_TAG_CBMEM_ENTRY)
+			continue;
+
+		lbe = (const void *)lbr;
+		name = cbmem_entry_name(lbe->id, stage_x, sizeof(stage_x));
+		printf("%s\n    {\"id\": %u, \"name\": ", n++ ? "," : "",
+		       lbe->id);
+		if (name) {
+			size_t len = strlen(name);
+
+			/* The names are padded for the text table. */
+			while (len && name[len - 1] == ' ')
+				len--;
+			json_string(name, len);
+		} else {
+			printf("null");
+		}
+		printf(", \"address\": %" PRIu64 ", \"size\": %u}",
+		       (uint64_t)lbe->address, lbe->entry_size);
+	}
+	printf("\n  ]");
+}
+
+static void json_timestamps(void)
+{
+	struct timestamp_table *tst_p;
+
+	tst_p = read_timestamps();
+	if (!tst_p)
+		return;
+
+	json_field("timestamps");
+	printf("{\"tick_freq_mhz\": %lu, \"base_time_us\": %" PRIu64
+	       ", \"entries\": [", tick_freq_mhz,
+	       arch_convert_raw_ts_entry(tst_p->base_time));
+	for (uint32_t i = 0; i < tst_p->num_entries; i++) {
+		const struct timestamp_entry *tse = &tst_p->entries[i];
+		const char *name = timestamp_name(tse->entry_id);
+
+		printf("%s\n    {\"id\": %u, \"name\": ", i ? "," : "",
+		       tse->entry_id);
+		json_string(name, strlen(name));
+		printf(", \"time_us\": %" PRIu64 "}",
+		       arch_convert_raw_ts_entry(tse->entry_stamp +
+						 tst_p->base_time));
+	}
+	printf("\n  ]}");
+	free(tst_p);
+}
+
+static void json_console(void)
+{
+	struct console_text t;
+	struct console_msg *msgs;
+	size_t n;
+
+	if (open_console(&t))
+		return;
+
+	json_field("console");
+	putchar('"');
+	console_write(&t, 0, t.len, json_escape, NULL);
+	putchar('"');
+
+	if (t.meta) {
+		unsigned long freq_mhz = t.meta->tick_freq_mhz;
+
+		n = console_messages(t.meta, t.len, t.body_size, t.cursor,
+				     &msgs);
+		json_field("console_messages");
+		putchar('[');
+		for (size_t i = 0; i < n; i++) {
+			const struct cbmem_console_msg *msg = msgs[i].meta;
+
+			printf("%s\n    {\"offset\": %zu, \"length\": %zu, "
+			       "\"level\": %u, \"stage\": \"%s\", "
+			       "\"cpu\": %u, \"time_us\": %llu}",
+			       i ? "," : "", msgs[i].start,
+			       msgs[i].end - msgs[i].start,
+			       msg->level & CBMEM_CONSOLE_MSG_LEVEL_MASK,
+			       console_stage_name(msg->stage), msg->cpu,
+			       (unsigned long long)(freq_mhz ?
+				msg->timestamp / freq_mhz : msg->timestamp));
+		}
+		printf("\n  ]");
+		free(msgs);
+	}
+
+	close_console(&t);
+}
+
+static void json_tcpa_log(void)
+{
+	const struct tcpa_table *tclt_p;
+	struct mapping tcpa_mapping;
+
+	tclt_p = map_tcpa_log(&tcpa_mapping);
+	if (!tclt_p)
+		return;
+
+	json_field("tcpa_log");
+	putchar('[');
+	for (uint16_t i = 0; i < tclt_p->num_entries; i++) {
+		const struct tcpa_entry *tce = &tclt_p->entries[i];
+		uint32_t len = tce->digest_length;
+
+		if (len > sizeof(tce->digest))
+			len = sizeof(tce->digest);
+
+		printf("%s\n    {\"pcr\": %u, \"digest\": \"", i ? "," : "",
+		       tce->pcr);
+		for (uint32_t j = 0; j < len; j++)
+			printf("%02x", tce->digest[j]);
+		printf("\", \"digest_type\": ");
+		json_string(tce->digest_type, sizeof(tce->digest_type));
+		printf(", \"name\": ");
+		json_string(tce->name, sizeof(tce->name));
+		putchar('}');
+	}
+	printf("\n  ]");
+
+	unmap_memory(&tcpa_mapping);
+}
+
+static void dump_json(void)
+{
+	printf("{");
+	json_toc();
+	json_timestamps();
+	json_console();
+	json_tcpa_log();
+	printf("\n}\n");
+}
+
 #define COVERAGE_MAGIC 0x584d4153
 struct file {
 	uint32_t magic;
@@ -1096,10 +1762,22 @@ static void print_version(void)
 
 static void print_usage(const char *name, int exit_code)
 {
-	printf("usage: %s [-cCltTLxVvh?]\n", name);
+	printf("usage: %s [-cfCltTLjpxVvh?] [-e ELF]\n", name);
 	printf("\n"
 	     "   -c | --console:                   print cbmem console\n"
 	     "   -1 | --oneboot:                   print cbmem console for last boot only\n"
+	     "   -f | --follow:                    print cbmem console, then keep printing\n"
+	     "                                     what is added to it, e.g. on S3 resume\n"
+	     "   -e | --elf FILE:                  ramstage ELF (ramstage.debug) to format\n"
+	     "                                     the binary log and name the profiled\n"
+	     "                                     functions with\n"
+	     "        --loglevel LEVEL:            print console messages up to LEVEL only\n"
+	     "        --stage STAGE:               print console messages from STAGE only\n"
+	     "        --msg-timestamps:            print time, stage, CPU and level of\n"
+	     "                                     each console message\n"
+	     "        --mem-file FILE:             read memory from FILE, e.g. a QEMU\n"
+	     "                                     pmemsave dump, instead of /dev/mem\n"
+	     "        --mem-base ADDR:             physical address FILE starts at\n"
 	     "   -C | --coverage:                  dump coverage information\n"
 	     "   -l | --list:                      print cbmem table of contents\n"
 	     "   -x | --hexdump:                   print hexdump of cbmem area\n"
@@ -1107,6 +1785,10 @@ static void print_usage(const char *name, int exit_code)
 	     "   -t | --timestamps:                print timestamp information\n"
 	     "   -T | --parseable-timestamps:      print parseable timestamps\n"
 	     "   -L | --tcpa-log                   print TCPA log\n"
+	     "   -j | --json:                      print table of contents, timestamps,\n"
+	     "                                     console and TCPA log as JSON\n"
+	     "   -p | --profile:                   print the ramstage profile in the folded\n"
+	     "                                     format flamegraph.pl takes\n"
 	     "   -V | --verbose:                   verbose (debugging) output\n"
 	     "   -v | --version:                   print the version\n"
 	     "   -h | --help:                      print this help\n"
@@ -1227,6 +1909,63 @@ static char *dt_find_compat(const char *parent, const char *compat,
 	closedir(dir);
 	return ret;
 }
+
+/* Find the coreboot table through the device tree. Returns < 0 on error. */
+static int parse_dt_cbtable(void)
+{
+	int addr_cells, size_cells;
+	char *coreboot_node = dt_find_compat("/proc/device-tree", "coreboot",
+					     &addr_cells, &size_cells);
+
+	if (!coreboot_node) {
+		fprintf(stderr, "Could not find 'coreboot' compatible node!\n");
+		return -1;
+	}
+
+	if (addr_cells < 0) {
+		fprintf(stderr, "Warning: no #address-cells node in tree!\n");
+		addr_cells = 1;
+	}
+
+	int nlen = strlen(coreboot_node);
+	char *reg = alloca(nlen + sizeof("/reg"));
+
+	strcpy(reg, coreboot_node);
+	strcpy(reg + nlen, "/reg");
+	free(coreboot_node);
+
+	int fd = open(reg, O_RDONLY);
+	if (fd < 0) {
+		perror(reg);
+		return -1;
+	}
+
+	int i;
+	size_t size_to_read = addr_cells * 4 + size_cells * 4;
+	u8 *dtbuffer = alloca(size_to_read);
+	if (read(fd, dtbuffer, size_to_read) < 0) {
+		perror(reg);
+		return -1;
+	}
+	close(fd);
+
+	/* No variable-length byte swap function anywhere in C... how sad. */
+	u64 baseaddr = 0;
+	for (i = 0; i < addr_cells * 4; i++) {
+		baseaddr <<= 8;
+		baseaddr |= *dtbuffer;
+		dtbuffer++;
+	}
+	u64 cb_table_size = 0;
+	for (i = 0; i < size_cells * 4; i++) {
+		cb_table_size <<= 8;
+		cb_table_size |= *dtbuffer;
+		dtbuffer++;
+	}
+
+	parse_cbtable(baseaddr, cb_table_size);
+	return 0;
+}
 #endif /* defined(__arm__) || defined(__aarch64__) */
 
 int main(int argc, char** argv)
@@ -1239,17 +1978,37 @@ int main(int argc, char** argv)
 	int print_rawdump = 0;
 	int print_timestamps = 0;
 	int print_tcpa_log = 0;
+	int print_json = 0;
+	int print_profile = 0;
+	int follow = 0;
 	int machine_readable_timestamps = 0;
 	int one_boot_only = 0;
+	const char *mem_file = NULL;
 	unsigned int rawdump_id = 0;
 
+	enum {
+		OPT_LOGLEVEL = 256,
+		OPT_STAGE,
+		OPT_MSG_TIMESTAMPS,
+		OPT_MEM_FILE,
+		OPT_MEM_BASE,
+	};
 	int opt, option_index = 0;
 	static struct option long_options[] = {
 		{"console", 0, 0, 'c'},
 		{"oneboot", 0, 0, '1'},
+		{"follow", 0, 0, 'f'},
+		{"elf", required_argument, 0, 'e'},
+		{"loglevel", required_argument, 0, OPT_LOGLEVEL},
+		{"stage", required_argument, 0, OPT_STAGE},
+		{"msg-timestamps", 0, 0, OPT_MSG_TIMESTAMPS},
+		{"mem-file", required_argument, 0, OPT_MEM_FILE},
+		{"mem-base", required_argument, 0, OPT_MEM_BASE},
 		{"coverage", 0, 0, 'C'},
 		{"list", 0, 0, 'l'},
 		{"tcpa-log", 0, 0, 'L'},
+		{"json", 0, 0, 'j'},
+		{"profile", 0, 0, 'p'},
 		{"timestamps", 0, 0, 't'},
 		{"parseable-timestamps", 0, 0, 'T'},
 		{"hexdump", 0, 0, 'x'},
@@ -1259,7 +2018,7 @@ int main(int argc, char** argv)
 		{"help", 0, 0, 'h'},
 		{0, 0, 0, 0}
 	};
-	while ((opt = getopt_long(argc, argv, "c1CltTLxVvh?r:",
+	while ((opt = getopt_long(argc, argv, "c1fe:CltTLjpxVvh?r:",
 				  long_options, &option_index)) != EOF) {
 		switch (opt) {
 		case 'c':
@@ -1271,6 +2030,30 @@ int main(int argc, char** argv)
 			one_boot_only = 1;
 			print_defaults = 0;
 			break;
+		case 'f':
+			print_console = 1;
+			follow = 1;
+			print_defaults = 0;
+			break;
+		case 'e':
+			if (stage_elf_load(optarg))
+				exit(1);
+			break;
+		case OPT_LOGLEVEL:
+			console_max_level = strtoul(optarg, NULL, 0);
+			break;
+		case OPT_STAGE:
+			console_stage = parse_console_stage(optarg);
+			break;
+		case OPT_MSG_TIMESTAMPS:
+			console_msg_times = 1;
+			break;
+		case OPT_MEM_FILE:
+			mem_file = optarg;
+			break;
+		case OPT_MEM_BASE:
+			mem_base = strtoull(optarg, NULL, 0);
+			break;
 		case 'C':
 			print_coverage = 1;
 			print_defaults = 0;
@@ -1283,6 +2066,14 @@ int main(int argc, char** argv)
 			print_tcpa_log = 1;
 			print_defaults = 0;
 			break;
+		case 'j':
+			print_json = 1;
+			print_defaults = 0;
+			break;
+		case 'p':
+			print_profile = 1;
+			print_defaults = 0;
+			break;
 		case 'x':
 			print_hexdump = 1;
 			print_defaults = 0;
@@ -1323,78 +2114,51 @@ int main(int argc, char** argv)
 		print_usage(argv[0], 1);
 	}
 
-	mem_fd = open("/dev/mem", O_RDONLY, 0);
+	mem_fd = open(mem_file ? mem_file : "/dev/mem", O_RDONLY, 0);
 	if (mem_fd < 0) {
 		fprintf(stderr, "Failed to gain memory access: %s\n",
 			strerror(errno));
 		return 1;
 	}
 
-#if defined(__arm__) || defined(__aarch64__)
-	int addr_cells, size_cells;
-	char *coreboot_node = dt_find_compat("/proc/device-tree", "coreboot",
-					     &addr_cells, &size_cells);
+	if (mem_file) {
+		struct stat st;
 
-	if (!coreboot_node) {
-		fprintf(stderr, "Could not find 'coreboot' compatible node!\n");
-		return 1;
-	}
-
-	if (addr_cells < 0) {
-		fprintf(stderr, "Warning: no #address-cells node in tree!\n");
-		addr_cells = 1;
-	}
-
-	int nlen = strlen(coreboot_node);
-	char *reg = alloca(nlen + sizeof("/reg"));
-
-	strcpy(reg, coreboot_node);
-	strcpy(reg + nlen, "/reg");
-	free(coreboot_node);
-
-	int fd = open(reg, O_RDONLY);
-	if (fd < 0) {
-		perror(reg);
-		return 1;
-	}
-
-	int i;
-	size_t size_to_read = addr_cells * 4 + size_cells * 4;
-	u8 *dtbuffer = alloca(size_to_read);
-	if (read(fd, dtbuffer, size_to_read) < 0) {
-		perror(reg);
-		return 1;
-	}
-	close(fd);
-
-	/* No variable-length byte swap function anywhere in C... how sad. */
-	u64 baseaddr = 0;
-	for (i = 0; i < addr_cells * 4; i++) {
-		baseaddr <<= 8;
-		baseaddr |= *dtbuffer;
-		dtbuffer++;
-	}
-	u64 cb_table_size = 0;
-	for (i = 0; i < size_cells * 4; i++) {
-		cb_table_size <<= 8;
-		cb_table_size |= *dtbuffer;
-		dtbuffer++;
-	}
-
-	parse_cbtable(baseaddr, cb_table_size);
+		if (mem_base % system_page_size() ||
+		    fstat(mem_fd, &st) < 0) {
+			fprintf(stderr, "Can't use %s as memory.\n", mem_file);
+			return 1;
+		}
+		mem_size = st.st_size;
+		/* A memory dump has no device tree or BIOS area to look at,
+		   so search all of it. */
+		parse_cbtable(mem_base, mem_size);
+	} else {
+#if defined(__arm__) || defined(__aarch64__)
+		if (parse_dt_cbtable() < 0)
+			return 1;
 #else
-	unsigned long long possible_base_addresses[] = { 0, 0xf0000 };
+		unsigned long long possible_base_addresses[] = { 0, 0xf0000 };
 
-	/* Find and parse coreboot table */
-	for (size_t j = 0; j < ARRAY_SIZE(possible_base_addresses); j++) {
-		if (!parse_cbtable(possible_base_addresses[j], 0))
-			break;
-	}
+		/* Find and parse coreboot table */
+		for (size_t j = 0; j < ARRAY_SIZE(possible_base_addresses);
+		     j++) {
+			if (!parse_cbtable(possible_base_addresses[j], 0))
+				break;
+		}
 #endif
+	}
 
 	if (mapping_virt(&lbtable_mapping) == NULL)
 		die("Table not found.\n");
 
+	/* Map all of CBMEM once, the dumps below take their tables from it.
+	 * Fall back to mapping them one by one if that's not allowed. */
+	if (cbmem.type == LB_MEM_TABLE &&
+	    !map_memory(&cbmem_mapping, unpack_lb64(cbmem.start),
+			unpack_lb64(cbmem.size)))
+		debug("Couldn't map CBMEM, mapping its tables separately.\n");
+
 	if (print_console)
 		dump_console(one_boot_only);
 
@@ -1416,6 +2180,16 @@ int main(int argc, char** argv)
 	if (print_tcpa_log)
 		dump_tcpa_log();
 
+	if (print_json)
+		dump_json();
+
+	if (print_profile)
+		dump_profile();
+
+	if (follow)
+		follow_console();
+
+	unmap_memory(&cbmem_mapping);
 	unmap_memory(&lbtable_mapping);
 
 	close(mem_fd);
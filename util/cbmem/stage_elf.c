@@ -0,0 +1,282 @@
+/*
+ * This file is part of the coreboot project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <elf.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stage_elf.h"
+
+/* An allocated section of the stage ELF file, by link-time address. */
+struct elf_section {
+	uint64_t addr;
+	uint64_t size;
+	const char *data;
+};
+
+static char *elf_image;
+static size_t elf_size;
+static struct elf_section *sections;
+static size_t num_sections;
+static uint64_t elf_program;	/* link-time address of _program */
+static int have_program;
+
+/* Function symbols, sorted by address. */
+struct elf_function {
+	uint64_t addr;
+	uint64_t size;
+	const char *name;
+};
+
+static struct elf_function *functions;
+static size_t num_functions;
+
+static int elf_range_ok(uint64_t offset, uint64_t size)
+{
+	return offset <= elf_size && size <= elf_size - offset;
+}
+
+static void elf_add_section(uint64_t flags, uint32_t type, uint64_t addr,
+			    uint64_t offset, uint64_t size)
+{
+	struct elf_section *s;
+
+	if (!(flags & SHF_ALLOC) || type == SHT_NOBITS || !size ||
+	    !elf_range_ok(offset, size))
+		return;
+
+	s = realloc(sections, (num_sections + 1) * sizeof(*s));
+	if (!s)
+		return;
+	sections = s;
+	s = &sections[num_sections++];
+	s->addr = addr;
+	s->size = size;
+	s->data = elf_image + offset;
+}
+
+static void elf_add_function(uint64_t addr, uint64_t size, const char *name)
+{
+	struct elf_function *f;
+
+	f = realloc(functions, (num_functions + 1) * sizeof(*f));
+	if (!f)
+		return;
+	functions = f;
+	f = &functions[num_functions++];
+	f->addr = addr;
+	f->size = size;
+	f->name = name;
+}
+
+/* Find _program and collect the functions. */
+static void elf_read_symbols(const char *syms, uint64_t syms_size,
+			     size_t sym_size, const char *strs,
+			     uint64_t strs_size, int is_64)
+{
+	uint64_t i;
+
+	for (i = 0; i + sym_size <= syms_size; i += sym_size) {
+		uint32_t name;
+		uint64_t value, size;
+		unsigned int type;
+
+		if (is_64) {
+			const Elf64_Sym *sym = (const void *)(syms + i);
+			name = sym->st_name;
+			value = sym->st_value;
+			size = sym->st_size;
+			type = ELF64_ST_TYPE(sym->st_info);
+		} else {
+			const Elf32_Sym *sym = (const void *)(syms + i);
+			name = sym->st_name;
+			value = sym->st_value;
+			size = sym->st_size;
+			type = ELF32_ST_TYPE(sym->st_info);
+		}
+		if (name >= strs_size ||
+		    !memchr(strs + name, '\0', strs_size - name))
+			continue;
+		if (type == STT_FUNC)
+			elf_add_function(value, size, strs + name);
+		if (!have_program && !strcmp(strs + name, "_program")) {
+			elf_program = value;
+			have_program = 1;
+		}
+	}
+}
+
+static int function_cmp(const void *a, const void *b)
+{
+	const struct elf_function *fa = a, *fb = b;
+
+	if (fa->addr != fb->addr)
+		return fa->addr < fb->addr ? -1 : 1;
+	return 0;
+}
+
+/* Pull the fields this needs out of a 32-bit or 64-bit section header. */
+static void elf_shdr(const char *shdrs, unsigned int idx, int is_64,
+		     uint32_t *type, uint64_t *flags, uint64_t *addr,
+		     uint64_t *offset, uint64_t *size, uint32_t *link)
+{
+	if (is_64) {
+		const Elf64_Shdr *sh = (const Elf64_Shdr *)shdrs + idx;
+		*type = sh->sh_type;
+		*flags = sh->sh_flags;
+		*addr = sh->sh_addr;
+		*offset = sh->sh_offset;
+		*size = sh->sh_size;
+		*link = sh->sh_link;
+	} else {
+		const Elf32_Shdr *sh = (const Elf32_Shdr *)shdrs + idx;
+		*type = sh->sh_type;
+		*flags = sh->sh_flags;
+		*addr = sh->sh_addr;
+		*offset = sh->sh_offset;
+		*size = sh->sh_size;
+		*link = sh->sh_link;
+	}
+}
+
+int stage_elf_load(const char *path)
+{
+	FILE *f = fopen(path, "rb");
+	uint64_t shoff;
+	unsigned int shnum, i;
+	size_t shentsize;
+	int is_64;
+
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+	fseek(f, 0, SEEK_END);
+	elf_size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	elf_image = malloc(elf_size);
+	if (!elf_image || fread(elf_image, 1, elf_size, f) != elf_size) {
+		fprintf(stderr, "%s: could not read file\n", path);
+		fclose(f);
+		return -1;
+	}
+	fclose(f);
+
+	if (elf_size < EI_NIDENT || memcmp(elf_image, ELFMAG, SELFMAG) ||
+	    elf_image[EI_DATA] != ELFDATA2LSB) {
+		fprintf(stderr, "%s: not a little-endian ELF file\n", path);
+		return -1;
+	}
+
+	is_64 = elf_image[EI_CLASS] == ELFCLASS64;
+	if (is_64) {
+		const Elf64_Ehdr *eh = (const void *)elf_image;
+		if (elf_size < sizeof(*eh))
+			return -1;
+		shoff = eh->e_shoff;
+		shnum = eh->e_shnum;
+		shentsize = sizeof(Elf64_Shdr);
+	} else {
+		const Elf32_Ehdr *eh = (const void *)elf_image;
+		if (elf_size < sizeof(*eh))
+			return -1;
+		shoff = eh->e_shoff;
+		shnum = eh->e_shnum;
+		shentsize = sizeof(Elf32_Shdr);
+	}
+	if (!elf_range_ok(shoff, (uint64_t)shnum * shentsize)) {
+		fprintf(stderr, "%s: bad section headers\n", path);
+		return -1;
+	}
+
+	for (i = 0; i < shnum; i++) {
+		const char *shdrs = elf_image + shoff;
+		uint64_t flags, addr, offset, size;
+		uint64_t str_flags, str_addr, str_offset, str_size;
+		uint32_t type, link, str_type, str_link;
+
+		elf_shdr(shdrs, i, is_64, &type, &flags, &addr, &offset, &size,
+			 &link);
+		elf_add_section(flags, type, addr, offset, size);
+
+		if (type != SHT_SYMTAB || link >= shnum ||
+		    !elf_range_ok(offset, size))
+			continue;
+		elf_shdr(shdrs, link, is_64, &str_type, &str_flags, &str_addr,
+			 &str_offset, &str_size, &str_link);
+		if (!elf_range_ok(str_offset, str_size))
+			continue;
+		elf_read_symbols(elf_image + offset, size,
+				 is_64 ? sizeof(Elf64_Sym) : sizeof(Elf32_Sym),
+				 elf_image + str_offset, str_size, is_64);
+	}
+
+	if (!have_program) {
+		fprintf(stderr, "%s: no _program symbol, is this a stage?\n",
+			path);
+		return -1;
+	}
+	qsort(functions, num_functions, sizeof(*functions), function_cmp);
+	return 0;
+}
+
+int stage_elf_loaded(void)
+{
+	return have_program;
+}
+
+uint64_t stage_elf_link_addr(uint32_t addr, uint32_t base)
+{
+	return addr - (uint64_t)base + elf_program;
+}
+
+const char *stage_elf_data(uint64_t link_addr, size_t *avail)
+{
+	size_t i;
+
+	for (i = 0; i < num_sections; i++) {
+		const struct elf_section *s = &sections[i];
+
+		if (link_addr < s->addr || link_addr - s->addr >= s->size)
+			continue;
+		*avail = s->size - (link_addr - s->addr);
+		return s->data + (link_addr - s->addr);
+	}
+	return NULL;
+}
+
+const char *stage_elf_function(uint64_t link_addr)
+{
+	size_t lo = 0, hi = num_functions;
+	const struct elf_function *f;
+
+	/* Find the last function that starts at or before link_addr. */
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (functions[mid].addr <= link_addr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (!lo)
+		return NULL;
+	f = &functions[lo - 1];
+	/* Assembly functions often have no size, give them the benefit of
+	   the doubt. */
+	if (f->size && link_addr - f->addr >= f->size)
+		return NULL;
+	return f->name;
+}
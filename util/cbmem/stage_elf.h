@@ -0,0 +1,38 @@
+/*
+ * This file is part of the coreboot project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef CBMEM_STAGE_ELF_H
+#define CBMEM_STAGE_ELF_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Read the sections and symbols of a stage's ELF file (like
+ * ramstage.debug). Returns < 0 on error. */
+int stage_elf_load(const char *path);
+
+/* Whether stage_elf_load() succeeded. */
+int stage_elf_loaded(void);
+
+/* Translate a run-time address of the stage loaded at base (where _program
+ * was at run time) to its link-time address. */
+uint64_t stage_elf_link_addr(uint32_t addr, uint32_t base);
+
+/* The file contents at link_addr, with *avail bytes left in its section, or
+ * NULL if no allocated section holds it. */
+const char *stage_elf_data(uint64_t link_addr, size_t *avail);
+
+/* The name of the function at link_addr, or NULL if unknown. */
+const char *stage_elf_function(uint64_t link_addr);
+
+#endif
@@ -15,15 +15,83 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
 #include "jpeg.h"
 
 const int depth = 16;
 
+#define FB_WIDTH	1920
+#define FB_HEIGHT	1080
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Decode the image 'rounds' times and print how long it took, both into a
+ * buffer of the image's size and into a 32bpp full-HD framebuffer.
+ */
+static int bench(char *buf, unsigned long len, int rounds,
+		 struct jpeg_decdata *decdata)
+{
+	static char fb[FB_WIDTH * FB_HEIGHT * 4];
+	int width, height, i, ret;
+	double t, ms;
+
+	jpeg_fetch_size((unsigned char *)buf, &width, &height);
+	char *pic = malloc(4 * width * height);
+	if (!pic)
+		return 1;
+
+	t = now();
+	for (i = 0; i < rounds; i++) {
+		ret = jpeg_decode((unsigned char *)buf, (unsigned char *)pic,
+				  width, height, 32, decdata);
+		if (ret) {
+			free(pic);
+			return ret;
+		}
+	}
+	ms = (now() - t) * 1000 / rounds;
+	printf("%dx%d: %.2f ms per decode, %.1f Mpixel/s, %.1f MB/s in\n",
+	       width, height, ms, width * height / ms / 1000, len / ms / 1000);
+
+	t = now();
+	for (i = 0; i < rounds; i++) {
+		ret = jpeg_decode_fb((unsigned char *)buf, (unsigned char *)fb,
+				     FB_WIDTH, FB_HEIGHT, FB_WIDTH * 4, 32,
+				     decdata);
+		if (ret) {
+			free(pic);
+			return ret;
+		}
+	}
+	ms = (now() - t) * 1000 / rounds;
+	printf("into %dx%d framebuffer: %.2f ms per decode\n", FB_WIDTH,
+	       FB_HEIGHT, ms);
+
+	free(pic);
+	return 0;
+}
+
 int main(int argc, char **argv)
 {
-	FILE *f = fopen(argv[1], "rb");
+	int rounds = 0;
 	unsigned long len;
 
+	/* jpeg-test -b <rounds> <file> benchmarks instead of fuzzing. */
+	if (argc == 4 && strcmp(argv[1], "-b") == 0) {
+		rounds = atoi(argv[2]);
+		argv += 2;
+	}
+
+	FILE *f = fopen(argv[1], "rb");
+
 	if (!f)
 		return 1;
 	if (fseek(f, 0, SEEK_END) != 0)
@@ -38,6 +106,9 @@ int main(int argc, char **argv)
 		return 1;
 	fclose(f);
 
+	if (rounds > 0)
+		return bench(buf, len, rounds, decdata);
+
 	int width;
 	int height;
 	jpeg_fetch_size(buf, &width, &height);
@@ -45,5 +116,6 @@ int main(int argc, char **argv)
 	char *pic = malloc(depth / 8 * width * height);
 	int ret = jpeg_decode(buf, pic, width, height, depth, decdata);
 	//printf("ret: %x\n", ret);
+	free(pic);
 	return ret;
 }